@@ -0,0 +1,103 @@
+#include "GmaArena.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+const size_t c_cbGmaArenaMinChunk = 1024;
+
+static size_t _AlignUp(size_t cb, size_t cbAlign)
+{
+	return (cb + cbAlign - 1) & ~(cbAlign - 1);
+}
+
+GmaStatus CGmaArena::_AddChunk(size_t cbMin)
+{
+	// Grow geometrically so a badly undersized Reserve() still only costs a handful of chunks
+	size_t cbCapacity = (_pChunk != NULL) ? _pChunk->cbCapacity * 2 : c_cbGmaArenaMinChunk;
+	if (cbCapacity < cbMin)
+		cbCapacity = cbMin;
+
+	size_t cbHeader = _AlignUp(sizeof(Chunk), sizeof(void*) * 2);
+	if (cbCapacity > ((size_t)-1) - cbHeader)
+		return GMA_E_OUTOFMEMORY;
+
+	uint8_t* pbChunk = new (std::nothrow) uint8_t[cbHeader + cbCapacity];
+	if (pbChunk == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	Chunk* pChunk = (Chunk*)pbChunk;
+	pChunk->pPrev = _pChunk;
+	pChunk->cbCapacity = cbCapacity;
+	pChunk->cbUsed = 0;
+	_pChunk = pChunk;
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaArena::Reserve(size_t cb)
+{
+	if (_pChunk != NULL && _pChunk->cbCapacity - _pChunk->cbUsed >= cb)
+		return GMA_S_OK;
+
+	return _AddChunk(cb);
+}
+
+void* CGmaArena::Alloc(size_t cb, size_t cbAlign)
+{
+	size_t cbHeader = _AlignUp(sizeof(Chunk), sizeof(void*) * 2);
+
+	if (_pChunk != NULL)
+	{
+		size_t ulStart = _AlignUp(_pChunk->cbUsed, cbAlign);
+		if (ulStart <= _pChunk->cbCapacity && _pChunk->cbCapacity - ulStart >= cb)
+		{
+			_pChunk->cbUsed = ulStart + cb;
+			return (uint8_t*)_pChunk + cbHeader + ulStart;
+		}
+	}
+
+	if (cb > ((size_t)-1) - cbAlign || GMA_FAILED(_AddChunk(cb + cbAlign)))
+		return NULL;
+
+	size_t ulStart = _AlignUp(_pChunk->cbUsed, cbAlign);
+	_pChunk->cbUsed = ulStart + cb;
+	return (uint8_t*)_pChunk + cbHeader + ulStart;
+}
+
+char* CGmaArena::DuplicateString(const char* psz, size_t cch)
+{
+	char* pszCopy = (char*)Alloc(cch + 1, 1);
+	if (pszCopy != NULL)
+	{
+		memcpy(pszCopy, psz, cch);
+		pszCopy[cch] = 0;
+	}
+	return pszCopy;
+}
+
+void CGmaArena::Release()
+{
+	while (_pChunk != NULL)
+	{
+		Chunk* pPrev = _pChunk->pPrev;
+		delete[] (uint8_t*)_pChunk;
+		_pChunk = pPrev;
+	}
+}
+
+void CGmaArena::Reset()
+{
+	if (_pChunk == NULL)
+		return;
+
+	if (_pChunk->pPrev != NULL)
+	{
+		size_t cbTotal = 0;
+		for (Chunk* pChunk = _pChunk; pChunk != NULL; pChunk = pChunk->pPrev)
+			cbTotal += pChunk->cbCapacity;
+		Release();
+		if (GMA_FAILED(_AddChunk(cbTotal)))
+			return; // Empty, which is a reset too
+	}
+
+	_pChunk->cbUsed = 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "GmaStatus.h"
+
+// Bump allocator for everything produced by one parse
+// Allocations are carved sequentially out of large chunks and never freed individually. Release() frees the whole lot at once.
+// Size it up front with Reserve() and a parse costs a single heap allocation. If it runs out, it chains another chunk rather than failing.
+// Not thread-safe. Use one arena per parse.
+class CGmaArena
+{
+public:
+	CGmaArena() : _pChunk(NULL) {}
+	~CGmaArena() { Release(); }
+
+	// Ensures at least cb bytes can be allocated without another heap allocation
+	GmaStatus Reserve(size_t cb);
+
+	// Returns NULL if out of memory
+	void* Alloc(size_t cb, size_t cbAlign = sizeof(void*));
+
+	template <class T> T* AllocArray(size_t c)
+	{
+		if (c > ((size_t)-1) / sizeof(T))
+			return NULL;
+		return (T*)Alloc(c * sizeof(T), sizeof(T) < sizeof(void*) ? sizeof(T) : sizeof(void*));
+	}
+
+	// Copies cch chars and appends a terminating null
+	char* DuplicateString(const char* psz, size_t cch);
+
+	// Frees every allocation made from this arena
+	void Release();
+
+	// Discards every allocation made from this arena but keeps the memory, so the next parse of the same size allocates nothing
+	// Constant time when everything fit in one chunk. Otherwise the chunks are traded for a single one as large as all of them together, so the arena settles at its high-water mark.
+	void Reset();
+
+private:
+	struct Chunk
+	{
+		Chunk* pPrev;
+		size_t cbCapacity;
+		size_t cbUsed;
+		// data follows
+	};
+
+	Chunk* _pChunk; // current chunk, newest first
+
+	GmaStatus _AddChunk(size_t cbMin);
+
+	CGmaArena(const CGmaArena&);
+	CGmaArena& operator=(const CGmaArena&);
+};
@@ -0,0 +1,273 @@
+#include "GmaByteSource.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Memory span
+// ____________________________________________________________________________________________________
+//
+
+GmaStatus CGmaMemoryByteSource::Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead)
+{
+	*pcbRead = 0;
+
+	if (_ullPos >= _cbData)
+		return GMA_S_OK; // EOF
+
+	uint64_t ullAvailable = _cbData - _ullPos;
+	uint32_t cbCopy = (ullAvailable < cbToRead) ? (uint32_t)ullAvailable : cbToRead;
+
+	memcpy(pBuf, _pData + _ullPos, cbCopy);
+	_ullPos += cbCopy;
+	*pcbRead = cbCopy;
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaMemoryByteSource::Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos)
+{
+	int64_t llBase;
+	switch (origin)
+	{
+	case GMA_SEEK_SET: llBase = 0ll; break;
+	case GMA_SEEK_CUR: llBase = (int64_t)_ullPos; break;
+	case GMA_SEEK_END: llBase = (int64_t)_cbData; break;
+	default: return GMA_E_UNEXPECTED;
+	}
+
+	int64_t llNewPos = llBase + llOffset;
+	if (llNewPos < 0)
+		return GMA_E_UNEXPECTED;
+
+	_ullPos = (uint64_t)llNewPos; // Seeking past the end is allowed, same as IStream. Reads there simply return 0 bytes.
+	if (pullNewPos != NULL)
+		*pullNewPos = _ullPos;
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaMemoryByteSource::GetSize(uint64_t* pullSize)
+{
+	*pullSize = _cbData;
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaMemoryByteSource::GetView(const uint8_t** ppbView, uint64_t* pcbView)
+{
+	*ppbView = _pData;
+	*pcbView = _cbData;
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Counting wrapper
+// ____________________________________________________________________________________________________
+//
+
+GmaStatus CGmaCountingByteSource::Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead)
+{
+	GmaStatus status = _pInner->Read(pBuf, cbToRead, pcbRead);
+	_cReads++;
+	if (GMA_SUCCEEDED(status))
+	{
+		_cbRead += *pcbRead;
+		_ullPos += *pcbRead;
+		if (_ullPos > _ullHighWater)
+			_ullHighWater = _ullPos;
+	}
+	return status;
+}
+
+GmaStatus CGmaCountingByteSource::Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos)
+{
+	uint64_t ullNewPos = 0ull;
+	GmaStatus status = _pInner->Seek(llOffset, origin, &ullNewPos);
+	_cSeeks++;
+	if (GMA_SUCCEEDED(status))
+	{
+		_ullPos = ullNewPos;
+		if (pullNewPos != NULL)
+			*pullNewPos = ullNewPos;
+	}
+	return status;
+}
+
+GmaStatus CGmaCountingByteSource::GetSize(uint64_t* pullSize)
+{
+	return _pInner->GetSize(pullSize);
+}
+
+GmaStatus CGmaCountingByteSource::GetView(const uint8_t** ppbView, uint64_t* pcbView)
+{
+	GmaStatus status = _pInner->GetView(ppbView, pcbView);
+	if (GMA_FAILED(status))
+		return status;
+
+	_cViews++;
+	uint64_t cbExposed = (*pcbView < _ullViewLimit) ? *pcbView : _ullViewLimit;
+	if (cbExposed > _ullHighWater)
+		_ullHighWater = cbExposed;
+
+	if (cbExposed < *pcbView)
+	{
+		if ((uint64_t)(size_t)*pcbView != *pcbView)
+			return GMA_E_OUTOFMEMORY;
+
+		delete[] _pbViewCopy;
+		_pbViewCopy = new (std::nothrow) uint8_t[(size_t)*pcbView];
+		if (_pbViewCopy == NULL)
+			return GMA_E_OUTOFMEMORY;
+
+		// 0xCC is never a GMA magic, string terminator or plausible file table entry, so a parse that reads past the limit fails or comes out different
+		memcpy(_pbViewCopy, *ppbView, (size_t)cbExposed);
+		memset(_pbViewCopy + cbExposed, 0xCC, (size_t)(*pcbView - cbExposed));
+		*ppbView = _pbViewCopy;
+	}
+
+	return GMA_S_OK;
+}
+
+
+#ifndef _WIN32
+
+// ____________________________________________________________________________________________________
+//
+//     POSIX file descriptor
+// ____________________________________________________________________________________________________
+//
+
+GmaStatus CGmaFdByteSource::Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead)
+{
+	*pcbRead = 0;
+
+	uint8_t* pbDest = (uint8_t*)pBuf;
+	while (*pcbRead < cbToRead)
+	{
+		ssize_t cbResult = read(_fd, pbDest + *pcbRead, cbToRead - *pcbRead);
+		if (cbResult < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			_iLastErrno = errno;
+			return GMA_E_IO;
+		}
+		if (cbResult == 0)
+			break; // EOF
+
+		*pcbRead += (uint32_t)cbResult;
+	}
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaFdByteSource::Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos)
+{
+	int iWhence;
+	switch (origin)
+	{
+	case GMA_SEEK_SET: iWhence = SEEK_SET; break;
+	case GMA_SEEK_CUR: iWhence = SEEK_CUR; break;
+	case GMA_SEEK_END: iWhence = SEEK_END; break;
+	default: return GMA_E_UNEXPECTED;
+	}
+
+	off_t llResult = lseek(_fd, (off_t)llOffset, iWhence);
+	if (llResult < 0)
+	{
+		_iLastErrno = errno;
+		return (errno == ESPIPE) ? GMA_E_NOTIMPL : GMA_E_IO;
+	}
+
+	if (pullNewPos != NULL)
+		*pullNewPos = (uint64_t)llResult;
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaFdByteSource::GetSize(uint64_t* pullSize)
+{
+	struct stat st;
+	if (fstat(_fd, &st) != 0)
+	{
+		_iLastErrno = errno;
+		return GMA_E_IO;
+	}
+
+	*pullSize = (uint64_t)st.st_size;
+	return GMA_S_OK;
+}
+
+
+
+// ____________________________________________________________________________________________________
+//
+//     POSIX memory-mapped file
+// ____________________________________________________________________________________________________
+//
+
+GmaStatus CGmaMappedFileByteSource::Map(int fd)
+{
+	Unmap();
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		_iLastErrno = errno;
+		return GMA_E_IO;
+	}
+
+	if ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+		return GMA_E_OUTOFMEMORY; // Larger than the address space
+
+	size_t cbFile = (size_t)st.st_size;
+	if (cbFile == 0)
+		return GMA_S_OK; // Nothing to map. Reads simply hit EOF.
+
+	void* pvMapping = mmap(NULL, cbFile, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (pvMapping == MAP_FAILED)
+	{
+		_iLastErrno = errno;
+		return GMA_E_IO;
+	}
+
+	// Parsing only touches the header and file table at the start, never the file data behind them
+	// Fault-driven readahead would pull in data pages nobody reads, so it's turned off for the whole mapping, and the start of the file is read ahead explicitly instead. File tables longer than that fault in page by page.
+	madvise(pvMapping, cbFile, MADV_RANDOM);
+	madvise(pvMapping, (cbFile < c_cbGmaMappedPrefetch) ? cbFile : c_cbGmaMappedPrefetch, MADV_WILLNEED);
+
+	_pvMapping = pvMapping;
+	_cbMapping = cbFile;
+	_pData = (const uint8_t*)pvMapping;
+	_cbData = cbFile;
+	_ullPos = 0ull;
+
+	return GMA_S_OK;
+}
+
+void CGmaMappedFileByteSource::Unmap()
+{
+	if (_pvMapping != NULL)
+	{
+		munmap(_pvMapping, _cbMapping);
+		_pvMapping = NULL;
+		_cbMapping = 0;
+	}
+
+	_pData = NULL;
+	_cbData = 0;
+	_ullPos = 0ull;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "GmaStatus.h"
+
+enum GmaSeekOrigin
+{
+	GMA_SEEK_SET = 0,
+	GMA_SEEK_CUR = 1,
+	GMA_SEEK_END = 2,
+};
+
+// Abstract source of GMA file bytes
+// The GMA core never touches a file, stream, or mapping directly. It only ever reads through one of these, so the same parser runs on an IStream in Explorer, a file descriptor on Linux, or a block of memory.
+class IGmaByteSource
+{
+public:
+	virtual ~IGmaByteSource() {}
+
+	// Reads up to cbToRead bytes at the current position and advances it. A short read with GMA_S_OK means the end of the source was reached.
+	virtual GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead) = 0;
+
+	// Moves the current position. pullNewPos may be NULL.
+	virtual GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos) = 0;
+
+	// Total size of the source in bytes
+	virtual GmaStatus GetSize(uint64_t* pullSize) = 0;
+
+	// Direct access to all of the source's bytes, for sources that already have them in memory
+	// Parsers then work on these bytes in place instead of copying them out through Read(), and hand out pointers into them, so the view must stay valid as long as anything parsed from it is in use.
+	// Fails with GMA_E_NOTIMPL for sources that can only be read.
+	virtual GmaStatus GetView(const uint8_t** ppbView, uint64_t* pcbView)
+	{
+		*ppbView = NULL;
+		*pcbView = 0ull;
+		return GMA_E_NOTIMPL;
+	}
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     Memory span
+// ____________________________________________________________________________________________________
+//
+
+// Reads from a caller-owned block of memory, which must outlive this object
+class CGmaMemoryByteSource : public IGmaByteSource
+{
+public:
+	CGmaMemoryByteSource(const void* pData, size_t cbData) : _pData((const uint8_t*)pData), _cbData(cbData), _ullPos(0ull) {}
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead);
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos);
+	GmaStatus GetSize(uint64_t* pullSize);
+	GmaStatus GetView(const uint8_t** ppbView, uint64_t* pcbView);
+
+protected:
+	const uint8_t* _pData;
+	size_t _cbData;
+	uint64_t _ullPos;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     Counting wrapper
+// ____________________________________________________________________________________________________
+//
+
+// Passes everything through to another byte source and records how it was used
+// A test double for checking how much of a file a consumer actually touches, e.g. that looking up the name never reads the file table. Runs anywhere, since it works on top of any other source.
+// Reads through a view can't be seen, so with SetViewLimit() the view is served from a copy in which everything from the limit on is overwritten. A consumer that still gets the right answer didn't depend on those bytes.
+class CGmaCountingByteSource : public IGmaByteSource
+{
+public:
+	static const uint64_t c_ullNoViewLimit = ~0ull;
+
+	explicit CGmaCountingByteSource(IGmaByteSource* pInner) : _pInner(pInner), _cReads(0ul), _cSeeks(0ul), _cViews(0ul), _cbRead(0ull), _ullPos(0ull), _ullHighWater(0ull), _ullViewLimit(c_ullNoViewLimit), _pbViewCopy(NULL) {}
+	~CGmaCountingByteSource() { delete[] _pbViewCopy; }
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead);
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos);
+	GmaStatus GetSize(uint64_t* pullSize);
+	GmaStatus GetView(const uint8_t** ppbView, uint64_t* pcbView);
+
+	// Bytes of any view handed out from here on that still hold the source's data. Only takes effect for views asked for after the call.
+	void SetViewLimit(uint64_t ullLimit) { _ullViewLimit = ullLimit; }
+
+	uint32_t GetReadCount() const { return _cReads; }
+	uint32_t GetSeekCount() const { return _cSeeks; }
+	uint32_t GetViewCount() const { return _cViews; }
+	uint64_t GetBytesRead() const { return _cbRead; }
+	uint64_t GetHighWater() const { return _ullHighWater; } // One past the furthest byte read so far, or exposed through a view
+
+	void ResetCounters() { _cReads = 0ul; _cSeeks = 0ul; _cViews = 0ul; _cbRead = 0ull; _ullHighWater = 0ull; }
+
+private:
+	IGmaByteSource* _pInner;
+	uint32_t _cReads;
+	uint32_t _cSeeks;
+	uint32_t _cViews;
+	uint64_t _cbRead;
+	uint64_t _ullPos;
+	uint64_t _ullHighWater;
+	uint64_t _ullViewLimit;
+	uint8_t* _pbViewCopy; // Served instead of the inner view while a limit is set
+
+	CGmaCountingByteSource(const CGmaCountingByteSource&);
+	CGmaCountingByteSource& operator=(const CGmaCountingByteSource&);
+};
+
+
+#ifndef _WIN32
+
+// ____________________________________________________________________________________________________
+//
+//     POSIX file descriptor
+// ____________________________________________________________________________________________________
+//
+
+// Reads from an open file descriptor. The descriptor is not closed by this object.
+class CGmaFdByteSource : public IGmaByteSource
+{
+public:
+	explicit CGmaFdByteSource(int fd) : _fd(fd), _iLastErrno(0) {}
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead);
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos);
+	GmaStatus GetSize(uint64_t* pullSize);
+
+	int GetLastErrno() const { return _iLastErrno; } // errno of the last call that returned GMA_E_IO
+
+private:
+	int _fd;
+	int _iLastErrno;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     POSIX memory-mapped file
+// ____________________________________________________________________________________________________
+//
+
+const size_t c_cbGmaMappedPrefetch = 65536; // How much of the start of a mapped file to ask the kernel to read ahead: the header and, for most addons, the whole file table
+
+// Maps a whole file read-only and serves it from memory
+// Parsers use the mapping in place through GetView(), so header fields and file table paths point straight into the page cache with no read() calls or copies. Anything parsed from it is only valid until Unmap().
+// If another process truncates the file while it's mapped, touching the pages past its new end raises SIGBUS. Only use it on files nothing else is writing to, or check the size around the parse as gmainfo does.
+class CGmaMappedFileByteSource : public CGmaMemoryByteSource
+{
+public:
+	CGmaMappedFileByteSource() : CGmaMemoryByteSource(NULL, 0), _pvMapping(NULL), _cbMapping(0), _iLastErrno(0) {}
+	~CGmaMappedFileByteSource() { Unmap(); }
+
+	// Maps the file open on fd. The descriptor is not needed after this returns, and is not closed by this object.
+	GmaStatus Map(int fd);
+	void Unmap();
+
+	int GetLastErrno() const { return _iLastErrno; } // errno of the last call that returned GMA_E_IO
+
+private:
+	void* _pvMapping;
+	size_t _cbMapping;
+	int _iLastErrno;
+
+	CGmaMappedFileByteSource(const CGmaMappedFileByteSource&);
+	CGmaMappedFileByteSource& operator=(const CGmaMappedFileByteSource&);
+};
+
+#endif
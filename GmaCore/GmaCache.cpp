@@ -0,0 +1,542 @@
+#include "GmaCache.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/stat.h>
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Helpers
+// ____________________________________________________________________________________________________
+//
+
+// Plain mutex, since the core has to build with compilers that predate std::mutex
+class CGmaMutex
+{
+public:
+#ifdef _WIN32
+	CGmaMutex() { InitializeCriticalSection(&_cs); }
+	~CGmaMutex() { DeleteCriticalSection(&_cs); }
+	void Lock() { EnterCriticalSection(&_cs); }
+	void Unlock() { LeaveCriticalSection(&_cs); }
+#else
+	CGmaMutex() { pthread_mutex_init(&_mutex, NULL); }
+	~CGmaMutex() { pthread_mutex_destroy(&_mutex); }
+	void Lock() { pthread_mutex_lock(&_mutex); }
+	void Unlock() { pthread_mutex_unlock(&_mutex); }
+#endif
+
+private:
+#ifdef _WIN32
+	CRITICAL_SECTION _cs;
+#else
+	pthread_mutex_t _mutex;
+#endif
+
+	CGmaMutex(const CGmaMutex&);
+	CGmaMutex& operator=(const CGmaMutex&);
+};
+
+class CGmaMutexLock
+{
+public:
+	explicit CGmaMutexLock(CGmaMutex* pMutex) : _pMutex(pMutex) { _pMutex->Lock(); }
+	~CGmaMutexLock() { _pMutex->Unlock(); }
+
+private:
+	CGmaMutex* _pMutex;
+
+	CGmaMutexLock(const CGmaMutexLock&);
+	CGmaMutexLock& operator=(const CGmaMutexLock&);
+};
+
+static size_t _AlignUp(size_t cb, size_t cbAlign)
+{
+	return (cb + cbAlign - 1) & ~(cbAlign - 1);
+}
+
+static inline uint64_t _MixHash(uint64_t ullHash, uint64_t ullValue)
+{
+	// splitmix64 finalizer over each field in turn
+	ullHash ^= ullValue + 0x9E3779B97F4A7C15ull + (ullHash << 6) + (ullHash >> 2);
+	ullHash ^= ullHash >> 30;
+	ullHash *= 0xBF58476D1CE4E5B9ull;
+	ullHash ^= ullHash >> 27;
+	ullHash *= 0x94D049BB133111EBull;
+	ullHash ^= ullHash >> 31;
+	return ullHash;
+}
+
+// Hands out consecutive pieces of an entry's block, which _MeasureStrings() sized beforehand. Same interface as CGmaArena::Alloc().
+class CGmaPackAllocator
+{
+public:
+	CGmaPackAllocator(uint8_t* pb, size_t cb) : _pb(pb), _cbLeft(cb) {}
+
+	void* Alloc(size_t cb, size_t cbAlign)
+	{
+		size_t cbPad = _AlignUp((size_t)_pb, cbAlign) - (size_t)_pb;
+		if (cbPad > _cbLeft || cb > _cbLeft - cbPad)
+			return NULL;
+		void* p = _pb + cbPad;
+		_pb += cbPad + cb;
+		_cbLeft -= cbPad + cb;
+		return p;
+	}
+
+private:
+	uint8_t* _pb;
+	size_t _cbLeft;
+};
+
+// Worst case bytes _CopyStrings() takes for meta's strings, alignment included
+static size_t _MeasureStrings(const GmaCachedMetadata& meta)
+{
+	if (meta.stage < GMA_STAGE_HEADER)
+		return 0;
+
+	const GmaHeaderInfo& header = meta.header;
+	size_t cb = header.strName.cch + header.strAuthor.cch + header.strDescription.cch + header.strType.cch + 4;
+	cb += sizeof(void*) + header.cTags * sizeof(GmaString);
+	for (uint32_t i = 0; i < header.cTags; i++)
+		cb += header.astrTags[i].cch + 1;
+	return cb;
+}
+
+template <class TAllocator> static bool _CopyString(const GmaString& strSource, GmaString* pstrDest, TAllocator* pAllocator)
+{
+	pstrDest->cch = strSource.cch;
+	pstrDest->psz = NULL;
+	if (strSource.psz == NULL)
+		return true;
+
+	char* psz = (char*)pAllocator->Alloc((size_t)strSource.cch + 1, 1);
+	if (psz == NULL)
+		return false;
+	memcpy(psz, strSource.psz, strSource.cch);
+	psz[strSource.cch] = '\0';
+	pstrDest->psz = psz;
+	return true;
+}
+
+// Copies metaSource into *pmetaDest, with its strings allocated from pAllocator
+template <class TAllocator> static bool _CopyMetadata(const GmaCachedMetadata& metaSource, GmaCachedMetadata* pmetaDest, TAllocator* pAllocator)
+{
+	*pmetaDest = metaSource;
+	if (metaSource.stage < GMA_STAGE_HEADER)
+	{
+		memset(&pmetaDest->header, 0, sizeof(pmetaDest->header));
+		return true;
+	}
+
+	const GmaHeaderInfo& headerSource = metaSource.header;
+	GmaHeaderInfo* pheaderDest = &pmetaDest->header;
+	if (!_CopyString(headerSource.strName, &pheaderDest->strName, pAllocator) || !_CopyString(headerSource.strAuthor, &pheaderDest->strAuthor, pAllocator)
+		|| !_CopyString(headerSource.strDescription, &pheaderDest->strDescription, pAllocator) || !_CopyString(headerSource.strType, &pheaderDest->strType, pAllocator))
+		return false;
+
+	pheaderDest->astrTags = NULL;
+	if (headerSource.cTags > 0)
+	{
+		pheaderDest->astrTags = (GmaString*)pAllocator->Alloc(headerSource.cTags * sizeof(GmaString), sizeof(void*));
+		if (pheaderDest->astrTags == NULL)
+			return false;
+		for (uint32_t i = 0; i < headerSource.cTags; i++)
+		{
+			if (!_CopyString(headerSource.astrTags[i], &pheaderDest->astrTags[i], pAllocator))
+				return false;
+		}
+	}
+	return true;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Keys and snapshots
+// ____________________________________________________________________________________________________
+//
+
+uint64_t GmaHashCacheKey(const GmaCacheKey& key)
+{
+	uint64_t ullHash = 0ull;
+	ullHash = _MixHash(ullHash, key.ullVolume);
+	ullHash = _MixHash(ullHash, key.ullFileId);
+	ullHash = _MixHash(ullHash, key.ullSize);
+	ullHash = _MixHash(ullHash, key.ullLastWrite);
+	return ullHash;
+}
+
+bool GmaCacheKeysEqual(const GmaCacheKey& key1, const GmaCacheKey& key2)
+{
+	return key1.ullVolume == key2.ullVolume && key1.ullFileId == key2.ullFileId && key1.ullSize == key2.ullSize && key1.ullLastWrite == key2.ullLastWrite;
+}
+
+void GmaGetDocumentMetadata(const CGmaDocument& document, GmaCachedMetadata* pMeta)
+{
+	memset(pMeta, 0, sizeof(*pMeta));
+	pMeta->stage = document.GetStage();
+	pMeta->statusFailed = document.GetFailureStatus();
+	pMeta->statusToc = GMA_E_UNEXPECTED;
+	if (pMeta->stage >= GMA_STAGE_HEADER)
+		pMeta->header = document.GetHeader();
+	if (pMeta->stage >= GMA_STAGE_TOC)
+	{
+		pMeta->statusToc = document.GetTocStatus();
+		pMeta->tocSummary = document.GetTocSummary();
+	}
+}
+
+GmaStatus GmaCopyMetadata(const GmaCachedMetadata& meta, GmaCachedMetadata* pmetaCopy, CGmaArena* pArena)
+{
+	if (GMA_FAILED(pArena->Reserve(_MeasureStrings(meta))) || !_CopyMetadata(meta, pmetaCopy, pArena))
+		return GMA_E_OUTOFMEMORY;
+	return GMA_S_OK;
+}
+
+#ifndef _WIN32
+static void _KeyFromStat(const struct stat& st, GmaCacheKey* pKey)
+{
+	pKey->ullVolume = (uint64_t)st.st_dev;
+	pKey->ullFileId = (uint64_t)st.st_ino;
+	pKey->ullSize = (uint64_t)st.st_size;
+#if defined(__APPLE__)
+	pKey->ullLastWrite = (uint64_t)st.st_mtimespec.tv_sec * 1000000000ull + (uint64_t)st.st_mtimespec.tv_nsec;
+#else
+	pKey->ullLastWrite = (uint64_t)st.st_mtim.tv_sec * 1000000000ull + (uint64_t)st.st_mtim.tv_nsec;
+#endif
+}
+
+GmaStatus GmaGetFileCacheKey(int fd, GmaCacheKey* pKey)
+{
+	memset(pKey, 0, sizeof(*pKey));
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return GMA_E_IO;
+	_KeyFromStat(st, pKey);
+	return GMA_S_OK;
+}
+
+GmaStatus GmaGetPathCacheKey(const char* pszPath, GmaCacheKey* pKey)
+{
+	memset(pKey, 0, sizeof(*pKey));
+
+	struct stat st;
+	if (stat(pszPath, &st) != 0)
+		return GMA_E_IO;
+	_KeyFromStat(st, pKey);
+	return GMA_S_OK;
+}
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Metadata cache
+// ____________________________________________________________________________________________________
+//
+
+// One cached file. The metadata's strings follow it in the same allocation.
+struct CGmaMetadataCache::Entry
+{
+	Entry* pHashNext;
+	Entry* pLruPrev; // towards the most recently used
+	Entry* pLruNext;
+	uint64_t ullHash;
+	size_t cbEntry; // the whole allocation
+	GmaCacheKey key;
+	GmaCachedMetadata meta;
+};
+
+// One independently locked part of the cache: a chained hash table of its entries, and a list of them from most to least recently used
+struct CGmaMetadataCache::Stripe
+{
+	CGmaMutex mutex;
+
+	Entry** apBuckets;
+	size_t cBuckets; // power of two, or 0 before the first insert
+	Entry* pLruHead;
+	Entry* pLruTail;
+	size_t cEntries;
+	size_t cbUsed;
+	size_t cbBudget;
+
+	uint64_t cHits;
+	uint64_t cMisses;
+	uint64_t cInserts;
+	uint64_t cEvictions;
+
+	Stripe() : apBuckets(NULL), cBuckets(0), pLruHead(NULL), pLruTail(NULL), cEntries(0), cbUsed(0), cbBudget(0), cHits(0ull), cMisses(0ull), cInserts(0ull), cEvictions(0ull) {}
+	~Stripe()
+	{
+		Clear();
+		delete[] apBuckets;
+	}
+
+	Entry* Find(const GmaCacheKey& key, uint64_t ullHash)
+	{
+		if (cBuckets == 0)
+			return NULL;
+		for (Entry* pEntry = apBuckets[ullHash & (cBuckets - 1)]; pEntry != NULL; pEntry = pEntry->pHashNext)
+		{
+			if (pEntry->ullHash == ullHash && GmaCacheKeysEqual(pEntry->key, key))
+				return pEntry;
+		}
+		return NULL;
+	}
+
+	void LinkFront(Entry* pEntry)
+	{
+		pEntry->pLruPrev = NULL;
+		pEntry->pLruNext = pLruHead;
+		if (pLruHead != NULL)
+			pLruHead->pLruPrev = pEntry;
+		pLruHead = pEntry;
+		if (pLruTail == NULL)
+			pLruTail = pEntry;
+	}
+
+	void Unlink(Entry* pEntry)
+	{
+		if (pEntry->pLruPrev != NULL)
+			pEntry->pLruPrev->pLruNext = pEntry->pLruNext;
+		else
+			pLruHead = pEntry->pLruNext;
+		if (pEntry->pLruNext != NULL)
+			pEntry->pLruNext->pLruPrev = pEntry->pLruPrev;
+		else
+			pLruTail = pEntry->pLruPrev;
+	}
+
+	void Touch(Entry* pEntry)
+	{
+		if (pEntry != pLruHead)
+		{
+			Unlink(pEntry);
+			LinkFront(pEntry);
+		}
+	}
+
+	// Doubles the bucket count once the chains average more than one entry. If that fails, the chains just get longer.
+	void Grow()
+	{
+		if (cEntries < cBuckets)
+			return;
+
+		size_t cNewBuckets = (cBuckets != 0) ? cBuckets * 2 : 16;
+		Entry** apNewBuckets = new (std::nothrow) Entry*[cNewBuckets];
+		if (apNewBuckets == NULL)
+			return;
+		memset(apNewBuckets, 0, cNewBuckets * sizeof(Entry*));
+
+		for (size_t i = 0; i < cBuckets; i++)
+		{
+			Entry* pEntry = apBuckets[i];
+			while (pEntry != NULL)
+			{
+				Entry* pNext = pEntry->pHashNext;
+				Entry** ppBucket = &apNewBuckets[pEntry->ullHash & (cNewBuckets - 1)];
+				pEntry->pHashNext = *ppBucket;
+				*ppBucket = pEntry;
+				pEntry = pNext;
+			}
+		}
+
+		delete[] apBuckets;
+		apBuckets = apNewBuckets;
+		cBuckets = cNewBuckets;
+	}
+
+	void Add(Entry* pEntry)
+	{
+		Entry** ppBucket = &apBuckets[pEntry->ullHash & (cBuckets - 1)];
+		pEntry->pHashNext = *ppBucket;
+		*ppBucket = pEntry;
+		LinkFront(pEntry);
+		cEntries++;
+		cbUsed += pEntry->cbEntry;
+	}
+
+	void Remove(Entry* pEntry)
+	{
+		Entry** ppLink = &apBuckets[pEntry->ullHash & (cBuckets - 1)];
+		while (*ppLink != pEntry)
+			ppLink = &(*ppLink)->pHashNext;
+		*ppLink = pEntry->pHashNext;
+
+		Unlink(pEntry);
+		cEntries--;
+		cbUsed -= pEntry->cbEntry;
+		delete[] (uint8_t*)pEntry;
+	}
+
+	// Evicts from the least recently used end until cbNeeded more bytes fit
+	void MakeRoom(size_t cbNeeded)
+	{
+		while (pLruTail != NULL && cbUsed + cbNeeded > cbBudget)
+		{
+			Remove(pLruTail);
+			cEvictions++;
+		}
+	}
+
+	void Clear()
+	{
+		while (pLruTail != NULL)
+			Remove(pLruTail);
+	}
+};
+
+CGmaMetadataCache::CGmaMetadataCache(size_t cbBudget) : _aStripes(NULL)
+{
+	_aStripes = new (std::nothrow) Stripe[c_cGmaMetadataCacheStripes];
+	SetBudget(cbBudget);
+}
+
+CGmaMetadataCache::~CGmaMetadataCache()
+{
+	delete[] _aStripes;
+}
+
+CGmaMetadataCache::Stripe* CGmaMetadataCache::_GetStripe(uint64_t ullHash)
+{
+	// The top bits pick the stripe and the bottom ones the bucket, so the two stay independent
+	return &_aStripes[(size_t)(ullHash >> 58) & (c_cGmaMetadataCacheStripes - 1)];
+}
+
+bool CGmaMetadataCache::Lookup(const GmaCacheKey& key, GmaCachedMetadata* pMeta, CGmaArena* pArena)
+{
+	memset(pMeta, 0, sizeof(*pMeta));
+	if (_aStripes == NULL)
+		return false;
+
+	uint64_t ullHash = GmaHashCacheKey(key);
+	Stripe* pStripe = _GetStripe(ullHash);
+	CGmaMutexLock lock(&pStripe->mutex);
+
+	Entry* pEntry = pStripe->Find(key, ullHash);
+	if (pEntry == NULL)
+	{
+		pStripe->cMisses++;
+		return false;
+	}
+
+	// The entry may be evicted as soon as the lock is released, so the caller gets its own copy
+	if (!_CopyMetadata(pEntry->meta, pMeta, pArena))
+	{
+		memset(pMeta, 0, sizeof(*pMeta));
+		pStripe->cMisses++;
+		return false;
+	}
+
+	pStripe->Touch(pEntry);
+	pStripe->cHits++;
+	return true;
+}
+
+GmaStatus CGmaMetadataCache::Insert(const GmaCacheKey& key, const GmaCachedMetadata& meta)
+{
+	if (_aStripes == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	// The next attempt might well succeed
+	if (meta.statusFailed == GMA_E_IO || meta.statusFailed == GMA_E_OUTOFMEMORY)
+		return GMA_S_OK;
+
+	// Build the entry before taking the lock
+	size_t cbHeader = _AlignUp(sizeof(Entry), sizeof(void*));
+	size_t cbEntry = cbHeader + _MeasureStrings(meta);
+	uint8_t* pbEntry = new (std::nothrow) uint8_t[cbEntry];
+	if (pbEntry == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	Entry* pEntry = (Entry*)pbEntry;
+	CGmaPackAllocator allocator(pbEntry + cbHeader, cbEntry - cbHeader);
+	if (!_CopyMetadata(meta, &pEntry->meta, &allocator))
+	{
+		delete[] pbEntry;
+		return GMA_E_UNEXPECTED; // _MeasureStrings() got it wrong
+	}
+	pEntry->ullHash = GmaHashCacheKey(key);
+	pEntry->cbEntry = cbEntry;
+	pEntry->key = key;
+
+	Stripe* pStripe = _GetStripe(pEntry->ullHash);
+	CGmaMutexLock lock(&pStripe->mutex);
+
+	Entry* pOld = pStripe->Find(key, pEntry->ullHash);
+	if (pOld != NULL)
+		pStripe->Remove(pOld);
+
+	if (cbEntry > pStripe->cbBudget)
+	{
+		delete[] pbEntry;
+		return GMA_E_ABORT;
+	}
+
+	pStripe->MakeRoom(cbEntry);
+	pStripe->Grow();
+	if (pStripe->cBuckets == 0)
+	{
+		delete[] pbEntry;
+		return GMA_E_OUTOFMEMORY;
+	}
+
+	pStripe->Add(pEntry);
+	pStripe->cInserts++;
+	return GMA_S_OK;
+}
+
+void CGmaMetadataCache::SetBudget(size_t cbBudget)
+{
+	if (_aStripes == NULL)
+		return;
+
+	for (uint32_t i = 0; i < c_cGmaMetadataCacheStripes; i++)
+	{
+		Stripe* pStripe = &_aStripes[i];
+		CGmaMutexLock lock(&pStripe->mutex);
+		pStripe->cbBudget = cbBudget / c_cGmaMetadataCacheStripes;
+		pStripe->MakeRoom(0);
+	}
+}
+
+void CGmaMetadataCache::Clear()
+{
+	if (_aStripes == NULL)
+		return;
+
+	for (uint32_t i = 0; i < c_cGmaMetadataCacheStripes; i++)
+	{
+		Stripe* pStripe = &_aStripes[i];
+		CGmaMutexLock lock(&pStripe->mutex);
+		pStripe->Clear();
+	}
+}
+
+void CGmaMetadataCache::GetStats(GmaCacheStats* pStats)
+{
+	memset(pStats, 0, sizeof(*pStats));
+	if (_aStripes == NULL)
+		return;
+
+	for (uint32_t i = 0; i < c_cGmaMetadataCacheStripes; i++)
+	{
+		Stripe* pStripe = &_aStripes[i];
+		CGmaMutexLock lock(&pStripe->mutex);
+		pStats->cHits += pStripe->cHits;
+		pStats->cMisses += pStripe->cMisses;
+		pStats->cInserts += pStripe->cInserts;
+		pStats->cEvictions += pStripe->cEvictions;
+		pStats->cEntries += pStripe->cEntries;
+		pStats->cbUsed += pStripe->cbUsed;
+		pStats->cbBudget += pStripe->cbBudget;
+	}
+}
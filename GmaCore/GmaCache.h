@@ -0,0 +1,101 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+#include "GmaDocument.h"
+
+const size_t c_cbGmaMetadataCacheDefaultBudget = 4 * 1024 * 1024; // Tens of thousands of typical addons
+const uint32_t c_cGmaMetadataCacheStripes = 16; // Independently locked parts of the cache. Must be a power of two.
+
+// Identity of one version of one file
+// Filled in by the caller from whatever its platform offers: ideally the volume and file ID (or device and inode), otherwise something derived from the path. Size and last write time make a modified file a different key, so entries never need invalidating; stale ones just age out.
+struct GmaCacheKey
+{
+	uint64_t ullVolume;
+	uint64_t ullFileId;
+	uint64_t ullSize;
+	uint64_t ullLastWrite; // Any unit, as long as it's used consistently
+};
+
+// Hashes every field of key. The result depends on nothing but the key, so it can be persisted.
+uint64_t GmaHashCacheKey(const GmaCacheKey& key);
+bool GmaCacheKeysEqual(const GmaCacheKey& key1, const GmaCacheKey& key2);
+
+// Everything a CGmaDocument found out about a file, detached from the document
+struct GmaCachedMetadata
+{
+	GmaParseStage stage; // Last stage parsed successfully
+	GmaStatus statusFailed; // Why the stage after it can't be reached (e.g. GMA_E_ABORT for a non-GMA), or GMA_S_OK if parsing just hasn't gone further yet
+	GmaHeaderInfo header; // Valid from GMA_STAGE_HEADER
+	GmaStatus statusToc; // Valid from GMA_STAGE_TOC
+	GmaTocSummary tocSummary;
+};
+
+struct GmaCacheStats
+{
+	uint64_t cHits;
+	uint64_t cMisses;
+	uint64_t cInserts;
+	uint64_t cEvictions; // Entries dropped to stay within the budget
+	size_t cEntries;
+	size_t cbUsed;
+	size_t cbBudget;
+};
+
+// Snapshots what document has parsed so far. The strings stay in the document.
+void GmaGetDocumentMetadata(const CGmaDocument& document, GmaCachedMetadata* pMeta);
+
+// Copies meta into *pmetaCopy with its strings allocated from pArena, e.g. so a snapshot outlives its document
+GmaStatus GmaCopyMetadata(const GmaCachedMetadata& meta, GmaCachedMetadata* pmetaCopy, CGmaArena* pArena);
+
+#ifndef _WIN32
+// Builds the key for an open file from its device, inode, size and modification time
+GmaStatus GmaGetFileCacheKey(int fd, GmaCacheKey* pKey);
+// Same for a file that isn't open, following symlinks
+GmaStatus GmaGetPathCacheKey(const char* pszPath, GmaCacheKey* pKey);
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Metadata cache
+// ____________________________________________________________________________________________________
+//
+
+// Thread-safe LRU cache of parse results, for consumers that see the same files over and over (e.g. the shell, which creates a new property handler each time it wants a file's properties)
+// Negative results are cached too, so a non-GMA or corrupt file is only parsed once. Transient failures (GMA_E_IO, GMA_E_OUTOFMEMORY) are not.
+// Keys are spread over c_cGmaMetadataCacheStripes stripes, each with its own lock, LRU list and share of the byte budget, so concurrent lookups of different files rarely contend.
+// Each entry is a single allocation holding the metadata and its strings, and counts its full size against the budget.
+class CGmaMetadataCache
+{
+public:
+	explicit CGmaMetadataCache(size_t cbBudget = c_cbGmaMetadataCacheDefaultBudget);
+	~CGmaMetadataCache();
+
+	// On a hit, copies the entry into *pMeta, with its strings allocated from pArena, and marks it most recently used
+	// Returns false on a miss, and also if the copy runs out of memory.
+	bool Lookup(const GmaCacheKey& key, GmaCachedMetadata* pMeta, CGmaArena* pArena);
+
+	// Adds or replaces the entry for key, evicting the least recently used entries of its stripe as needed
+	// Fails with GMA_E_ABORT if the entry alone exceeds a stripe's share of the budget. Transient failures are ignored and return GMA_S_OK.
+	GmaStatus Insert(const GmaCacheKey& key, const GmaCachedMetadata& meta);
+
+	// Changes the budget, evicting entries right away if it shrank. A budget of 0 disables the cache.
+	void SetBudget(size_t cbBudget);
+	void Clear();
+
+	// Counters since construction (not reset by Clear), and the current contents
+	void GetStats(GmaCacheStats* pStats);
+
+private:
+	struct Entry;
+	struct Stripe;
+
+	Stripe* _aStripes; // c_cGmaMetadataCacheStripes of them. NULL if they couldn't be allocated, in which case every lookup misses.
+
+	Stripe* _GetStripe(uint64_t ullHash);
+
+	CGmaMetadataCache(const CGmaMetadataCache&);
+	CGmaMetadataCache& operator=(const CGmaMetadataCache&);
+};
@@ -0,0 +1,1259 @@
+#include "GmaCacheFile.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+#ifdef _WIN32
+#include <stddef.h>  // offsetof
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>  // rename
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Fingerprints
+// ____________________________________________________________________________________________________
+//
+
+// Multiply-xorshift over 8-byte words. Only meant to notice that bytes changed, not to resist anyone changing them on purpose.
+static uint64_t _HashBytes(uint64_t ullHash, const uint8_t* pb, size_t cb)
+{
+	uint64_t ullWord;
+	for (; cb >= 8; pb += 8, cb -= 8)
+	{
+		memcpy(&ullWord, pb, 8);
+		ullHash = (ullHash ^ ullWord) * 0x9E3779B97F4A7C15ull;
+		ullHash ^= ullHash >> 29;
+	}
+
+	ullWord = (uint64_t)cb << 56;
+	memcpy(&ullWord, pb, cb);
+	ullHash = (ullHash ^ ullWord) * 0x9E3779B97F4A7C15ull;
+	ullHash ^= ullHash >> 29;
+	return ullHash;
+}
+
+static uint64_t _FinishHash(uint64_t ullHash)
+{
+	ullHash ^= ullHash >> 30;
+	ullHash *= 0xBF58476D1CE4E5B9ull;
+	ullHash ^= ullHash >> 27;
+	ullHash *= 0x94D049BB133111EBull;
+	ullHash ^= ullHash >> 31;
+	return ullHash;
+}
+
+// Hashes [ullStart, ullEnd) of the source, straight from its view if it has one. The range is at most c_cbGmaFingerprintWindow bytes.
+static GmaStatus _HashRange(IGmaByteSource* pSource, const uint8_t* pbView, uint64_t ullStart, uint64_t ullEnd, uint64_t* pullHash)
+{
+	uint32_t cb = (uint32_t)(ullEnd - ullStart);
+	if (pbView != NULL)
+	{
+		*pullHash = _HashBytes(*pullHash, pbView + ullStart, cb);
+		return GMA_S_OK;
+	}
+
+	uint8_t abBuf[c_cbGmaFingerprintWindow];
+	GmaStatus status = pSource->Seek((int64_t)ullStart, GMA_SEEK_SET, NULL);
+	if (GMA_FAILED(status))
+		return status;
+
+	uint32_t cbDone = 0;
+	while (cbDone < cb)
+	{
+		uint32_t cbRead;
+		status = pSource->Read(abBuf + cbDone, cb - cbDone, &cbRead);
+		if (GMA_FAILED(status))
+			return status;
+		if (cbRead == 0)
+			return GMA_E_UNEXPECTED;
+		cbDone += cbRead;
+	}
+
+	*pullHash = _HashBytes(*pullHash, abBuf, cb);
+	return GMA_S_OK;
+}
+
+GmaStatus GmaComputeFingerprint(IGmaByteSource* pSource, uint64_t ullDataStart, uint64_t* pullFingerprint)
+{
+	*pullFingerprint = 0ull;
+
+	uint64_t ullSize;
+	GmaStatus status = pSource->GetSize(&ullSize);
+	if (GMA_FAILED(status))
+		return status;
+	if (ullDataStart > ullSize)
+		return GMA_E_UNEXPECTED;
+
+	const uint8_t* pbView;
+	uint64_t cbView;
+	if (GMA_FAILED(pSource->GetView(&pbView, &cbView)) || cbView < ullSize)
+		pbView = NULL;
+
+	uint64_t ullHash = _FinishHash(ullDataStart);
+	uint64_t ullHeadEnd = (ullSize < c_cbGmaFingerprintWindow) ? ullSize : c_cbGmaFingerprintWindow;
+	status = _HashRange(pSource, pbView, 0ull, ullHeadEnd, &ullHash);
+	if (GMA_FAILED(status))
+		return status;
+
+	if (ullDataStart > ullHeadEnd)
+	{
+		uint64_t ullTailStart = (ullDataStart - ullHeadEnd > c_cbGmaFingerprintWindow) ? ullDataStart - c_cbGmaFingerprintWindow : ullHeadEnd;
+		status = _HashRange(pSource, pbView, ullTailStart, ullDataStart, &ullHash);
+		if (GMA_FAILED(status))
+			return status;
+	}
+
+	*pullFingerprint = _FinishHash(ullHash);
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Packed metadata
+// ____________________________________________________________________________________________________
+//
+
+// A string stored in a record
+struct GmaPackedString
+{
+	uint32_t ulOffset; // From the start of the record, 0 for a missing string. The string is null-terminated.
+	uint32_t cch;
+};
+
+// Everything known about one file. Followed by cTags GmaPackedStrings for its tags, then the bytes of all its strings.
+// Stored in native byte order and naturally aligned, so it can be read in place.
+struct GmaPackedRecord
+{
+	uint64_t ullNext; // Cache file only: offset of the next older record in the same bucket, always lower than this one's
+	uint64_t ullChecksum; // Of everything after it, strings included
+	GmaCacheKey key;
+	uint64_t ullFingerprint;
+	uint64_t ullDataStart; // What ullFingerprint was computed with
+	uint64_t ullSteamId;
+	uint64_t ullTimestamp;
+	uint64_t ullTotalSize;
+	uint64_t ullLargestSize;
+	uint32_t cbRecord; // Whole record, strings included, rounded up to 8 bytes
+	uint32_t cFiles;
+	int32_t lAddonVersion;
+	uint32_t cTags;
+	uint8_t bStage;
+	uint8_t bStatusFailed;
+	uint8_t bStatusToc;
+	uint8_t bFormatVersion;
+	uint8_t bUsesJsonChunkInDescription;
+	uint8_t abReserved[3];
+	GmaPackedString strName;
+	GmaPackedString strAuthor;
+	GmaPackedString strDescription;
+	GmaPackedString strType;
+};
+
+static uint64_t _AlignUp(uint64_t cb, uint64_t cbAlign)
+{
+	return (cb + cbAlign - 1) & ~(cbAlign - 1);
+}
+
+static uint64_t _ChecksumRecord(const GmaPackedRecord* pRecord)
+{
+	const uint8_t* pbChecked = (const uint8_t*)&pRecord->ullChecksum + sizeof(pRecord->ullChecksum);
+	return _FinishHash(_HashBytes(0ull, pbChecked, (const uint8_t*)pRecord + pRecord->cbRecord - pbChecked));
+}
+
+static uint64_t _MeasureString(const GmaString& str)
+{
+	return (str.psz != NULL) ? (uint64_t)str.cch + 1 : 0ull;
+}
+
+// Size of the record for meta
+static GmaStatus _MeasureRecord(const GmaCachedMetadata& meta, uint32_t* pcbRecord)
+{
+	*pcbRecord = 0;
+
+	uint64_t cb = sizeof(GmaPackedRecord);
+	if (meta.stage >= GMA_STAGE_HEADER)
+	{
+		const GmaHeaderInfo& header = meta.header;
+		cb += _MeasureString(header.strName) + _MeasureString(header.strAuthor) + _MeasureString(header.strDescription) + _MeasureString(header.strType);
+		cb += (uint64_t)header.cTags * sizeof(GmaPackedString);
+		for (uint32_t i = 0; i < header.cTags; i++)
+			cb += _MeasureString(header.astrTags[i]);
+	}
+	cb = _AlignUp(cb, 8);
+	if (cb > 0xFFFFFFFFull)
+		return GMA_E_ARITHMETIC;
+	*pcbRecord = (uint32_t)cb;
+	return GMA_S_OK;
+}
+
+static void _WriteString(uint8_t* pbRecord, uint32_t* pibNext, const GmaString& str, GmaPackedString* pstrOut)
+{
+	pstrOut->ulOffset = 0;
+	pstrOut->cch = 0;
+	if (str.psz == NULL)
+		return;
+
+	memcpy(pbRecord + *pibNext, str.psz, str.cch);
+	pbRecord[*pibNext + str.cch] = '\0';
+	pstrOut->ulOffset = *pibNext;
+	pstrOut->cch = str.cch;
+	*pibNext += str.cch + 1;
+}
+
+// Fills in a record of cbRecord bytes (from _MeasureRecord()) for meta, except for ullNext, which the checksum leaves out so compaction can relink records without rehashing them
+static void _WriteRecord(GmaPackedRecord* pRecord, uint32_t cbRecord, const GmaCacheKey& key, uint64_t ullFingerprint, const GmaCachedMetadata& meta)
+{
+	memset(pRecord, 0, sizeof(*pRecord));
+	pRecord->key = key;
+	pRecord->ullFingerprint = ullFingerprint;
+	pRecord->cbRecord = cbRecord;
+	pRecord->bStage = (uint8_t)meta.stage;
+	pRecord->bStatusFailed = (uint8_t)meta.statusFailed;
+	pRecord->bStatusToc = (uint8_t)meta.statusToc;
+
+	if (meta.stage >= GMA_STAGE_TOC)
+	{
+		pRecord->ullDataStart = meta.tocSummary.ullDataStart;
+		pRecord->cFiles = meta.tocSummary.cFiles;
+		pRecord->ullTotalSize = meta.tocSummary.ullTotalSize;
+		pRecord->ullLargestSize = meta.tocSummary.ullLargestSize;
+	}
+
+	if (meta.stage >= GMA_STAGE_HEADER)
+	{
+		const GmaHeaderInfo& header = meta.header;
+		pRecord->ullSteamId = header.ullSteamId;
+		pRecord->ullTimestamp = header.ullTimestamp;
+		pRecord->lAddonVersion = header.lAddonVersion;
+		pRecord->bFormatVersion = header.bFormatVersion;
+		pRecord->bUsesJsonChunkInDescription = header.bUsesJsonChunkInDescription ? 1 : 0;
+		pRecord->cTags = header.cTags;
+
+		uint8_t* pbRecord = (uint8_t*)pRecord;
+		GmaPackedString* astrTags = (GmaPackedString*)(pRecord + 1);
+		uint32_t ibNext = sizeof(GmaPackedRecord) + header.cTags * sizeof(GmaPackedString);
+		_WriteString(pbRecord, &ibNext, header.strName, &pRecord->strName);
+		_WriteString(pbRecord, &ibNext, header.strAuthor, &pRecord->strAuthor);
+		_WriteString(pbRecord, &ibNext, header.strDescription, &pRecord->strDescription);
+		_WriteString(pbRecord, &ibNext, header.strType, &pRecord->strType);
+		for (uint32_t i = 0; i < header.cTags; i++)
+			_WriteString(pbRecord, &ibNext, header.astrTags[i], &astrTags[i]);
+	}
+
+	pRecord->ullChecksum = _ChecksumRecord(pRecord);
+}
+
+static bool _ReadString(const GmaPackedRecord* pRecord, const GmaPackedString& strStored, GmaString* pstr)
+{
+	uint32_t ulOffset = strStored.ulOffset;
+	uint32_t cch = strStored.cch;
+	pstr->psz = NULL;
+	pstr->cch = 0;
+	if (ulOffset == 0)
+		return cch == 0;
+
+	uint32_t cbRecord = pRecord->cbRecord;
+	if (ulOffset < sizeof(GmaPackedRecord) || ulOffset >= cbRecord || cch >= cbRecord - ulOffset)
+		return false;
+
+	const char* psz = (const char*)pRecord + ulOffset;
+	if (psz[cch] != '\0')
+		return false;
+	pstr->psz = psz;
+	pstr->cch = cch;
+	return true;
+}
+
+// Turns a record back into metadata whose strings point into it. Only the tag array comes from pArena.
+static bool _ReadRecord(const GmaPackedRecord* pRecord, GmaCachedMetadata* pMeta, CGmaArena* pArena)
+{
+	if (pRecord->bStage > GMA_STAGE_TOC || pRecord->bStatusFailed > GMA_E_TOOLARGE || pRecord->bStatusToc > GMA_E_TOOLARGE)
+		return false;
+
+	pMeta->stage = (GmaParseStage)pRecord->bStage;
+	pMeta->statusFailed = (GmaStatus)pRecord->bStatusFailed;
+	pMeta->statusToc = (GmaStatus)pRecord->bStatusToc;
+
+	if (pMeta->stage >= GMA_STAGE_TOC)
+	{
+		pMeta->tocSummary.cFiles = pRecord->cFiles;
+		pMeta->tocSummary.ullTotalSize = pRecord->ullTotalSize;
+		pMeta->tocSummary.ullLargestSize = pRecord->ullLargestSize;
+		pMeta->tocSummary.ullDataStart = pRecord->ullDataStart;
+	}
+
+	if (pMeta->stage >= GMA_STAGE_HEADER)
+	{
+		GmaHeaderInfo* pHeader = &pMeta->header;
+		pHeader->ullSteamId = pRecord->ullSteamId;
+		pHeader->ullTimestamp = pRecord->ullTimestamp;
+		pHeader->lAddonVersion = pRecord->lAddonVersion;
+		pHeader->bFormatVersion = pRecord->bFormatVersion;
+		pHeader->bUsesJsonChunkInDescription = pRecord->bUsesJsonChunkInDescription != 0;
+		if (!_ReadString(pRecord, pRecord->strName, &pHeader->strName) || !_ReadString(pRecord, pRecord->strAuthor, &pHeader->strAuthor)
+			|| !_ReadString(pRecord, pRecord->strDescription, &pHeader->strDescription) || !_ReadString(pRecord, pRecord->strType, &pHeader->strType))
+			return false;
+
+		uint32_t cTags = pRecord->cTags;
+		if (cTags > (pRecord->cbRecord - sizeof(GmaPackedRecord)) / sizeof(GmaPackedString))
+			return false;
+		if (cTags > 0)
+		{
+			pHeader->astrTags = pArena->AllocArray<GmaString>(cTags);
+			if (pHeader->astrTags == NULL)
+				return false;
+			const GmaPackedString* astrTags = (const GmaPackedString*)(pRecord + 1);
+			for (uint32_t i = 0; i < cTags; i++)
+			{
+				if (!_ReadString(pRecord, astrTags[i], &pHeader->astrTags[i]))
+					return false;
+			}
+		}
+		pHeader->cTags = cTags;
+	}
+	return true;
+}
+
+GmaStatus GmaGetPackedMetadataSize(const GmaCachedMetadata& meta, uint32_t* pcb)
+{
+	return _MeasureRecord(meta, pcb);
+}
+
+void GmaPackMetadata(const GmaCacheKey& key, uint64_t ullFingerprint, const GmaCachedMetadata& meta, void* pv, uint32_t cb)
+{
+	_WriteRecord((GmaPackedRecord*)pv, cb, key, ullFingerprint, meta);
+}
+
+bool GmaUnpackMetadata(const void* pv, size_t cb, GmaCacheKey* pKey, uint64_t* pullFingerprint, GmaCachedMetadata* pMeta, CGmaArena* pArena)
+{
+	memset(pKey, 0, sizeof(*pKey));
+	*pullFingerprint = 0ull;
+	memset(pMeta, 0, sizeof(*pMeta));
+
+	const GmaPackedRecord* pRecord = (const GmaPackedRecord*)pv;
+	if (cb < sizeof(GmaPackedRecord) || pRecord->cbRecord < sizeof(GmaPackedRecord) || pRecord->cbRecord > cb || pRecord->ullChecksum != _ChecksumRecord(pRecord))
+		return false;
+	if (!_ReadRecord(pRecord, pMeta, pArena))
+	{
+		memset(pMeta, 0, sizeof(*pMeta));
+		return false;
+	}
+
+	*pKey = pRecord->key;
+	*pullFingerprint = pRecord->ullFingerprint;
+	return true;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Platform
+// ____________________________________________________________________________________________________
+//
+
+// The few file, lock and mapping calls the cache file needs, on POSIX and on Windows
+// Each returns false or an invalid handle on failure, with the reason left in errno or GetLastError() for _LastError().
+
+#ifdef _WIN32
+
+static const GmaFileHandle c_hNoFile = INVALID_HANDLE_VALUE;
+const int c_iErrorReadOnly = ERROR_ACCESS_DENIED;
+const int c_iErrorBusy = ERROR_RETRY;
+
+// LockFileEx() locks are mandatory, so rather than the file's bytes, the lock covers a single byte far past the end of any cache file, where it can't get in the way of reads
+const DWORD c_ulLockOffsetHigh = 0x7FFFFFFFul;
+
+static int _LastError()
+{
+	return (int)GetLastError();
+}
+
+// Every handle allows others to delete and rename the file, or a compaction in another process couldn't replace it
+static GmaFileHandle _OpenFile(const GmaPathChar* pszPath, bool bWritable, bool bTruncate)
+{
+	DWORD dwAccess = bWritable ? (GENERIC_READ | GENERIC_WRITE | DELETE) : GENERIC_READ;
+	DWORD dwDisposition = !bWritable ? OPEN_EXISTING : bTruncate ? CREATE_ALWAYS : OPEN_ALWAYS;
+	return CreateFileW(pszPath, dwAccess, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, dwDisposition, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static void _CloseFile(GmaFileHandle hFile)
+{
+	CloseHandle(hFile);
+}
+
+static bool _LockFile(GmaFileHandle hFile, bool bExclusive)
+{
+	OVERLAPPED ov;
+	ZeroMemory(&ov, sizeof(ov));
+	ov.OffsetHigh = c_ulLockOffsetHigh;
+	return LockFileEx(hFile, bExclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, 1, 0, &ov) != FALSE;
+}
+
+static void _UnlockFile(GmaFileHandle hFile)
+{
+	OVERLAPPED ov;
+	ZeroMemory(&ov, sizeof(ov));
+	ov.OffsetHigh = c_ulLockOffsetHigh;
+	UnlockFileEx(hFile, 0, 1, 0, &ov);
+}
+
+static bool _GetFileSize(GmaFileHandle hFile, uint64_t* pcbFile)
+{
+	LARGE_INTEGER liSize;
+	if (!GetFileSizeEx(hFile, &liSize))
+		return false;
+	*pcbFile = (uint64_t)liSize.QuadPart;
+	return true;
+}
+
+static bool _SetFileSize(GmaFileHandle hFile, uint64_t cbFile)
+{
+	LARGE_INTEGER liSize;
+	liSize.QuadPart = (LONGLONG)cbFile;
+	return SetFilePointerEx(hFile, liSize, NULL, FILE_BEGIN) && SetEndOfFile(hFile);
+}
+
+static bool _ReadAt(GmaFileHandle hFile, uint64_t ullOffset, void* pv, uint32_t cb)
+{
+	OVERLAPPED ov;
+	ZeroMemory(&ov, sizeof(ov));
+	ov.Offset = (DWORD)ullOffset;
+	ov.OffsetHigh = (DWORD)(ullOffset >> 32);
+	DWORD cbRead;
+	return ReadFile(hFile, pv, cb, &cbRead, &ov) && cbRead == cb;
+}
+
+static bool _WriteAt(GmaFileHandle hFile, uint64_t ullOffset, const void* pv, uint32_t cb)
+{
+	OVERLAPPED ov;
+	ZeroMemory(&ov, sizeof(ov));
+	ov.Offset = (DWORD)ullOffset;
+	ov.OffsetHigh = (DWORD)(ullOffset >> 32);
+	DWORD cbWritten;
+	return WriteFile(hFile, pv, cb, &cbWritten, &ov) && cbWritten == cb;
+}
+
+static void* _MapView(GmaFileHandle hFile, size_t cb, bool bWritable)
+{
+	// The view keeps the section alive, so the mapping handle isn't needed past this
+	HANDLE hMapping = CreateFileMappingW(hFile, NULL, bWritable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (hMapping == NULL)
+		return NULL;
+	void* pv = MapViewOfFile(hMapping, bWritable ? (FILE_MAP_READ | FILE_MAP_WRITE) : FILE_MAP_READ, 0, 0, cb);
+	DWORD dwError = GetLastError();
+	CloseHandle(hMapping);
+	SetLastError(dwError);
+	return pv;
+}
+
+static void _UnmapView(void* pv, size_t cb)
+{
+	(void)cb;
+	UnmapViewOfFile(pv);
+}
+
+// Whether pszPath names the file open on hFile. False if it names nothing.
+static bool _IsSameFile(GmaFileHandle hFile, const GmaPathChar* pszPath)
+{
+	HANDLE hCurrent = CreateFileW(pszPath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hCurrent == INVALID_HANDLE_VALUE)
+		return false;
+
+	BY_HANDLE_FILE_INFORMATION infoMapped;
+	BY_HANDLE_FILE_INFORMATION infoCurrent;
+	bool bSame = GetFileInformationByHandle(hFile, &infoMapped) && GetFileInformationByHandle(hCurrent, &infoCurrent)
+		&& infoMapped.dwVolumeSerialNumber == infoCurrent.dwVolumeSerialNumber && infoMapped.nFileIndexHigh == infoCurrent.nFileIndexHigh && infoMapped.nFileIndexLow == infoCurrent.nFileIndexLow;
+	CloseHandle(hCurrent);
+	return bSame;
+}
+
+// Renames the file open on hFrom over pszTo
+// MoveFileExW() can't replace a file that's still open, and other processes, like this one, keep the old cache file mapped until they move on. POSIX rename semantics (Windows 10 1809 and later) can, so those are tried first.
+static bool _ReplaceFile(GmaFileHandle hFrom, const GmaPathChar* pszFrom, const GmaPathChar* pszTo)
+{
+#ifdef FILE_RENAME_FLAG_POSIX_SEMANTICS
+	size_t cchTo = wcslen(pszTo);
+	size_t cbInfo = offsetof(FILE_RENAME_INFO, FileName) + (cchTo + 1) * sizeof(WCHAR);
+	FILE_RENAME_INFO* pInfo = (FILE_RENAME_INFO*)new (std::nothrow) uint8_t[cbInfo];
+	if (pInfo != NULL)
+	{
+		ZeroMemory(pInfo, cbInfo);
+		pInfo->Flags = FILE_RENAME_FLAG_REPLACE_IF_EXISTS | FILE_RENAME_FLAG_POSIX_SEMANTICS;
+		pInfo->FileNameLength = (DWORD)(cchTo * sizeof(WCHAR));
+		memcpy(pInfo->FileName, pszTo, (cchTo + 1) * sizeof(WCHAR));
+		BOOL bRenamed = SetFileInformationByHandle(hFrom, FileRenameInfoEx, pInfo, (DWORD)cbInfo);
+		delete[] (uint8_t*)pInfo;
+		if (bRenamed)
+			return true;
+	}
+#else
+	(void)hFrom;
+#endif
+	return MoveFileExW(pszFrom, pszTo, MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+
+static void _DeleteFile(const GmaPathChar* pszPath)
+{
+	DeleteFileW(pszPath);
+}
+
+// Acquire and release accesses to words other processes write through their own mappings
+// Offsets never reach 4 GB (see c_cbGmaCacheFileMax), so even a 32-bit build, where a 64-bit load takes two instructions, can't see a torn one.
+template <typename T> static T _LoadAcquire(T* p)
+{
+	T value = *(volatile T*)p;
+	MemoryBarrier();
+	return value;
+}
+
+template <typename T> static void _StoreRelease(T* p, T value)
+{
+	MemoryBarrier();
+	*(volatile T*)p = value;
+}
+
+#else
+
+static const GmaFileHandle c_hNoFile = -1;
+const int c_iErrorReadOnly = EACCES;
+const int c_iErrorBusy = EAGAIN;
+
+static int _LastError()
+{
+	return errno;
+}
+
+static GmaFileHandle _OpenFile(const GmaPathChar* pszPath, bool bWritable, bool bTruncate)
+{
+	int iFlags = bWritable ? (O_RDWR | O_CREAT | (bTruncate ? O_TRUNC : 0)) : O_RDONLY;
+	return open(pszPath, iFlags | O_CLOEXEC, 0666);
+}
+
+static void _CloseFile(GmaFileHandle fd)
+{
+	close(fd);
+}
+
+static int _Flock(int fd, int iOperation)
+{
+	int iResult;
+	do
+	{
+		iResult = flock(fd, iOperation);
+	} while (iResult != 0 && errno == EINTR);
+	return iResult;
+}
+
+static bool _LockFile(GmaFileHandle fd, bool bExclusive)
+{
+	return _Flock(fd, bExclusive ? LOCK_EX : LOCK_SH) == 0;
+}
+
+static void _UnlockFile(GmaFileHandle fd)
+{
+	_Flock(fd, LOCK_UN);
+}
+
+static bool _GetFileSize(GmaFileHandle fd, uint64_t* pcbFile)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return false;
+	*pcbFile = (uint64_t)st.st_size;
+	return true;
+}
+
+static bool _SetFileSize(GmaFileHandle fd, uint64_t cbFile)
+{
+	return ftruncate(fd, (off_t)cbFile) == 0;
+}
+
+static bool _ReadAt(GmaFileHandle fd, uint64_t ullOffset, void* pv, uint32_t cb)
+{
+	return pread(fd, pv, cb, (off_t)ullOffset) == (ssize_t)cb;
+}
+
+static bool _WriteAt(GmaFileHandle fd, uint64_t ullOffset, const void* pv, uint32_t cb)
+{
+	return pwrite(fd, pv, cb, (off_t)ullOffset) == (ssize_t)cb;
+}
+
+static void* _MapView(GmaFileHandle fd, size_t cb, bool bWritable)
+{
+	void* pv = mmap(NULL, cb, bWritable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	return (pv != MAP_FAILED) ? pv : NULL;
+}
+
+static void _UnmapView(void* pv, size_t cb)
+{
+	munmap(pv, cb);
+}
+
+// Whether pszPath names the file open on fd. False if it names nothing.
+static bool _IsSameFile(GmaFileHandle fd, const GmaPathChar* pszPath)
+{
+	struct stat stMapped;
+	struct stat stCurrent;
+	if (fstat(fd, &stMapped) != 0 || stat(pszPath, &stCurrent) != 0)
+		return false;
+	return stMapped.st_dev == stCurrent.st_dev && stMapped.st_ino == stCurrent.st_ino;
+}
+
+static bool _ReplaceFile(GmaFileHandle fdFrom, const GmaPathChar* pszFrom, const GmaPathChar* pszTo)
+{
+	(void)fdFrom;
+	return rename(pszFrom, pszTo) == 0;
+}
+
+static void _DeleteFile(const GmaPathChar* pszPath)
+{
+	unlink(pszPath);
+}
+
+// Acquire and release accesses to words other processes write through their own mappings
+template <typename T> static T _LoadAcquire(T* p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T> static void _StoreRelease(T* p, T value)
+{
+	__atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+#endif
+
+// A copy of pszPath with pszSuffix appended, or NULL if out of memory
+static GmaPathChar* _CopyPath(const GmaPathChar* pszPath, const char* pszSuffix)
+{
+	size_t cchPath = 0;
+	while (pszPath[cchPath] != 0)
+		cchPath++;
+	size_t cchSuffix = strlen(pszSuffix);
+
+	GmaPathChar* pszCopy = new (std::nothrow) GmaPathChar[cchPath + cchSuffix + 1];
+	if (pszCopy == NULL)
+		return NULL;
+	memcpy(pszCopy, pszPath, cchPath * sizeof(GmaPathChar));
+	for (size_t i = 0; i <= cchSuffix; i++)
+		pszCopy[cchPath + i] = (GmaPathChar)pszSuffix[i];
+	return pszCopy;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     File layout
+// ____________________________________________________________________________________________________
+//
+
+// Everything is stored in native byte order and naturally aligned, so it can be used in place. A file from a machine of the other endianness fails the magic check.
+// The file is a header, then a table of cBuckets record offsets, then records, each starting on an 8-byte boundary. Offset 0 marks an empty bucket or the end of a chain.
+
+const uint32_t c_ulCacheFileMagic = 0x43414D47ul; // "GMAC"
+const uint32_t c_ulCacheFileMagicSwapped = 0x474D4143ul; // As a machine of the other endianness writes it
+const uint32_t c_cCacheFileMinBuckets = 1024ul;
+const size_t c_cbCacheFileBytesPerBucket = 512; // About one typical record, so a full file averages a record per chain
+const size_t c_cbCacheFileGranularity = 65536;
+
+struct GmaCacheFileHeader
+{
+	uint32_t ulMagic;
+	uint32_t ulVersion;
+	uint32_t cBuckets; // power of two
+	uint32_t ulSuperseded; // Set once a compaction has renamed a newer file over this one
+	uint64_t cbFile;
+	uint64_t cbUsed; // End of the last record. Only the writer holding the lock reads or writes it.
+	uint64_t cRecords;
+	uint64_t aullReserved[3];
+};
+
+struct CGmaCacheFile::Mapping
+{
+	uint8_t* pb;
+	size_t cb;
+	bool bWritable;
+	Mapping* pOlder;
+};
+
+static uint32_t _CountBuckets(uint64_t cbFile)
+{
+	uint32_t cBuckets = c_cCacheFileMinBuckets;
+	while (cBuckets < cbFile / c_cbCacheFileBytesPerBucket)
+		cBuckets *= 2;
+	return cBuckets;
+}
+
+static uint64_t _FirstRecordOffset(uint32_t cBuckets)
+{
+	return sizeof(GmaCacheFileHeader) + (uint64_t)cBuckets * sizeof(uint64_t);
+}
+
+// The header of a mapping, or NULL if it isn't a cache file this version can read
+static GmaCacheFileHeader* _GetHeader(uint8_t* pb, size_t cb)
+{
+	if (pb == NULL || cb < sizeof(GmaCacheFileHeader))
+		return NULL;
+
+	GmaCacheFileHeader* pHeader = (GmaCacheFileHeader*)pb;
+	uint32_t cBuckets = pHeader->cBuckets;
+	if (pHeader->ulMagic != c_ulCacheFileMagic || pHeader->ulVersion != c_ulGmaCacheFileVersion || pHeader->cbFile != cb)
+		return NULL;
+	if (cBuckets == 0 || (cBuckets & (cBuckets - 1)) != 0 || _FirstRecordOffset(cBuckets) > cb)
+		return NULL;
+	return pHeader;
+}
+
+static uint64_t* _GetBuckets(GmaCacheFileHeader* pHeader)
+{
+	return (uint64_t*)(pHeader + 1);
+}
+
+// The record at ullOffset, or NULL if it doesn't lie within the mapping
+static GmaPackedRecord* _GetRecord(uint8_t* pb, size_t cb, const GmaCacheFileHeader* pHeader, uint64_t ullOffset)
+{
+	if (ullOffset < _FirstRecordOffset(pHeader->cBuckets) || (ullOffset & 7) != 0 || ullOffset > cb - sizeof(GmaPackedRecord))
+		return NULL;
+
+	GmaPackedRecord* pRecord = (GmaPackedRecord*)(pb + ullOffset);
+	uint32_t cbRecord = pRecord->cbRecord;
+	if (cbRecord < sizeof(GmaPackedRecord) || cbRecord > cb - ullOffset)
+		return NULL;
+	return pRecord;
+}
+
+// The newest record for key, or NULL. Chains run from newest to oldest, and must point strictly backwards, so the walk always ends.
+static GmaPackedRecord* _FindRecord(uint8_t* pb, size_t cb, const GmaCacheKey& key)
+{
+	GmaCacheFileHeader* pHeader = _GetHeader(pb, cb);
+	if (pHeader == NULL)
+		return NULL;
+
+	uint64_t* pullBucket = &_GetBuckets(pHeader)[GmaHashCacheKey(key) & (pHeader->cBuckets - 1)];
+	uint64_t ullOffset = _LoadAcquire(pullBucket);
+	while (ullOffset != 0)
+	{
+		GmaPackedRecord* pRecord = _GetRecord(pb, cb, pHeader, ullOffset);
+		if (pRecord == NULL)
+			return NULL;
+		if (GmaCacheKeysEqual(pRecord->key, key))
+			return (pRecord->ullChecksum == _ChecksumRecord(pRecord)) ? pRecord : NULL;
+
+		uint64_t ullNext = pRecord->ullNext;
+		if (ullNext >= ullOffset)
+			return NULL;
+		ullOffset = ullNext;
+	}
+	return NULL;
+}
+
+// Whether pRecord is the newest record for its key in the chain starting at ullHead
+static bool _IsNewest(uint8_t* pb, size_t cb, const GmaCacheFileHeader* pHeader, uint64_t ullHead, const GmaPackedRecord* pRecord)
+{
+	for (uint64_t ullOffset = ullHead; ullOffset != 0; )
+	{
+		GmaPackedRecord* pNewer = _GetRecord(pb, cb, pHeader, ullOffset);
+		if (pNewer == pRecord)
+			return true;
+		if (pNewer == NULL || GmaCacheKeysEqual(pNewer->key, pRecord->key))
+			return false;
+		ullOffset = (pNewer->ullNext < ullOffset) ? pNewer->ullNext : 0ull;
+	}
+	return false;
+}
+
+// Sizes the file to cbFile and writes an empty table into it. Only for files nothing has mapped yet.
+static bool _InitializeFile(GmaFileHandle hFile, uint64_t cbFile)
+{
+	if (!_SetFileSize(hFile, cbFile))
+		return false;
+
+	GmaCacheFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.ulMagic = c_ulCacheFileMagic;
+	header.ulVersion = c_ulGmaCacheFileVersion;
+	header.cBuckets = _CountBuckets(cbFile);
+	header.cbFile = cbFile;
+	header.cbUsed = _FirstRecordOffset(header.cBuckets);
+	return _WriteAt(hFile, 0ull, &header, sizeof(header));
+}
+
+// Whether the file starts with the cache file magic, of any version and either byte order. Only those are ever replaced, so a mistyped path can't destroy someone's file.
+static bool _HasCacheFileMagic(GmaFileHandle hFile)
+{
+	uint32_t ulMagic;
+	if (!_ReadAt(hFile, 0ull, &ulMagic, sizeof(ulMagic)))
+		return false;
+	return ulMagic == c_ulCacheFileMagic || ulMagic == c_ulCacheFileMagicSwapped;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Persistent metadata cache file
+// ____________________________________________________________________________________________________
+//
+
+CGmaCacheFile::CGmaCacheFile() : _pszPath(NULL), _hFile(c_hNoFile), _bWritable(false), _pMapping(NULL), _iLastErrno(0)
+{
+#ifdef _WIN32
+	InitializeCriticalSection(&_csWriter);
+#else
+	pthread_mutex_init(&_mutexWriter, NULL);
+#endif
+}
+
+CGmaCacheFile::~CGmaCacheFile()
+{
+	Close();
+#ifdef _WIN32
+	DeleteCriticalSection(&_csWriter);
+#else
+	pthread_mutex_destroy(&_mutexWriter);
+#endif
+}
+
+void CGmaCacheFile::_LockWriter()
+{
+#ifdef _WIN32
+	EnterCriticalSection(&_csWriter);
+#else
+	pthread_mutex_lock(&_mutexWriter);
+#endif
+}
+
+void CGmaCacheFile::_UnlockWriter()
+{
+#ifdef _WIN32
+	LeaveCriticalSection(&_csWriter);
+#else
+	pthread_mutex_unlock(&_mutexWriter);
+#endif
+}
+
+GmaStatus CGmaCacheFile::Open(const GmaPathChar* pszPath)
+{
+	Close();
+
+	_pszPath = _CopyPath(pszPath, "");
+	if (_pszPath == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	_LockWriter();
+	GmaStatus status = _OpenCurrent();
+	_UnlockWriter();
+	if (GMA_FAILED(status))
+		Close();
+	return status;
+}
+
+void CGmaCacheFile::Close()
+{
+	Mapping* pMapping = _pMapping;
+	while (pMapping != NULL)
+	{
+		Mapping* pOlder = pMapping->pOlder;
+		if (pMapping->pb != NULL)
+			_UnmapView(pMapping->pb, pMapping->cb);
+		delete pMapping;
+		pMapping = pOlder;
+	}
+	_pMapping = NULL;
+
+	if (_hFile != c_hNoFile)
+		_CloseFile(_hFile);
+	_hFile = c_hNoFile;
+	_bWritable = false;
+
+	delete[] _pszPath;
+	_pszPath = NULL;
+}
+
+GmaStatus CGmaCacheFile::_Fail(int iErrno)
+{
+	_iLastErrno = iErrno;
+	return GMA_E_IO;
+}
+
+// Opens whatever file is at the path now, giving it an empty table if it was just created, and switches to it
+GmaStatus CGmaCacheFile::_OpenCurrent()
+{
+	bool bWritable = true;
+	GmaFileHandle hFile = _OpenFile(_pszPath, true, false);
+	if (hFile == c_hNoFile)
+	{
+		bWritable = false;
+		hFile = _OpenFile(_pszPath, false, false);
+		if (hFile == c_hNoFile)
+			return _Fail(_LastError());
+	}
+
+	// Whoever gets the lock first on a new file sets it up. Existing cache files, even ones we can't read, are left to compaction, which replaces rather than rewrites them. Anything else is refused.
+	// Readers lock too, so they don't mistake a file another process is still setting up for someone else's.
+	if (!_LockFile(hFile, bWritable))
+	{
+		int iError = _LastError();
+		_CloseFile(hFile);
+		return _Fail(iError);
+	}
+
+	uint64_t cbFile = 0;
+	bool bOk = _GetFileSize(hFile, &cbFile) && (cbFile != 0 || !bWritable || _InitializeFile(hFile, c_cbGmaCacheFileInitial));
+	int iError = _LastError();
+	bool bForeign = bOk && cbFile != 0 && !_HasCacheFileMagic(hFile);
+	_UnlockFile(hFile);
+	if (!bOk || bForeign)
+	{
+		_CloseFile(hFile);
+		return bForeign ? GMA_E_ABORT : _Fail(iError);
+	}
+
+	Mapping* pMapping;
+	GmaStatus status = _MapFile(hFile, bWritable, &pMapping);
+	if (GMA_FAILED(status))
+	{
+		_CloseFile(hFile);
+		return status;
+	}
+
+	_Publish(hFile, pMapping);
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaCacheFile::_MapFile(GmaFileHandle hFile, bool bWritable, Mapping** ppMapping)
+{
+	*ppMapping = NULL;
+
+	uint64_t cbFile;
+	if (!_GetFileSize(hFile, &cbFile))
+		return _Fail(_LastError());
+	if (cbFile > (size_t)-1)
+		return GMA_E_ARITHMETIC;
+
+	Mapping* pMapping = new (std::nothrow) Mapping;
+	if (pMapping == NULL)
+		return GMA_E_OUTOFMEMORY;
+	pMapping->pb = NULL;
+	pMapping->cb = 0;
+	pMapping->bWritable = bWritable;
+	pMapping->pOlder = NULL;
+
+	// An empty file maps to nothing, and every lookup misses until Refresh() maps it again
+	if (cbFile > 0)
+	{
+		void* pv = _MapView(hFile, (size_t)cbFile, bWritable);
+		if (pv == NULL)
+		{
+			int iError = _LastError();
+			delete pMapping;
+			return _Fail(iError);
+		}
+		pMapping->pb = (uint8_t*)pv;
+		pMapping->cb = (size_t)cbFile;
+	}
+
+	*ppMapping = pMapping;
+	return GMA_S_OK;
+}
+
+// Makes pMapping, of the file open on hFile, the one lookups use. The old mapping stays valid for lookups still reading it; the old handle is closed, which drops its lock.
+void CGmaCacheFile::_Publish(GmaFileHandle hFile, Mapping* pMapping)
+{
+	pMapping->pOlder = _pMapping;
+	GmaFileHandle hOld = _hFile;
+	_hFile = hFile;
+	_bWritable = pMapping->bWritable;
+	_StoreRelease(&_pMapping, pMapping);
+	if (hOld != c_hNoFile)
+		_CloseFile(hOld);
+}
+
+// Whether the path now names a different file than the one mapped, or the mapped one has grown since it was mapped empty
+bool CGmaCacheFile::_IsStale()
+{
+	GmaCacheFileHeader* pHeader = _GetHeader(_pMapping->pb, _pMapping->cb);
+	if (pHeader != NULL && _LoadAcquire(&pHeader->ulSuperseded) != 0)
+		return true;
+
+	uint64_t cbFile;
+	if (!_GetFileSize(_hFile, &cbFile) || !_IsSameFile(_hFile, _pszPath))
+		return true;
+	return cbFile != _pMapping->cb;
+}
+
+// Takes the writers' lock on the current file, switching to it first if needed
+GmaStatus CGmaCacheFile::_LockCurrent()
+{
+	// Each retry means another process compacted in between, so a few are plenty
+	for (int iAttempt = 0; iAttempt < 4; iAttempt++)
+	{
+		if (!_bWritable)
+			return _Fail(c_iErrorReadOnly);
+		if (!_LockFile(_hFile, true))
+			return _Fail(_LastError());
+		if (!_IsStale())
+			return GMA_S_OK;
+
+		_UnlockFile(_hFile);
+		GmaStatus status = _OpenCurrent();
+		if (GMA_FAILED(status))
+			return status;
+	}
+	return _Fail(c_iErrorBusy);
+}
+
+void CGmaCacheFile::_UnlockCurrent()
+{
+	_UnlockFile(_hFile);
+}
+
+// Appends a record to the current file, whose lock must be held. Sets *pbFull instead if it doesn't fit, or if the file is unusable and needs replacing.
+GmaStatus CGmaCacheFile::_Append(const GmaCacheKey& key, uint64_t ullFingerprint, const GmaCachedMetadata& meta, uint32_t cbRecord, bool* pbFull)
+{
+	*pbFull = true;
+
+	Mapping* pMapping = _pMapping;
+	GmaCacheFileHeader* pHeader = _GetHeader(pMapping->pb, pMapping->cb);
+	if (pHeader == NULL)
+		return GMA_S_OK;
+
+	uint64_t ibRecord = pHeader->cbUsed;
+	if (ibRecord < _FirstRecordOffset(pHeader->cBuckets) || (ibRecord & 7) != 0 || ibRecord > pMapping->cb || cbRecord > pMapping->cb - ibRecord)
+		return GMA_S_OK;
+	*pbFull = false;
+
+	// Claim the space before filling it, so a writer that dies halfway leaves a hole rather than a published record for the next one to overwrite
+	pHeader->cbUsed = ibRecord + cbRecord;
+
+	GmaPackedRecord* pRecord = (GmaPackedRecord*)(pMapping->pb + ibRecord);
+	_WriteRecord(pRecord, cbRecord, key, ullFingerprint, meta);
+
+	uint64_t* pullBucket = &_GetBuckets(pHeader)[GmaHashCacheKey(key) & (pHeader->cBuckets - 1)];
+	pRecord->ullNext = *pullBucket;
+	_StoreRelease(pullBucket, ibRecord);
+	pHeader->cRecords++;
+	return GMA_S_OK;
+}
+
+// Writes the newest record for each key into a new file with room to spare, renames it over the current one, and switches to it. The current file's lock must be held.
+GmaStatus CGmaCacheFile::_CompactLocked(uint64_t cbReserve)
+{
+	Mapping* pOld = _pMapping;
+	GmaCacheFileHeader* pHeaderOld = _GetHeader(pOld->pb, pOld->cb);
+
+	uint64_t cbLive = 0;
+	if (pHeaderOld != NULL)
+	{
+		uint64_t* aullBuckets = _GetBuckets(pHeaderOld);
+		for (uint32_t iBucket = 0; iBucket < pHeaderOld->cBuckets; iBucket++)
+		{
+			uint64_t ullHead = aullBuckets[iBucket];
+			for (uint64_t ullOffset = ullHead; ullOffset != 0; )
+			{
+				GmaPackedRecord* pRecord = _GetRecord(pOld->pb, pOld->cb, pHeaderOld, ullOffset);
+				if (pRecord == NULL)
+					break;
+				if (_IsNewest(pOld->pb, pOld->cb, pHeaderOld, ullHead, pRecord))
+					cbLive += pRecord->cbRecord;
+				ullOffset = (pRecord->ullNext < ullOffset) ? pRecord->ullNext : 0ull;
+			}
+		}
+	}
+
+	// Leave as much room again as the live records take. If that's too big, start over with just the reserve.
+	bool bKeepRecords = true;
+	uint64_t cbFile = 0;
+	for (;;)
+	{
+		uint64_t cbRecords = 2 * ((bKeepRecords ? cbLive : 0ull) + cbReserve);
+		cbFile = (cbRecords > c_cbGmaCacheFileInitial) ? cbRecords : (uint64_t)c_cbGmaCacheFileInitial;
+		cbFile = _AlignUp(cbFile + _FirstRecordOffset(_CountBuckets(cbFile)), c_cbCacheFileGranularity);
+		if (cbFile <= c_cbGmaCacheFileMax)
+			break;
+		if (!bKeepRecords)
+			return GMA_E_ABORT;
+		bKeepRecords = false;
+	}
+
+	GmaPathChar* pszTemp = _CopyPath(_pszPath, ".tmp");
+	if (pszTemp == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	// Only the holder of the current file's lock gets this far, so the temporary name is ours. Lock the new file too, since other processes can open it as soon as it's renamed.
+	GmaStatus status = GMA_S_OK;
+	Mapping* pNew = NULL;
+	GmaFileHandle hNew = _OpenFile(pszTemp, true, true);
+	if (hNew == c_hNoFile)
+		status = _Fail(_LastError());
+	else if (!_LockFile(hNew, true) || !_InitializeFile(hNew, cbFile))
+		status = _Fail(_LastError());
+	else
+		status = _MapFile(hNew, true, &pNew);
+
+	GmaCacheFileHeader* pHeaderNew = NULL;
+	if (GMA_SUCCEEDED(status))
+	{
+		pHeaderNew = _GetHeader(pNew->pb, pNew->cb);
+		if (pHeaderNew == NULL)
+			status = GMA_E_UNEXPECTED;
+	}
+
+	if (GMA_SUCCEEDED(status) && bKeepRecords && pHeaderOld != NULL)
+	{
+		uint64_t* aullBucketsOld = _GetBuckets(pHeaderOld);
+		uint64_t* aullBucketsNew = _GetBuckets(pHeaderNew);
+		uint64_t ibNext = pHeaderNew->cbUsed;
+		for (uint32_t iBucket = 0; iBucket < pHeaderOld->cBuckets; iBucket++)
+		{
+			uint64_t ullHead = aullBucketsOld[iBucket];
+			for (uint64_t ullOffset = ullHead; ullOffset != 0; )
+			{
+				GmaPackedRecord* pRecord = _GetRecord(pOld->pb, pOld->cb, pHeaderOld, ullOffset);
+				if (pRecord == NULL)
+					break;
+				if (_IsNewest(pOld->pb, pOld->cb, pHeaderOld, ullHead, pRecord) && pRecord->cbRecord <= pNew->cb - ibNext)
+				{
+					GmaPackedRecord* pCopy = (GmaPackedRecord*)(pNew->pb + ibNext);
+					memcpy(pCopy, pRecord, pRecord->cbRecord);
+					uint64_t* pullBucket = &aullBucketsNew[GmaHashCacheKey(pCopy->key) & (pHeaderNew->cBuckets - 1)];
+					pCopy->ullNext = *pullBucket;
+					*pullBucket = ibNext;
+					ibNext += pCopy->cbRecord;
+					pHeaderNew->cRecords++;
+				}
+				ullOffset = (pRecord->ullNext < ullOffset) ? pRecord->ullNext : 0ull;
+			}
+		}
+		pHeaderNew->cbUsed = ibNext;
+	}
+
+	if (GMA_SUCCEEDED(status) && !_ReplaceFile(hNew, pszTemp, _pszPath))
+		status = _Fail(_LastError());
+
+	if (GMA_FAILED(status))
+	{
+		if (pNew != NULL)
+		{
+			_UnmapView(pNew->pb, pNew->cb);
+			delete pNew;
+		}
+		if (hNew != c_hNoFile)
+		{
+			_DeleteFile(pszTemp);
+			_CloseFile(hNew);
+		}
+		delete[] pszTemp;
+		return status;
+	}
+	delete[] pszTemp;
+
+	// Tell other processes mapping the old file to move on. It stays valid for them until they do.
+	if (pHeaderOld != NULL && pOld->bWritable)
+		_StoreRelease(&pHeaderOld->ulSuperseded, (uint32_t)1ul);
+	_Publish(hNew, pNew);
+	return GMA_S_OK;
+}
+
+bool CGmaCacheFile::Lookup(const GmaCacheKey& key, IGmaByteSource* pSource, GmaCachedMetadata* pMeta, CGmaArena* pArena)
+{
+	memset(pMeta, 0, sizeof(*pMeta));
+
+	Mapping* pMapping = _LoadAcquire(&_pMapping);
+	if (pMapping == NULL)
+		return false;
+
+	const GmaPackedRecord* pRecord = _FindRecord(pMapping->pb, pMapping->cb, key);
+	if (pRecord == NULL)
+		return false;
+
+	if (pSource != NULL)
+	{
+		uint64_t ullFingerprint;
+		if (GMA_FAILED(GmaComputeFingerprint(pSource, pRecord->ullDataStart, &ullFingerprint)) || ullFingerprint != pRecord->ullFingerprint)
+			return false;
+	}
+
+	if (!_ReadRecord(pRecord, pMeta, pArena))
+	{
+		memset(pMeta, 0, sizeof(*pMeta));
+		return false;
+	}
+	return true;
+}
+
+GmaStatus CGmaCacheFile::Insert(const GmaCacheKey& key, IGmaByteSource* pSource, const GmaCachedMetadata& meta)
+{
+	if (_pszPath == NULL)
+		return GMA_E_UNEXPECTED;
+
+	uint32_t cbRecord;
+	GmaStatus status = _MeasureRecord(meta, &cbRecord);
+	if (GMA_FAILED(status))
+		return status;
+
+	// Compaction sizes a file at twice the records it has to hold
+	if (cbRecord > (c_cbGmaCacheFileMax - _FirstRecordOffset(_CountBuckets(c_cbGmaCacheFileMax))) / 2)
+		return GMA_E_ABORT;
+
+	// Read the file before taking the lock, so other writers never wait on our I/O
+	uint64_t ullFingerprint;
+	status = GmaComputeFingerprint(pSource, (meta.stage >= GMA_STAGE_TOC) ? meta.tocSummary.ullDataStart : 0ull, &ullFingerprint);
+	if (GMA_FAILED(status))
+		return status;
+
+	_LockWriter();
+	status = _LockCurrent();
+	if (GMA_SUCCEEDED(status))
+	{
+		bool bFull;
+		status = _Append(key, ullFingerprint, meta, cbRecord, &bFull);
+		if (GMA_SUCCEEDED(status) && bFull)
+		{
+			status = _CompactLocked(cbRecord);
+			if (GMA_SUCCEEDED(status))
+				status = _Append(key, ullFingerprint, meta, cbRecord, &bFull);
+			if (GMA_SUCCEEDED(status) && bFull)
+				status = GMA_E_ABORT;
+		}
+		_UnlockCurrent();
+	}
+	_UnlockWriter();
+	return status;
+}
+
+GmaStatus CGmaCacheFile::Compact(size_t cbReserve)
+{
+	if (_pszPath == NULL)
+		return GMA_E_UNEXPECTED;
+
+	_LockWriter();
+	GmaStatus status = _LockCurrent();
+	if (GMA_SUCCEEDED(status))
+	{
+		status = _CompactLocked(cbReserve);
+		_UnlockCurrent();
+	}
+	_UnlockWriter();
+	return status;
+}
+
+GmaStatus CGmaCacheFile::Refresh()
+{
+	if (_pszPath == NULL)
+		return GMA_E_UNEXPECTED;
+
+	_LockWriter();
+	GmaStatus status = _IsStale() ? _OpenCurrent() : GMA_S_OK;
+	_UnlockWriter();
+	return status;
+}
+
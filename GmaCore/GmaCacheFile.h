@@ -0,0 +1,111 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaByteSource.h"
+#include "GmaCache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE GmaFileHandle;
+typedef WCHAR GmaPathChar; // Paths are UTF-16 on Windows, for the wide file APIs
+#else
+#include <pthread.h>
+typedef int GmaFileHandle;
+typedef char GmaPathChar;
+#endif
+
+const uint32_t c_cbGmaFingerprintWindow = 4096ul; // Bytes hashed at each end of the header and file table by GmaComputeFingerprint()
+
+// Fingerprints the parts of a GMA that metadata comes from: the first c_cbGmaFingerprintWindow bytes (magic and header) and the last c_cbGmaFingerprintWindow bytes of the file table, which ends at ullDataStart
+// Pass 0 for ullDataStart if the file table hasn't been parsed; only the start of the file is hashed then. Costs at most two small reads (and moves pSource's position), so a cached entry can be checked against the file far more cheaply than reparsing it.
+// Catches a file rewritten in place with the same size and modification time, which its GmaCacheKey can't tell apart.
+GmaStatus GmaComputeFingerprint(IGmaByteSource* pSource, uint64_t ullDataStart, uint64_t* pullFingerprint);
+
+// Packed metadata is the self-contained form of a cache entry that CGmaCacheFile stores and GmaXattr.h stamps on files: the fixed fields, then the strings, under a checksum
+// It's in native byte order with natural alignment, and is read in place rather than deserialized. Its fingerprint covers meta's tocSummary.ullDataStart from GMA_STAGE_TOC, and 0 before.
+
+// Bytes needed to pack meta. Fails with GMA_E_ARITHMETIC past 4 GB.
+GmaStatus GmaGetPackedMetadataSize(const GmaCachedMetadata& meta, uint32_t* pcb);
+
+// Packs meta into the cb bytes at pv, which must be 8-byte aligned, with cb from GmaGetPackedMetadataSize()
+void GmaPackMetadata(const GmaCacheKey& key, uint64_t ullFingerprint, const GmaCachedMetadata& meta, void* pv, uint32_t cb);
+
+// Validates and unpacks the packed metadata at the start of pv[0..cb), which must be 8-byte aligned
+// *pMeta's strings point into pv; only the tag array is allocated from pArena. Returns false if the bytes are truncated or corrupt.
+bool GmaUnpackMetadata(const void* pv, size_t cb, GmaCacheKey* pKey, uint64_t* pullFingerprint, GmaCachedMetadata* pMeta, CGmaArena* pArena);
+
+
+// ____________________________________________________________________________________________________
+//
+//     Persistent metadata cache file
+// ____________________________________________________________________________________________________
+//
+
+const uint32_t c_ulGmaCacheFileVersion = 3ul; // Cache files written by any other version are ignored, and replaced by the next writer
+const size_t c_cbGmaCacheFileInitial = 1024 * 1024; // Size a new cache file is created with
+const size_t c_cbGmaCacheFileMax = 64 * 1024 * 1024; // Compaction starts over with an empty file rather than grow past this
+
+// Metadata cache shared between processes through a memory-mapped file
+// The file is a fixed-size hash table of record offsets followed by append-only records, laid out so lookups read the metadata straight out of the mapping: finding an entry is a hash, an atomic load and a short chain walk, with no locks, no system calls and nothing to deserialize.
+// Writers take an exclusive lock on the file (flock(), or LockFileEx() on Windows), append a record into preallocated space, and only then publish it by storing its offset into its bucket, so readers in any process see either the old chain or the complete new record. When the space runs out, the writer compacts the live records into a new file and renames it over the old one, then marks the old one superseded; processes still mapping it keep reading it safely until they Refresh().
+// Nothing in the file is trusted: every offset and length is bounds-checked against the mapping, chains must point strictly backwards, and each record carries a checksum, so a corrupt file only causes misses.
+// Lookup() is safe to call from any number of threads at once, including during Insert(), Compact() and Refresh(), which serialize among themselves. Mappings replaced by those are kept until Close(), so everything Lookup() returned stays valid until then.
+class CGmaCacheFile
+{
+public:
+	CGmaCacheFile();
+	~CGmaCacheFile();
+
+	// Opens the cache file at pszPath, creating it if needed
+	// If it can't be written, it's opened read-only and Insert() and Compact() fail with GMA_E_IO. If it doesn't exist and can't be created, fails with GMA_E_IO.
+	// Fails with GMA_E_ABORT if pszPath is a non-empty file that isn't a cache file. A cache file of another version, or a corrupt one, is replaced by the next writer instead.
+	GmaStatus Open(const GmaPathChar* pszPath);
+	void Close();
+
+	// Looks up key, and returns false on a miss
+	// On a hit, *pMeta's strings point straight into the mapping, and only the tag array is allocated from pArena. If pSource is not NULL, the entry only counts as a hit if the file's fingerprint still matches the one it was inserted with.
+	bool Lookup(const GmaCacheKey& key, IGmaByteSource* pSource, GmaCachedMetadata* pMeta, CGmaArena* pArena);
+
+	// Appends an entry for key, which then shadows any older one. pSource is the file meta was parsed from, and is only used to fingerprint it (before the file is locked).
+	// Compacts the file first if the entry doesn't fit. Fails with GMA_E_ABORT if the entry wouldn't fit in a file of c_cbGmaCacheFileMax bytes.
+	GmaStatus Insert(const GmaCacheKey& key, IGmaByteSource* pSource, const GmaCachedMetadata& meta);
+
+	// Rewrites the file with only the newest entry for each key, leaving room for at least cbReserve more bytes of entries
+	GmaStatus Compact(size_t cbReserve = 0);
+
+	// Switches to the current file if another process has compacted it since it was mapped, so this process sees the entries written since
+	GmaStatus Refresh();
+
+	bool IsWritable() const { return _bWritable; }
+	int GetLastErrno() const { return _iLastErrno; } // errno of the last call that returned GMA_E_IO. GetLastError() on Windows.
+
+private:
+	struct Mapping;
+
+	GmaPathChar* _pszPath;
+	GmaFileHandle _hFile; // Of the file _pMapping maps. Also what writers lock.
+	bool _bWritable;
+	Mapping* _pMapping; // Current mapping, read by Lookup() without locks. Older ones hang off it until Close().
+#ifdef _WIN32
+	CRITICAL_SECTION _csWriter; // Serializes everything but Lookup() within this process. The file lock does the same between processes.
+#else
+	pthread_mutex_t _mutexWriter; // Serializes everything but Lookup() within this process. The file lock does the same between processes.
+#endif
+	int _iLastErrno;
+
+	void _LockWriter();
+	void _UnlockWriter();
+	GmaStatus _OpenCurrent();
+	GmaStatus _MapFile(GmaFileHandle hFile, bool bWritable, Mapping** ppMapping);
+	void _Publish(GmaFileHandle hFile, Mapping* pMapping);
+	bool _IsStale();
+	GmaStatus _LockCurrent();
+	void _UnlockCurrent();
+	GmaStatus _Append(const GmaCacheKey& key, uint64_t ullFingerprint, const GmaCachedMetadata& meta, uint32_t cbRecord, bool* pbFull);
+	GmaStatus _CompactLocked(uint64_t cbReserve);
+	GmaStatus _Fail(int iErrno);
+
+	CGmaCacheFile(const CGmaCacheFile&);
+	CGmaCacheFile& operator=(const CGmaCacheFile&);
+};
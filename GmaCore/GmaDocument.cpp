@@ -0,0 +1,137 @@
+#include "GmaDocument.h"
+#include "GmaPushParser.h"
+#include <new>  // std::nothrow
+
+// Parses the source again from the start with a push parser, for a header that outgrew the reader's window
+// Feeds the source's view in place when it has one, and otherwise reads it a chunk at a time into memory from the document's arena.
+struct CGmaDocument::PushFallback : public IGmaPushParserSink
+{
+	GmaHeaderInfo* pHeader;
+	GmaTocSummary* pTocSummary;
+	CGmaPushParser parser;
+
+	const uint8_t* pbView;
+	uint64_t cbView;
+	uint64_t ullViewPos;
+	uint8_t* pbChunk; // Read() buffer for sources without a view
+
+	PushFallback(GmaHeaderInfo* pHeaderOut, GmaTocSummary* pTocSummaryOut, CGmaArena* pArena, CGmaArena* pScratchArena) : pHeader(pHeaderOut), pTocSummary(pTocSummaryOut), parser(this, pArena, c_cbGmaPushParserDefaultMemoryLimit, pScratchArena), pbView(NULL), cbView(0ull), ullViewPos(0ull), pbChunk(NULL) {}
+
+	GmaStatus OnHeader(const GmaHeaderInfo& info) { *pHeader = info; return GMA_S_OK; }
+	GmaStatus OnTocEntry(const GmaTocEntry&) { return GMA_S_OK; }
+	GmaStatus OnTocEnd(const GmaTocSummary& summary) { *pTocSummary = summary; return GMA_S_OK; }
+};
+
+CGmaDocument::~CGmaDocument()
+{
+	delete _pPush;
+}
+
+GmaStatus CGmaDocument::Open()
+{
+	return EnsureStage(GMA_STAGE_MAGIC);
+}
+
+GmaStatus CGmaDocument::EnsureStage(GmaParseStage stage)
+{
+	while (_stage < stage)
+	{
+		// Don't retry a stage that already failed. The source position is unknown by now, and the answer won't change anyway.
+		if (_bFailed)
+			return _statusFailed;
+
+		GmaStatus status = GMA_S_OK;
+		switch (_stage)
+		{
+		case GMA_STAGE_NONE:
+			status = _reader.ReadMagic(_pArena);
+			break;
+
+		case GMA_STAGE_MAGIC:
+			status = _reader.ReadHeader(&_header, _pArena);
+			if (status == GMA_E_TOOLARGE)
+				status = _PushParse(GMA_STAGE_HEADER);
+			break;
+
+		case GMA_STAGE_HEADER:
+			// A damaged table (e.g. a truncated download) doesn't invalidate the header, so it's recorded rather than failing the stage
+			_statusToc = (_pPush != NULL) ? _PushParse(GMA_STAGE_TOC) : _reader.ReadToc(NULL, &_tocSummary);
+			if (GMA_FAILED(_statusToc))
+				memset(&_tocSummary, 0, sizeof(_tocSummary));
+			break;
+
+		default:
+			status = GMA_E_UNEXPECTED;
+			break;
+		}
+
+		if (GMA_FAILED(status))
+		{
+			_bFailed = true;
+			_statusFailed = status;
+			return status;
+		}
+
+		_stage = (GmaParseStage)(_stage + 1);
+	}
+
+	return GMA_S_OK;
+}
+
+// Feeds the push parser until it has reached stage (GMA_STAGE_HEADER or GMA_STAGE_TOC), starting it on the first call
+// Fails with GMA_E_TOOLARGE, as the reader did, if the source can't be read again from the start.
+GmaStatus CGmaDocument::_PushParse(GmaParseStage stage)
+{
+	if (_pPush == NULL)
+	{
+		const uint8_t* pbView;
+		uint64_t cbView;
+		bool bView = GMA_SUCCEEDED(_pSource->GetView(&pbView, &cbView));
+		if (!bView && GMA_FAILED(_pSource->Seek(0ll, GMA_SEEK_SET, NULL)))
+			return GMA_E_TOOLARGE; // e.g. a pipe, whose start is gone
+
+		_pPush = new (std::nothrow) PushFallback(&_header, &_tocSummary, _pArena, _pScratchArena);
+		if (_pPush == NULL)
+			return GMA_E_OUTOFMEMORY;
+		if (bView)
+		{
+			_pPush->pbView = pbView;
+			_pPush->cbView = cbView;
+		}
+		else
+		{
+			_pPush->pbChunk = (uint8_t*)_pArena->Alloc(c_cbGmaTocReadChunk, 1);
+			if (_pPush->pbChunk == NULL)
+				return GMA_E_OUTOFMEMORY;
+		}
+	}
+
+	CGmaPushParser* pParser = &_pPush->parser;
+	GmaStatus status = pParser->Feed(NULL, 0); // Returns the earlier failure, if the last call ended on one
+	while (GMA_SUCCEEDED(status) && !((stage == GMA_STAGE_HEADER) ? pParser->IsHeaderDone() : pParser->IsDone()))
+	{
+		const uint8_t* pb = _pPush->pbChunk;
+		uint32_t cb = 0;
+		if (_pPush->pbChunk == NULL)
+		{
+			// Fed in chunks too, so asking for the header doesn't also parse the whole file table
+			uint64_t cbRest = _pPush->cbView - _pPush->ullViewPos;
+			pb = _pPush->pbView + _pPush->ullViewPos;
+			cb = (cbRest < c_cbGmaTocReadChunk) ? (uint32_t)cbRest : c_cbGmaTocReadChunk;
+			_pPush->ullViewPos += cb;
+		}
+		else
+		{
+			status = _pSource->Read(_pPush->pbChunk, c_cbGmaTocReadChunk, &cb);
+			if (GMA_FAILED(status))
+				break;
+		}
+
+		status = (cb == 0) ? pParser->Finish() : pParser->Feed(pb, cb);
+	}
+
+	// The chunk that completes the header can run on into a bad file table. That's for the next stage to report.
+	if (stage == GMA_STAGE_HEADER && pParser->IsHeaderDone())
+		return GMA_S_OK;
+	return status;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaByteSource.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+#include "GmaParseContext.h"
+#include <string.h>
+
+// How far a CGmaDocument has parsed its source. Each stage includes the ones before it.
+enum GmaParseStage
+{
+	GMA_STAGE_NONE = 0,
+	GMA_STAGE_MAGIC = 1, // The source starts with the GMA magic. Costs a single block read.
+	GMA_STAGE_HEADER = 2, // GetHeader() is valid
+	GMA_STAGE_TOC = 3, // The file table has been walked. GetTocStatus() and GetTocSummary() are valid.
+};
+
+// A GMA that is parsed only as far as its consumer asks
+// Open() just checks the magic. Later stages are parsed the first time EnsureStage() asks for them and never again, so a consumer that only wants the name never reads the file table.
+// Not thread-safe.
+class CGmaDocument
+{
+public:
+	explicit CGmaDocument(IGmaByteSource* pSource) : _pSource(pSource), _pArena(&_arena), _pScratchArena(NULL), _reader(pSource), _pPush(NULL), _stage(GMA_STAGE_NONE), _statusFailed(GMA_S_OK), _bFailed(false), _statusToc(GMA_E_UNEXPECTED)
+	{
+		memset(&_header, 0, sizeof(_header));
+		memset(&_tocSummary, 0, sizeof(_tocSummary));
+	}
+
+	// Parses with pContext's memory instead of its own, for batch callers. The header strings then live in pContext until it's reset, not until the document goes.
+	CGmaDocument(IGmaByteSource* pSource, CGmaParseContext* pContext) : _pSource(pSource), _pArena(pContext->GetArena()), _pScratchArena(pContext->GetScratchArena()), _reader(pSource, pContext->GetTocBuffer(), pContext->GetScratchArena()), _pPush(NULL), _stage(GMA_STAGE_NONE), _statusFailed(GMA_S_OK), _bFailed(false), _statusToc(GMA_E_UNEXPECTED)
+	{
+		memset(&_header, 0, sizeof(_header));
+		memset(&_tocSummary, 0, sizeof(_tocSummary));
+	}
+
+	~CGmaDocument();
+
+	// Checks that the source is a GMA. Fails with GMA_E_ABORT if it isn't.
+	GmaStatus Open();
+
+	// Parses up to and including stage, if that hasn't happened yet
+	// A header too large for CGmaReader's window is parsed again with CGmaPushParser, which only fails with GMA_E_TOOLARGE past its own, much larger, memory limit.
+	// A failure at the header stage is returned every time it's asked for again, without reparsing. A damaged file table doesn't fail GMA_STAGE_TOC, since the header is still good; see GetTocStatus().
+	GmaStatus EnsureStage(GmaParseStage stage);
+
+	GmaParseStage GetStage() const { return _stage; }
+
+	// Why parsing can't go past GetStage(), or GMA_S_OK if nothing has failed
+	GmaStatus GetFailureStatus() const { return _bFailed ? _statusFailed : GMA_S_OK; }
+
+	const GmaHeaderInfo& GetHeader() const { return _header; }
+
+	// Whether the file table could be read. GetTocSummary() is zeroed if not.
+	GmaStatus GetTocStatus() const { return _statusToc; }
+	const GmaTocSummary& GetTocSummary() const { return _tocSummary; }
+
+private:
+	struct PushFallback;
+
+	IGmaByteSource* _pSource;
+	CGmaArena _arena; // Backs the reader's window and the header strings, unless a parse context does. Declared before _reader so it outlives it.
+	CGmaArena* _pArena; // _arena or the context's
+	CGmaArena* _pScratchArena; // The context's, or NULL
+	CGmaReader _reader;
+	PushFallback* _pPush; // Takes over from _reader once a header turns out too large for it. NULL until then.
+
+	GmaParseStage _stage;
+	GmaStatus _statusFailed; // Why the next stage after _stage can't be reached. Only meaningful while _bFailed is set.
+	bool _bFailed;
+
+	GmaHeaderInfo _header;
+	GmaStatus _statusToc;
+	GmaTocSummary _tocSummary;
+
+	GmaStatus _PushParse(GmaParseStage stage);
+
+	CGmaDocument(const CGmaDocument&);
+	CGmaDocument& operator=(const CGmaDocument&);
+};
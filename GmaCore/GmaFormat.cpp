@@ -0,0 +1,344 @@
+#include "GmaFormat.h"
+#include "cJSON.h"
+#include "GmaJson.h"
+#include "GmaScan.h"
+#include <string.h>
+
+
+// ____________________________________________________________________________________________________
+//
+//     Helpers
+// ____________________________________________________________________________________________________
+//
+
+static bool _IsAsciiSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Empties a string without writing to it, by pointing it at its own terminator
+static void _TruncateString(GmaString* pstr)
+{
+	pstr->psz += pstr->cch;
+	pstr->cch = 0ul;
+}
+
+// Copies a string value out of the json chunk into the arena
+// cJSON unescapes values into its own buffers, which are freed along with the parsed tree, so unlike plain fields these can't be views into the header bytes
+static GmaStatus _CopyJsonString(CGmaArena* pArena, const char* pszValue, GmaString* pstrOutField)
+{
+	size_t cch = strlen(pszValue);
+	const char* pszCopy = pArena->DuplicateString(pszValue, cch);
+	if (pszCopy == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	pstrOutField->psz = pszCopy;
+	pstrOutField->cch = (uint32_t)cch;
+	return GMA_S_OK;
+}
+
+// Extracts description, type and tags from the json chunk with the streaming extractor
+// pInfo is only touched on success
+static GmaStatus _ParseDescriptionJson(const char* pszJson, uint32_t cchJson, CGmaArena* pArena, GmaHeaderInfo* pInfo)
+{
+	GmaJsonKey aKeys[3];
+	memset(aKeys, 0, sizeof(aKeys));
+	aKeys[0].pszName = "description";
+	aKeys[1].pszName = "type";
+	aKeys[2].pszName = "tags";
+	aKeys[2].bStringArray = true;
+
+	GmaStatus status = GmaJsonExtractKeys(pszJson, cchJson, aKeys, 3, pArena);
+	if (GMA_FAILED(status))
+		return status;
+
+	pInfo->strDescription = aKeys[0].str;
+	pInfo->strType = aKeys[1].str;
+	pInfo->astrTags = aKeys[2].astr;
+	pInfo->cTags = aKeys[2].cStrings;
+	return GMA_S_OK;
+}
+
+// cJSON allocator that carves the whole tree out of a CGmaArena
+// Nothing is freed node by node: the tree goes away when the arena is released
+static void* CJSON_CDECL _CJsonArenaAlloc(void* pvContext, size_t cb)
+{
+	return ((CGmaArena*)pvContext)->Alloc(cb, sizeof(double)); // cJSON nodes hold a double
+}
+
+// Same, by parsing the whole chunk into a cJSON tree
+// Fails with GMA_E_UNEXPECTED if cJSON doesn't consider it json
+// The tree is scratch, only needed until the wanted values are copied into pArena, so it goes in pScratchArena, which the caller resets
+static GmaStatus _ParseDescriptionJsonWithCJson(const char* pszJson, uint32_t cchJson, CGmaArena* pArena, CGmaArena* pScratchArena, GmaHeaderInfo* pInfo)
+{
+	// Hooks are passed per call rather than through cJSON_InitHooks(), since other threads may be parsing at the same time
+	cJSON_ContextHooks hooks;
+	hooks.malloc_fn = _CJsonArenaAlloc;
+	hooks.free_fn = NULL;
+	hooks.context = pScratchArena;
+
+	// JSON is a Unicode standard, yet cJSON expects a UTF8 encoded string when parsing json bytes
+	cJSON* pDescriptionJson = cJSON_ParseWithHooks(pszJson, (size_t)cchJson + 1, NULL, false, &hooks);
+
+	// Return will be null if parsing failed
+	// Passing return_parse_end would tell where, but cJSON_GetErrorPtr() won't, since it's global
+	// Could be malformed json, could be data that is not json
+	// gmad.exe presumably validates addon.json on gma creation, so the former is unlikely, but still possible
+	// In any regard, if the parsing fails, we will treat the body of the `description` field as basic text, i.e. the old(er) format before the json chunk introduction
+	if (pDescriptionJson == NULL)
+		return GMA_E_UNEXPECTED;
+
+	// Extract "description" from json chunk
+	cJSON* pjnDescription = cJSON_GetObjectItem(pDescriptionJson, "description");
+	if (cJSON_IsString(pjnDescription) && (pjnDescription->valuestring != NULL))
+	{
+		if (GMA_FAILED(_CopyJsonString(pArena, pjnDescription->valuestring, &pInfo->strDescription)))
+			return GMA_E_OUTOFMEMORY;
+	}
+
+	// Extract "type" from json chunk
+	cJSON* pjnType = cJSON_GetObjectItem(pDescriptionJson, "type");
+	if (cJSON_IsString(pjnType) && (pjnType->valuestring != NULL))
+	{
+		if (GMA_FAILED(_CopyJsonString(pArena, pjnType->valuestring, &pInfo->strType)))
+			return GMA_E_OUTOFMEMORY;
+	}
+
+	// Extact the "tags" list from json chunk
+	cJSON* pjnTags = cJSON_GetObjectItem(pDescriptionJson, "tags");
+	if (cJSON_IsArray(pjnTags))
+	{
+		int cTags = cJSON_GetArraySize(pjnTags);
+		if (cTags > 0)
+		{
+			pInfo->astrTags = pArena->AllocArray<GmaString>((size_t)cTags);
+			if (pInfo->astrTags == NULL)
+				return GMA_E_OUTOFMEMORY;
+
+			// Non-string entries are skipped, so cTags only counts the tags actually stored
+			// Walks the list directly, since looking each tag up by position would be quadratic
+			cJSON* pjnTagsTag = NULL;
+			cJSON_ArrayForEach(pjnTagsTag, pjnTags)
+			{
+				if (cJSON_IsString(pjnTagsTag) && (pjnTagsTag->valuestring != NULL))
+				{
+					if (GMA_FAILED(_CopyJsonString(pArena, pjnTagsTag->valuestring, &pInfo->astrTags[pInfo->cTags])))
+						return GMA_E_OUTOFMEMORY;
+					pInfo->cTags++;
+				}
+			}
+		}
+	}
+
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Header fields
+// ____________________________________________________________________________________________________
+//
+
+GmaStatus GmaParseDescriptionField(const char* pszAddonDescription, uint32_t cAddonDescription, CGmaArena* pArena, CGmaArena* pScratchArena, GmaHeaderInfo* pInfo)
+{
+	// The field is null-terminated where it is, so it can be inspected and handed to cJSON in place
+
+	// Detect json chunk in this field and handle it
+	// Afaik there is no indicator in the GMA header that states whether the bytes in `description` are an old(er)-format normal string or a new(er)-format json chunk
+	// And I do not know how ugc/gmod does the json or not detection
+	// So we will simply check for a leading '{' and trailing '}' and try to parse it as json if both are found
+
+	bool bFoundLeadingBrace = false;
+	bool bFoundTrailingBrace = false;
+
+	// Search for leading brace
+	for (uint32_t i = 0; i < cAddonDescription; i++)
+	{
+		char cCur = pszAddonDescription[i];
+
+		if (_IsAsciiSpace(cCur))
+			continue;
+
+		if (cCur == '{')
+			bFoundLeadingBrace = true;
+		break;
+	}
+
+	// Search for trailing brace
+	if (bFoundLeadingBrace)
+	{
+		for (uint32_t i = cAddonDescription; i > 0; i--)
+		{
+			char cCur = pszAddonDescription[i - 1];
+
+			if (_IsAsciiSpace(cCur))
+				continue;
+
+			if (cCur == '}')
+				bFoundTrailingBrace = true;
+			break;
+		}
+	}
+
+	if (bFoundLeadingBrace && bFoundTrailingBrace)
+	{
+		// Pull out just the keys we want in a single pass. It only gives up on malformed json and on a few rare constructs, and cJSON then has the final say on whether this is json.
+		GmaStatus status = _ParseDescriptionJson(pszAddonDescription, cAddonDescription, pArena, pInfo);
+		if ((status == GMA_E_UNEXPECTED) || (status == GMA_E_NOTIMPL))
+		{
+			// Callers without a parse context pay for an arena per tree
+			CGmaArena arenaTree;
+			if (pScratchArena == NULL)
+			{
+				arenaTree.Reserve((size_t)cAddonDescription * 2); // A starting guess. It grows if needed.
+				pScratchArena = &arenaTree;
+			}
+			status = _ParseDescriptionJsonWithCJson(pszAddonDescription, cAddonDescription, pArena, pScratchArena, pInfo);
+			pScratchArena->Reset(); // Keeps the context's memory for the next tree
+		}
+
+		if (GMA_SUCCEEDED(status))
+		{
+			pInfo->bUsesJsonChunkInDescription = true;
+			return GMA_S_OK;
+		}
+		if (status == GMA_E_OUTOFMEMORY)
+			return status;
+	}
+
+	// Treat as basic text
+	pInfo->bUsesJsonChunkInDescription = false;
+	pInfo->strDescription.psz = pszAddonDescription;
+	pInfo->strDescription.cch = cAddonDescription;
+	return GMA_S_OK;
+}
+
+GmaStatus GmaPostProcessHeaderInfo(GmaHeaderInfo* pInfo)
+{
+	//
+	// Remove stubs
+	//
+
+	// Some fields are unused and populated with meaningless stub values. We're going to remove those, so the associated Property is blank instead.
+
+	// Author
+	// In the old(er) GMA format, the `author` header field is always "author"
+	// In the new(er) format, the "author" element in the json chunk is always "Author Name"
+	if (pInfo->strAuthor.psz != NULL)
+	{
+		if (strcmp(pInfo->strAuthor.psz, pInfo->bUsesJsonChunkInDescription ? "Author Name" : "author") == 0)
+			_TruncateString(&pInfo->strAuthor);
+	}
+
+	// Description
+	// In the new(er) GMA format, the "description" element in the json chunk is always "Description"
+	if (pInfo->strDescription.psz != NULL)
+	{
+		if (pInfo->bUsesJsonChunkInDescription && strcmp(pInfo->strDescription.psz, "Description") == 0)
+			_TruncateString(&pInfo->strDescription);
+	}
+
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     File table
+// ____________________________________________________________________________________________________
+//
+
+bool GmaTryParseTocEntry(const uint8_t* pb, uint32_t cb, GmaTocEntry* pEntry, uint32_t* pcbEntry)
+{
+	if (cb < 4ul)
+		return false;
+
+	pEntry->ulIndex = GmaReadLE32(pb);
+	if (pEntry->ulIndex == 0ul)
+	{
+		*pcbEntry = 4ul;
+		return true;
+	}
+
+	uint32_t ulPathEnd = 4ul + (uint32_t)GmaFindNull(pb + 4, cb - 4ul);
+	if (ulPathEnd == cb)
+		return false;
+	const uint8_t* pbNull = pb + ulPathEnd;
+
+	if (cb - ulPathEnd - 1ul < 12ul)
+		return false;
+
+	pEntry->pszPath = (const char*)(pb + 4);
+	pEntry->cchPath = ulPathEnd - 4ul;
+	pEntry->ullSize = GmaReadLE64(pbNull + 1);
+	pEntry->ulCrc = GmaReadLE32(pbNull + 9);
+	*pcbEntry = ulPathEnd + 1ul + 12ul;
+	return true;
+}
+
+GmaStatus GmaAddTocEntry(GmaTocEntry* pEntry, GmaTocSummary* pSummary)
+{
+	if (pEntry->ullSize > (uint64_t)INT64_MAX || pEntry->ullSize > UINT64_MAX - pSummary->ullTotalSize)
+		return GMA_E_UNEXPECTED; // Negative size, or a total that cannot exist on disk
+
+	pEntry->ullDataOffset = pSummary->ullTotalSize;
+
+	pSummary->cFiles++;
+	pSummary->ullTotalSize += pEntry->ullSize;
+	if (pEntry->ullSize > pSummary->ullLargestSize)
+		pSummary->ullLargestSize = pEntry->ullSize;
+
+	return GMA_S_OK;
+}
+
+GmaStatus GmaFindTocEnd(const uint8_t* pb, uint32_t cb, uint64_t* pullEnd)
+{
+	*pullEnd = 0ull;
+	if (cb < 4ul)
+		return GMA_E_UNEXPECTED;
+	if (memcmp(pb, "GMAD", 4) != 0)
+		return GMA_E_ABORT;
+	if (cb < c_cbGmaFixedHeader)
+		return GMA_E_UNEXPECTED;
+	if (pb[c_ulGmaOffsetVersion] > c_bGmaMaxFormatVersion)
+		return GMA_E_ABORT;
+
+	// Required content list (format version 2+), up to an empty string
+	uint32_t ulPos = c_cbGmaFixedHeader;
+	if (pb[c_ulGmaOffsetVersion] > 1)
+	{
+		for (;;)
+		{
+			uint32_t ulFieldEnd = ulPos + (uint32_t)GmaFindNull(pb + ulPos, cb - ulPos);
+			if (ulFieldEnd == cb)
+				return GMA_E_UNEXPECTED;
+			bool bEmpty = (ulFieldEnd == ulPos);
+			ulPos = ulFieldEnd + 1ul;
+			if (bEmpty)
+				break;
+		}
+	}
+
+	// Name, description, author, then the addon version
+	GmaSpan aTextFields[3];
+	if (GmaFindNullTerminatedSpans(pb + ulPos, cb - ulPos, aTextFields, 3) < 3)
+		return GMA_E_UNEXPECTED;
+	ulPos += aTextFields[2].ulOffset + aTextFields[2].cb + 1ul + 4ul;
+	if (ulPos > cb)
+		return GMA_E_UNEXPECTED;
+
+	for (;;)
+	{
+		GmaTocEntry entry;
+		uint32_t cbEntry;
+		if (!GmaTryParseTocEntry(pb + ulPos, cb - ulPos, &entry, &cbEntry))
+			return GMA_E_UNEXPECTED;
+		ulPos += cbEntry;
+		if (entry.ulIndex == 0ul)
+			break;
+	}
+
+	*pullEnd = ulPos;
+	return GMA_S_OK;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+
+// Pieces of the GMA format shared by the pull reader (CGmaReader) and the push parser (CGmaPushParser)
+// Everything here works on bytes that are already in memory. Getting them there is up to the parser.
+
+static inline uint32_t GmaReadLE32(const uint8_t* pb)
+{
+	return (uint32_t)pb[0] | ((uint32_t)pb[1] << 8) | ((uint32_t)pb[2] << 16) | ((uint32_t)pb[3] << 24);
+}
+
+static inline uint64_t GmaReadLE64(const uint8_t* pb)
+{
+	return (uint64_t)GmaReadLE32(pb) | ((uint64_t)GmaReadLE32(pb + 4) << 32);
+}
+
+// Splits the `description` header field into the description, type and tags of pInfo, depending on whether it's plain text or a json chunk
+// pszDescription must be null-terminated at cchDescription. A plain text description is referenced rather than copied, so it must live as long as pInfo. Json values are copied into pArena.
+// pScratchArena, if not NULL, holds the cJSON tree for json the single-pass extractor leaves to cJSON, and is reset afterwards. Otherwise the tree gets a temporary arena.
+GmaStatus GmaParseDescriptionField(const char* pszDescription, uint32_t cchDescription, CGmaArena* pArena, CGmaArena* pScratchArena, GmaHeaderInfo* pInfo);
+
+// Various adjustments to the header fields once they've all been read
+GmaStatus GmaPostProcessHeaderInfo(GmaHeaderInfo* pInfo);
+
+// Parses one file table entry from pb if all of it is present. Returns false if more bytes are needed.
+// pEntry->pszPath points into pb. pEntry->ullDataOffset is not set; see GmaAddTocEntry().
+bool GmaTryParseTocEntry(const uint8_t* pb, uint32_t cb, GmaTocEntry* pEntry, uint32_t* pcbEntry);
+
+// Checks a parsed entry's size, sets its data offset, and adds it to the running summary
+// Fails with GMA_E_UNEXPECTED for sizes no real file table can contain
+GmaStatus GmaAddTocEntry(GmaTocEntry* pEntry, GmaTocSummary* pSummary);
+
+// Finds where the file table ends, i.e. how much of the start of a file a parser needs, from the first cb bytes of it
+// Only walks the field boundaries: nothing is decoded or copied. Returns GMA_S_OK with *pullEnd set once the end is within pb[0..cb). Returns GMA_E_UNEXPECTED if more bytes are needed to tell, and GMA_E_ABORT if this isn't a GMA.
+GmaStatus GmaFindTocEnd(const uint8_t* pb, uint32_t cb, uint64_t* pullEnd);
@@ -0,0 +1,605 @@
+#include "GmaJson.h"
+#include <string.h>
+
+// Reading position in the json text
+struct GmaJsonCursor
+{
+	const char* pch;
+	const char* pchEnd;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     Helpers
+// ____________________________________________________________________________________________________
+//
+
+// Same notion of whitespace as cJSON: every byte up to and including ' '
+static void _SkipWhitespace(GmaJsonCursor* pCur)
+{
+	while ((pCur->pch < pCur->pchEnd) && ((unsigned char)*pCur->pch <= ' '))
+		pCur->pch++;
+}
+
+static bool _IsAtChar(const GmaJsonCursor* pCur, char c)
+{
+	return (pCur->pch < pCur->pchEnd) && (*pCur->pch == c);
+}
+
+static char _ToLowerAscii(char c)
+{
+	return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool _ParseHex4(const char* pch, uint32_t* pulValue)
+{
+	uint32_t ulValue = 0ul;
+	for (int i = 0; i < 4; i++)
+	{
+		char c = pch[i];
+		uint32_t ulDigit;
+		if ((c >= '0') && (c <= '9'))
+			ulDigit = (uint32_t)(c - '0');
+		else if ((c >= 'a') && (c <= 'f'))
+			ulDigit = (uint32_t)(c - 'a' + 10);
+		else if ((c >= 'A') && (c <= 'F'))
+			ulDigit = (uint32_t)(c - 'A' + 10);
+		else
+			return false;
+		ulValue = (ulValue << 4) | ulDigit;
+	}
+	*pulValue = ulValue;
+	return true;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Strings
+// ____________________________________________________________________________________________________
+//
+
+// Checks the escapes of a string's contents (between its quotes) the way cJSON does while unescaping them, for strings that are skipped rather than copied
+// cJSON reads bad hex digits in a \u escape as 0 rather than failing, so only unknown escapes and broken surrogate pairs are malformed
+static GmaStatus _CheckEscapes(const char* pchStart, const char* pchEnd)
+{
+	const char* pch = pchStart;
+	for (;;)
+	{
+		pch = (const char*)memchr(pch, '\\', (size_t)(pchEnd - pch));
+		if (pch == NULL)
+			return GMA_S_OK;
+
+		switch (pch[1])
+		{
+		case 'b':
+		case 'f':
+		case 'n':
+		case 'r':
+		case 't':
+		case '"':
+		case '\\':
+		case '/':
+			pch += 2;
+			break;
+
+		case 'u':
+			{
+				uint32_t ulCodepoint;
+				if (pchEnd - pch < 6)
+					return GMA_E_UNEXPECTED;
+				if (!_ParseHex4(pch + 2, &ulCodepoint))
+					ulCodepoint = 0ul;
+				pch += 6;
+
+				if ((ulCodepoint >= 0xdc00ul) && (ulCodepoint <= 0xdffful))
+					return GMA_E_UNEXPECTED;
+
+				if ((ulCodepoint >= 0xd800ul) && (ulCodepoint <= 0xdbfful))
+				{
+					uint32_t ulLow;
+					if ((pchEnd - pch < 6) || (pch[0] != '\\') || (pch[1] != 'u') || !_ParseHex4(pch + 2, &ulLow) || (ulLow < 0xdc00ul) || (ulLow > 0xdffful))
+						return GMA_E_UNEXPECTED;
+					pch += 6;
+				}
+			}
+			break;
+
+		default:
+			return GMA_E_UNEXPECTED;
+		}
+	}
+}
+
+// Finds the extent of the string whose opening quote is at the cursor, without unescaping or validating its contents
+// Leaves the cursor just past the closing quote
+static GmaStatus _SkipString(GmaJsonCursor* pCur, const char** ppchStart, const char** ppchEnd)
+{
+	const char* pchStart = pCur->pch + 1;
+	const char* pchQuote = pchStart;
+	for (;;)
+	{
+		pchQuote = (const char*)memchr(pchQuote, '"', (size_t)(pCur->pchEnd - pchQuote));
+		if (pchQuote == NULL)
+			return GMA_E_UNEXPECTED; // Unterminated
+
+		// A quote preceded by an odd number of backslashes is escaped
+		const char* pchBackslashes = pchQuote;
+		while ((pchBackslashes > pchStart) && (pchBackslashes[-1] == '\\'))
+			pchBackslashes--;
+		if (((pchQuote - pchBackslashes) & 1) == 0)
+			break;
+
+		pchQuote++;
+	}
+
+	*ppchStart = pchStart;
+	*ppchEnd = pchQuote;
+	pCur->pch = pchQuote + 1;
+	return GMA_S_OK;
+}
+
+// Decodes the \uXXXX escape (or surrogate pair of them) at *ppch to UTF-8, advancing both pointers
+static GmaStatus _DecodeUtf16Escape(const char** ppch, const char* pchEnd, char** ppchOut)
+{
+	const char* pch = *ppch;
+	if (pchEnd - pch < 6)
+		return GMA_E_UNEXPECTED;
+
+	// cJSON reads bad hex digits as 0, and stops the string at a \u0000, so leave those to it to get the same result
+	uint32_t ulCodepoint;
+	if (!_ParseHex4(pch + 2, &ulCodepoint) || (ulCodepoint == 0ul))
+		return GMA_E_NOTIMPL;
+	pch += 6;
+
+	if ((ulCodepoint >= 0xdc00ul) && (ulCodepoint <= 0xdffful))
+		return GMA_E_UNEXPECTED; // Lone low surrogate
+
+	if ((ulCodepoint >= 0xd800ul) && (ulCodepoint <= 0xdbfful))
+	{
+		if ((pchEnd - pch < 6) || (pch[0] != '\\') || (pch[1] != 'u'))
+			return GMA_E_UNEXPECTED; // Missing low surrogate
+
+		uint32_t ulLow;
+		if (!_ParseHex4(pch + 2, &ulLow))
+			return GMA_E_NOTIMPL;
+		if ((ulLow < 0xdc00ul) || (ulLow > 0xdffful))
+			return GMA_E_UNEXPECTED;
+		pch += 6;
+
+		ulCodepoint = 0x10000ul + (((ulCodepoint & 0x3fful) << 10) | (ulLow & 0x3fful));
+	}
+
+	char* pchOut = *ppchOut;
+	if (ulCodepoint < 0x80ul)
+	{
+		*pchOut++ = (char)ulCodepoint;
+	}
+	else if (ulCodepoint < 0x800ul)
+	{
+		*pchOut++ = (char)(0xc0 | (ulCodepoint >> 6));
+		*pchOut++ = (char)(0x80 | (ulCodepoint & 0x3f));
+	}
+	else if (ulCodepoint < 0x10000ul)
+	{
+		*pchOut++ = (char)(0xe0 | (ulCodepoint >> 12));
+		*pchOut++ = (char)(0x80 | ((ulCodepoint >> 6) & 0x3f));
+		*pchOut++ = (char)(0x80 | (ulCodepoint & 0x3f));
+	}
+	else
+	{
+		*pchOut++ = (char)(0xf0 | (ulCodepoint >> 18));
+		*pchOut++ = (char)(0x80 | ((ulCodepoint >> 12) & 0x3f));
+		*pchOut++ = (char)(0x80 | ((ulCodepoint >> 6) & 0x3f));
+		*pchOut++ = (char)(0x80 | (ulCodepoint & 0x3f));
+	}
+
+	*ppch = pch;
+	*ppchOut = pchOut;
+	return GMA_S_OK;
+}
+
+// Unescapes the contents of a string (between its quotes) into the arena
+// Unescaping never lengthens a string, so the raw length is always enough
+static GmaStatus _CopyString(const char* pchStart, const char* pchEnd, CGmaArena* pArena, GmaString* pstrOut)
+{
+	char* pszOut = (char*)pArena->Alloc((size_t)(pchEnd - pchStart) + 1, 1);
+	if (pszOut == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	char* pchOut = pszOut;
+	const char* pch = pchStart;
+	while (pch < pchEnd)
+	{
+		// Copy up to the next escape in one go
+		const char* pchBackslash = (const char*)memchr(pch, '\\', (size_t)(pchEnd - pch));
+		size_t cchPlain = (size_t)(((pchBackslash != NULL) ? pchBackslash : pchEnd) - pch);
+		memcpy(pchOut, pch, cchPlain);
+		pchOut += cchPlain;
+		pch += cchPlain;
+		if (pch == pchEnd)
+			break;
+
+		// A backslash can't be last, since it would have escaped the closing quote
+		char cEscaped;
+		switch (pch[1])
+		{
+		case 'b': cEscaped = '\b'; break;
+		case 'f': cEscaped = '\f'; break;
+		case 'n': cEscaped = '\n'; break;
+		case 'r': cEscaped = '\r'; break;
+		case 't': cEscaped = '\t'; break;
+		case '"':
+		case '\\':
+		case '/':
+			cEscaped = pch[1];
+			break;
+
+		case 'u':
+			{
+				GmaStatus status = _DecodeUtf16Escape(&pch, pchEnd, &pchOut);
+				if (GMA_FAILED(status))
+					return status;
+				continue;
+			}
+
+		default:
+			return GMA_E_UNEXPECTED;
+		}
+
+		*pchOut++ = cEscaped;
+		pch += 2;
+	}
+	*pchOut = '\0';
+
+	pstrOut->psz = pszOut;
+	pstrOut->cch = (uint32_t)(pchOut - pszOut);
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Skipping values
+// ____________________________________________________________________________________________________
+//
+
+static GmaStatus _SkipValue(GmaJsonCursor* pCur, uint32_t cDepth);
+
+static GmaStatus _SkipLiteral(GmaJsonCursor* pCur, const char* pszLiteral, size_t cchLiteral)
+{
+	if (((size_t)(pCur->pchEnd - pCur->pch) < cchLiteral) || (memcmp(pCur->pch, pszLiteral, cchLiteral) != 0))
+		return GMA_E_UNEXPECTED;
+
+	pCur->pch += cchLiteral;
+	return GMA_S_OK;
+}
+
+// Skips as much of a number as cJSON reads: the prefix of it that strtod() takes, out of the first 63 characters
+// Whatever strtod() leaves, e.g. the "e" of "1e", then fails as the next token, as it does in cJSON
+static GmaStatus _SkipNumber(GmaJsonCursor* pCur)
+{
+	const char* pch = pCur->pch;
+	const char* pchEnd = ((pCur->pchEnd - pch) < 63) ? pCur->pchEnd : pch + 63;
+
+	if ((pch < pchEnd) && ((*pch == '-') || (*pch == '+')))
+		pch++;
+
+	bool bFoundDigit = false;
+	for (; (pch < pchEnd) && (*pch >= '0') && (*pch <= '9'); pch++)
+		bFoundDigit = true;
+	if ((pch < pchEnd) && (*pch == '.'))
+	{
+		for (pch++; (pch < pchEnd) && (*pch >= '0') && (*pch <= '9'); pch++)
+			bFoundDigit = true;
+	}
+	if (!bFoundDigit)
+		return GMA_E_UNEXPECTED;
+
+	// An exponent only counts if it has digits
+	if ((pch < pchEnd) && ((*pch == 'e') || (*pch == 'E')))
+	{
+		const char* pchExponent = pch + 1;
+		if ((pchExponent < pchEnd) && ((*pchExponent == '-') || (*pchExponent == '+')))
+			pchExponent++;
+		if ((pchExponent < pchEnd) && (*pchExponent >= '0') && (*pchExponent <= '9'))
+		{
+			for (pch = pchExponent; (pch < pchEnd) && (*pch >= '0') && (*pch <= '9'); pch++)
+				;
+		}
+	}
+
+	pCur->pch = pch;
+	return GMA_S_OK;
+}
+
+// Skips an object or array, whose opening bracket is at the cursor, checking only its structure
+// cDepth is the nesting depth of the container itself
+static GmaStatus _SkipContainer(GmaJsonCursor* pCur, uint32_t cDepth)
+{
+	if (cDepth > c_cGmaJsonNestingLimit)
+		return GMA_E_UNEXPECTED;
+
+	bool bObject = (*pCur->pch == '{');
+	char cClose = bObject ? '}' : ']';
+
+	pCur->pch++;
+	_SkipWhitespace(pCur);
+	if (_IsAtChar(pCur, cClose))
+	{
+		pCur->pch++;
+		return GMA_S_OK;
+	}
+
+	for (;;)
+	{
+		GmaStatus status;
+		if (bObject)
+		{
+			if (!_IsAtChar(pCur, '"'))
+				return GMA_E_UNEXPECTED;
+
+			const char* pchKeyStart;
+			const char* pchKeyEnd;
+			status = _SkipString(pCur, &pchKeyStart, &pchKeyEnd);
+			if (GMA_SUCCEEDED(status))
+				status = _CheckEscapes(pchKeyStart, pchKeyEnd);
+			if (GMA_FAILED(status))
+				return status;
+
+			_SkipWhitespace(pCur);
+			if (!_IsAtChar(pCur, ':'))
+				return GMA_E_UNEXPECTED;
+			pCur->pch++;
+			_SkipWhitespace(pCur);
+		}
+
+		status = _SkipValue(pCur, cDepth);
+		if (GMA_FAILED(status))
+			return status;
+
+		_SkipWhitespace(pCur);
+		if (_IsAtChar(pCur, ','))
+		{
+			pCur->pch++;
+			_SkipWhitespace(pCur);
+			continue;
+		}
+		if (_IsAtChar(pCur, cClose))
+		{
+			pCur->pch++;
+			return GMA_S_OK;
+		}
+		return GMA_E_UNEXPECTED;
+	}
+}
+
+// Skips the value at the cursor. cDepth is the nesting depth of the container it's in.
+static GmaStatus _SkipValue(GmaJsonCursor* pCur, uint32_t cDepth)
+{
+	if (pCur->pch >= pCur->pchEnd)
+		return GMA_E_UNEXPECTED;
+
+	switch (*pCur->pch)
+	{
+	case '"':
+		{
+			const char* pchStart;
+			const char* pchEnd;
+			GmaStatus status = _SkipString(pCur, &pchStart, &pchEnd);
+			if (GMA_FAILED(status))
+				return status;
+			return _CheckEscapes(pchStart, pchEnd);
+		}
+
+	case '{':
+	case '[':
+		return _SkipContainer(pCur, cDepth + 1ul);
+
+	case 't':
+		return _SkipLiteral(pCur, "true", 4);
+	case 'f':
+		return _SkipLiteral(pCur, "false", 5);
+	case 'n':
+		return _SkipLiteral(pCur, "null", 4);
+
+	default:
+		if ((*pCur->pch == '-') || ((*pCur->pch >= '0') && (*pCur->pch <= '9')))
+			return _SkipNumber(pCur);
+		return GMA_E_UNEXPECTED;
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Extraction
+// ____________________________________________________________________________________________________
+//
+
+// Collects the strings of the array at the cursor, which is a value of the top-level object
+static GmaStatus _ExtractStringArray(GmaJsonCursor* pCur, CGmaArena* pArena, GmaJsonKey* pKey)
+{
+	uint32_t cCapacity = 0ul;
+
+	pCur->pch++;
+	_SkipWhitespace(pCur);
+	if (_IsAtChar(pCur, ']'))
+	{
+		pCur->pch++;
+		return GMA_S_OK;
+	}
+
+	for (;;)
+	{
+		GmaStatus status;
+		if (_IsAtChar(pCur, '"'))
+		{
+			const char* pchStart;
+			const char* pchEnd;
+			status = _SkipString(pCur, &pchStart, &pchEnd);
+			if (GMA_FAILED(status))
+				return status;
+
+			// The element count isn't known up front, so grow the array by doubling. Abandoned arrays stay in the arena, which is fine for a handful of tags.
+			if (pKey->cStrings == cCapacity)
+			{
+				cCapacity = (cCapacity == 0ul) ? 8ul : cCapacity * 2ul;
+				GmaString* astrNew = pArena->AllocArray<GmaString>(cCapacity);
+				if (astrNew == NULL)
+					return GMA_E_OUTOFMEMORY;
+				if (pKey->cStrings != 0ul)
+					memcpy(astrNew, pKey->astr, pKey->cStrings * sizeof(GmaString));
+				pKey->astr = astrNew;
+			}
+
+			status = _CopyString(pchStart, pchEnd, pArena, &pKey->astr[pKey->cStrings]);
+			if (GMA_FAILED(status))
+				return status;
+			pKey->cStrings++;
+		}
+		else
+		{
+			// Non-string elements are skipped, as the cJSON path does
+			status = _SkipValue(pCur, 2ul);
+			if (GMA_FAILED(status))
+				return status;
+		}
+
+		_SkipWhitespace(pCur);
+		if (_IsAtChar(pCur, ','))
+		{
+			pCur->pch++;
+			_SkipWhitespace(pCur);
+			continue;
+		}
+		if (_IsAtChar(pCur, ']'))
+		{
+			pCur->pch++;
+			return GMA_S_OK;
+		}
+		return GMA_E_UNEXPECTED;
+	}
+}
+
+// Finds the wanted key a top-level key names, if any
+static GmaStatus _FindWantedKey(const char* pchStart, const char* pchEnd, GmaJsonKey* aKeys, size_t cKeys, GmaJsonKey** ppKey)
+{
+	*ppKey = NULL;
+
+	size_t cch = (size_t)(pchEnd - pchStart);
+	if (memchr(pchStart, '\\', cch) != NULL)
+		return GMA_E_NOTIMPL; // Would have to be unescaped to compare
+
+	for (size_t i = 0; i < cKeys; i++)
+	{
+		const char* pszName = aKeys[i].pszName;
+		size_t j = 0;
+		while ((j < cch) && (pszName[j] != '\0') && (_ToLowerAscii(pchStart[j]) == _ToLowerAscii(pszName[j])))
+			j++;
+
+		if ((j == cch) && (pszName[j] == '\0'))
+		{
+			*ppKey = &aKeys[i];
+			break;
+		}
+	}
+	return GMA_S_OK;
+}
+
+GmaStatus GmaJsonExtractKeys(const char* pch, uint32_t cch, GmaJsonKey* aKeys, size_t cKeys, CGmaArena* pArena)
+{
+	for (size_t i = 0; i < cKeys; i++)
+	{
+		aKeys[i].bFound = false;
+		aKeys[i].str.psz = NULL;
+		aKeys[i].str.cch = 0ul;
+		aKeys[i].astr = NULL;
+		aKeys[i].cStrings = 0ul;
+	}
+	size_t cKeysRemaining = cKeys;
+
+	GmaJsonCursor cur;
+	cur.pch = pch;
+	cur.pchEnd = pch + cch;
+
+	_SkipWhitespace(&cur);
+	if (!_IsAtChar(&cur, '{'))
+		return GMA_E_UNEXPECTED;
+	cur.pch++;
+	_SkipWhitespace(&cur);
+	if (_IsAtChar(&cur, '}'))
+		return GMA_S_OK;
+
+	for (;;)
+	{
+		if (!_IsAtChar(&cur, '"'))
+			return GMA_E_UNEXPECTED;
+
+		const char* pchKeyStart;
+		const char* pchKeyEnd;
+		GmaStatus status = _SkipString(&cur, &pchKeyStart, &pchKeyEnd);
+		if (GMA_FAILED(status))
+			return status;
+
+		_SkipWhitespace(&cur);
+		if (!_IsAtChar(&cur, ':'))
+			return GMA_E_UNEXPECTED;
+		cur.pch++;
+		_SkipWhitespace(&cur);
+		if (cur.pch >= cur.pchEnd)
+			return GMA_E_UNEXPECTED;
+
+		GmaJsonKey* pKey = NULL;
+		status = _FindWantedKey(pchKeyStart, pchKeyEnd, aKeys, cKeys, &pKey);
+		if (GMA_FAILED(status))
+			return status;
+
+		if ((pKey != NULL) && !pKey->bFound)
+		{
+			pKey->bFound = true;
+			cKeysRemaining--;
+
+			if (pKey->bStringArray && (*cur.pch == '['))
+			{
+				status = _ExtractStringArray(&cur, pArena, pKey);
+			}
+			else if (!pKey->bStringArray && (*cur.pch == '"'))
+			{
+				const char* pchStart;
+				const char* pchEnd;
+				status = _SkipString(&cur, &pchStart, &pchEnd);
+				if (GMA_SUCCEEDED(status))
+					status = _CopyString(pchStart, pchEnd, pArena, &pKey->str);
+			}
+			else
+			{
+				status = _SkipValue(&cur, 1ul); // Wrong type, so it stays empty
+			}
+			if (GMA_FAILED(status))
+				return status;
+
+			if (cKeysRemaining == 0)
+				return GMA_S_OK; // Everything wanted has been seen. Whatever follows, e.g. a huge "ignore" list, is never looked at.
+		}
+		else
+		{
+			// Unwanted, or a later duplicate of a key already found
+			status = _SkipValue(&cur, 1ul);
+			if (GMA_FAILED(status))
+				return status;
+		}
+
+		_SkipWhitespace(&cur);
+		if (_IsAtChar(&cur, ','))
+		{
+			cur.pch++;
+			_SkipWhitespace(&cur);
+			continue;
+		}
+		if (_IsAtChar(&cur, '}'))
+			return GMA_S_OK;
+		return GMA_E_UNEXPECTED;
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+
+const uint32_t c_cGmaJsonNestingLimit = 1000ul; // Same as cJSON's CJSON_NESTING_LIMIT, so both accept the same documents
+
+// One top-level key for GmaJsonExtractKeys() to pull out of an object
+// Keys match the way cJSON_GetObjectItem() does: ASCII case-insensitively, first occurrence wins.
+struct GmaJsonKey
+{
+	const char* pszName;
+	bool bStringArray; // Wants an array of strings rather than a string
+
+	// Results. Values that aren't of the wanted type are left NULL/empty, as are array elements that aren't strings.
+	bool bFound;
+	GmaString str;
+	GmaString* astr;
+	uint32_t cStrings;
+};
+
+// Single-pass extractor for a few top-level keys of a json object
+// Unlike cJSON_Parse(), it builds no tree: values of other keys are skipped structurally without allocating anything, and it stops reading as soon as every wanted key has been seen. Only the wanted strings are unescaped, straight into pArena.
+// Since it stops early, whatever follows the last wanted key is not validated.
+// Fails with GMA_E_UNEXPECTED for malformed json, and GMA_E_NOTIMPL for the rare constructs it leaves to cJSON (escaped top-level keys, and \u escapes that cJSON decodes loosely). Results are only valid on success.
+GmaStatus GmaJsonExtractKeys(const char* pch, uint32_t cch, GmaJsonKey* aKeys, size_t cKeys, CGmaArena* pArena);
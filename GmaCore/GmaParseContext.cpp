@@ -0,0 +1,10 @@
+#include "GmaParseContext.h"
+#include "GmaReader.h"
+#include <new>  // std::nothrow
+
+uint8_t* CGmaParseContext::GetTocBuffer()
+{
+	if (_pbTocBuffer == NULL)
+		_pbTocBuffer = new (std::nothrow) uint8_t[c_cbGmaTocReadChunk];
+	return _pbTocBuffer;
+}
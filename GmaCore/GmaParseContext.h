@@ -0,0 +1,33 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+
+// Memory that one thread reuses from parse to parse, for batch callers that parse many files in a row
+// Holds the arena behind the header window, the extracted strings and the tag array, the scratch arena for the cJSON tree of a json description, and the buffer the file table streams through. Each grows to the largest parse it has seen and is kept, so once a thread has parsed a file of every size it meets, a parse costs no heap allocation at all.
+// Pass it to CGmaDocument and call Reset() between files. Not thread-safe; use one per thread.
+class CGmaParseContext
+{
+public:
+	CGmaParseContext() : _pbTocBuffer(NULL) {}
+	~CGmaParseContext() { delete[] _pbTocBuffer; }
+
+	// Makes everything the last parse allocated available to the next one. Invalidates whatever that parse returned, such as its header strings.
+	void Reset() { _arena.Reset(); _arenaScratch.Reset(); }
+
+	CGmaArena* GetArena() { return &_arena; }
+
+	// For memory that is only needed during one step of a parse. Whoever uses it resets it when done, so nothing in it outlives that step.
+	CGmaArena* GetScratchArena() { return &_arenaScratch; }
+
+	// c_cbGmaTocReadChunk bytes for CGmaReader::ReadToc() to stream the file table through, or NULL if out of memory
+	uint8_t* GetTocBuffer();
+
+private:
+	CGmaArena _arena;
+	CGmaArena _arenaScratch;
+	uint8_t* _pbTocBuffer; // Allocated on first use
+
+	CGmaParseContext(const CGmaParseContext&);
+	CGmaParseContext& operator=(const CGmaParseContext&);
+};
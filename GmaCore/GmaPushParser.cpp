@@ -0,0 +1,383 @@
+#include "GmaPushParser.h"
+#include "GmaFormat.h"
+#include "GmaScan.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+/*
+	The push parser walks the same layout as CGmaReader (see GmaReader.cpp), but one state per part instead of from a window:
+
+		Fixed header      21 bytes, collected across chunks if need be
+		Required content  Skipped string by string without buffering, up to the empty string
+		Text fields       Name, description and author, buffered back to back until the third terminator
+		Addon version     4 bytes
+		File table        Entries are parsed straight out of the chunk when they're whole. One that straddles two chunks is carried over.
+
+	Nothing is ever re-read or re-scanned, so the total work is linear in the input no matter how it's chunked.
+*/
+
+CGmaPushParser::CGmaPushParser(IGmaPushParserSink* pSink, CGmaArena* pArena, size_t cbMemoryLimit, CGmaArena* pScratchArena) :
+	_pSink(pSink), _pArena(pArena), _pScratchArena(pScratchArena), _cbMemoryLimit(cbMemoryLimit),
+	_state(GMA_PUSH_FIXED_HEADER), _statusFailed(GMA_S_OK), _ullOffset(0ull),
+	_cbFixed(0ul), _bInRequiredContent(false),
+	_pbText(NULL), _cbText(0), _cbTextCapacity(0), _cTextFields(0ul),
+	_bHeaderDone(false),
+	_pbCarry(NULL), _cbCarry(0), _cbCarryCapacity(0), _ulCarryPathEnd(0)
+{
+	if (_cbMemoryLimit > (size_t)UINT32_MAX)
+		_cbMemoryLimit = (size_t)UINT32_MAX; // Field lengths are 32-bit
+	memset(_aulTextFieldEnd, 0, sizeof(_aulTextFieldEnd));
+	memset(&_header, 0, sizeof(_header));
+	memset(&_tocSummary, 0, sizeof(_tocSummary));
+}
+
+CGmaPushParser::~CGmaPushParser()
+{
+	delete[] _pbText;
+	delete[] _pbCarry;
+}
+
+GmaStatus CGmaPushParser::Feed(const void* pv, size_t cb)
+{
+	if (_state == GMA_PUSH_FAILED)
+		return _statusFailed;
+
+	const uint8_t* pb = (const uint8_t*)pv;
+	while (cb > 0)
+	{
+		GmaStatus status = GMA_S_OK;
+		size_t cbUsed = 0;
+
+		switch (_state)
+		{
+		case GMA_PUSH_FIXED_HEADER:
+			cbUsed = _FeedFixed(pb, cb, c_cbGmaFixedHeader);
+			if (_cbFixed >= 4ul && memcmp(_abFixed, "GMAD", 4) != 0) // Reject non-GMAs as soon as possible
+				status = GMA_E_ABORT;
+			else if (_cbFixed == c_cbGmaFixedHeader)
+				status = _CompleteFixedHeader();
+			break;
+
+		case GMA_PUSH_REQUIRED_CONTENT:
+			cbUsed = _FeedRequiredContent(pb, cb);
+			break;
+
+		case GMA_PUSH_TEXT_FIELDS:
+			cbUsed = _FeedTextFields(pb, cb, &status);
+			break;
+
+		case GMA_PUSH_ADDON_VERSION:
+			cbUsed = _FeedFixed(pb, cb, 4ul);
+			if (_cbFixed == 4ul)
+				status = _CompleteHeader();
+			break;
+
+		case GMA_PUSH_TOC:
+			cbUsed = _FeedToc(pb, cb, &status);
+			break;
+
+		case GMA_PUSH_DONE:
+			cbUsed = cb; // File data. Not ours to parse.
+			break;
+
+		default:
+			status = GMA_E_UNEXPECTED;
+			break;
+		}
+
+		_ullOffset += cbUsed;
+		pb += cbUsed;
+		cb -= cbUsed;
+
+		if (GMA_FAILED(status))
+			return _Fail(status);
+	}
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaPushParser::Finish()
+{
+	if (_state == GMA_PUSH_FAILED)
+		return _statusFailed;
+	if (_state != GMA_PUSH_DONE)
+		return _Fail(GMA_E_UNEXPECTED); // Truncated
+
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaPushParser::_Fail(GmaStatus status)
+{
+	_state = GMA_PUSH_FAILED;
+	_statusFailed = status;
+
+	delete[] _pbText;
+	_pbText = NULL;
+	_cbText = _cbTextCapacity = 0;
+	delete[] _pbCarry;
+	_pbCarry = NULL;
+	_cbCarry = _cbCarryCapacity = 0;
+
+	return status;
+}
+
+// Appends to one of the partial-part buffers, growing it within the memory limit
+GmaStatus CGmaPushParser::_Append(uint8_t** ppbBuf, size_t* pcbBuf, size_t* pcbCapacity, const uint8_t* pb, size_t cb)
+{
+	if (cb > _cbMemoryLimit - _cbText - _cbCarry)
+		return GMA_E_TOOLARGE; // Bigger than anything we're willing to buffer
+
+	size_t cbNeeded = *pcbBuf + cb;
+	if (cbNeeded > *pcbCapacity)
+	{
+		size_t cbCapacity = (*pcbCapacity < 256) ? 256 : *pcbCapacity;
+		while (cbCapacity < cbNeeded)
+			cbCapacity *= 2;
+		if (cbCapacity > _cbMemoryLimit)
+			cbCapacity = _cbMemoryLimit;
+
+		uint8_t* pbNew = new (std::nothrow) uint8_t[cbCapacity];
+		if (pbNew == NULL)
+			return GMA_E_OUTOFMEMORY;
+		if (*pcbBuf > 0)
+			memcpy(pbNew, *ppbBuf, *pcbBuf);
+		delete[] *ppbBuf;
+		*ppbBuf = pbNew;
+		*pcbCapacity = cbCapacity;
+	}
+
+	memcpy(*ppbBuf + *pcbBuf, pb, cb);
+	*pcbBuf += cb;
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Header
+// ____________________________________________________________________________________________________
+//
+
+// Collects bytes of a fixed-size part until _cbFixed reaches cbWanted
+size_t CGmaPushParser::_FeedFixed(const uint8_t* pb, size_t cb, uint32_t cbWanted)
+{
+	size_t cbCopy = cbWanted - _cbFixed;
+	if (cbCopy > cb)
+		cbCopy = cb;
+
+	memcpy(_abFixed + _cbFixed, pb, cbCopy);
+	_cbFixed += (uint32_t)cbCopy;
+	return cbCopy;
+}
+
+GmaStatus CGmaPushParser::_CompleteFixedHeader()
+{
+	_header.bFormatVersion = _abFixed[c_ulGmaOffsetVersion];
+	_header.ullSteamId = GmaReadLE64(_abFixed + c_ulGmaOffsetSteamId);
+	_header.ullTimestamp = GmaReadLE64(_abFixed + c_ulGmaOffsetTimestamp);
+	_cbFixed = 0ul;
+
+	if (_header.bFormatVersion > c_bGmaMaxFormatVersion) // Same rule gmad.exe applies
+		return GMA_E_ABORT;
+
+	// Format version 2 added the required content list
+	_state = (_header.bFormatVersion > 1) ? GMA_PUSH_REQUIRED_CONTENT : GMA_PUSH_TEXT_FIELDS;
+	return GMA_S_OK;
+}
+
+// Skips required content strings, which we have no use for, without buffering them
+size_t CGmaPushParser::_FeedRequiredContent(const uint8_t* pb, size_t cb)
+{
+	size_t ulNull = GmaFindNull(pb, cb);
+	if (ulNull == cb)
+	{
+		_bInRequiredContent = true;
+		return cb;
+	}
+
+	if (ulNull == 0 && !_bInRequiredContent)
+		_state = GMA_PUSH_TEXT_FIELDS; // The empty string ends the list
+
+	_bInRequiredContent = false;
+	return ulNull + 1;
+}
+
+size_t CGmaPushParser::_FeedTextFields(const uint8_t* pb, size_t cb, GmaStatus* pStatus)
+{
+	size_t ulPos = 0;
+	while (_cTextFields < 3ul)
+	{
+		size_t ulNull = GmaFindNull(pb + ulPos, cb - ulPos);
+		if (ulNull == cb - ulPos)
+		{
+			ulPos = cb;
+			break;
+		}
+
+		_aulTextFieldEnd[_cTextFields++] = _cbText + ulPos + ulNull;
+		ulPos += ulNull + 1;
+	}
+
+	*pStatus = _Append(&_pbText, &_cbText, &_cbTextCapacity, pb, ulPos);
+	if (GMA_SUCCEEDED(*pStatus) && _cTextFields == 3ul)
+		_state = GMA_PUSH_ADDON_VERSION;
+
+	return ulPos;
+}
+
+// Turns the buffered text fields into the header and hands it to the sink
+GmaStatus CGmaPushParser::_CompleteHeader()
+{
+	_header.lAddonVersion = (int32_t)GmaReadLE32(_abFixed);
+	_cbFixed = 0ul;
+
+	// One copy of the whole text block into the arena, which the fields then point into, same as they point into CGmaReader's window
+	char* pszText = (char*)_pArena->Alloc(_cbText, 1);
+	if (pszText == NULL)
+		return GMA_E_OUTOFMEMORY;
+	memcpy(pszText, _pbText, _cbText);
+
+	delete[] _pbText;
+	_pbText = NULL;
+	_cbText = _cbTextCapacity = 0;
+
+	size_t ulDescription = _aulTextFieldEnd[0] + 1;
+	size_t ulAuthor = _aulTextFieldEnd[1] + 1;
+
+	_header.strName.psz = pszText;
+	_header.strName.cch = (uint32_t)_aulTextFieldEnd[0];
+
+	GmaStatus status = GmaParseDescriptionField(pszText + ulDescription, (uint32_t)(_aulTextFieldEnd[1] - ulDescription), _pArena, _pScratchArena, &_header);
+	if (GMA_FAILED(status))
+		return status;
+
+	_header.strAuthor.psz = pszText + ulAuthor;
+	_header.strAuthor.cch = (uint32_t)(_aulTextFieldEnd[2] - ulAuthor);
+
+	status = GmaPostProcessHeaderInfo(&_header);
+	if (GMA_FAILED(status))
+		return status;
+
+	_state = GMA_PUSH_TOC;
+	_bHeaderDone = true;
+	return _pSink->OnHeader(_header);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     File table
+// ____________________________________________________________________________________________________
+//
+
+size_t CGmaPushParser::_FeedToc(const uint8_t* pb, size_t cb, GmaStatus* pStatus)
+{
+	size_t ulPos = 0;
+	while (ulPos < cb && _state == GMA_PUSH_TOC && GMA_SUCCEEDED(*pStatus))
+	{
+		if (_cbCarry == 0)
+		{
+			// Whole entries are parsed in place, without copying
+			size_t cbRest = cb - ulPos;
+			uint32_t cbAvailable = (cbRest > (size_t)UINT32_MAX) ? UINT32_MAX : (uint32_t)cbRest;
+
+			GmaTocEntry entry;
+			uint32_t cbEntry;
+			if (GmaTryParseTocEntry(pb + ulPos, cbAvailable, &entry, &cbEntry))
+			{
+				ulPos += cbEntry;
+				*pStatus = (cbEntry > c_cbGmaMaxTocEntry) ? GMA_E_TOOLARGE : _CompleteTocEntry(&entry, _ullOffset + ulPos);
+				continue;
+			}
+		}
+
+		// The entry continues past this chunk, or already started in an earlier one
+		ulPos += _FeedCarriedTocEntry(pb + ulPos, cb - ulPos, pStatus);
+	}
+
+	return ulPos;
+}
+
+// Collects an entry that straddles chunks in the carry buffer, taking only as many bytes as it still needs
+size_t CGmaPushParser::_FeedCarriedTocEntry(const uint8_t* pb, size_t cb, GmaStatus* pStatus)
+{
+	size_t ulPos = 0;
+
+	// File number
+	if (_cbCarry < 4)
+	{
+		size_t cbCopy = 4 - _cbCarry;
+		if (cbCopy > cb)
+			cbCopy = cb;
+		*pStatus = _Append(&_pbCarry, &_cbCarry, &_cbCarryCapacity, pb, cbCopy);
+		ulPos += cbCopy;
+		if (GMA_FAILED(*pStatus) || _cbCarry < 4)
+			return ulPos;
+	}
+
+	if (GmaReadLE32(_pbCarry) != 0ul) // 0 is the terminator, which is just the file number
+	{
+		// Path
+		if (_ulCarryPathEnd == 0)
+		{
+			size_t ulNull = GmaFindNull(pb + ulPos, cb - ulPos);
+			bool bFound = (ulNull < cb - ulPos);
+			size_t cbCopy = bFound ? ulNull + 1 : cb - ulPos;
+			if (_cbCarry + cbCopy + (bFound ? 12 : 13) > c_cbGmaMaxTocEntry) // The size and CRC, and the null too if it hasn't come yet, are still to follow
+			{
+				*pStatus = GMA_E_TOOLARGE;
+				return ulPos;
+			}
+			*pStatus = _Append(&_pbCarry, &_cbCarry, &_cbCarryCapacity, pb + ulPos, cbCopy);
+			ulPos += cbCopy;
+			if (GMA_FAILED(*pStatus) || !bFound)
+				return ulPos;
+			_ulCarryPathEnd = _cbCarry - 1;
+		}
+
+		// Size and CRC
+		size_t cbEntry = _ulCarryPathEnd + 1 + 12;
+		size_t cbCopy = cbEntry - _cbCarry;
+		if (cbCopy > cb - ulPos)
+			cbCopy = cb - ulPos;
+		*pStatus = _Append(&_pbCarry, &_cbCarry, &_cbCarryCapacity, pb + ulPos, cbCopy);
+		ulPos += cbCopy;
+		if (GMA_FAILED(*pStatus) || _cbCarry < cbEntry)
+			return ulPos;
+	}
+
+	// The carried entry is whole now
+	GmaTocEntry entry;
+	uint32_t cbEntry;
+	if (!GmaTryParseTocEntry(_pbCarry, (uint32_t)_cbCarry, &entry, &cbEntry))
+	{
+		*pStatus = GMA_E_UNEXPECTED;
+		return ulPos;
+	}
+
+	*pStatus = _CompleteTocEntry(&entry, _ullOffset + ulPos);
+	_cbCarry = 0;
+	_ulCarryPathEnd = 0;
+	return ulPos;
+}
+
+GmaStatus CGmaPushParser::_CompleteTocEntry(GmaTocEntry* pEntry, uint64_t ullEntryEnd)
+{
+	if (pEntry->ulIndex == 0ul)
+	{
+		_tocSummary.ullDataStart = ullEntryEnd;
+		_state = GMA_PUSH_DONE;
+
+		delete[] _pbCarry;
+		_pbCarry = NULL;
+		_cbCarry = _cbCarryCapacity = 0;
+
+		return _pSink->OnTocEnd(_tocSummary);
+	}
+
+	GmaStatus status = GmaAddTocEntry(pEntry, &_tocSummary);
+	if (GMA_FAILED(status))
+		return status;
+
+	return _pSink->OnTocEntry(*pEntry);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+
+const size_t c_cbGmaPushParserDefaultMemoryLimit = 1024 * 1024; // Default cap on bytes buffered for a single header or file table entry. Far beyond any real header, including ones with huge "ignore" lists.
+
+// Receives what a CGmaPushParser finds, as soon as each part is complete
+// OnTocEntry() is called for every file table entry, between OnHeader() and OnTocEnd(). Return anything but GMA_S_OK from any of these to stop parsing; Feed() then returns that status.
+class IGmaPushParserSink : public IGmaTocVisitor
+{
+public:
+	// The whole header has been parsed. Its strings live in the arena passed to the parser.
+	virtual GmaStatus OnHeader(const GmaHeaderInfo& info) = 0;
+
+	// The end of the file table has been reached. Nothing after it is parsed.
+	virtual GmaStatus OnTocEnd(const GmaTocSummary& summary) = 0;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     Push parser
+// ____________________________________________________________________________________________________
+//
+
+// Forward-only, resumable GMA parser
+// Feed() it the file's bytes in order, in chunks of any size, and it reports each part to the sink as it completes. It never seeks and never asks for more, so it can parse straight out of a pipe, a download or a decompressor.
+// Bytes are only buffered while a header or file table entry is incomplete, and never more than cbMemoryLimit of them, so there's no fixed limit on the header size like CGmaReader's.
+// Not thread-safe.
+class CGmaPushParser
+{
+public:
+	// pScratchArena, if not NULL, backs the cJSON tree of a json description instead of a temporary arena (see CGmaParseContext)
+	CGmaPushParser(IGmaPushParserSink* pSink, CGmaArena* pArena, size_t cbMemoryLimit = c_cbGmaPushParserDefaultMemoryLimit, CGmaArena* pScratchArena = NULL);
+	~CGmaPushParser();
+
+	// Parses the next cb bytes of the file
+	// After a failure, every later call returns the same status. Fails with GMA_E_ABORT for a non-GMA, and GMA_E_TOOLARGE when an incomplete part would need more than the memory limit, or a file table entry is over c_cbGmaMaxTocEntry like CGmaReader::ReadToc() refuses.
+	// Bytes after the file table (i.e. the file data) are accepted and ignored, so callers can stop feeding once IsDone().
+	GmaStatus Feed(const void* pb, size_t cb);
+
+	// Signals the end of the input. Fails with GMA_E_UNEXPECTED if it ended before the file table did.
+	GmaStatus Finish();
+
+	bool IsHeaderDone() const { return _bHeaderDone; } // OnHeader() has been called
+	bool IsDone() const { return _state == GMA_PUSH_DONE; }
+	uint64_t GetOffset() const { return _ullOffset; } // Bytes fed so far
+
+private:
+	enum GmaPushState
+	{
+		GMA_PUSH_FIXED_HEADER, // magic, version, SteamID64, timestamp
+		GMA_PUSH_REQUIRED_CONTENT, // strings up to an empty one
+		GMA_PUSH_TEXT_FIELDS, // name, description, author
+		GMA_PUSH_ADDON_VERSION,
+		GMA_PUSH_TOC,
+		GMA_PUSH_DONE,
+		GMA_PUSH_FAILED,
+	};
+
+	IGmaPushParserSink* _pSink;
+	CGmaArena* _pArena;
+	CGmaArena* _pScratchArena; // The caller's, or NULL
+	size_t _cbMemoryLimit;
+
+	GmaPushState _state;
+	GmaStatus _statusFailed;
+	uint64_t _ullOffset; // Absolute offset of the next byte to be fed
+
+	// Fixed-size fields being collected across chunks
+	uint8_t _abFixed[c_cbGmaFixedHeader];
+	uint32_t _cbFixed;
+
+	bool _bInRequiredContent; // Partway through a (non-empty) required content string
+
+	// The three text fields, collected back to back with their terminators
+	uint8_t* _pbText;
+	size_t _cbText;
+	size_t _cbTextCapacity;
+	uint32_t _cTextFields; // terminators seen
+	size_t _aulTextFieldEnd[3]; // Offset of each field's terminator in the text buffer
+
+	GmaHeaderInfo _header;
+	bool _bHeaderDone;
+	GmaTocSummary _tocSummary;
+
+	// A file table entry that straddles chunks
+	uint8_t* _pbCarry;
+	size_t _cbCarry;
+	size_t _cbCarryCapacity;
+	size_t _ulCarryPathEnd; // Offset of the path terminator in the carry buffer, or 0 if not found yet
+
+	GmaStatus _Fail(GmaStatus status);
+	GmaStatus _Append(uint8_t** ppbBuf, size_t* pcbBuf, size_t* pcbCapacity, const uint8_t* pb, size_t cb);
+
+	size_t _FeedFixed(const uint8_t* pb, size_t cb, uint32_t cbWanted);
+	size_t _FeedRequiredContent(const uint8_t* pb, size_t cb);
+	size_t _FeedTextFields(const uint8_t* pb, size_t cb, GmaStatus* pStatus);
+	size_t _FeedToc(const uint8_t* pb, size_t cb, GmaStatus* pStatus);
+	size_t _FeedCarriedTocEntry(const uint8_t* pb, size_t cb, GmaStatus* pStatus);
+
+	GmaStatus _CompleteFixedHeader();
+	GmaStatus _CompleteHeader();
+	GmaStatus _CompleteTocEntry(GmaTocEntry* pEntry, uint64_t ullEntryEnd);
+
+	CGmaPushParser(const CGmaPushParser&);
+	CGmaPushParser& operator=(const CGmaPushParser&);
+};
@@ -0,0 +1,506 @@
+#include "GmaReader.h"
+#include "GmaFormat.h"
+#include "GmaScan.h"
+#include "GmaArena.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+
+// ____________________________________________________________________________________________________
+//
+//     GMA information retrieval
+// ____________________________________________________________________________________________________
+//
+
+/*
+	Header examples
+
+	159321088.gma
+		- Old(er) gma header format, back when `description` actually had a description in it, before it was turned into a json chunk
+		- `author` field is always* constant "author" string
+
+		0000h  47 4D 41 44 03 1E 18 19 08 01 00 10 01 0C 11 DF 51 00 00 00 00 00 74 74  GMAD...........?Q.....tt
+		0018h  74 5F 6D 69 6E 65 63 72 61 66 74 5F 62 35 00 4E 6F 20 63 72 65 64 69 74  t_minecraft_b5.No credit
+		0030h  20 74 6F 20 6D 65 20 69 20 6A 75 73 74 20 75 70 6C 6F 61 64 65 64 20 61   to me i just uploaded a
+		0048h  6C 6C 20 63 72 65 64 69 74 20 74 6F 20 20 20 20 20 28 3D 43 47 3D 29 20  ll credit to     (=CG=)
+		0060h  46 69 6E 6E 69 65 73 70 2E 20 41 20 54 72 6F 75 62 6C 65 20 49 6E 20 54  Finniesp. A Trouble In T
+		0078h  65 72 72 6F 72 69 73 74 20 54 6F 77 6E 20 4D 43 20 62 65 74 61 20 6D 61  errorist Town MC beta ma
+		0090h  70 2E 20 49 66 20 74 68 65 20 6F 77 6E 65 72 20 77 61 6E 74 73 20 69 74  p. If the owner wants it
+		00A8h  20 6F 66 66 20 74 68 65 20 77 6F 72 6B 73 68 6F 70 20 68 65 20 63 61 6E   off the workshop he can
+		00C0h  20 6A 75 73 74 20 6C 65 61 76 65 20 61 20 63 6F 6D 6D 65 6E 74 2E 0A 20   just leave a comment..
+		00D8h  20 20 20 0A 00 61 75 74 68 6F 72 00 01 00 00 00 01 00 00 00 6D 61 70 73     ..author.........maps
+		00F0h  2F 74 74 74 5F 6D 69 6E 65 63 72 61 66 74 5F 62 35 2E 62 73 70 00 9A 6C  /ttt_minecraft_b5.bsp.?l
+		0108h  53 01 00 00 00 00 9B 50 51 93 00 00 00 00 56 42 53 50 14 00 00 00 04 48  S.....?PQ?....VBSP.....H
+
+	124648402.gma
+		- New(er) gma header format, with json chunk in `description`
+		- `author` field is now always* a constant "Author Name" string
+
+		0000h  47 4D 41 44 03 00 00 00 00 00 00 00 00 E4 78 0B 5D 00 00 00 00 00 4F 72  GMAD.........?x.].....Or
+		0018h  62 69 74 61 6C 20 46 72 69 65 6E 64 73 68 69 70 20 43 61 6E 6E 6F 6E 00  bital Friendship Cannon.
+		0030h  7B 0A 09 22 64 65 73 63 72 69 70 74 69 6F 6E 22 3A 20 22 44 65 73 63 72  {.."description": "Descr
+		0048h  69 70 74 69 6F 6E 22 2C 0A 09 22 74 79 70 65 22 3A 20 22 77 65 61 70 6F  iption",.."type": "weapo
+		0060h  6E 22 2C 0A 09 22 74 61 67 73 22 3A 20 5B 0A 09 09 22 66 75 6E 22 2C 0A  n",.."tags": [..."fun",.
+		0078h  09 09 22 63 61 72 74 6F 6F 6E 22 0A 09 5D 0A 7D 00 41 75 74 68 6F 72 20  .."cartoon"..].}.Author
+		0090h  4E 61 6D 65 00 01 00 00 00 01 00 00 00 6C 75 61 2F 77 65 61 70 6F 6E 73  Name.........lua/weapons
+		00A8h  2F 6F 72 62 69 74 61 6C 5F 66 72 69 65 6E 64 73 68 69 70 5F 63 61 6E 6E  /orbital_friendship_cann
+		00C0h  6F 6E 2E 6C 75 61 00 CB 3C 00 00 00 00 00 00 37 E2 3B 90 02 00 00 00 6D  on.lua.?<......7?;
+
+	*Some gmas have actual strings in `author`. gmad.exe does not support this, so these gmas were modified or produced through alternate means.
+
+	Header layout (all integers little-endian, all strings null-terminated)
+
+		Offset  Size  Field
+		0       4     "GMAD" magic
+		4       1     Format version (currently 3)
+		5       8     SteamID64 of the creator (usually 0)
+		13      8     Creation timestamp, Unix seconds
+		21      ...   Required content: strings terminated by an empty string (format version 2+, always empty in practice)
+		...     ...   Name
+		...     ...   Description (plain text, or a json chunk in new(er) addons)
+		...     ...   Author
+		...     4     Addon version (int32, always 1)
+		...     ...   File table, then file data
+
+	Everything up to the name is at a fixed offset, so the only scanning needed is for the null terminator of each string.
+*/
+
+GmaStatus CGmaReader::ReadMagic(CGmaArena* pArena)
+{
+	_pArena = pArena;
+
+	if (_bMagicVerified)
+		return GMA_S_OK;
+
+	// Every field we want lives within the first c_ullGmaHeaderSizeLimit bytes, so rather than walking the stream byte by byte, we pull in a block and parse everything from memory
+	// Most headers fit in this first read. Long ones get one more read up to the size limit.
+
+	GmaStatus status = _pSource->Seek(0ll, GMA_SEEK_SET, NULL);
+	if (GMA_FAILED(status))
+		return status;
+
+	status = _FillWindow(c_cbGmaHeaderReadChunk);
+	if (GMA_FAILED(status))
+		return status;
+
+	if (_cbWindow < 4ul)
+		return GMA_E_ABORT;
+
+	if (memcmp(_pbWindow, "GMAD", 4) != 0) // First four bytes are "GMAD" in ascii
+		return GMA_E_ABORT;
+
+	_bMagicVerified = true;
+	return GMA_S_OK;
+}
+
+GmaStatus CGmaReader::ReadHeader(GmaHeaderInfo* pInfo, CGmaArena* pArena)
+{
+	memset(pInfo, 0, sizeof(*pInfo));
+
+	// Read the property data we want from the GMA file
+	GmaStatus status = ReadMagic(pArena);
+	if (GMA_SUCCEEDED(status))
+		status = _ReadRelevantGmaData(pInfo);
+	if (GMA_FAILED(status))
+	{
+		memset(pInfo, 0, sizeof(*pInfo));
+		return status;
+	}
+
+	// Clean up the data
+	status = GmaPostProcessHeaderInfo(pInfo);
+	if (GMA_FAILED(status))
+	{
+		memset(pInfo, 0, sizeof(*pInfo));
+		return status;
+	}
+
+	return GMA_S_OK;
+}
+
+// Load the property data we want from the byte source
+GmaStatus CGmaReader::_ReadRelevantGmaData(GmaHeaderInfo* pInfo)
+{
+	GmaStatus status = GMA_E_UNEXPECTED;
+
+
+	// The header window is loaded and the 4 byte magic verified by ReadMagic()
+	uint32_t ulPos = 4ul;
+
+
+	//
+	// Fixed-size fields
+	//
+
+	// Format version, SteamID64 of the creator, and the creation time as 64-bit Unix seconds
+	status = _EnsureWindow(c_cbGmaFixedHeader);
+	if (GMA_FAILED(status))
+		return (status == GMA_E_UNEXPECTED) ? GMA_E_ABORT : status; // Too short to be a GMA at all
+
+	pInfo->bFormatVersion = _pbWindow[c_ulGmaOffsetVersion];
+	pInfo->ullSteamId = GmaReadLE64(_pbWindow + c_ulGmaOffsetSteamId);
+	pInfo->ullTimestamp = GmaReadLE64(_pbWindow + c_ulGmaOffsetTimestamp);
+
+	if (pInfo->bFormatVersion > c_bGmaMaxFormatVersion) // Same rule gmad.exe applies
+		return GMA_E_ABORT;
+
+	ulPos = c_cbGmaFixedHeader;
+
+
+	//
+	// Required content list
+	//
+
+	// Format version 2 added a list of required content names, terminated by an empty string
+	// gmad.exe always writes it empty, but we skip any entries there might be
+	if (pInfo->bFormatVersion > 1)
+	{
+		for (;;)
+		{
+			uint32_t ulFieldEnd;
+			status = _FindGmaHeaderFieldEnd(ulPos, &ulFieldEnd);
+			if (GMA_FAILED(status))
+				return status;
+
+			bool bEmpty = (ulFieldEnd == ulPos);
+			ulPos = ulFieldEnd + 1ul;
+			if (bEmpty)
+				break;
+		}
+	}
+
+
+	//
+	// Text fields
+	//
+
+	// Name, description and author follow each other directly, so all three boundaries are found in a single scan of the window
+	GmaSpan aTextFields[3];
+	status = _FindGmaHeaderFieldSpans(ulPos, aTextFields, 3);
+	if (GMA_FAILED(status))
+		return status;
+
+	const GmaSpan& spanName = aTextFields[0];
+	const GmaSpan& spanDescription = aTextFields[1];
+	const GmaSpan& spanAuthor = aTextFields[2];
+	ulPos = spanAuthor.ulOffset + spanAuthor.cb + 1ul;
+
+
+	//
+	// Parse `name` header field
+	//
+
+	_GetGmaHeaderField(spanName, &pInfo->strName);
+
+
+	//
+	// Parse `description` field
+	//
+
+	status = GmaParseDescriptionField((const char*)_pbWindow + spanDescription.ulOffset, spanDescription.cb, _pArena, _pScratchArena, pInfo); // parsed in place in the window
+	if (GMA_FAILED(status))
+		return status;
+
+
+	//
+	// Parse `author` header field
+	//
+
+	_GetGmaHeaderField(spanAuthor, &pInfo->strAuthor);
+
+
+	//
+	// Addon version
+	//
+
+	status = _EnsureWindow(ulPos + 4ul);
+	if (GMA_FAILED(status))
+		return status;
+
+	pInfo->lAddonVersion = (int32_t)GmaReadLE32(_pbWindow + ulPos);
+	ulPos += 4ul;
+
+	_ulTocStart = ulPos;
+
+
+	// All required data has been read from the GMA file
+	return GMA_S_OK;
+}
+
+// Reads from the byte source until the window holds at least cbWanted bytes, the source ends, or the window is full
+GmaStatus CGmaReader::_FillWindow(uint32_t cbWanted)
+{
+	if (_pbWindow == NULL)
+	{
+		// Sources that already hold everything in memory are parsed in place, so there's nothing to load
+		if (GMA_SUCCEEDED(_pSource->GetView(&_pbView, &_cbView)))
+		{
+			_pbWindow = _pbView;
+			_cbWindow = (_cbView < c_ullGmaHeaderSizeLimit) ? (uint32_t)_cbView : (uint32_t)c_ullGmaHeaderSizeLimit;
+			_bSourceEnded = true; // As far as the window goes. Growing past the limit still aborts.
+			return GMA_S_OK;
+		}
+		_pbView = NULL;
+		_cbView = 0ull;
+
+		// The only other things that go into the arena are json values copied out of the description, which can't be longer than the window itself
+		// So reserving twice the window up front makes the whole parse a single heap allocation
+		GmaStatus status = _pArena->Reserve(2 * (size_t)c_ullGmaHeaderSizeLimit + c_cbGmaArenaSlack);
+		if (GMA_FAILED(status))
+			return status;
+
+		_pbWindowBuf = (uint8_t*)_pArena->Alloc((size_t)c_ullGmaHeaderSizeLimit);
+		if (_pbWindowBuf == NULL)
+			return GMA_E_OUTOFMEMORY;
+		_pbWindow = _pbWindowBuf;
+	}
+
+	if (cbWanted > (uint32_t)c_ullGmaHeaderSizeLimit)
+		cbWanted = (uint32_t)c_ullGmaHeaderSizeLimit;
+
+	while (_cbWindow < cbWanted && !_bSourceEnded)
+	{
+		uint32_t ulBytesRead = 0;
+		GmaStatus status = _pSource->Read(_pbWindowBuf + _cbWindow, cbWanted - _cbWindow, &ulBytesRead);
+		if (GMA_FAILED(status))
+			return status;
+
+		if (ulBytesRead == 0)
+			_bSourceEnded = true;
+
+		_cbWindow += ulBytesRead;
+	}
+
+	return GMA_S_OK;
+}
+
+// Extends the window by another chunk, for when a field runs past the bytes loaded so far
+// Fails if there is nothing more to load: GMA_E_UNEXPECTED at the end of the source, GMA_E_TOOLARGE at the header size limit
+GmaStatus CGmaReader::_GrowWindow()
+{
+	if (_cbWindow >= c_ullGmaHeaderSizeLimit)
+		return GMA_E_TOOLARGE;
+	if (_bSourceEnded)
+		return GMA_E_UNEXPECTED;
+
+	uint32_t cbBefore = _cbWindow;
+	GmaStatus status = _FillWindow(_cbWindow + c_cbGmaHeaderReadChunk);
+	if (GMA_FAILED(status))
+		return status;
+
+	return (_cbWindow > cbBefore) ? GMA_S_OK : GMA_E_UNEXPECTED;
+}
+
+// Ensures the window holds at least cbNeeded bytes
+GmaStatus CGmaReader::_EnsureWindow(uint32_t cbNeeded)
+{
+	while (_cbWindow < cbNeeded)
+	{
+		GmaStatus status = _GrowWindow();
+		if (GMA_FAILED(status))
+			return status;
+	}
+	return GMA_S_OK;
+}
+
+// Finds the null byte that terminates the field starting at ulFieldStartPos, loading more of the header if needed
+GmaStatus CGmaReader::_FindGmaHeaderFieldEnd(uint32_t ulFieldStartPos, uint32_t* pulFieldEnd)
+{
+	for (;;)
+	{
+		if (ulFieldStartPos < _cbWindow)
+		{
+			size_t ulNull = GmaFindNull(_pbWindow + ulFieldStartPos, _cbWindow - ulFieldStartPos);
+			if (ulNull < _cbWindow - ulFieldStartPos)
+			{
+				*pulFieldEnd = ulFieldStartPos + (uint32_t)ulNull;
+				return GMA_S_OK;
+			}
+		}
+
+		GmaStatus status = _GrowWindow();
+		if (GMA_FAILED(status))
+			return status;
+	}
+}
+
+// Finds the boundaries of cSpans consecutive fields starting at ulPos, loading more of the header if needed
+// Span offsets are relative to the start of the window
+GmaStatus CGmaReader::_FindGmaHeaderFieldSpans(uint32_t ulPos, GmaSpan* aSpans, size_t cSpans)
+{
+	for (;;)
+	{
+		if (ulPos < _cbWindow && GmaFindNullTerminatedSpans(_pbWindow + ulPos, _cbWindow - ulPos, aSpans, cSpans) == cSpans)
+		{
+			for (size_t i = 0; i < cSpans; i++)
+				aSpans[i].ulOffset += ulPos;
+			return GMA_S_OK;
+		}
+
+		GmaStatus status = _GrowWindow();
+		if (GMA_FAILED(status))
+			return status;
+	}
+}
+
+// Points a header field at its bytes in the window, without copying
+void CGmaReader::_GetGmaHeaderField(const GmaSpan& span, GmaString* pstrOutField)
+{
+	// Note that the very limited design of the gma header format (using \0 to delineate strings) implies that these strings cannot possibly be in any multi-byte encoding
+	// In all likelihood these are UTF8 strings
+	// They are handed out as-is. Conversion to the consumer's string type (e.g. UTF-16 for the shell) is up to the consumer.
+
+	pstrOutField->psz = (const char*)_pbWindow + span.ulOffset; // the window holds the field's terminator too
+	pstrOutField->cch = span.cb;
+}
+
+// ____________________________________________________________________________________________________
+//
+//     File table
+// ____________________________________________________________________________________________________
+//
+
+/*
+	The file table immediately follows the header. Each entry is:
+
+		4     File number (uint32, 1-based). A file number of 0 ends the table.
+		...   Path (null-terminated)
+		8     Size (int64)
+		4     CRC32 (uint32)
+
+	File data follows the table in the same order, with no padding, so each entry's data offset is the running sum of the sizes before it.
+*/
+
+GmaStatus CGmaReader::ReadToc(IGmaTocVisitor* pVisitor, GmaTocSummary* pSummary)
+{
+	memset(pSummary, 0, sizeof(*pSummary));
+
+	if (_ulTocStart == 0ul)
+		return GMA_E_UNEXPECTED; // ReadHeader() has not succeeded
+
+	if (_pbView != NULL)
+		return _ReadTocFromView(pVisitor, pSummary);
+
+	// The table can be far larger than the header window, so it is streamed through its own buffer
+	// The buffer starts out with whatever part of the table the header window already loaded, then continues reading where the window left off
+	uint8_t* pbBuf = (_pbTocBuffer != NULL) ? _pbTocBuffer : new (std::nothrow) uint8_t[c_cbGmaTocReadChunk];
+	if (pbBuf == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	uint32_t cbBuf = _cbWindow - _ulTocStart;
+	memcpy(pbBuf, _pbWindow + _ulTocStart, cbBuf);
+	uint64_t ullBufBase = _ulTocStart; // Absolute offset of pbBuf[0]
+	uint32_t ulPos = 0ul;
+	bool bSourceEnded = _bSourceEnded;
+
+	GmaStatus status = GMA_S_OK;
+	for (;;)
+	{
+		GmaTocEntry entry;
+		uint32_t cbEntry;
+		if (GmaTryParseTocEntry(pbBuf + ulPos, cbBuf - ulPos, &entry, &cbEntry))
+		{
+			ulPos += cbEntry;
+
+			if (entry.ulIndex == 0ul)
+			{
+				pSummary->ullDataStart = ullBufBase + ulPos;
+				break;
+			}
+
+			status = GmaAddTocEntry(&entry, pSummary);
+			if (GMA_FAILED(status))
+				break;
+
+			if (pVisitor != NULL)
+			{
+				status = pVisitor->OnTocEntry(entry);
+				if (GMA_FAILED(status))
+					break;
+			}
+			continue;
+		}
+
+		// Entry is incomplete. Move the partial entry to the front and read more behind it.
+		if (cbBuf - ulPos >= c_cbGmaMaxTocEntry)
+		{
+			status = GMA_E_TOOLARGE;
+			break;
+		}
+		if (bSourceEnded)
+		{
+			status = GMA_E_UNEXPECTED;
+			break;
+		}
+
+		memmove(pbBuf, pbBuf + ulPos, cbBuf - ulPos);
+		cbBuf -= ulPos;
+		ullBufBase += ulPos;
+		ulPos = 0ul;
+
+		uint32_t ulBytesRead = 0ul;
+		status = _pSource->Read(pbBuf + cbBuf, c_cbGmaTocReadChunk - cbBuf, &ulBytesRead);
+		if (GMA_FAILED(status))
+			break;
+		if (ulBytesRead == 0ul)
+			bSourceEnded = true;
+		cbBuf += ulBytesRead;
+	}
+
+	if (pbBuf != _pbTocBuffer)
+		delete[] pbBuf;
+
+	if (GMA_FAILED(status))
+		memset(pSummary, 0, sizeof(*pSummary));
+
+	return status;
+}
+
+// Walks the file table in place in the source's view, with no reads or copies
+GmaStatus CGmaReader::_ReadTocFromView(IGmaTocVisitor* pVisitor, GmaTocSummary* pSummary)
+{
+	GmaStatus status = GMA_S_OK;
+	uint64_t ullPos = _ulTocStart;
+	for (;;)
+	{
+		uint64_t cbRest = _cbView - ullPos;
+		uint32_t cbAvailable = (cbRest > (uint64_t)UINT32_MAX) ? UINT32_MAX : (uint32_t)cbRest;
+
+		// The same limit on single entries as when streaming, although the whole table is in view
+		GmaTocEntry entry;
+		uint32_t cbEntry;
+		if (!GmaTryParseTocEntry(_pbView + (size_t)ullPos, cbAvailable, &entry, &cbEntry))
+		{
+			status = (cbAvailable >= c_cbGmaMaxTocEntry) ? GMA_E_TOOLARGE : GMA_E_UNEXPECTED; // Already too large, or truncated
+			break;
+		}
+		if (cbEntry > c_cbGmaMaxTocEntry)
+		{
+			status = GMA_E_TOOLARGE;
+			break;
+		}
+		ullPos += cbEntry;
+
+		if (entry.ulIndex == 0ul)
+		{
+			pSummary->ullDataStart = ullPos;
+			break;
+		}
+
+		status = GmaAddTocEntry(&entry, pSummary);
+		if (GMA_FAILED(status))
+			break;
+
+		if (pVisitor != NULL)
+		{
+			status = pVisitor->OnTocEntry(entry);
+			if (GMA_FAILED(status))
+				break;
+		}
+	}
+
+	if (GMA_FAILED(status))
+		memset(pSummary, 0, sizeof(*pSummary));
+
+	return status;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaByteSource.h"
+#include "GmaScan.h"
+#include "GmaArena.h"
+
+const uint64_t c_ullGmaHeaderSizeLimit = 8192ull; // Largest header the reader loads into its window. CGmaDocument hands anything larger to CGmaPushParser.
+// Afaik there is no data in the GMA header that specifies its length, and there is no public specification I can find that specifies a length on the 3 fields it contains
+// The only way to know we've reached the end of the header is to find the null byte that follows and delineates each of the 3 consecutive fields, which could be unnaturally deep in the file
+// So we will abort our reading past this number of bytes as a fallback, for bizarre GMAs and non-GMAs that might otherwise fool us into reading say 3GB of null bytes
+// 8192 is an arbitrary number that should be plenty long for the majority of GMAs. GMAs using the recently added "ignore" field in the json chunk with an absurd number of entries might breach this limit.
+// CGmaPushParser (GmaPushParser.h) has no such limit, only a configurable memory ceiling, for callers that need to handle those.
+
+// Fixed-offset part of the GMA header. See the layout in GmaReader.cpp.
+const uint32_t c_ulGmaOffsetVersion = 4ul;
+const uint32_t c_ulGmaOffsetSteamId = 5ul;
+const uint32_t c_ulGmaOffsetTimestamp = 13ul;
+const uint32_t c_cbGmaFixedHeader = 21ul;
+const uint8_t c_bGmaMaxFormatVersion = 3; // Newest format version gmad.exe writes and accepts
+
+const uint32_t c_cbGmaHeaderReadChunk = 4096ul; // Size of each block read while loading the header window
+
+const size_t c_cbGmaArenaSlack = 256; // Extra arena space reserved per parse, for the tag array and alignment
+
+// A UTF-8 string extracted from the header
+// Plain header fields are views straight into the header window, json values are copies. Either way the string is null-terminated and lives in the arena passed to CGmaReader::ReadHeader().
+struct GmaString
+{
+	const char* psz; // NULL if the field was not present in the GMA
+	uint32_t cch; // excludes the terminator
+};
+
+// The GMA header fields we care about
+// Conversion to the consumer's string type (e.g. UTF-16 for the shell) is left to the consumer, so it only pays for the fields it actually uses
+struct GmaHeaderInfo
+{
+	GmaString strName;
+	GmaString strAuthor;
+	GmaString strDescription;
+	GmaString strType;
+	GmaString* astrTags; // array of strings, one string for each tag
+	uint32_t cTags;
+	bool bUsesJsonChunkInDescription;
+
+	uint8_t bFormatVersion;
+	uint64_t ullSteamId;
+	uint64_t ullTimestamp; // Unix seconds. 0 if the GMA doesn't record it.
+	int32_t lAddonVersion;
+};
+
+const uint32_t c_cbGmaMaxTocEntry = 65536ul; // Largest single file table entry any of the parsers accept, path included. Real ones are a few hundred bytes at most.
+const uint32_t c_cbGmaTocReadChunk = 65536ul; // Size of each block read while streaming the file table. Must be at least c_cbGmaMaxTocEntry, which has to fit in it whole.
+
+// One entry of the GMA file table
+// pszPath points into the reader's buffer and is only valid for the duration of the IGmaTocVisitor::OnTocEntry call
+// (For sources with a view, e.g. a mapped file, it points into the view and stays valid as long as the view does.)
+struct GmaTocEntry
+{
+	uint32_t ulIndex; // 1-based, as written by gmad.exe
+	const char* pszPath;
+	uint32_t cchPath;
+	uint64_t ullSize;
+	uint32_t ulCrc;
+	uint64_t ullDataOffset; // Offset of this file's data relative to the start of the data section. Add GmaTocSummary::ullDataStart for an absolute offset.
+};
+
+// Totals over the whole file table
+struct GmaTocSummary
+{
+	uint32_t cFiles;
+	uint64_t ullTotalSize; // Sum of all file sizes, i.e. the uncompressed payload
+	uint64_t ullLargestSize;
+	uint64_t ullDataStart; // Absolute offset of the first file's data, just past the end of the table
+};
+
+// Receives file table entries as they are parsed
+class IGmaTocVisitor
+{
+public:
+	virtual ~IGmaTocVisitor() {}
+
+	// Return anything but GMA_S_OK to stop the walk. ReadToc then returns that status.
+	virtual GmaStatus OnTocEntry(const GmaTocEntry& entry) = 0;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     GMA header reader
+// ____________________________________________________________________________________________________
+//
+
+class CGmaReader
+{
+public:
+	// pbTocBuffer, if not NULL, is c_cbGmaTocReadChunk bytes for ReadToc() to stream the file table through instead of allocating its own (see CGmaParseContext)
+	// pScratchArena, if not NULL, backs the cJSON tree of a json description instead of an arena of the reader's own
+	explicit CGmaReader(IGmaByteSource* pSource, uint8_t* pbTocBuffer = NULL, CGmaArena* pScratchArena = NULL) : _pSource(pSource), _pbTocBuffer(pbTocBuffer), _pScratchArena(pScratchArena), _pbWindow(NULL), _pbWindowBuf(NULL), _cbWindow(0ul), _bSourceEnded(false), _pbView(NULL), _cbView(0ull), _ulTocStart(0ul), _bMagicVerified(false), _pArena(NULL) {}
+	// Loads the first block of the header and checks that it starts with the GMA magic. Fails with GMA_E_ABORT if it doesn't.
+	// ReadHeader() does this itself if needed, so calling it first is only useful to reject non-GMAs cheaply. The block it reads is reused, not read again, so pass ReadHeader() the same arena.
+	GmaStatus ReadMagic(CGmaArena* pArena);
+
+	// Reads and post-processes the relevant header fields from the start of the byte source
+	// The header window and every extracted string are allocated from pArena, so the result stays valid after the reader is gone and releasing the arena releases all of it. On failure, pInfo is left zeroed.
+	// For sources with a view, the plain header fields point into the view instead, and are only valid as long as it is.
+	GmaStatus ReadHeader(GmaHeaderInfo* pInfo, CGmaArena* pArena);
+
+	// Streams the file table that follows the header, without reading any file data
+	// Must be called after a successful ReadHeader(), and at most once. pVisitor may be NULL if only the summary is wanted.
+	// Fails with GMA_E_TOOLARGE for an entry over c_cbGmaMaxTocEntry, and GMA_E_UNEXPECTED if the table is truncated or otherwise corrupt.
+	GmaStatus ReadToc(IGmaTocVisitor* pVisitor, GmaTocSummary* pSummary);
+
+private:
+	IGmaByteSource* _pSource;
+	uint8_t* _pbTocBuffer; // The caller's, or NULL
+	CGmaArena* _pScratchArena; // The caller's, or NULL
+
+	// Header window: the first bytes of the source, loaded in large blocks and parsed in place
+	// Allocated from the arena, since the extracted strings point into it. Sources with a view skip the copy and the window is simply the start of the view.
+	const uint8_t* _pbWindow;
+	uint8_t* _pbWindowBuf; // _pbWindow, when it's ours to load
+	uint32_t _cbWindow; // bytes loaded so far
+	bool _bSourceEnded;
+
+	// The whole source, if it offers a view (see IGmaByteSource::GetView)
+	const uint8_t* _pbView;
+	uint64_t _cbView;
+
+	uint32_t _ulTocStart; // Window offset just past the header, where the file table begins. 0 until ReadHeader() succeeds.
+	bool _bMagicVerified;
+
+	CGmaArena* _pArena; // Backs the window and everything ReadHeader() extracts
+
+	GmaStatus _FillWindow(uint32_t cbWanted);
+	GmaStatus _GrowWindow();
+	GmaStatus _EnsureWindow(uint32_t cbNeeded);
+	GmaStatus _FindGmaHeaderFieldEnd(uint32_t ulFieldStartPos, uint32_t* pulFieldEnd);
+
+	GmaStatus _ReadRelevantGmaData(GmaHeaderInfo* pInfo);
+	GmaStatus _FindGmaHeaderFieldSpans(uint32_t ulPos, GmaSpan* aSpans, size_t cSpans);
+	GmaStatus _ReadTocFromView(IGmaTocVisitor* pVisitor, GmaTocSummary* pSummary);
+	void _GetGmaHeaderField(const GmaSpan& span, GmaString* pstrOutField);
+};
@@ -0,0 +1,389 @@
+#include "GmaScan.h"
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GMA_SCAN_X86
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// AVX2 intrinsics need VS2013+ on MSVC. GCC and Clang build the AVX2 path per-function, so the rest of the core stays baseline x86.
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+#define GMA_SCAN_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GMA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GMA_TARGET_AVX2
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__i386__)
+#define GMA_TARGET_SSE2 __attribute__((target("sse2"))) // not baseline on 32-bit x86
+#else
+#define GMA_TARGET_SSE2
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Helpers
+// ____________________________________________________________________________________________________
+//
+
+#ifdef GMA_SCAN_X86
+
+static inline uint32_t _CountTrailingZeros(uint32_t ulMask) // ulMask must be nonzero
+{
+#if defined(_MSC_VER)
+	unsigned long ulIndex;
+	_BitScanForward(&ulIndex, ulMask);
+	return ulIndex;
+#else
+	return (uint32_t)__builtin_ctz(ulMask);
+#endif
+}
+
+// Emits spans for every zero bit in ulMask, where bit i stands for byte ulBlockOffset + i
+// Returns false once cMaxSpans spans have been written
+static inline bool _EmitSpans(uint32_t ulMask, uint32_t ulBlockOffset, GmaSpan* aSpans, size_t cMaxSpans, size_t* pcSpans, uint32_t* pulFieldStart)
+{
+	while (ulMask != 0)
+	{
+		uint32_t ulNull = ulBlockOffset + _CountTrailingZeros(ulMask);
+		aSpans[*pcSpans].ulOffset = *pulFieldStart;
+		aSpans[*pcSpans].cb = ulNull - *pulFieldStart;
+		*pulFieldStart = ulNull + 1ul;
+		if (++*pcSpans == cMaxSpans)
+			return false;
+		ulMask &= ulMask - 1; // clear lowest set bit
+	}
+	return true;
+}
+
+#endif
+
+// Finishes a span search byte by byte from ulPos
+static size_t _FindNullTerminatedSpansTail(const uint8_t* pb, size_t cb, size_t ulPos, GmaSpan* aSpans, size_t cMaxSpans, size_t cSpans, uint32_t ulFieldStart)
+{
+	for (; ulPos < cb && cSpans < cMaxSpans; ulPos++)
+	{
+		if (pb[ulPos] == 0)
+		{
+			aSpans[cSpans].ulOffset = ulFieldStart;
+			aSpans[cSpans].cb = (uint32_t)ulPos - ulFieldStart;
+			ulFieldStart = (uint32_t)ulPos + 1ul;
+			cSpans++;
+		}
+	}
+	return cSpans;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Scalar
+// ____________________________________________________________________________________________________
+//
+
+static size_t _FindNullScalar(const uint8_t* pb, size_t cb)
+{
+	const uint8_t* pbNull = (const uint8_t*)memchr(pb, 0, cb);
+	return (pbNull != NULL) ? (size_t)(pbNull - pb) : cb;
+}
+
+static size_t _FindNullTerminatedSpansScalar(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	return _FindNullTerminatedSpansTail(pb, cb, 0, aSpans, cMaxSpans, 0, 0ul);
+}
+
+
+#ifdef GMA_SCAN_X86
+
+// ____________________________________________________________________________________________________
+//
+//     SSE2
+// ____________________________________________________________________________________________________
+//
+
+GMA_TARGET_SSE2 static size_t _FindNullSse2(const uint8_t* pb, size_t cb)
+{
+	const __m128i vZero = _mm_setzero_si128();
+
+	size_t ulPos = 0;
+	if (cb >= 16)
+	{
+		// Most fields end within the first block, so it's checked on its own
+		uint32_t ulMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)pb), vZero));
+		if (ulMask != 0)
+			return _CountTrailingZeros(ulMask);
+		ulPos = 16;
+
+		// Long runs are checked four blocks to a branch
+		for (; ulPos + 64 <= cb; ulPos += 64)
+		{
+			// A zero anywhere makes the bytewise minimum zero, so one compare covers all four
+			__m128i v0 = _mm_loadu_si128((const __m128i*)(pb + ulPos));
+			__m128i v1 = _mm_loadu_si128((const __m128i*)(pb + ulPos + 16));
+			__m128i v2 = _mm_loadu_si128((const __m128i*)(pb + ulPos + 32));
+			__m128i v3 = _mm_loadu_si128((const __m128i*)(pb + ulPos + 48));
+			__m128i vMin = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(vMin, vZero)) != 0)
+				break; // The loop below finds which block
+		}
+	}
+
+	for (; ulPos + 16 <= cb; ulPos += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pb + ulPos));
+		uint32_t ulMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vZero));
+		if (ulMask != 0)
+			return ulPos + _CountTrailingZeros(ulMask);
+	}
+
+	for (; ulPos < cb; ulPos++)
+	{
+		if (pb[ulPos] == 0)
+			return ulPos;
+	}
+	return cb;
+}
+
+GMA_TARGET_SSE2 static size_t _FindNullTerminatedSpansSse2(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	const __m128i vZero = _mm_setzero_si128();
+
+	size_t cSpans = 0;
+	uint32_t ulFieldStart = 0ul;
+	if (cMaxSpans == 0)
+		return 0;
+
+	size_t ulPos = 0;
+	for (; ulPos + 16 <= cb; ulPos += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pb + ulPos));
+		uint32_t ulMask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, vZero));
+		if (!_EmitSpans(ulMask, (uint32_t)ulPos, aSpans, cMaxSpans, &cSpans, &ulFieldStart))
+			return cSpans;
+	}
+
+	return _FindNullTerminatedSpansTail(pb, cb, ulPos, aSpans, cMaxSpans, cSpans, ulFieldStart);
+}
+
+#endif
+
+
+#ifdef GMA_SCAN_HAVE_AVX2
+
+// ____________________________________________________________________________________________________
+//
+//     AVX2
+// ____________________________________________________________________________________________________
+//
+
+GMA_TARGET_AVX2 static size_t _FindNullAvx2(const uint8_t* pb, size_t cb)
+{
+	const __m256i vZero = _mm256_setzero_si256();
+
+	size_t ulPos = 0;
+	if (cb >= 32)
+	{
+		// Same shape as the SSE2 scan: the first block alone, then four to a branch
+		uint32_t ulMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)pb), vZero));
+		if (ulMask != 0)
+			return _CountTrailingZeros(ulMask);
+		ulPos = 32;
+
+		for (; ulPos + 128 <= cb; ulPos += 128)
+		{
+			// A zero anywhere makes the bytewise minimum zero, so one compare covers all four
+			__m256i v0 = _mm256_loadu_si256((const __m256i*)(pb + ulPos));
+			__m256i v1 = _mm256_loadu_si256((const __m256i*)(pb + ulPos + 32));
+			__m256i v2 = _mm256_loadu_si256((const __m256i*)(pb + ulPos + 64));
+			__m256i v3 = _mm256_loadu_si256((const __m256i*)(pb + ulPos + 96));
+			__m256i vMin = _mm256_min_epu8(_mm256_min_epu8(v0, v1), _mm256_min_epu8(v2, v3));
+			if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(vMin, vZero)) != 0)
+				break;
+		}
+	}
+
+	for (; ulPos + 32 <= cb; ulPos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pb + ulPos));
+		uint32_t ulMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vZero));
+		if (ulMask != 0)
+			return ulPos + _CountTrailingZeros(ulMask);
+	}
+
+	return ulPos + _FindNullSse2(pb + ulPos, cb - ulPos);
+}
+
+GMA_TARGET_AVX2 static size_t _FindNullTerminatedSpansAvx2(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	const __m256i vZero = _mm256_setzero_si256();
+
+	size_t cSpans = 0;
+	uint32_t ulFieldStart = 0ul;
+	if (cMaxSpans == 0)
+		return 0;
+
+	size_t ulPos = 0;
+	for (; ulPos + 32 <= cb; ulPos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pb + ulPos));
+		uint32_t ulMask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vZero));
+		if (!_EmitSpans(ulMask, (uint32_t)ulPos, aSpans, cMaxSpans, &cSpans, &ulFieldStart))
+			return cSpans;
+	}
+
+	return _FindNullTerminatedSpansTail(pb, cb, ulPos, aSpans, cMaxSpans, cSpans, ulFieldStart);
+}
+
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Dispatch
+// ____________________________________________________________________________________________________
+//
+
+typedef size_t (*PFNFINDNULL)(const uint8_t* pb, size_t cb);
+typedef size_t (*PFNFINDNULLSPANS)(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans);
+
+bool GmaIsScanImplSupported(GmaScanImpl impl)
+{
+	switch (impl)
+	{
+	case GMA_SCAN_SCALAR:
+		return true;
+
+#ifdef GMA_SCAN_X86
+	case GMA_SCAN_SSE2:
+#if defined(_M_X64) || defined(__x86_64__)
+		return true; // baseline on x64
+#elif defined(_MSC_VER)
+		{
+			int aiInfo[4];
+			__cpuid(aiInfo, 1);
+			return (aiInfo[3] & (1 << 26)) != 0;
+		}
+#else
+		return __builtin_cpu_supports("sse2") != 0;
+#endif
+#endif
+
+#ifdef GMA_SCAN_HAVE_AVX2
+	case GMA_SCAN_AVX2:
+#if defined(_MSC_VER)
+		{
+			int aiInfo[4];
+			__cpuid(aiInfo, 1);
+			bool bOsSavesYmm = (aiInfo[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6; // OSXSAVE, and the OS preserves XMM and YMM state
+			if (!bOsSavesYmm)
+				return false;
+			__cpuidex(aiInfo, 7, 0);
+			return (aiInfo[1] & (1 << 5)) != 0;
+		}
+#else
+		return __builtin_cpu_supports("avx2") != 0;
+#endif
+#endif
+
+	default:
+		return false;
+	}
+}
+
+static GmaScanImpl _SelectBestScanImpl()
+{
+	if (GmaIsScanImplSupported(GMA_SCAN_AVX2))
+		return GMA_SCAN_AVX2;
+	if (GmaIsScanImplSupported(GMA_SCAN_SSE2))
+		return GMA_SCAN_SSE2;
+	return GMA_SCAN_SCALAR;
+}
+
+// One implementation's entry points, indexed by GmaScanImpl
+// Builds without an implementation get the scalar one in its slot, which GmaIsScanImplSupported() keeps from ever being selected.
+struct GmaScanDispatch
+{
+	GmaScanImpl impl;
+	PFNFINDNULL pfnFindNull;
+	PFNFINDNULLSPANS pfnFindNullSpans;
+};
+
+static const GmaScanDispatch c_aScanDispatch[] =
+{
+	{ GMA_SCAN_SCALAR, _FindNullScalar, _FindNullTerminatedSpansScalar },
+#ifdef GMA_SCAN_X86
+	{ GMA_SCAN_SSE2, _FindNullSse2, _FindNullTerminatedSpansSse2 },
+#else
+	{ GMA_SCAN_SCALAR, _FindNullScalar, _FindNullTerminatedSpansScalar },
+#endif
+#ifdef GMA_SCAN_HAVE_AVX2
+	{ GMA_SCAN_AVX2, _FindNullAvx2, _FindNullTerminatedSpansAvx2 },
+#else
+	{ GMA_SCAN_SCALAR, _FindNullScalar, _FindNullTerminatedSpansScalar },
+#endif
+};
+
+// NULL until the first scan picks the best implementation the CPU supports
+// Resolved on first use rather than by a static initializer, so nothing runs at module load (under the loader lock, in a DLL) and callers that run before static initialization still get one.
+// Function-local statics aren't thread-safe with the v100 toolset, so this is a single pointer instead. Threads racing on the first scan all store the same value, and the table it points to is constant.
+static const GmaScanDispatch* s_pScanDispatch = NULL;
+
+static const GmaScanDispatch* _LoadScanDispatch()
+{
+#if defined(_MSC_VER)
+	return *(const GmaScanDispatch* volatile*)&s_pScanDispatch;
+#else
+	return __atomic_load_n(&s_pScanDispatch, __ATOMIC_RELAXED);
+#endif
+}
+
+static void _StoreScanDispatch(const GmaScanDispatch* pDispatch)
+{
+#if defined(_MSC_VER)
+	*(const GmaScanDispatch* volatile*)&s_pScanDispatch = pDispatch;
+#else
+	__atomic_store_n(&s_pScanDispatch, pDispatch, __ATOMIC_RELAXED);
+#endif
+}
+
+static const GmaScanDispatch* _GetScanDispatch()
+{
+	const GmaScanDispatch* pDispatch = _LoadScanDispatch();
+	if (pDispatch == NULL)
+	{
+		pDispatch = &c_aScanDispatch[_SelectBestScanImpl()];
+		_StoreScanDispatch(pDispatch);
+	}
+	return pDispatch;
+}
+
+GmaScanImpl GmaGetScanImpl()
+{
+	return _GetScanDispatch()->impl;
+}
+
+GmaStatus GmaSetScanImpl(GmaScanImpl impl)
+{
+	if (!GmaIsScanImplSupported(impl))
+		return GMA_E_NOTIMPL;
+
+	_StoreScanDispatch(&c_aScanDispatch[impl]);
+	return GMA_S_OK;
+}
+
+size_t GmaFindNull(const uint8_t* pb, size_t cb)
+{
+	return _GetScanDispatch()->pfnFindNull(pb, cb);
+}
+
+size_t GmaFindNullTerminatedSpans(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	return _GetScanDispatch()->pfnFindNullSpans(pb, cb, aSpans, cMaxSpans);
+}
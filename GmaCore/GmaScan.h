@@ -0,0 +1,34 @@
+#pragma once
+
+#include "GmaStatus.h"
+
+// Delimiter scanning for GMA header fields and file table paths
+// All GMA strings are null-terminated, so finding field boundaries is a pure search for zero bytes. These routines do that search 16 (SSE2) or 32 (AVX2) bytes at a time, picking the best implementation the CPU supports the first time they're called.
+
+enum GmaScanImpl
+{
+	GMA_SCAN_SCALAR = 0,
+	GMA_SCAN_SSE2 = 1,
+	GMA_SCAN_AVX2 = 2,
+};
+
+// A null-terminated field within a buffer. cb excludes the terminator, which sits at ulOffset + cb.
+struct GmaSpan
+{
+	uint32_t ulOffset;
+	uint32_t cb;
+};
+
+// Returns the offset of the first zero byte in pb[0..cb), or cb if there is none
+size_t GmaFindNull(const uint8_t* pb, size_t cb);
+
+// Splits pb[0..cb) into consecutive null-terminated fields in a single pass
+// Stops after cMaxSpans fields, or at the last terminator in the buffer. Trailing bytes without a terminator are not reported.
+// Returns the number of spans written. Buffers must be under 4 GB.
+size_t GmaFindNullTerminatedSpans(const uint8_t* pb, size_t cb, GmaSpan* aSpans, size_t cMaxSpans);
+
+// Implementation in use, and an override for benchmarking and testing
+// GmaSetScanImpl() fails with GMA_E_NOTIMPL if the CPU or build doesn't support the requested implementation. Not thread-safe; call before any scanning starts.
+GmaScanImpl GmaGetScanImpl();
+GmaStatus GmaSetScanImpl(GmaScanImpl impl);
+bool GmaIsScanImplSupported(GmaScanImpl impl);
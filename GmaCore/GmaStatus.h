@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Result codes for the GMA core
+// These intentionally mirror the HRESULTs that the shell property handler has always returned for the same conditions, so the handler can translate them 1:1
+enum GmaStatus
+{
+	GMA_S_OK = 0,
+	GMA_E_UNEXPECTED,  // Data ended early or was otherwise malformed
+	GMA_E_ABORT,       // Not a GMA file
+	GMA_E_OUTOFMEMORY,
+	GMA_E_ARITHMETIC,  // A size or offset did not fit in the target type
+	GMA_E_IO,          // The byte source failed. Byte sources may keep a more detailed native error code for their owner.
+	GMA_E_NOTIMPL,     // The byte source does not support the requested operation (e.g. Seek on a pipe)
+	GMA_E_TOOLARGE,    // The header, or a single file table entry, breached its size limit
+};
+
+#define GMA_SUCCEEDED(s) ((s) == GMA_S_OK)
+#define GMA_FAILED(s) ((s) != GMA_S_OK)
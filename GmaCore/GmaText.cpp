@@ -0,0 +1,956 @@
+#include "GmaText.h"
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GMA_TEXT_X86
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+// Same requirements as the AVX2 scanner in GmaScan.cpp. The AVX2 path also uses the SSSE3/SSE4.1 instructions every AVX2 CPU has.
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1800)
+#define GMA_TEXT_HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define GMA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GMA_TARGET_AVX2
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__i386__)
+#define GMA_TARGET_SSE2 __attribute__((target("sse2"))) // not baseline on 32-bit x86
+#else
+#define GMA_TARGET_SSE2
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Scalar
+// ____________________________________________________________________________________________________
+//
+
+const uint32_t c_ulInvalidSequence = 0xFFFFFFFFul;
+
+// Matches the sequence starting at the non-ASCII byte pb[ulPos], and returns the position just past it
+// An invalid sequence ends at the first byte that can't continue it, and *pulCodePoint is then c_ulInvalidSequence. That maximal invalid subpart is what gets replaced with a single U+FFFD (Unicode's recommended practice, also followed by MultiByteToWideChar).
+static inline size_t _MatchSequence(const uint8_t* pb, size_t cb, size_t ulPos, uint32_t* pulCodePoint)
+{
+	uint8_t bLead = pb[ulPos];
+	uint32_t cbSequence = 0;
+	uint32_t ulCodePoint = 0;
+	uint8_t bMin = 0x80; // Range of the first continuation byte, which is narrowed for leads that could otherwise start an overlong form, a surrogate or a code point past U+10FFFF
+	uint8_t bMax = 0xBF;
+
+	if (bLead >= 0xC2 && bLead <= 0xDF)
+	{
+		cbSequence = 2;
+		ulCodePoint = bLead & 0x1F;
+	}
+	else if (bLead >= 0xE0 && bLead <= 0xEF)
+	{
+		cbSequence = 3;
+		ulCodePoint = bLead & 0x0F;
+		if (bLead == 0xE0)
+			bMin = 0xA0;
+		else if (bLead == 0xED)
+			bMax = 0x9F;
+	}
+	else if (bLead >= 0xF0 && bLead <= 0xF4)
+	{
+		cbSequence = 4;
+		ulCodePoint = bLead & 0x07;
+		if (bLead == 0xF0)
+			bMin = 0x90;
+		else if (bLead == 0xF4)
+			bMax = 0x8F;
+	}
+
+	size_t ulEnd = ulPos + 1;
+	if (cbSequence == 0)
+		ulCodePoint = c_ulInvalidSequence;
+	for (uint32_t i = 1; i < cbSequence; i++)
+	{
+		if (ulEnd >= cb || pb[ulEnd] < bMin || pb[ulEnd] > bMax)
+		{
+			ulCodePoint = c_ulInvalidSequence;
+			break;
+		}
+		ulCodePoint = (ulCodePoint << 6) | (pb[ulEnd] & 0x3F);
+		ulEnd++;
+		bMin = 0x80;
+		bMax = 0xBF;
+	}
+
+	*pulCodePoint = ulCodePoint;
+	return ulEnd;
+}
+
+// Decodes the sequence starting at the non-ASCII byte pb[ulPos], and returns the position just past it
+static inline size_t _DecodeSequence(const uint8_t* pb, size_t cb, size_t ulPos, GmaWChar* pwchOut, size_t* pulOut, bool* pbValid)
+{
+	uint32_t ulCodePoint;
+	size_t ulEnd = _MatchSequence(pb, cb, ulPos, &ulCodePoint);
+
+	if (ulCodePoint == c_ulInvalidSequence)
+	{
+		pwchOut[(*pulOut)++] = c_wchGmaReplacement;
+		*pbValid = false;
+	}
+	else if (ulCodePoint >= 0x10000)
+	{
+		// Surrogate pair. The 4 input bytes cover both units, so output still doesn't get ahead of input.
+		ulCodePoint -= 0x10000;
+		pwchOut[(*pulOut)++] = (GmaWChar)(0xD800 + (ulCodePoint >> 10));
+		pwchOut[(*pulOut)++] = (GmaWChar)(0xDC00 + (ulCodePoint & 0x3FF));
+	}
+	else
+	{
+		pwchOut[(*pulOut)++] = (GmaWChar)ulCodePoint;
+	}
+	return ulEnd;
+}
+
+// Decodes sequences from the non-ASCII byte pb[ulPos] up to the next ASCII byte, and returns the position of that byte
+static inline size_t _DecodeNonAsciiRun(const uint8_t* pb, size_t cb, size_t ulPos, GmaWChar* pwchOut, size_t* pulOut, bool* pbValid)
+{
+	do
+	{
+		ulPos = _DecodeSequence(pb, cb, ulPos, pwchOut, pulOut, pbValid);
+	} while (ulPos < cb && pb[ulPos] >= 0x80);
+	return ulPos;
+}
+
+// Finishes a conversion byte by byte from ulPos, and returns the total number of units written
+static size_t _Utf8ToUtf16Tail(const uint8_t* pb, size_t cb, size_t ulPos, GmaWChar* pwchOut, size_t ulOut, bool* pbValid)
+{
+	while (ulPos < cb)
+	{
+		if (pb[ulPos] < 0x80)
+			pwchOut[ulOut++] = pb[ulPos++];
+		else
+			ulPos = _DecodeNonAsciiRun(pb, cb, ulPos, pwchOut, &ulOut, pbValid);
+	}
+	return ulOut;
+}
+
+static size_t _Utf8ToUtf16Scalar(const uint8_t* pb, size_t cb, GmaWChar* pwchOut, bool* pbValid)
+{
+	return _Utf8ToUtf16Tail(pb, cb, 0, pwchOut, 0, pbValid);
+}
+
+// Finishes a validation byte by byte from ulPos
+static bool _IsValidUtf8Tail(const uint8_t* pb, size_t cb, size_t ulPos)
+{
+	while (ulPos < cb)
+	{
+		if (pb[ulPos] < 0x80)
+		{
+			ulPos++;
+			continue;
+		}
+
+		uint32_t ulCodePoint;
+		ulPos = _MatchSequence(pb, cb, ulPos, &ulCodePoint);
+		if (ulCodePoint == c_ulInvalidSequence)
+			return false;
+	}
+	return true;
+}
+
+static bool _IsValidUtf8Scalar(const uint8_t* pb, size_t cb)
+{
+	return _IsValidUtf8Tail(pb, cb, 0);
+}
+
+
+#ifdef GMA_TEXT_X86
+
+// ____________________________________________________________________________________________________
+//
+//     SSE2
+// ____________________________________________________________________________________________________
+//
+
+static inline uint32_t _CountTrailingZeros(uint32_t ulMask) // ulMask must be nonzero
+{
+#if defined(_MSC_VER)
+	unsigned long ulIndex;
+	_BitScanForward(&ulIndex, ulMask);
+	return ulIndex;
+#else
+	return (uint32_t)__builtin_ctz(ulMask);
+#endif
+}
+
+// Every block is widened and stored in full, even when only its ASCII prefix is kept
+// That's always in bounds: output never gets ahead of input, so there's room for a unit per remaining input byte.
+GMA_TARGET_SSE2 static size_t _Utf8ToUtf16Sse2(const uint8_t* pb, size_t cb, GmaWChar* pwchOut, bool* pbValid)
+{
+	const __m128i vZero = _mm_setzero_si128();
+
+	size_t ulPos = 0;
+	size_t ulOut = 0;
+	while (ulPos + 16 <= cb)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(pb + ulPos));
+		uint32_t ulNonAscii = (uint32_t)_mm_movemask_epi8(v);
+		_mm_storeu_si128((__m128i*)(pwchOut + ulOut), _mm_unpacklo_epi8(v, vZero));
+		_mm_storeu_si128((__m128i*)(pwchOut + ulOut + 8), _mm_unpackhi_epi8(v, vZero));
+		if (ulNonAscii == 0)
+		{
+			ulPos += 16;
+			ulOut += 16;
+			continue;
+		}
+
+		uint32_t cAscii = _CountTrailingZeros(ulNonAscii);
+		ulPos += cAscii;
+		ulOut += cAscii;
+		ulPos = _DecodeNonAsciiRun(pb, cb, ulPos, pwchOut, &ulOut, pbValid);
+	}
+
+	return _Utf8ToUtf16Tail(pb, cb, ulPos, pwchOut, ulOut, pbValid);
+}
+
+// Skips ASCII 16 bytes at a time, and checks the sequences in between one by one
+GMA_TARGET_SSE2 static bool _IsValidUtf8Sse2(const uint8_t* pb, size_t cb)
+{
+	size_t ulPos = 0;
+	while (ulPos + 16 <= cb)
+	{
+		uint32_t ulNonAscii = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(pb + ulPos)));
+		if (ulNonAscii == 0)
+		{
+			ulPos += 16;
+			continue;
+		}
+
+		ulPos += _CountTrailingZeros(ulNonAscii);
+		do
+		{
+			uint32_t ulCodePoint;
+			ulPos = _MatchSequence(pb, cb, ulPos, &ulCodePoint);
+			if (ulCodePoint == c_ulInvalidSequence)
+				return false;
+		} while (ulPos < cb && pb[ulPos] >= 0x80);
+	}
+
+	return _IsValidUtf8Tail(pb, cb, ulPos);
+}
+
+#endif
+
+
+#ifdef GMA_TEXT_HAVE_AVX2
+
+// ____________________________________________________________________________________________________
+//
+//     AVX2
+// ____________________________________________________________________________________________________
+//
+
+// Shuffles that pack the 16-bit lanes selected by an 8-bit mask to the front of a vector (0x80 zero-fills the rest), and how many lanes each keeps
+// Constant rather than filled in at startup, so the AVX2 path needs no initialization before its first use.
+static const uint8_t c_aabCompactLanes[256][16] =
+{
+	{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x00
+	{ 0x00, 0x01, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x01
+	{ 0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x02
+	{ 0x00, 0x01, 0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x03
+	{ 0x04, 0x05, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x04
+	{ 0x00, 0x01, 0x04, 0x05, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x05
+	{ 0x02, 0x03, 0x04, 0x05, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x06
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x07
+	{ 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x08
+	{ 0x00, 0x01, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x09
+	{ 0x02, 0x03, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0B
+	{ 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x0F
+	{ 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x10
+	{ 0x00, 0x01, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x11
+	{ 0x02, 0x03, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x12
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x13
+	{ 0x04, 0x05, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x14
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x15
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x16
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x17
+	{ 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x18
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x19
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1B
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x1F
+	{ 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x20
+	{ 0x00, 0x01, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x21
+	{ 0x02, 0x03, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x22
+	{ 0x00, 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x23
+	{ 0x04, 0x05, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x24
+	{ 0x00, 0x01, 0x04, 0x05, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x25
+	{ 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x26
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x27
+	{ 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x28
+	{ 0x00, 0x01, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x29
+	{ 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2B
+	{ 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x2F
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x30
+	{ 0x00, 0x01, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x31
+	{ 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x32
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x33
+	{ 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x34
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x35
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x36
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x37
+	{ 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x38
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x39
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x3A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x3B
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x3C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x3D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x3E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80 }, // 0x3F
+	{ 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x40
+	{ 0x00, 0x01, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x41
+	{ 0x02, 0x03, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x42
+	{ 0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x43
+	{ 0x04, 0x05, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x44
+	{ 0x00, 0x01, 0x04, 0x05, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x45
+	{ 0x02, 0x03, 0x04, 0x05, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x46
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x47
+	{ 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x48
+	{ 0x00, 0x01, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x49
+	{ 0x02, 0x03, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4B
+	{ 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x4F
+	{ 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x50
+	{ 0x00, 0x01, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x51
+	{ 0x02, 0x03, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x52
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x53
+	{ 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x54
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x55
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x56
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x57
+	{ 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x58
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x59
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x5A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x5B
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x5C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x5D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x5E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x5F
+	{ 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x60
+	{ 0x00, 0x01, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x61
+	{ 0x02, 0x03, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x62
+	{ 0x00, 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x63
+	{ 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x64
+	{ 0x00, 0x01, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x65
+	{ 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x66
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x67
+	{ 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x68
+	{ 0x00, 0x01, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x69
+	{ 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x6A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x6B
+	{ 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x6C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x6D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x6E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x6F
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x70
+	{ 0x00, 0x01, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x71
+	{ 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x72
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x73
+	{ 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x74
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x75
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x76
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x77
+	{ 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x78
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x79
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x7A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x7B
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x7C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x7D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80, 0x80, 0x80 }, // 0x7E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x80, 0x80 }, // 0x7F
+	{ 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x80
+	{ 0x00, 0x01, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x81
+	{ 0x02, 0x03, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x82
+	{ 0x00, 0x01, 0x02, 0x03, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x83
+	{ 0x04, 0x05, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x84
+	{ 0x00, 0x01, 0x04, 0x05, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x85
+	{ 0x02, 0x03, 0x04, 0x05, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x86
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x87
+	{ 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x88
+	{ 0x00, 0x01, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x89
+	{ 0x02, 0x03, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8B
+	{ 0x04, 0x05, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x8F
+	{ 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x90
+	{ 0x00, 0x01, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x91
+	{ 0x02, 0x03, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x92
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x93
+	{ 0x04, 0x05, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x94
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x95
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x96
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x97
+	{ 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x98
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x99
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x9A
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x9B
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x9C
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x9D
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0x9E
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0x9F
+	{ 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA0
+	{ 0x00, 0x01, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA1
+	{ 0x02, 0x03, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA2
+	{ 0x00, 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA3
+	{ 0x04, 0x05, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA4
+	{ 0x00, 0x01, 0x04, 0x05, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA5
+	{ 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA7
+	{ 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA8
+	{ 0x00, 0x01, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xA9
+	{ 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xAA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xAB
+	{ 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xAC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xAD
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xAE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xAF
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB0
+	{ 0x00, 0x01, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB1
+	{ 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB2
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB3
+	{ 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB4
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB5
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xB7
+	{ 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB8
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xB9
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xBA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xBB
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xBC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xBD
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xBE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0E, 0x0F, 0x80, 0x80 }, // 0xBF
+	{ 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC0
+	{ 0x00, 0x01, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC1
+	{ 0x02, 0x03, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC2
+	{ 0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC3
+	{ 0x04, 0x05, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC4
+	{ 0x00, 0x01, 0x04, 0x05, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC5
+	{ 0x02, 0x03, 0x04, 0x05, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC7
+	{ 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC8
+	{ 0x00, 0x01, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xC9
+	{ 0x02, 0x03, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xCA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xCB
+	{ 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xCC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xCD
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xCE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xCF
+	{ 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD0
+	{ 0x00, 0x01, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD1
+	{ 0x02, 0x03, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD2
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD3
+	{ 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD4
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD5
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xD7
+	{ 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD8
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xD9
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xDA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xDB
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xDC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xDD
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xDE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xDF
+	{ 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE0
+	{ 0x00, 0x01, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE1
+	{ 0x02, 0x03, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE2
+	{ 0x00, 0x01, 0x02, 0x03, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE3
+	{ 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE4
+	{ 0x00, 0x01, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE5
+	{ 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xE7
+	{ 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE8
+	{ 0x00, 0x01, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xE9
+	{ 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xEA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xEB
+	{ 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xEC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xED
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xEE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xEF
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xF0
+	{ 0x00, 0x01, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xF1
+	{ 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xF2
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xF3
+	{ 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xF4
+	{ 0x00, 0x01, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xF5
+	{ 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xF6
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xF7
+	{ 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 }, // 0xF8
+	{ 0x00, 0x01, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xF9
+	{ 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xFA
+	{ 0x00, 0x01, 0x02, 0x03, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xFB
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 }, // 0xFC
+	{ 0x00, 0x01, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xFD
+	{ 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80 }, // 0xFE
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F }, // 0xFF
+};
+
+static const uint8_t c_acCompactLanes[256] =
+{
+	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
+	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
+};
+
+// Turns lanes holding a 2-byte lead into the code point it starts with the following byte, leaving the other lanes as they are
+GMA_TARGET_AVX2 static inline __m128i _DecodeTwoByteLanes(__m128i vBytes, __m128i vNextBytes)
+{
+	__m128i vIsLead = _mm_cmpgt_epi16(vBytes, _mm_set1_epi16(0xBF));
+	__m128i vDecoded = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(vBytes, _mm_set1_epi16(0x1F)), 6), _mm_and_si128(vNextBytes, _mm_set1_epi16(0x3F)));
+	return _mm_blendv_epi8(vBytes, vDecoded, vIsLead);
+}
+
+// Decodes the 16 bytes at pb in registers, if they hold nothing but ASCII and valid 2-byte sequences
+// A lead byte in the last position is left for the next block. Returns the number of bytes consumed and stores *pcUnits units, or returns 0 (having written junk) for any other block.
+// Needs room for 16 units at pwchOut.
+GMA_TARGET_AVX2 static uint32_t _DecodeTwoByteBlockAvx2(const uint8_t* pb, GmaWChar* pwchOut, uint32_t* pcUnits)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)pb);
+
+	// Signed compares: continuation bytes 0x80..0xBF are the only ones below (char)0xC0, and leads of longer sequences, 0xE0..0xFF, the only non-ASCII ones above (char)0xDF
+	uint32_t ulNonAscii = (uint32_t)_mm_movemask_epi8(v);
+	uint32_t ulContinuation = (uint32_t)_mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8((char)0xC0)));
+	uint32_t ulLongLead = (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8((char)0xDF))) & ulNonAscii;
+	uint32_t ulOverlongLead = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(v, _mm_set1_epi8((char)0xFE)), _mm_set1_epi8((char)0xC0))); // 0xC0, 0xC1
+	if ((ulLongLead | ulOverlongLead) != 0)
+		return 0;
+
+	uint32_t ulLead = ulNonAscii & ~ulContinuation;
+	uint32_t cbBlock = 16;
+	if ((ulLead & 0x8000u) != 0)
+	{
+		ulLead &= 0x7FFFu;
+		cbBlock = 15;
+	}
+	// Every lead must be followed by exactly one continuation byte, and every continuation byte preceded by a lead
+	if (ulContinuation != (ulLead << 1))
+		return 0;
+
+	const __m128i vZero = _mm_setzero_si128();
+	__m128i vNext = _mm_srli_si128(v, 1);
+	__m128i vLow = _DecodeTwoByteLanes(_mm_unpacklo_epi8(v, vZero), _mm_unpacklo_epi8(vNext, vZero));
+	__m128i vHigh = _DecodeTwoByteLanes(_mm_unpackhi_epi8(v, vZero), _mm_unpackhi_epi8(vNext, vZero));
+
+	// Drop the continuation lanes (and the trailing lead, if any)
+	uint32_t ulKeep = ~ulContinuation & ((1u << cbBlock) - 1u);
+	uint32_t ulKeepLow = ulKeep & 0xFFu;
+	uint32_t ulKeepHigh = ulKeep >> 8;
+	_mm_storeu_si128((__m128i*)pwchOut, _mm_shuffle_epi8(vLow, _mm_loadu_si128((const __m128i*)c_aabCompactLanes[ulKeepLow])));
+	_mm_storeu_si128((__m128i*)(pwchOut + c_acCompactLanes[ulKeepLow]), _mm_shuffle_epi8(vHigh, _mm_loadu_si128((const __m128i*)c_aabCompactLanes[ulKeepHigh])));
+
+	*pcUnits = (uint32_t)c_acCompactLanes[ulKeepLow] + c_acCompactLanes[ulKeepHigh];
+	return cbBlock;
+}
+
+GMA_TARGET_AVX2 static inline void _StoreWidenedAvx2(GmaWChar* pwchOut, __m256i v)
+{
+	_mm256_storeu_si256((__m256i*)pwchOut, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+	_mm256_storeu_si256((__m256i*)(pwchOut + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+}
+
+// Same in-bounds argument for the full-width stores as the SSE2 version
+GMA_TARGET_AVX2 static size_t _Utf8ToUtf16Avx2(const uint8_t* pb, size_t cb, GmaWChar* pwchOut, bool* pbValid)
+{
+	size_t ulPos = 0;
+	size_t ulOut = 0;
+	while (ulPos + 32 <= cb)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pb + ulPos));
+		uint32_t ulNonAscii = (uint32_t)_mm256_movemask_epi8(v);
+		if (ulNonAscii == 0)
+		{
+			_StoreWidenedAvx2(pwchOut + ulOut, v);
+			ulPos += 32;
+			ulOut += 32;
+			continue;
+		}
+
+		uint32_t cUnits;
+		uint32_t cbBlock = _DecodeTwoByteBlockAvx2(pb + ulPos, pwchOut + ulOut, &cUnits);
+		if (cbBlock != 0)
+		{
+			ulPos += cbBlock;
+			ulOut += cUnits;
+			continue;
+		}
+
+		// Longer or invalid sequences: keep the ASCII prefix and decode the rest of the run one sequence at a time
+		_StoreWidenedAvx2(pwchOut + ulOut, v);
+		uint32_t cAscii = _CountTrailingZeros(ulNonAscii);
+		ulPos += cAscii;
+		ulOut += cAscii;
+		ulPos = _DecodeNonAsciiRun(pb, cb, ulPos, pwchOut, &ulOut, pbValid);
+	}
+
+	return ulOut + _Utf8ToUtf16Sse2(pb + ulPos, cb - ulPos, pwchOut + ulOut, pbValid);
+}
+
+// Validation by table lookups, 32 bytes at a time with no branches on the data (Keiser and Lemire, "Validating UTF-8 in less than one instruction per byte")
+// Every error shows up in the first two bytes of a sequence, so three tables indexed by the high and low nibble of each byte and the high nibble of the next give a bitmask of the errors each pair of bytes could be part of; ANDing them leaves the actual ones.
+// The only thing pairs can't see is a 3- or 4-byte sequence that is cut short, or has too many continuation bytes, which is checked against the leads 2 and 3 bytes back.
+const uint8_t c_bUtf8TooShort = 1 << 0; // lead followed by a non-continuation byte
+const uint8_t c_bUtf8TooLong = 1 << 1; // ASCII followed by a continuation byte
+const uint8_t c_bUtf8Overlong3 = 1 << 2; // 11100000 100_____
+const uint8_t c_bUtf8TooLarge = 1 << 3; // 11110100 1001____, 11110100 101_____, 11110101+ 1001____...
+const uint8_t c_bUtf8Surrogate = 1 << 4; // 11101101 101_____
+const uint8_t c_bUtf8Overlong2 = 1 << 5; // 1100000_ 10______
+const uint8_t c_bUtf8TooLarge1000 = 1 << 6; // 11110101+ 1000____
+const uint8_t c_bUtf8Overlong4 = 1 << 6; // 11110000 1000____ (can share a bit, since only the low nibble of the lead tells the two apart)
+const uint8_t c_bUtf8TwoConts = 1 << 7; // continuation followed by a continuation, which is only an error if no 3- or 4-byte lead comes 2 or 3 bytes before
+const uint8_t c_bUtf8Carry = c_bUtf8TooShort | c_bUtf8TooLong | c_bUtf8TwoConts; // errors that don't depend on the low nibble of the first byte
+
+static const uint8_t c_abUtf8Byte1High[16] =
+{
+	// 0_______ ASCII
+	c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong, c_bUtf8TooLong,
+	// 10______ continuation
+	c_bUtf8TwoConts, c_bUtf8TwoConts, c_bUtf8TwoConts, c_bUtf8TwoConts,
+	// 1100____, 1101____ 2-byte lead
+	c_bUtf8TooShort | c_bUtf8Overlong2,
+	c_bUtf8TooShort,
+	// 1110____ 3-byte lead
+	c_bUtf8TooShort | c_bUtf8Overlong3 | c_bUtf8Surrogate,
+	// 1111____ 4-byte lead
+	c_bUtf8TooShort | c_bUtf8TooLarge | c_bUtf8TooLarge1000 | c_bUtf8Overlong4,
+};
+
+static const uint8_t c_abUtf8Byte1Low[16] =
+{
+	c_bUtf8Carry | c_bUtf8Overlong3 | c_bUtf8Overlong2 | c_bUtf8Overlong4, // ____0000
+	c_bUtf8Carry | c_bUtf8Overlong2, // ____0001
+	c_bUtf8Carry, // ____001_
+	c_bUtf8Carry,
+	c_bUtf8Carry | c_bUtf8TooLarge, // ____0100
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000, // ____0101 and up
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000 | c_bUtf8Surrogate, // ____1101
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+	c_bUtf8Carry | c_bUtf8TooLarge | c_bUtf8TooLarge1000,
+};
+
+static const uint8_t c_abUtf8Byte2High[16] =
+{
+	// ________ 0_______ ASCII
+	c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort,
+	// ________ 1000____
+	c_bUtf8TooLong | c_bUtf8Overlong2 | c_bUtf8TwoConts | c_bUtf8Overlong3 | c_bUtf8TooLarge1000 | c_bUtf8Overlong4,
+	// ________ 1001____
+	c_bUtf8TooLong | c_bUtf8Overlong2 | c_bUtf8TwoConts | c_bUtf8Overlong3 | c_bUtf8TooLarge,
+	// ________ 101_____
+	c_bUtf8TooLong | c_bUtf8Overlong2 | c_bUtf8TwoConts | c_bUtf8Surrogate | c_bUtf8TooLarge,
+	c_bUtf8TooLong | c_bUtf8Overlong2 | c_bUtf8TwoConts | c_bUtf8Surrogate | c_bUtf8TooLarge,
+	// ________ 11______ lead
+	c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort, c_bUtf8TooShort,
+};
+
+// Highest byte allowed in each of the last 3 positions of a block without the sequence it starts running into the next block
+static const uint8_t c_abUtf8MaxBlockEnd[32] =
+{
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+GMA_TARGET_AVX2 static inline __m256i _LoadNibbleTableAvx2(const uint8_t* ab16)
+{
+	return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ab16));
+}
+
+// Returns nonzero bytes for any error in the 32-byte block v, given the block before it
+GMA_TARGET_AVX2 static inline __m256i _CheckUtf8BlockAvx2(__m256i v, __m256i vPrev, __m256i vByte1HighTable, __m256i vByte1LowTable, __m256i vByte2HighTable)
+{
+	const __m256i vLowNibble = _mm256_set1_epi8(0x0F);
+
+	// The bytes 1, 2 and 3 positions back, running into the previous block
+	__m256i vStraddle = _mm256_permute2x128_si256(vPrev, v, 0x21);
+	__m256i vPrev1 = _mm256_alignr_epi8(v, vStraddle, 15);
+	__m256i vPrev2 = _mm256_alignr_epi8(v, vStraddle, 14);
+	__m256i vPrev3 = _mm256_alignr_epi8(v, vStraddle, 13);
+
+	__m256i vByte1High = _mm256_shuffle_epi8(vByte1HighTable, _mm256_and_si256(_mm256_srli_epi16(vPrev1, 4), vLowNibble));
+	__m256i vByte1Low = _mm256_shuffle_epi8(vByte1LowTable, _mm256_and_si256(vPrev1, vLowNibble));
+	__m256i vByte2High = _mm256_shuffle_epi8(vByte2HighTable, _mm256_and_si256(_mm256_srli_epi16(v, 4), vLowNibble));
+	__m256i vSpecialCases = _mm256_and_si256(_mm256_and_si256(vByte1High, vByte1Low), vByte2High);
+
+	// A continuation after a continuation is right exactly when a 3-byte lead is 2 back or a 4-byte lead 3 back. The saturating subtractions leave the high bit set for those.
+	__m256i vIsThirdByte = _mm256_subs_epu8(vPrev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+	__m256i vIsFourthByte = _mm256_subs_epu8(vPrev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+	__m256i vMustBeContinuation = _mm256_and_si256(_mm256_or_si256(vIsThirdByte, vIsFourthByte), _mm256_set1_epi8((char)0x80));
+	return _mm256_xor_si256(vMustBeContinuation, vSpecialCases);
+}
+
+GMA_TARGET_AVX2 static bool _IsValidUtf8Avx2(const uint8_t* pb, size_t cb)
+{
+	const __m256i vByte1HighTable = _LoadNibbleTableAvx2(c_abUtf8Byte1High);
+	const __m256i vByte1LowTable = _LoadNibbleTableAvx2(c_abUtf8Byte1Low);
+	const __m256i vByte2HighTable = _LoadNibbleTableAvx2(c_abUtf8Byte2High);
+	const __m256i vMaxBlockEnd = _mm256_loadu_si256((const __m256i*)c_abUtf8MaxBlockEnd);
+
+	__m256i vError = _mm256_setzero_si256();
+	__m256i vPrev = _mm256_setzero_si256();
+	__m256i vPrevIncomplete = _mm256_setzero_si256(); // nonzero if the previous block ended partway through a sequence
+
+	size_t ulPos = 0;
+	for (; ulPos + 32 <= cb; ulPos += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(pb + ulPos));
+		if (_mm256_movemask_epi8(v) == 0)
+		{
+			vError = _mm256_or_si256(vError, vPrevIncomplete);
+			vPrevIncomplete = _mm256_setzero_si256();
+		}
+		else
+		{
+			vError = _mm256_or_si256(vError, _CheckUtf8BlockAvx2(v, vPrev, vByte1HighTable, vByte1LowTable, vByte2HighTable));
+			vPrevIncomplete = _mm256_subs_epu8(v, vMaxBlockEnd);
+		}
+		vPrev = v;
+	}
+
+	// The rest goes through the same check, padded with ASCII, which also catches a sequence cut short by the end of the input
+	if (ulPos < cb)
+	{
+		uint8_t abLast[32] = {};
+		memcpy(abLast, pb + ulPos, cb - ulPos);
+		__m256i v = _mm256_loadu_si256((const __m256i*)abLast);
+		vError = _mm256_or_si256(vError, _CheckUtf8BlockAvx2(v, vPrev, vByte1HighTable, vByte1LowTable, vByte2HighTable));
+	}
+	else
+	{
+		vError = _mm256_or_si256(vError, vPrevIncomplete);
+	}
+
+	return _mm256_testz_si256(vError, vError) != 0;
+}
+
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Dispatch
+// ____________________________________________________________________________________________________
+//
+
+typedef size_t (*PFNUTF8TOUTF16)(const uint8_t* pb, size_t cb, GmaWChar* pwchOut, bool* pbValid);
+typedef bool (*PFNISVALIDUTF8)(const uint8_t* pb, size_t cb);
+
+// One implementation's entry points, indexed by GmaScanImpl, as in GmaScan.cpp
+struct GmaTextDispatch
+{
+	GmaScanImpl impl;
+	PFNUTF8TOUTF16 pfnUtf8ToUtf16;
+	PFNISVALIDUTF8 pfnIsValidUtf8;
+};
+
+static const GmaTextDispatch c_aTextDispatch[] =
+{
+	{ GMA_SCAN_SCALAR, _Utf8ToUtf16Scalar, _IsValidUtf8Scalar },
+#ifdef GMA_TEXT_X86
+	{ GMA_SCAN_SSE2, _Utf8ToUtf16Sse2, _IsValidUtf8Sse2 },
+#else
+	{ GMA_SCAN_SCALAR, _Utf8ToUtf16Scalar, _IsValidUtf8Scalar },
+#endif
+#ifdef GMA_TEXT_HAVE_AVX2
+	{ GMA_SCAN_AVX2, _Utf8ToUtf16Avx2, _IsValidUtf8Avx2 },
+#else
+	{ GMA_SCAN_SCALAR, _Utf8ToUtf16Scalar, _IsValidUtf8Scalar },
+#endif
+};
+
+// NULL until the first conversion picks the best implementation the CPU supports, as the scanner does
+// Resolved on first use for the same reasons as s_pScanDispatch in GmaScan.cpp. The tables the implementations use are all constant, so there's nothing else to set up.
+static const GmaTextDispatch* s_pTextDispatch = NULL;
+
+static const GmaTextDispatch* _LoadTextDispatch()
+{
+#if defined(_MSC_VER)
+	return *(const GmaTextDispatch* volatile*)&s_pTextDispatch;
+#else
+	return __atomic_load_n(&s_pTextDispatch, __ATOMIC_RELAXED);
+#endif
+}
+
+static void _StoreTextDispatch(const GmaTextDispatch* pDispatch)
+{
+#if defined(_MSC_VER)
+	*(const GmaTextDispatch* volatile*)&s_pTextDispatch = pDispatch;
+#else
+	__atomic_store_n(&s_pTextDispatch, pDispatch, __ATOMIC_RELAXED);
+#endif
+}
+
+static const GmaTextDispatch* _GetTextDispatch()
+{
+	const GmaTextDispatch* pDispatch = _LoadTextDispatch();
+	if (pDispatch == NULL)
+	{
+		GmaScanImpl impl = GMA_SCAN_SCALAR;
+		if (GmaIsScanImplSupported(GMA_SCAN_AVX2))
+			impl = GMA_SCAN_AVX2;
+		else if (GmaIsScanImplSupported(GMA_SCAN_SSE2))
+			impl = GMA_SCAN_SSE2;
+		pDispatch = &c_aTextDispatch[impl];
+		_StoreTextDispatch(pDispatch);
+	}
+	return pDispatch;
+}
+
+GmaScanImpl GmaGetTextImpl()
+{
+	return _GetTextDispatch()->impl;
+}
+
+GmaStatus GmaSetTextImpl(GmaScanImpl impl)
+{
+	if (!GmaIsScanImplSupported(impl))
+		return GMA_E_NOTIMPL;
+
+	_StoreTextDispatch(&c_aTextDispatch[impl]);
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Conversion
+// ____________________________________________________________________________________________________
+//
+
+bool GmaIsValidUtf8(const char* pch, size_t cb)
+{
+	return _GetTextDispatch()->pfnIsValidUtf8((const uint8_t*)pch, cb);
+}
+
+size_t GmaUtf8ToUtf16(const char* pch, size_t cb, GmaWChar* pwchOut, bool* pbValid)
+{
+	bool bValid = true;
+	size_t cch = _GetTextDispatch()->pfnUtf8ToUtf16((const uint8_t*)pch, cb, pwchOut, &bValid);
+	if (pbValid != NULL)
+		*pbValid = bValid;
+	return cch;
+}
+
+GmaStatus GmaUtf8ToUtf16(const GmaString& str, CGmaArena* pArena, GmaWChar** ppwsz, uint32_t* pcch, bool* pbValid)
+{
+	*ppwsz = NULL;
+	if (pcch != NULL)
+		*pcch = 0ul;
+	if (pbValid != NULL)
+		*pbValid = true;
+
+	if (str.psz == NULL)
+		return GMA_S_OK;
+
+	GmaWChar* pwsz = pArena->AllocArray<GmaWChar>((size_t)str.cch + 1);
+	if (pwsz == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	size_t cch = GmaUtf8ToUtf16(str.psz, str.cch, pwsz, pbValid);
+	pwsz[cch] = 0;
+
+	*ppwsz = pwsz;
+	if (pcch != NULL)
+		*pcch = (uint32_t)cch;
+	return GMA_S_OK;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Legacy codepages
+// ____________________________________________________________________________________________________
+//
+
+// Windows-1252, the ANSI codepage of Western Windows installs, and the likeliest encoding of a header string that isn't UTF-8
+// 0xA0..0xFF match Latin-1. The 5 bytes Windows-1252 leaves undefined map to the C1 controls with the same value, as MultiByteToWideChar maps them.
+static const GmaWChar c_awchCp1252High[128] =
+{
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+	0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+	0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7, 0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+	0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7, 0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+	0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7, 0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+	0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7, 0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7, 0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+};
+
+size_t GmaCodepageToUtf16(const char* pch, size_t cb, GmaTextEncoding encoding, GmaWChar* pwchOut)
+{
+	const GmaWChar* awchHigh = NULL;
+	switch (encoding)
+	{
+	case GMA_TEXT_CP1252:
+		awchHigh = c_awchCp1252High;
+		break;
+	default:
+		return 0; // not a single-byte codepage
+	}
+
+	const uint8_t* pb = (const uint8_t*)pch;
+	for (size_t i = 0; i < cb; i++)
+		pwchOut[i] = (pb[i] < 0x80) ? (GmaWChar)pb[i] : awchHigh[pb[i] - 0x80];
+	return cb;
+}
+
+GmaStatus GmaHeaderStringToUtf16(const GmaString& str, CGmaArena* pArena, GmaWChar** ppwsz, uint32_t* pcch, GmaTextEncoding* pEncoding)
+{
+	if (pEncoding != NULL)
+		*pEncoding = GMA_TEXT_UTF8;
+
+	// Valid UTF-8 is by far the common case, so convert optimistically and only decode again if the conversion found otherwise
+	bool bValid;
+	GmaStatus status = GmaUtf8ToUtf16(str, pArena, ppwsz, pcch, &bValid);
+	if (GMA_FAILED(status) || bValid)
+		return status;
+
+	// A codepage never takes more units than bytes either, so the buffer is big enough
+	size_t cch = GmaCodepageToUtf16(str.psz, str.cch, GMA_TEXT_CP1252, *ppwsz);
+	(*ppwsz)[cch] = 0;
+	if (pcch != NULL)
+		*pcch = (uint32_t)cch;
+	if (pEncoding != NULL)
+		*pEncoding = GMA_TEXT_CP1252;
+	return GMA_S_OK;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaReader.h"
+#include "GmaScan.h"
+
+// UTF-8 validation and UTF-16 conversion for header strings
+// Header strings are overwhelmingly ASCII, so the converters widen whole blocks of 16 (SSE2) or 32 (AVX2) bytes at a time while they're plain ASCII. The AVX2 implementation also decodes blocks mixing ASCII with 2-byte sequences (Latin, Greek, Cyrillic...) without leaving vector registers. Everything else takes a scalar decoder.
+// Conversion and validation happen in the same single pass, with no sizing pass: UTF-8 never takes fewer bytes than UTF-16 code units, so the input length bounds the output.
+
+// UTF-16 code unit, matching WCHAR on Windows so the shell can use the output directly
+#ifdef _WIN32
+typedef wchar_t GmaWChar;
+#else
+typedef uint16_t GmaWChar;
+#endif
+
+const GmaWChar c_wchGmaReplacement = 0xFFFD; // Stands in for each invalid UTF-8 sequence
+
+// Encodings a header string can be decoded from
+// gmad.exe copies the strings it's given byte for byte, so older or hand-made addons can carry text in the author's ANSI codepage rather than UTF-8.
+enum GmaTextEncoding
+{
+	GMA_TEXT_UTF8 = 0,
+	GMA_TEXT_CP1252 = 1, // Windows-1252 (Western European)
+};
+
+// Checks whether pch[0..cb) is entirely valid UTF-8, without converting it
+// The AVX2 implementation checks 32 bytes at a time with table lookups and no branches on the data, so even non-ASCII text validates at memory speed. The others skip ASCII in blocks and check the rest sequence by sequence.
+bool GmaIsValidUtf8(const char* pch, size_t cb);
+
+// Converts pch[0..cb) from UTF-8 to UTF-16 and returns the number of code units written to pwchOut
+// pwchOut must have room for cb code units, and all of them may be written to. No terminator is written.
+// Invalid input (stray or missing continuation bytes, overlong forms, surrogates, code points past U+10FFFF) is not an error: each maximal invalid subpart is replaced with U+FFFD, as MultiByteToWideChar does. *pbValid, if not NULL, says whether the input was entirely valid.
+size_t GmaUtf8ToUtf16(const char* pch, size_t cb, GmaWChar* pwchOut, bool* pbValid);
+
+// Converts str into a null-terminated UTF-16 string allocated from pArena
+// A missing string (NULL psz) stays NULL. pcch (excluding the terminator) and pbValid may be NULL.
+GmaStatus GmaUtf8ToUtf16(const GmaString& str, CGmaArena* pArena, GmaWChar** ppwsz, uint32_t* pcch, bool* pbValid);
+
+// Converts pch[0..cb) from a single-byte codepage to UTF-16 through a lookup table, and returns the number of code units written to pwchOut (always cb)
+// Returns 0, writing nothing, if encoding isn't a single-byte codepage.
+size_t GmaCodepageToUtf16(const char* pch, size_t cb, GmaTextEncoding encoding, GmaWChar* pwchOut);
+
+// Converts a header string into a null-terminated UTF-16 string allocated from pArena, like GmaUtf8ToUtf16(), but decodes it as Windows-1252 instead if it isn't valid UTF-8
+// Valid UTF-8 still takes a single pass; only invalid strings are decoded twice. *pEncoding, if not NULL, receives the encoding used.
+GmaStatus GmaHeaderStringToUtf16(const GmaString& str, CGmaArena* pArena, GmaWChar** ppwsz, uint32_t* pcch, GmaTextEncoding* pEncoding);
+
+// Implementation in use, and an override for benchmarking and testing. Same rules as GmaSetScanImpl().
+GmaScanImpl GmaGetTextImpl();
+GmaStatus GmaSetTextImpl(GmaScanImpl impl);
@@ -0,0 +1,164 @@
+#include "GmaXattr.h"
+#include "GmaCacheFile.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+#ifdef __linux__
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#endif
+
+#ifndef _WIN32
+
+const uint32_t c_ulXattrStampMagic = 0x58414D47ul; // "GMAX"
+const uint32_t c_ulXattrStampVersion = 3ul;
+const size_t c_cbXattrStampGuess = 1024; // Buffer for the first getxattr() attempt, which fits a typical stamp
+const size_t c_cbXattrStampMax = 65536; // Linux's XATTR_SIZE_MAX
+
+// Precedes the packed metadata in the attribute
+struct GmaXattrStampHeader
+{
+	uint32_t ulMagic;
+	uint32_t ulVersion;
+};
+
+#ifdef __linux__
+
+// Maps a failed *xattr() call's errno to a status
+static GmaStatus _XattrError(int iErrno)
+{
+	switch (iErrno)
+	{
+	case ENOTSUP:
+		return GMA_E_NOTIMPL;
+	case E2BIG:
+	case ENOSPC:
+	case ERANGE:
+		return GMA_E_ABORT;
+	default:
+		return GMA_E_IO;
+	}
+}
+
+// Checks a stamp read into pb[0..cb) against the file it came from
+static GmaStatus _ReadStamp(const uint8_t* pb, size_t cb, const GmaCacheKey& key, IGmaByteSource* pSource, GmaCachedMetadata* pMeta, CGmaArena* pArena, bool* pbFound)
+{
+	const GmaXattrStampHeader* pHeader = (const GmaXattrStampHeader*)pb;
+	if (cb < sizeof(GmaXattrStampHeader) || pHeader->ulMagic != c_ulXattrStampMagic || pHeader->ulVersion != c_ulXattrStampVersion)
+		return GMA_S_OK;
+
+	GmaCacheKey keyStamped;
+	uint64_t ullFingerprint;
+	if (!GmaUnpackMetadata(pb + sizeof(GmaXattrStampHeader), cb - sizeof(GmaXattrStampHeader), &keyStamped, &ullFingerprint, pMeta, pArena))
+		return GMA_S_OK;
+
+	// Only size and time: the device and inode number change when a file is copied along with its attributes, while the contents don't
+	bool bCurrent = keyStamped.ullSize == key.ullSize && keyStamped.ullLastWrite == key.ullLastWrite;
+	if (bCurrent && pSource != NULL)
+	{
+		uint64_t ullCurrentFingerprint;
+		bCurrent = GMA_SUCCEEDED(GmaComputeFingerprint(pSource, (pMeta->stage >= GMA_STAGE_TOC) ? pMeta->tocSummary.ullDataStart : 0ull, &ullCurrentFingerprint))
+			&& ullCurrentFingerprint == ullFingerprint;
+	}
+
+	if (!bCurrent)
+	{
+		memset(pMeta, 0, sizeof(*pMeta));
+		return GMA_S_OK;
+	}
+	*pbFound = true;
+	return GMA_S_OK;
+}
+
+#endif
+
+GmaStatus GmaReadXattrStamp(const char* pszPath, const GmaCacheKey& key, IGmaByteSource* pSource, GmaCachedMetadata* pMeta, CGmaArena* pArena, bool* pbFound)
+{
+	memset(pMeta, 0, sizeof(*pMeta));
+	*pbFound = false;
+
+#ifdef __linux__
+	// Guess first, so the usual case is a single call. The attribute can change between calls, hence the retries.
+	size_t cb = c_cbXattrStampGuess;
+	for (int iAttempt = 0; iAttempt < 3; iAttempt++)
+	{
+		uint8_t* pb = (uint8_t*)pArena->Alloc(cb, sizeof(uint64_t));
+		if (pb == NULL)
+			return GMA_E_OUTOFMEMORY;
+
+		ssize_t cbRead = getxattr(pszPath, c_szGmaXattrName, pb, cb);
+		if (cbRead >= 0)
+			return _ReadStamp(pb, (size_t)cbRead, key, pSource, pMeta, pArena, pbFound);
+		if (errno == ENODATA)
+			return GMA_S_OK;
+		if (errno != ERANGE)
+			return _XattrError(errno);
+
+		ssize_t cbNeeded = getxattr(pszPath, c_szGmaXattrName, NULL, 0);
+		if (cbNeeded < 0)
+			return (errno == ENODATA) ? GMA_S_OK : _XattrError(errno);
+		cb = (size_t)cbNeeded;
+	}
+	return GMA_S_OK;
+#else
+	(void)pszPath;
+	(void)key;
+	(void)pSource;
+	(void)pArena;
+	return GMA_E_NOTIMPL;
+#endif
+}
+
+GmaStatus GmaWriteXattrStamp(int fd, const GmaCacheKey& key, IGmaByteSource* pSource, const GmaCachedMetadata& meta)
+{
+#ifdef __linux__
+	uint32_t cbRecord;
+	GmaStatus status = GmaGetPackedMetadataSize(meta, &cbRecord);
+	if (GMA_FAILED(status))
+		return status;
+	if (cbRecord > c_cbXattrStampMax - sizeof(GmaXattrStampHeader))
+		return GMA_E_ABORT;
+
+	uint64_t ullFingerprint;
+	status = GmaComputeFingerprint(pSource, (meta.stage >= GMA_STAGE_TOC) ? meta.tocSummary.ullDataStart : 0ull, &ullFingerprint);
+	if (GMA_FAILED(status))
+		return status;
+
+	// Packed metadata is 8-byte aligned and a multiple of 8 bytes long, and so is the header
+	size_t cbStamp = sizeof(GmaXattrStampHeader) + cbRecord;
+	uint64_t* pullStamp = new (std::nothrow) uint64_t[cbStamp / sizeof(uint64_t)];
+	if (pullStamp == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	GmaXattrStampHeader* pHeader = (GmaXattrStampHeader*)pullStamp;
+	pHeader->ulMagic = c_ulXattrStampMagic;
+	pHeader->ulVersion = c_ulXattrStampVersion;
+	GmaPackMetadata(key, ullFingerprint, meta, (uint8_t*)pullStamp + sizeof(GmaXattrStampHeader), cbRecord);
+
+	if (fsetxattr(fd, c_szGmaXattrName, pullStamp, cbStamp, 0) != 0)
+		status = _XattrError(errno);
+	delete[] pullStamp;
+	return status;
+#else
+	(void)fd;
+	(void)key;
+	(void)pSource;
+	(void)meta;
+	return GMA_E_NOTIMPL;
+#endif
+}
+
+GmaStatus GmaRemoveXattrStamp(int fd)
+{
+#ifdef __linux__
+	if (fremovexattr(fd, c_szGmaXattrName) != 0 && errno != ENODATA)
+		return _XattrError(errno);
+	return GMA_S_OK;
+#else
+	(void)fd;
+	return GMA_E_NOTIMPL;
+#endif
+}
+
+#endif
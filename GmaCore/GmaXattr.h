@@ -0,0 +1,35 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaByteSource.h"
+#include "GmaCache.h"
+
+#ifndef _WIN32
+
+// ____________________________________________________________________________________________________
+//
+//     Extended attribute stamps
+// ____________________________________________________________________________________________________
+//
+
+// A file's parse results, kept in an extended attribute on the file itself so later scans don't have to open it
+// The stamp is the file's packed metadata (see GmaPackMetadata()) behind a small versioned header, in a single attribute, so reading it back is one getxattr() with no open(), read() or parse. It records the size and modification time the file had when it was parsed and is ignored once either changes. Setting it doesn't change the modification time itself.
+// Only implemented on Linux. Elsewhere, and on filesystems without user extended attributes, everything fails with GMA_E_NOTIMPL and callers just parse.
+
+const char c_szGmaXattrName[] = "user.gma.summary"; // In the user namespace, so anyone who can write a file can stamp it
+
+// Reads the stamp on the file at pszPath, following symlinks
+// key is the file's current key (e.g. from GmaGetPathCacheKey()), whose size and modification time the stamp must match. If pSource is not NULL, the fingerprint must match too, which costs a couple of small reads but catches rewrites that kept both.
+// Returns GMA_S_OK with *pbFound false if there's no current stamp. *pMeta and its strings are allocated from pArena.
+GmaStatus GmaReadXattrStamp(const char* pszPath, const GmaCacheKey& key, IGmaByteSource* pSource, GmaCachedMetadata* pMeta, CGmaArena* pArena, bool* pbFound);
+
+// Stamps meta on the file open on fd. pSource is only used to fingerprint the file.
+// key should be taken before the file is parsed, so a file that changes while it's parsed gets a stamp that's already stale rather than one that's wrong.
+// Fails with GMA_E_ABORT if the stamp is too large for the filesystem (ext4 fits all of a file's attributes in a few KB), and GMA_E_IO if the file can't be written to.
+GmaStatus GmaWriteXattrStamp(int fd, const GmaCacheKey& key, IGmaByteSource* pSource, const GmaCachedMetadata& meta);
+
+// Removes the stamp, if there is one
+GmaStatus GmaRemoveXattrStamp(int fd);
+
+#endif
@@ -0,0 +1,604 @@
+// Checks cJSON's own number parser against strtod, that strings survive a print and parse, and that lookups through cJSON_BuildIndex's index find what walking the children does
+// Numbers are compared bit for bit: random doubles printed with printf("%.17g") and shorter, random decimal strings of every length, and the edge cases of the binary64 format.
+
+#include "GmaTest.h"
+#include "cJSON.h"
+#include <stdlib.h>
+#include <locale.h>
+#include <float.h>
+#include <math.h>
+#include <ctype.h>
+
+static uint64_t s_ullRandom = 0x9E3779B97F4A7C15ull;
+
+// xorshift64*, so every run checks the same inputs
+static uint64_t _Random()
+{
+	s_ullRandom ^= s_ullRandom >> 12;
+	s_ullRandom ^= s_ullRandom << 25;
+	s_ullRandom ^= s_ullRandom >> 27;
+	return s_ullRandom * 0x2545F4914F6CDD1Dull;
+}
+
+static uint64_t _Bits(double d)
+{
+	uint64_t ull;
+	memcpy(&ull, &d, sizeof(ull));
+	return ull;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Numbers
+// ____________________________________________________________________________________________________
+//
+
+static unsigned long s_cNumbers = 0ul;
+
+// Parses psz with cJSON and with strtod in the C locale and expects the same bits
+static void _CheckNumber(const char* psz, double dExpected)
+{
+	s_cNumbers++;
+
+	cJSON* pjn = cJSON_Parse(psz);
+	if (pjn == NULL || !cJSON_IsNumber(pjn))
+	{
+		fprintf(stderr, "cJSON rejected %s\n", psz);
+		g_cGmaTestFailures++;
+		cJSON_Delete(pjn);
+		return;
+	}
+
+	if (_Bits(pjn->valuedouble) != _Bits(dExpected))
+	{
+		fprintf(stderr, "%s: cJSON gave %.17g, strtod %.17g\n", psz, pjn->valuedouble, dExpected);
+		g_cGmaTestFailures++;
+	}
+	cJSON_Delete(pjn);
+}
+
+static void _CheckNumber(const char* psz)
+{
+	_CheckNumber(psz, strtod(psz, NULL));
+}
+
+static double _RandomDouble()
+{
+	for (;;)
+	{
+		uint64_t ull = _Random();
+		double d;
+		memcpy(&d, &ull, sizeof(d));
+		if (d == d && d - d == 0.0) // finite
+			return d;
+	}
+}
+
+static void _CheckRandomDoubles(unsigned long cDoubles)
+{
+	static const char* const c_apszFormats[] = { "%.17g", "%.16g", "%.15g", "%.6g", "%.3e", "%.20e" };
+	char sz[64];
+	for (unsigned long i = 0; i < cDoubles; i++)
+	{
+		double d = _RandomDouble();
+
+		// Enough digits round-trip exactly, to the very double that was printed
+		snprintf(sz, sizeof(sz), "%.17g", d);
+		_CheckNumber(sz, d);
+
+		for (size_t iFormat = 1; iFormat < sizeof(c_apszFormats) / sizeof(c_apszFormats[0]); iFormat++)
+		{
+			snprintf(sz, sizeof(sz), c_apszFormats[iFormat], d);
+			_CheckNumber(sz);
+		}
+	}
+}
+
+// Decimal strings with random mantissas and exponents, including mantissas longer than the 19 digits that fit in 64 bits
+static void _CheckRandomDecimals(unsigned long cNumbers)
+{
+	char sz[64];
+	for (unsigned long i = 0; i < cNumbers; i++)
+	{
+		size_t ich = 0;
+		if (_Random() & 1)
+			sz[ich++] = '-';
+
+		uint32_t cDigits = 1ul + (uint32_t)(_Random() % 40ull);
+		uint32_t ulPoint = (uint32_t)(_Random() % (cDigits + 1ull)); // Where the '.' goes, if anywhere
+		sz[ich++] = (char)('1' + _Random() % 9ull);
+		for (uint32_t iDigit = 1; iDigit < cDigits; iDigit++)
+		{
+			if (iDigit == ulPoint)
+				sz[ich++] = '.';
+			sz[ich++] = (char)('0' + _Random() % 10ull);
+		}
+
+		if (_Random() & 1)
+		{
+			int iExponent = (int)(_Random() % 700ull) - 350;
+			ich += (size_t)snprintf(sz + ich, sizeof(sz) - ich, "e%d", iExponent);
+		}
+		sz[ich] = 0;
+
+		_CheckNumber(sz);
+	}
+}
+
+static void _CheckEdgeCases()
+{
+	static const char* const c_apsz[] =
+	{
+		"0", "-0", "0.0", "0e0", "1", "-1", "0.1", "0.2", "0.3", "1e23", "8.98846567431158e307",
+		"2147483647", "2147483648", "-2147483648", "-2147483649",
+		"9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995", // 2^53 and the halfway cases around it
+		"18446744073709551615", "18446744073709551616", "123456789012345678901234567890",
+		"1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "1e309", "-1e400", // DBL_MAX and overflow
+		"2.2250738585072014e-308", "2.2250738585072011e-308", "2.2250738585072012e-308", // smallest normal and below it
+		"4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", // subnormals and underflow
+		"7.2057594037927933e16", "9007199254740993.0000000000000000000000000000001",
+		"2.225073858507201136057409796709131975934819546351645648e-308",
+		"0.000000000000000000000000000000000000000000001e300",
+		"1000000000000000000000000000000000000000000000000000000e-50",
+	};
+	for (size_t i = 0; i < sizeof(c_apsz) / sizeof(c_apsz[0]); i++)
+		_CheckNumber(c_apsz[i]);
+
+	double dMin = DBL_MIN;
+	double dTrueMin = 4.9406564584124654e-324;
+	char sz[64];
+	for (int i = 0; i < 64; i++)
+	{
+		snprintf(sz, sizeof(sz), "%.17g", dMin * (1.0 + i / 64.0));
+		_CheckNumber(sz);
+		snprintf(sz, sizeof(sz), "%.17g", dTrueMin * (i + 1));
+		_CheckNumber(sz);
+	}
+}
+
+static void _CheckUnderLocale(unsigned long cDoubles)
+{
+	const char* pszLocale = NULL;
+	char (*asz)[32] = new char[cDoubles][32];
+	double* ad = new double[cDoubles];
+	for (unsigned long i = 0; i < cDoubles; i++)
+	{
+		ad[i] = _RandomDouble();
+		snprintf(asz[i], sizeof(asz[i]), "%.17g", ad[i]);
+	}
+
+	pszLocale = setlocale(LC_NUMERIC, "de_DE.UTF-8");
+	if (pszLocale == NULL)
+		pszLocale = setlocale(LC_NUMERIC, "fr_FR.UTF-8");
+	for (unsigned long i = 0; i < cDoubles; i++)
+		_CheckNumber(asz[i], ad[i]);
+	setlocale(LC_NUMERIC, "C");
+
+	printf("CJsonRoundTripTest: also parsed under %s\n", pszLocale);
+	delete[] asz;
+	delete[] ad;
+}
+
+// cJSON's own output parses back to the same double, within the precision print_number() promises
+static void _CheckPrintedNumbers(unsigned long cDoubles)
+{
+	for (unsigned long i = 0; i < cDoubles; i++)
+	{
+		double d = _RandomDouble();
+		cJSON* pjn = cJSON_CreateNumber(d);
+		char* psz = cJSON_PrintUnformatted(pjn);
+		GMA_CHECK(psz != NULL);
+		if (psz != NULL)
+		{
+			_CheckNumber(psz);
+			cJSON* pjnBack = cJSON_Parse(psz);
+			GMA_CHECK(pjnBack != NULL && fabs(pjnBack->valuedouble - d) <= fabs(d) * DBL_EPSILON);
+			cJSON_Delete(pjnBack);
+			cJSON_free(psz);
+		}
+		cJSON_Delete(pjn);
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Strings
+// ____________________________________________________________________________________________________
+//
+
+// Appends the UTF-8 encoding of a code point
+static size_t _EncodeUtf8(uint32_t ulCodePoint, char* pch)
+{
+	if (ulCodePoint < 0x80ul)
+	{
+		pch[0] = (char)ulCodePoint;
+		return 1;
+	}
+	if (ulCodePoint < 0x800ul)
+	{
+		pch[0] = (char)(0xC0 | (ulCodePoint >> 6));
+		pch[1] = (char)(0x80 | (ulCodePoint & 0x3F));
+		return 2;
+	}
+	if (ulCodePoint < 0x10000ul)
+	{
+		pch[0] = (char)(0xE0 | (ulCodePoint >> 12));
+		pch[1] = (char)(0x80 | ((ulCodePoint >> 6) & 0x3F));
+		pch[2] = (char)(0x80 | (ulCodePoint & 0x3F));
+		return 3;
+	}
+	pch[0] = (char)(0xF0 | (ulCodePoint >> 18));
+	pch[1] = (char)(0x80 | ((ulCodePoint >> 12) & 0x3F));
+	pch[2] = (char)(0x80 | ((ulCodePoint >> 6) & 0x3F));
+	pch[3] = (char)(0x80 | (ulCodePoint & 0x3F));
+	return 4;
+}
+
+// Random strings of control characters, quotes, backslashes, long plain runs and multi-byte UTF-8 survive print then parse
+static void _CheckRandomStrings(unsigned long cStrings)
+{
+	char sz[1024];
+	for (unsigned long i = 0; i < cStrings; i++)
+	{
+		size_t cch = 0;
+		size_t cchWanted = (size_t)(_Random() % 200ull);
+		while (cch < cchWanted)
+		{
+			uint64_t ullKind = _Random() % 8ull;
+			uint32_t ulCodePoint;
+			if (ullKind == 0)
+				ulCodePoint = 1ul + (uint32_t)(_Random() % 0x1Full); // control
+			else if (ullKind == 1)
+				ulCodePoint = (_Random() & 1) ? '"' : '\\';
+			else if (ullKind == 2)
+				ulCodePoint = 0x80ul + (uint32_t)(_Random() % 0xD780ull); // up to the surrogates
+			else if (ullKind == 3)
+				ulCodePoint = 0x10000ul + (uint32_t)(_Random() % 0x100000ull);
+			else
+				ulCodePoint = 0x20ul + (uint32_t)(_Random() % 0x5Full); // printable ASCII
+			cch += _EncodeUtf8(ulCodePoint, sz + cch);
+		}
+		sz[cch] = 0;
+
+		cJSON* pjn = cJSON_CreateString(sz);
+		char* pszJson = cJSON_PrintUnformatted(pjn);
+		cJSON* pjnBack = (pszJson != NULL) ? cJSON_Parse(pszJson) : NULL;
+		GMA_CHECK(pjnBack != NULL && cJSON_IsString(pjnBack) && strcmp(pjnBack->valuestring, sz) == 0);
+		cJSON_Delete(pjnBack);
+		cJSON_free(pszJson);
+		cJSON_Delete(pjn);
+	}
+}
+
+static void _CheckStringEscapes()
+{
+	static const struct
+	{
+		const char* pszJson;
+		const char* pszExpected;
+	} c_aCases[] =
+	{
+		{ "\"plain\"", "plain" },
+		{ "\"a\\\"b\\\\c\\/d\"", "a\"b\\c/d" },
+		{ "\"\\b\\f\\n\\r\\t\"", "\b\f\n\r\t" },
+		{ "\"\\u0041\\u00e9\\u20AC\"", "A\xC3\xA9\xE2\x82\xAC" },
+		{ "\"\\ud83d\\ude00\"", "\xF0\x9F\x98\x80" }, // surrogate pair
+		{ "\"caf\xC3\xA9\"", "caf\xC3\xA9" },
+	};
+	for (size_t i = 0; i < sizeof(c_aCases) / sizeof(c_aCases[0]); i++)
+	{
+		cJSON* pjn = cJSON_Parse(c_aCases[i].pszJson);
+		GMA_CHECK(pjn != NULL && cJSON_IsString(pjn) && strcmp(pjn->valuestring, c_aCases[i].pszExpected) == 0);
+		cJSON_Delete(pjn);
+	}
+
+	GMA_CHECK(cJSON_Parse("\"unterminated") == NULL);
+	GMA_CHECK(cJSON_Parse("\"\\ud83d\"") == NULL); // lone high surrogate
+	GMA_CHECK(cJSON_Parse("\"\\x41\"") == NULL);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Index
+// ____________________________________________________________________________________________________
+//
+
+// What a lookup does without an index: the first member whose key matches, keys compared byte by byte after tolower() if case-insensitive
+static const cJSON* _FindLinear(const cJSON* pjnObject, const char* pszKey, bool bCaseSensitive)
+{
+	for (const cJSON* pjn = pjnObject->child; pjn != NULL; pjn = pjn->next)
+	{
+		const unsigned char* pbMember = (const unsigned char*)pjn->string;
+		const unsigned char* pbKey = (const unsigned char*)pszKey;
+		while (*pbMember != 0 && (bCaseSensitive ? *pbMember == *pbKey : tolower(*pbMember) == tolower(*pbKey)))
+		{
+			pbMember++;
+			pbKey++;
+		}
+		if (*pbMember == 0 && *pbKey == 0)
+			return pjn;
+	}
+	return NULL;
+}
+
+// A member key: mostly unique ones in mixed case, the same key in three cases every few members, and an empty one
+static void _FormatIndexKey(uint32_t i, char* psz, size_t cch)
+{
+	static const char* const c_apszDuplicates[] = { "dup", "DUP", "Dup" };
+	if (i % 7 == 3)
+		snprintf(psz, cch, "%s", c_apszDuplicates[(i / 7) % 3]);
+	else if (i == 5)
+		psz[0] = 0;
+	else
+	{
+		snprintf(psz, cch, "key%u", i);
+		for (char* pch = psz; *pch != 0; pch++)
+		{
+			if (_Random() & 1)
+				*pch = (char)toupper((unsigned char)*pch);
+		}
+	}
+}
+
+// {"<key 0>": 0, ..., "nested": {...}, "list": [...]}, with cMembers numbered members and a nested object and array as large
+static void _BuildIndexText(uint32_t cMembers, CGmaTestFile* pText)
+{
+	char szKey[32];
+	char sz[64];
+	pText->Clear();
+	pText->AppendByte('{');
+	for (uint32_t i = 0; i < cMembers; i++)
+	{
+		_FormatIndexKey(i, szKey, sizeof(szKey));
+		snprintf(sz, sizeof(sz), "\"%s\":%u,", szKey, i);
+		pText->Append(sz, strlen(sz));
+	}
+	pText->Append("\"nested\":{", 10);
+	for (uint32_t i = 0; i < cMembers; i++)
+	{
+		snprintf(sz, sizeof(sz), "%s\"n%u\":%u", (i != 0) ? "," : "", i, i);
+		pText->Append(sz, strlen(sz));
+	}
+	pText->Append("},\"list\":[", 10);
+	for (uint32_t i = 0; i < cMembers; i++)
+	{
+		snprintf(sz, sizeof(sz), "%s%u", (i != 0) ? "," : "", i);
+		pText->Append(sz, strlen(sz));
+	}
+	pText->Append("]}", 2);
+	pText->AppendByte(0);
+}
+
+// Every lookup gives the very item a linear walk finds: each member's key as is, upper and lower cased, keys that aren't there, and every position
+static void _CheckLookups(const cJSON* pjnObject)
+{
+	char szKey[32];
+	uint32_t iMember = 0;
+	for (const cJSON* pjn = pjnObject->child; pjn != NULL; pjn = pjn->next, iMember++)
+	{
+		GMA_CHECK(cJSON_GetArrayItem(pjnObject, (int)iMember) == pjn);
+		if (pjn->string == NULL)
+			continue;
+
+		snprintf(szKey, sizeof(szKey), "%s", pjn->string);
+		for (int iCase = 0; iCase < 3; iCase++)
+		{
+			for (char* pch = szKey; *pch != 0 && iCase != 0; pch++)
+				*pch = (char)((iCase == 1) ? toupper((unsigned char)*pch) : tolower((unsigned char)*pch));
+			GMA_CHECK(cJSON_GetObjectItemCaseSensitive(pjnObject, szKey) == _FindLinear(pjnObject, szKey, true));
+			GMA_CHECK(cJSON_GetObjectItem(pjnObject, szKey) == _FindLinear(pjnObject, szKey, false));
+		}
+	}
+	GMA_CHECK(cJSON_GetArrayItem(pjnObject, (int)iMember) == NULL);
+	GMA_CHECK(cJSON_GetArrayItem(pjnObject, -1) == NULL);
+
+	for (uint32_t i = 0; i < 64; i++)
+	{
+		snprintf(szKey, sizeof(szKey), "missing%u", i);
+		GMA_CHECK(cJSON_GetObjectItem(pjnObject, szKey) == NULL && cJSON_GetObjectItemCaseSensitive(pjnObject, szKey) == NULL);
+	}
+}
+
+static void _CheckTreeLookups(const cJSON* pjnRoot)
+{
+	_CheckLookups(pjnRoot);
+	_CheckLookups(cJSON_GetObjectItemCaseSensitive(pjnRoot, "nested"));
+	_CheckLookups(cJSON_GetObjectItemCaseSensitive(pjnRoot, "list"));
+}
+
+// Indexed lookups agree with the linear walk on either side of CJSON_INDEX_THRESHOLD, and the first of several duplicate keys wins
+static void _CheckIndexedLookups()
+{
+	static const uint32_t c_acMembers[] = { 0, 1, CJSON_INDEX_THRESHOLD - 3, CJSON_INDEX_THRESHOLD - 2, CJSON_INDEX_THRESHOLD - 1, CJSON_INDEX_THRESHOLD, 100, 1000, 5000 };
+	CGmaTestFile text;
+	for (size_t i = 0; i < sizeof(c_acMembers) / sizeof(c_acMembers[0]); i++)
+	{
+		_BuildIndexText(c_acMembers[i], &text);
+		cJSON* pjnRoot = cJSON_Parse((const char*)text.GetData());
+		GMA_CHECK(pjnRoot != NULL);
+		if (pjnRoot == NULL)
+			continue;
+
+		_CheckTreeLookups(pjnRoot);
+		GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+		bool bIndexed = c_acMembers[i] >= CJSON_INDEX_THRESHOLD;
+		GMA_CHECK((pjnRoot->index != NULL) == (c_acMembers[i] + 2 >= CJSON_INDEX_THRESHOLD));
+		GMA_CHECK((cJSON_GetObjectItemCaseSensitive(pjnRoot, "nested")->index != NULL) == bIndexed);
+		GMA_CHECK((cJSON_GetObjectItemCaseSensitive(pjnRoot, "list")->index != NULL) == bIndexed);
+		_CheckTreeLookups(pjnRoot);
+
+		// Building again replaces the index rather than stacking another one on it
+		GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+		_CheckTreeLookups(pjnRoot);
+
+		if (c_acMembers[i] > 3)
+		{
+			GMA_CHECK(cJSON_GetObjectItemCaseSensitive(pjnRoot, "dup")->valueint == 3);
+			GMA_CHECK(cJSON_GetObjectItem(pjnRoot, "DuP")->valueint == 3);
+		}
+		if (c_acMembers[i] > 10)
+			GMA_CHECK(cJSON_GetObjectItemCaseSensitive(pjnRoot, "DUP")->valueint == 10);
+		cJSON_Delete(pjnRoot);
+	}
+}
+
+// Whatever changes an indexed object's members drops its index, and only its own, and lookups see the change
+static void _CheckIndexDropped()
+{
+	CGmaTestFile text;
+	_BuildIndexText(100, &text);
+	cJSON* pjnRoot = cJSON_Parse((const char*)text.GetData());
+	GMA_CHECK(pjnRoot != NULL);
+	if (pjnRoot == NULL)
+		return;
+	cJSON* pjnNested = cJSON_GetObjectItemCaseSensitive(pjnRoot, "nested");
+	cJSON* pjnList = cJSON_GetObjectItemCaseSensitive(pjnRoot, "list");
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	GMA_CHECK(cJSON_AddNumberToObject(pjnRoot, "added", 1.0) != NULL);
+	GMA_CHECK(pjnRoot->index == NULL && pjnNested->index != NULL && pjnList->index != NULL);
+	GMA_CHECK(cJSON_GetObjectItemCaseSensitive(pjnRoot, "added") != NULL);
+	_CheckTreeLookups(pjnRoot);
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	cJSON_Delete(cJSON_DetachItemFromObjectCaseSensitive(pjnNested, "n50"));
+	GMA_CHECK(pjnRoot->index != NULL && pjnNested->index == NULL && pjnList->index != NULL);
+	GMA_CHECK(cJSON_GetObjectItemCaseSensitive(pjnNested, "n50") == NULL && cJSON_GetObjectItemCaseSensitive(pjnNested, "n51")->valueint == 51);
+	_CheckTreeLookups(pjnRoot);
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	cJSON_Delete(cJSON_DetachItemFromArray(pjnList, 0));
+	GMA_CHECK(pjnList->index == NULL && cJSON_GetArrayItem(pjnList, 0)->valueint == 1);
+	_CheckTreeLookups(pjnRoot);
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	GMA_CHECK(cJSON_InsertItemInArray(pjnList, 10, cJSON_CreateNumber(-1.0)));
+	GMA_CHECK(pjnList->index == NULL && cJSON_GetArrayItem(pjnList, 10)->valueint == -1 && cJSON_GetArrayItem(pjnList, 11)->valueint == 11);
+	_CheckTreeLookups(pjnRoot);
+
+	// A member inserted in front of the first "dup" becomes the first match
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	cJSON* pjnDup = cJSON_CreateNumber(-2.0);
+	GMA_CHECK(cJSON_InsertItemInArray(pjnRoot, 0, pjnDup));
+	pjnDup->string = (char*)cJSON_malloc(4);
+	memcpy(pjnDup->string, "DUP", 4);
+	GMA_CHECK(pjnRoot->index == NULL && cJSON_GetObjectItem(pjnRoot, "dup") == pjnDup);
+	_CheckTreeLookups(pjnRoot);
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	GMA_CHECK(cJSON_ReplaceItemInObjectCaseSensitive(pjnNested, "n7", cJSON_CreateString("seven")));
+	GMA_CHECK(pjnNested->index == NULL && cJSON_IsString(cJSON_GetObjectItemCaseSensitive(pjnNested, "n7")));
+	_CheckTreeLookups(pjnRoot);
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	GMA_CHECK(cJSON_ReplaceItemInArray(pjnList, 20, cJSON_CreateNumber(-3.0)));
+	GMA_CHECK(pjnList->index == NULL && cJSON_GetArrayItem(pjnList, 20)->valueint == -3);
+	_CheckTreeLookups(pjnRoot);
+
+	cJSON_Delete(pjnRoot);
+}
+
+// References share their children with an item that wouldn't tell them about changes, so neither they nor what they point to through them get indexed
+static void _CheckIndexSkipsReferences()
+{
+	CGmaTestFile text;
+	_BuildIndexText(100, &text);
+	cJSON* pjnTarget = cJSON_Parse((const char*)text.GetData());
+	cJSON* pjnRoot = cJSON_CreateObject();
+	GMA_CHECK(pjnTarget != NULL && pjnRoot != NULL);
+	if (pjnTarget == NULL || pjnRoot == NULL)
+		return;
+
+	GMA_CHECK(cJSON_AddItemReferenceToObject(pjnRoot, "ref", pjnTarget));
+	GMA_CHECK(cJSON_AddItemReferenceToObject(pjnRoot, "refNested", cJSON_GetObjectItemCaseSensitive(pjnTarget, "nested")));
+	for (uint32_t i = 0; i < CJSON_INDEX_THRESHOLD; i++)
+	{
+		char szKey[16];
+		snprintf(szKey, sizeof(szKey), "m%u", i);
+		cJSON_AddNumberToObject(pjnRoot, szKey, i);
+	}
+
+	GMA_CHECK(cJSON_BuildIndex(pjnRoot));
+	cJSON* pjnRef = cJSON_GetObjectItemCaseSensitive(pjnRoot, "ref");
+	GMA_CHECK(pjnRoot->index != NULL);
+	GMA_CHECK(pjnRef->index == NULL && pjnTarget->index == NULL && cJSON_GetObjectItemCaseSensitive(pjnTarget, "nested")->index == NULL);
+	GMA_CHECK(!cJSON_BuildIndex(pjnRef) && pjnRef->index == NULL);
+	_CheckLookups(pjnRoot);
+	_CheckTreeLookups(pjnRef);
+
+	// Indexing the target itself is fine, and doesn't change the references
+	GMA_CHECK(cJSON_BuildIndex(pjnTarget));
+	GMA_CHECK(pjnTarget->index != NULL && pjnRef->index == NULL);
+	_CheckTreeLookups(pjnRef);
+
+	cJSON_Delete(pjnRoot);
+	cJSON_Delete(pjnTarget);
+}
+
+static size_t s_cHookAllocations = 0;
+
+static void* CJSON_CDECL _HookMalloc(void* pvContext, size_t cb)
+{
+	(*(size_t*)pvContext)++;
+	return malloc(cb);
+}
+
+static void CJSON_CDECL _HookFree(void* pvContext, void* pv)
+{
+	(*(size_t*)pvContext)--;
+	free(pv);
+}
+
+// A tree parsed with cJSON_ParseWithHooks is never indexed, since the index would come from the global hooks, and lookups still work on it
+static void _CheckIndexSkipsHookedTrees()
+{
+	CGmaTestFile text;
+	_BuildIndexText(100, &text);
+	cJSON_ContextHooks hooks;
+	hooks.malloc_fn = _HookMalloc;
+	hooks.free_fn = _HookFree;
+	hooks.context = &s_cHookAllocations;
+
+	cJSON* pjnRoot = cJSON_ParseWithHooks((const char*)text.GetData(), text.GetSize(), NULL, true, &hooks);
+	GMA_CHECK(pjnRoot != NULL);
+	if (pjnRoot == NULL)
+		return;
+	size_t cAllocations = s_cHookAllocations;
+	GMA_CHECK(!cJSON_BuildIndex(pjnRoot));
+	GMA_CHECK(!cJSON_BuildIndex(cJSON_GetObjectItemCaseSensitive(pjnRoot, "nested")));
+	GMA_CHECK(!cJSON_BuildIndex(cJSON_GetObjectItemCaseSensitive(pjnRoot, "list")));
+	GMA_CHECK(s_cHookAllocations == cAllocations);
+	_CheckTreeLookups(pjnRoot);
+
+	cJSON_DeleteWithHooks(pjnRoot, &hooks);
+	GMA_CHECK(s_cHookAllocations == 0);
+}
+
+
+int main()
+{
+	_CheckEdgeCases();
+	_CheckRandomDoubles(50000ul);
+	_CheckRandomDecimals(200000ul);
+	_CheckPrintedNumbers(20000ul);
+	_CheckRandomStrings(20000ul);
+	_CheckStringEscapes();
+	_CheckIndexedLookups();
+	_CheckIndexDropped();
+	_CheckIndexSkipsReferences();
+	_CheckIndexSkipsHookedTrees();
+
+	// The parser must not care about the locale. Where one with a decimal comma is installed, parse again under it.
+	// The texts and expected values are made in the C locale first, since printf and strtod do follow it.
+	if (setlocale(LC_NUMERIC, "de_DE.UTF-8") != NULL || setlocale(LC_NUMERIC, "fr_FR.UTF-8") != NULL)
+	{
+		setlocale(LC_NUMERIC, "C");
+		_CheckUnderLocale(5000ul);
+	}
+
+	printf("CJsonRoundTripTest: %lu numbers compared\n", s_cNumbers);
+	return GmaTestResult("CJsonRoundTripTest");
+}
@@ -0,0 +1,197 @@
+// Checks CGmaCacheFile shared between processes and threads
+// Several processes, each with several threads, insert entries into one cache file and look up each other's as they go, through as many compactions as the entries force. Every hit must be the entry that was inserted for its key, and at the end every key must be found.
+// Build it with make check-tsan to have ThreadSanitizer watch the threads of each process.
+
+#include "GmaTest.h"
+#include "GmaCacheFile.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+const uint32_t c_cProcesses = 4ul;
+const uint32_t c_cThreads = 2ul; // Per process
+const uint32_t c_cKeysPerThread = 600ul;
+const size_t c_cchDescription = 1500; // Large enough that the entries outgrow the initial file and force compactions
+
+static char s_szPath[256];
+static char s_szDescription[c_cchDescription + 1];
+
+struct WorkerArgs
+{
+	CGmaCacheFile* pCacheFile;
+	uint32_t iProcess;
+	uint32_t iThread;
+	uint32_t cFailures;
+};
+
+static GmaCacheKey _MakeKey(uint32_t iProcess, uint32_t iThread, uint32_t iKey)
+{
+	GmaCacheKey key;
+	key.ullVolume = 42ull;
+	key.ullFileId = ((uint64_t)iProcess << 40) | ((uint64_t)iThread << 32) | iKey;
+	key.ullSize = 1000ull + iKey;
+	key.ullLastWrite = 1600000000ull;
+	return key;
+}
+
+static void _MakeName(const GmaCacheKey& key, char* psz, size_t cch)
+{
+	snprintf(psz, cch, "addon-%llx", (unsigned long long)key.ullFileId);
+}
+
+static GmaStatus _Insert(CGmaCacheFile* pCacheFile, const GmaCacheKey& key)
+{
+	char szName[64];
+	_MakeName(key, szName, sizeof(szName));
+
+	GmaCachedMetadata meta;
+	memset(&meta, 0, sizeof(meta));
+	meta.stage = GMA_STAGE_HEADER;
+	meta.statusFailed = GMA_S_OK;
+	meta.statusToc = GMA_E_UNEXPECTED;
+	meta.header.strName.psz = szName;
+	meta.header.strName.cch = (uint32_t)strlen(szName);
+	meta.header.strDescription.psz = s_szDescription;
+	meta.header.strDescription.cch = (uint32_t)c_cchDescription;
+	meta.header.strAuthor.psz = "Author";
+	meta.header.strAuthor.cch = 6ul;
+	meta.header.bFormatVersion = 3;
+
+	// The fingerprint is taken from whatever source comes with the entry, so a small GMA stands in for the file
+	CGmaTestFile file;
+	file.BuildGma(szName, "d", "Author", 1ul);
+	CGmaMemoryByteSource source(file.GetData(), file.GetSize());
+	return pCacheFile->Insert(key, &source, meta);
+}
+
+// A hit must be exactly the entry inserted for the key
+static bool _CheckHit(CGmaCacheFile* pCacheFile, const GmaCacheKey& key, bool* pbHit)
+{
+	CGmaArena arena;
+	GmaCachedMetadata meta;
+	*pbHit = pCacheFile->Lookup(key, NULL, &meta, &arena);
+	if (!*pbHit)
+		return true;
+
+	char szName[64];
+	_MakeName(key, szName, sizeof(szName));
+	return meta.stage == GMA_STAGE_HEADER && meta.header.strName.cch == strlen(szName) && memcmp(meta.header.strName.psz, szName, meta.header.strName.cch) == 0 &&
+		meta.header.strDescription.cch == c_cchDescription && memcmp(meta.header.strDescription.psz, s_szDescription, c_cchDescription) == 0;
+}
+
+static void* _WorkerProc(void* pv)
+{
+	WorkerArgs* pArgs = (WorkerArgs*)pv;
+	uint64_t ullRandom = 0x9E3779B97F4A7C15ull * (pArgs->iProcess * c_cThreads + pArgs->iThread + 1);
+	for (uint32_t iKey = 0; iKey < c_cKeysPerThread; iKey++)
+	{
+		GmaCacheKey key = _MakeKey(pArgs->iProcess, pArgs->iThread, iKey);
+		if (GMA_FAILED(_Insert(pArgs->pCacheFile, key)))
+			pArgs->cFailures++;
+
+		// Our own entry must be there right away
+		bool bHit;
+		if (!_CheckHit(pArgs->pCacheFile, key, &bHit) || !bHit)
+			pArgs->cFailures++;
+
+		// Anybody else's may or may not be there yet, but if it is, it must be intact
+		for (int i = 0; i < 4; i++)
+		{
+			ullRandom ^= ullRandom << 13;
+			ullRandom ^= ullRandom >> 7;
+			ullRandom ^= ullRandom << 17;
+			GmaCacheKey keyOther = _MakeKey((uint32_t)(ullRandom % c_cProcesses), (uint32_t)((ullRandom >> 8) % c_cThreads), (uint32_t)((ullRandom >> 16) % c_cKeysPerThread));
+			if (!_CheckHit(pArgs->pCacheFile, keyOther, &bHit))
+				pArgs->cFailures++;
+		}
+
+		if (iKey % 64 == 0)
+			pArgs->pCacheFile->Refresh();
+	}
+	return NULL;
+}
+
+static int _RunProcess(uint32_t iProcess)
+{
+	CGmaCacheFile cacheFile;
+	if (GMA_FAILED(cacheFile.Open(s_szPath)))
+		return 1;
+
+	pthread_t athreads[c_cThreads];
+	WorkerArgs aArgs[c_cThreads];
+	for (uint32_t i = 0; i < c_cThreads; i++)
+	{
+		aArgs[i].pCacheFile = &cacheFile;
+		aArgs[i].iProcess = iProcess;
+		aArgs[i].iThread = i;
+		aArgs[i].cFailures = 0ul;
+		pthread_create(&athreads[i], NULL, _WorkerProc, &aArgs[i]);
+	}
+
+	uint32_t cFailures = 0ul;
+	for (uint32_t i = 0; i < c_cThreads; i++)
+	{
+		pthread_join(athreads[i], NULL);
+		cFailures += aArgs[i].cFailures;
+	}
+	if (cFailures != 0ul)
+		fprintf(stderr, "process %u: %u failure(s)\n", iProcess, cFailures);
+	return (cFailures != 0ul) ? 1 : 0;
+}
+
+int main()
+{
+	for (size_t i = 0; i < c_cchDescription; i++)
+		s_szDescription[i] = (char)('a' + i % 26);
+
+	char szDirectory[] = "/tmp/gmacachetest.XXXXXX";
+	GMA_CHECK(mkdtemp(szDirectory) != NULL);
+	snprintf(s_szPath, sizeof(s_szPath), "%s/metadata.cache", szDirectory);
+
+	pid_t apid[c_cProcesses];
+	for (uint32_t i = 0; i < c_cProcesses; i++)
+	{
+		fflush(NULL);
+		apid[i] = fork();
+		if (apid[i] == 0)
+			_exit(_RunProcess(i));
+		GMA_CHECK(apid[i] > 0);
+	}
+
+	for (uint32_t i = 0; i < c_cProcesses; i++)
+	{
+		int iStatus = 0;
+		GMA_CHECK(waitpid(apid[i], &iStatus, 0) == apid[i]);
+		GMA_CHECK(WIFEXITED(iStatus) && WEXITSTATUS(iStatus) == 0);
+	}
+
+	// Compaction keeps the newest entry for every key, so nothing may be missing
+	CGmaCacheFile cacheFile;
+	GMA_CHECK(cacheFile.Open(s_szPath) == GMA_S_OK);
+	uint32_t cMissing = 0ul;
+	for (uint32_t iProcess = 0; iProcess < c_cProcesses; iProcess++)
+	{
+		for (uint32_t iThread = 0; iThread < c_cThreads; iThread++)
+		{
+			for (uint32_t iKey = 0; iKey < c_cKeysPerThread; iKey++)
+			{
+				bool bHit;
+				GMA_CHECK(_CheckHit(&cacheFile, _MakeKey(iProcess, iThread, iKey), &bHit));
+				if (!bHit)
+					cMissing++;
+			}
+		}
+	}
+	if (cMissing != 0ul)
+		fprintf(stderr, "%u entries missing\n", cMissing);
+	GMA_CHECK(cMissing == 0ul);
+	cacheFile.Close();
+
+	struct stat st;
+	GMA_CHECK(stat(s_szPath, &st) == 0 && (uint64_t)st.st_size > (uint64_t)c_cbGmaCacheFileInitial); // It did have to compact
+
+	unlink(s_szPath);
+	rmdir(szDirectory);
+	return GmaTestResult("CacheFileTest");
+}
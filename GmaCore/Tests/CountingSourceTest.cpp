@@ -0,0 +1,97 @@
+// Checks through CGmaCountingByteSource that each parse stage reads only what it needs, from streams and from views
+
+#include "GmaTest.h"
+#include "GmaByteSource.h"
+#include "GmaDocument.h"
+
+const uint32_t c_cFiles = 5000ul; // A file table several read chunks long
+
+static bool _SameHeader(const GmaHeaderInfo& header1, const GmaHeaderInfo& header2)
+{
+	return header1.strName.cch == header2.strName.cch && memcmp(header1.strName.psz, header2.strName.psz, header1.strName.cch) == 0 &&
+		header1.strAuthor.cch == header2.strAuthor.cch && memcmp(header1.strAuthor.psz, header2.strAuthor.psz, header1.strAuthor.cch) == 0 &&
+		header1.cTags == header2.cTags && header1.ullSteamId == header2.ullSteamId && header1.ullTimestamp == header2.ullTimestamp;
+}
+
+// Stream sources: the magic costs one block, the header stops short of the file table, and the table is streamed once
+static void _CheckStream(const CGmaTestFile& file)
+{
+	CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+	CGmaTestStreamSource stream(&memory);
+	CGmaCountingByteSource counting(&stream);
+	CGmaDocument document(&counting);
+
+	GMA_CHECK(document.Open() == GMA_S_OK);
+	GMA_CHECK(counting.GetReadCount() == 1ul);
+	GMA_CHECK(counting.GetHighWater() <= c_cbGmaHeaderReadChunk);
+	GMA_CHECK(counting.GetViewCount() == 0ul);
+
+	GMA_CHECK(document.EnsureStage(GMA_STAGE_HEADER) == GMA_S_OK);
+	GMA_CHECK(counting.GetReadCount() == 1ul); // The header fits in the block the magic came with
+	GMA_CHECK(counting.GetHighWater() < file.GetDataStart());
+	GMA_CHECK(strcmp(document.GetHeader().strName.psz, "Counted") == 0);
+
+	uint32_t cReadsBefore = counting.GetReadCount();
+	GMA_CHECK(document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK);
+	GMA_CHECK(document.GetTocStatus() == GMA_S_OK);
+	GMA_CHECK(document.GetTocSummary().cFiles == c_cFiles);
+	GMA_CHECK(document.GetTocSummary().ullDataStart == file.GetDataStart());
+	GMA_CHECK(counting.GetHighWater() >= file.GetDataStart());
+	GMA_CHECK(counting.GetBytesRead() <= file.GetSize());
+	GMA_CHECK(counting.GetReadCount() - cReadsBefore <= (uint32_t)(file.GetDataStart() / c_cbGmaTocReadChunk) + 2ul);
+
+	// A finished stage is never read again
+	counting.ResetCounters();
+	GMA_CHECK(document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK);
+	GMA_CHECK(counting.GetReadCount() == 0ul && counting.GetSeekCount() == 0ul);
+}
+
+// Sources with a view: nothing goes through Read(), and the header doesn't depend on a single byte of the file table
+static void _CheckView(const CGmaTestFile& file, const GmaHeaderInfo& headerExpected)
+{
+	{
+		CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+		CGmaCountingByteSource counting(&memory);
+		counting.SetViewLimit(file.GetHeaderSize());
+		CGmaDocument document(&counting);
+
+		GMA_CHECK(document.EnsureStage(GMA_STAGE_HEADER) == GMA_S_OK);
+		GMA_CHECK(_SameHeader(document.GetHeader(), headerExpected));
+		GMA_CHECK(counting.GetViewCount() == 1ul);
+		GMA_CHECK(counting.GetReadCount() == 0ul);
+		GMA_CHECK(counting.GetHighWater() == file.GetHeaderSize());
+
+		// The file table is past the limit, so walking it has to notice
+		document.EnsureStage(GMA_STAGE_TOC);
+		GMA_CHECK(document.GetTocStatus() != GMA_S_OK || document.GetTocSummary().cFiles != c_cFiles);
+	}
+
+	{
+		CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+		CGmaCountingByteSource counting(&memory);
+		counting.SetViewLimit(file.GetDataStart());
+		CGmaDocument document(&counting);
+
+		GMA_CHECK(document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK);
+		GMA_CHECK(document.GetTocStatus() == GMA_S_OK);
+		GMA_CHECK(document.GetTocSummary().cFiles == c_cFiles);
+		GMA_CHECK(counting.GetViewCount() == 1ul);
+		GMA_CHECK(counting.GetReadCount() == 0ul);
+	}
+}
+
+int main()
+{
+	CGmaTestFile file;
+	file.BuildGma("Counted", "{\"description\":\"d\",\"type\":\"tool\",\"tags\":[\"fun\"]}", "Author", c_cFiles);
+	GMA_CHECK(file.GetDataStart() > 2 * (size_t)c_cbGmaTocReadChunk); // Long enough to need several table reads
+
+	CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+	CGmaDocument documentExpected(&memory);
+	GMA_CHECK(documentExpected.EnsureStage(GMA_STAGE_HEADER) == GMA_S_OK);
+
+	_CheckStream(file);
+	_CheckView(file, documentExpected.GetHeader());
+
+	return GmaTestResult("CountingSourceTest");
+}
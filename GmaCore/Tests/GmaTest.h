@@ -0,0 +1,149 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaReader.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Shared bits of the GMA core checks (make check)
+// Each check is its own program that prints what failed and exits non-zero if anything did.
+
+static int g_cGmaTestFailures = 0;
+
+#define GMA_CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+			g_cGmaTestFailures++; \
+		} \
+	} while (0)
+
+static inline int GmaTestResult(const char* pszName)
+{
+	if (g_cGmaTestFailures != 0)
+		fprintf(stderr, "%s: %d check(s) failed\n", pszName, g_cGmaTestFailures);
+	else
+		printf("%s: ok\n", pszName);
+	return (g_cGmaTestFailures != 0) ? 1 : 0;
+}
+
+// For the benchmarks (make bench)
+static inline uint64_t GmaTestGetMonotonicNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     GMA builder
+// ____________________________________________________________________________________________________
+//
+
+// Growable byte buffer that test GMAs are written into
+class CGmaTestFile
+{
+public:
+	CGmaTestFile() : _pb(NULL), _cb(0), _cbCapacity(0), _cbHeader(0), _cbBeforeData(0) {}
+	~CGmaTestFile() { delete[] _pb; }
+
+	const uint8_t* GetData() const { return _pb; }
+	size_t GetSize() const { return _cb; }
+	size_t GetHeaderSize() const { return _cbHeader; } // Where BuildGma() started the file table
+	size_t GetDataStart() const { return _cbBeforeData; } // Where BuildGma() started the file data
+	void Clear() { _cb = 0; }
+	void Truncate(size_t cb) { if (cb < _cb) _cb = cb; }
+
+	void Append(const void* pv, size_t cb)
+	{
+		if (_cb + cb > _cbCapacity)
+		{
+			size_t cbCapacity = (_cbCapacity != 0) ? _cbCapacity * 2 : 4096;
+			while (cbCapacity < _cb + cb)
+				cbCapacity *= 2;
+			uint8_t* pb = new uint8_t[cbCapacity];
+			if (_cb != 0)
+				memcpy(pb, _pb, _cb);
+			delete[] _pb;
+			_pb = pb;
+			_cbCapacity = cbCapacity;
+		}
+		memcpy(_pb + _cb, pv, cb);
+		_cb += cb;
+	}
+
+	void AppendString(const char* psz) { Append(psz, strlen(psz) + 1); } // With its terminator
+	void AppendByte(uint8_t b) { Append(&b, 1); }
+
+	void AppendLE32(uint32_t ul)
+	{
+		uint8_t ab[4] = { (uint8_t)ul, (uint8_t)(ul >> 8), (uint8_t)(ul >> 16), (uint8_t)(ul >> 24) };
+		Append(ab, sizeof(ab));
+	}
+
+	void AppendLE64(uint64_t ull)
+	{
+		AppendLE32((uint32_t)ull);
+		AppendLE32((uint32_t)(ull >> 32));
+	}
+
+	// A complete version 3 GMA with cFiles file table entries and a few bytes of file data
+	void BuildGma(const char* pszName, const char* pszDescription, const char* pszAuthor, uint32_t cFiles)
+	{
+		Clear();
+		Append("GMAD", 4);
+		AppendByte(3);
+		AppendLE64(76561197960287930ull); // SteamID64
+		AppendLE64(1600000000ull); // timestamp
+		AppendString(""); // required content
+		AppendString(pszName);
+		AppendString(pszDescription);
+		AppendString(pszAuthor);
+		AppendLE32(1ul); // addon version
+		_cbHeader = _cb;
+
+		char szPath[64];
+		for (uint32_t i = 0; i < cFiles; i++)
+		{
+			AppendLE32(i + 1);
+			snprintf(szPath, sizeof(szPath), "lua/autorun/file_%u.lua", i);
+			AppendString(szPath);
+			AppendLE64(16ull + i); // size
+			AppendLE32(0ul); // CRC
+		}
+		AppendLE32(0ul);
+		_cbBeforeData = _cb;
+
+		for (int i = 0; i < 64; i++)
+			AppendByte('x');
+	}
+
+private:
+	uint8_t* _pb;
+	size_t _cb;
+	size_t _cbCapacity;
+	size_t _cbHeader;
+	size_t _cbBeforeData;
+
+	CGmaTestFile(const CGmaTestFile&);
+	CGmaTestFile& operator=(const CGmaTestFile&);
+};
+
+// Hides a source's view, so parsers have to go through Read() like they do for a stream
+class CGmaTestStreamSource : public IGmaByteSource
+{
+public:
+	explicit CGmaTestStreamSource(IGmaByteSource* pInner) : _pInner(pInner) {}
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead) { return _pInner->Read(pBuf, cbToRead, pcbRead); }
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos) { return _pInner->Seek(llOffset, origin, pullNewPos); }
+	GmaStatus GetSize(uint64_t* pullSize) { return _pInner->GetSize(pullSize); }
+
+private:
+	IGmaByteSource* _pInner;
+};
@@ -0,0 +1,168 @@
+// Throughput of the description field parsers: cJSON building a whole tree, GmaParseDescriptionField() as the readers call it, and the streaming extractor on its own
+// The descriptions are pretty-printed the way gmad.exe writes addon.json. Each parser's results are checked against cJSON's first.
+
+#include "GmaTest.h"
+#include "GmaFormat.h"
+#include "GmaJson.h"
+#include "GmaParseContext.h"
+#include "cJSON.h"
+
+struct JsonInput
+{
+	const char* pszName;
+	CGmaTestFile text;
+};
+
+static void _AppendText(CGmaTestFile* pText, const char* psz)
+{
+	pText->Append(psz, strlen(psz));
+}
+
+// A typical addon.json: a paragraph of description, a type and a few tags
+static void _BuildTypical(CGmaTestFile* pText)
+{
+	_AppendText(pText, "{\n\t\"title\": \"Some Addon\",\n\t\"type\": \"weapon\",\n\t\"tags\": [\n\t\t\"fun\",\n\t\t\"realism\"\n\t],\n\t\"description\": \"");
+	for (int i = 0; i < 4; i++)
+		_AppendText(pText, "A weapon pack with a few models, sounds and a \\\"custom\\\" base.\\nWorks in singleplayer and multiplayer. ");
+	_AppendText(pText, "\"\n}");
+}
+
+// A long description, with the escapes and non-ASCII text a changelog tends to have
+static void _BuildLongDescription(CGmaTestFile* pText)
+{
+	_AppendText(pText, "{\n\t\"title\": \"Big Addon\",\n\t\"type\": \"gamemode\",\n\t\"tags\": [\n\t\t\"roleplay\",\n\t\t\"build\"\n\t],\n\t\"description\": \"");
+	for (int i = 0; i < 200; i++)
+		_AppendText(pText, "\\t- Fixed a bug with the caf\\u00e9 map \\u2014 thanks \\\"someone\\\" \xc3\xa9\xc3\xa8\\n");
+	_AppendText(pText, "\"\n}");
+}
+
+// The wanted keys first, then a long "ignore" list the extractor never has to look at
+static void _BuildIgnoreList(CGmaTestFile* pText)
+{
+	_AppendText(pText, "{\n\t\"title\": \"Map Pack\",\n\t\"type\": \"map\",\n\t\"tags\": [\n\t\t\"scenic\"\n\t],\n\t\"description\": \"Some maps\",\n\t\"ignore\": [\n");
+	char szLine[64];
+	for (int i = 0; i < 2000; i++)
+	{
+		snprintf(szLine, sizeof(szLine), "%s\t\t\"src/maps/work_%d.vmf\"", (i != 0) ? ",\n" : "", i);
+		_AppendText(pText, szLine);
+	}
+	_AppendText(pText, "\n\t]\n}");
+}
+
+// Same keys as above, but with the ignore list first, so every parser has to get through it
+static void _BuildIgnoreListFirst(CGmaTestFile* pText)
+{
+	_AppendText(pText, "{\n\t\"ignore\": [\n");
+	char szLine[64];
+	for (int i = 0; i < 2000; i++)
+	{
+		snprintf(szLine, sizeof(szLine), "%s\t\t\"src/maps/work_%d.vmf\"", (i != 0) ? ",\n" : "", i);
+		_AppendText(pText, szLine);
+	}
+	_AppendText(pText, "\n\t],\n\t\"title\": \"Map Pack\",\n\t\"type\": \"map\",\n\t\"tags\": [\n\t\t\"scenic\"\n\t],\n\t\"description\": \"Some maps\"\n}");
+}
+
+static void _CheckAgainstCJson(const JsonInput& input, const GmaHeaderInfo& info)
+{
+	cJSON* pjnRoot = cJSON_Parse((const char*)input.text.GetData());
+	GMA_CHECK(pjnRoot != NULL);
+	if (pjnRoot == NULL)
+		return;
+
+	const cJSON* pjnDescription = cJSON_GetObjectItem(pjnRoot, "description");
+	const cJSON* pjnType = cJSON_GetObjectItem(pjnRoot, "type");
+	GMA_CHECK(info.bUsesJsonChunkInDescription);
+	GMA_CHECK(info.strDescription.cch == strlen(pjnDescription->valuestring) && memcmp(info.strDescription.psz, pjnDescription->valuestring, info.strDescription.cch) == 0);
+	GMA_CHECK(info.strType.cch == strlen(pjnType->valuestring) && memcmp(info.strType.psz, pjnType->valuestring, info.strType.cch) == 0);
+	GMA_CHECK(info.cTags == (uint32_t)cJSON_GetArraySize(cJSON_GetObjectItem(pjnRoot, "tags")));
+	cJSON_Delete(pjnRoot);
+}
+
+static void _PrintRate(const JsonInput& input, const char* pszParser, uint64_t cIterations, uint64_t nsElapsed)
+{
+	double dNs = (double)nsElapsed / cIterations;
+	printf("  %-12s %-20s %10.1f us %9.1f MB/s\n", input.pszName, pszParser, dNs / 1000.0, input.text.GetSize() * 1000.0 / dNs);
+}
+
+static void _Bench(const JsonInput& input)
+{
+	const char* psz = (const char*)input.text.GetData();
+	uint32_t cch = (uint32_t)input.text.GetSize() - 1;
+	uint64_t cIterations;
+	uint64_t nsStart;
+	uint64_t nsElapsed;
+	size_t ulSink = 0;
+
+	// A whole tree, allocated with malloc, as cJSON_Parse() is usually called
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		cJSON* pjnRoot = cJSON_Parse(psz);
+		ulSink += (pjnRoot != NULL) ? 1 : 0;
+		cJSON_Delete(pjnRoot);
+		cIterations++;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input, "cJSON_Parse", cIterations, nsElapsed);
+
+	// What the readers do, with a parse context's arenas reset between headers
+	CGmaParseContext context;
+	GmaHeaderInfo info;
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		context.Reset();
+		memset(&info, 0, sizeof(info));
+		GmaParseDescriptionField(psz, cch, context.GetArena(), context.GetScratchArena(), &info);
+		ulSink += info.cTags;
+		cIterations++;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input, "ParseDescription", cIterations, nsElapsed);
+	_CheckAgainstCJson(input, info);
+
+	// Just the extractor
+	GmaJsonKey aKeys[3];
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		memset(aKeys, 0, sizeof(aKeys));
+		aKeys[0].pszName = "description";
+		aKeys[1].pszName = "type";
+		aKeys[2].pszName = "tags";
+		aKeys[2].bStringArray = true;
+		context.Reset();
+		GmaJsonExtractKeys(psz, cch, aKeys, 3, context.GetArena());
+		ulSink += aKeys[2].cStrings;
+		cIterations++;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input, "GmaJsonExtractKeys", cIterations, nsElapsed);
+
+	if (ulSink == 0)
+		printf("\n"); // Keeps the calls from being optimized away
+}
+
+int main()
+{
+	JsonInput aInputs[4];
+	aInputs[0].pszName = "typical";
+	_BuildTypical(&aInputs[0].text);
+	aInputs[1].pszName = "long";
+	_BuildLongDescription(&aInputs[1].text);
+	aInputs[2].pszName = "ignore-last";
+	_BuildIgnoreList(&aInputs[2].text);
+	aInputs[3].pszName = "ignore-first";
+	_BuildIgnoreListFirst(&aInputs[3].text);
+
+	printf("JsonBench:\n");
+	for (size_t i = 0; i < sizeof(aInputs) / sizeof(aInputs[0]); i++)
+	{
+		aInputs[i].text.AppendByte(0); // As the field is in a GMA
+		_Bench(aInputs[i]);
+	}
+	return GmaTestResult("JsonBench");
+}
@@ -0,0 +1,424 @@
+// Differential fuzzing of the description field parser, with cJSON as the oracle, and of the GMA parsers against each other
+// Descriptions are generated json objects shaped like addon.json, plus random mutations of them. Whenever cJSON accepts one, GmaParseDescriptionField() must find exactly what cJSON finds. The streaming extractor may accept json that cJSON rejects only past the last wanted key, since it stops reading there.
+// GMAs are valid files with random bytes changed or cut off. CGmaDocument over a view, over a stream and CGmaPushParser fed in random chunks must all agree on them, and none may crash (run under make check-asan for the memory errors).
+
+#include "GmaTest.h"
+#include "GmaFormat.h"
+#include "GmaJson.h"
+#include "GmaDocument.h"
+#include "GmaPushParser.h"
+#include "cJSON.h"
+#include <stdlib.h>
+
+const uint32_t c_cDescriptions = 20000ul;
+const uint32_t c_cGmas = 2000ul;
+
+static uint64_t s_ullRandom = 0x2545F4914F6CDD1Dull;
+
+static uint32_t _Random(uint32_t ulBound)
+{
+	s_ullRandom ^= s_ullRandom << 13;
+	s_ullRandom ^= s_ullRandom >> 7;
+	s_ullRandom ^= s_ullRandom << 17;
+	return (uint32_t)((s_ullRandom >> 16) % ulBound);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Description generator
+// ____________________________________________________________________________________________________
+//
+
+static void _AppendWhitespace(CGmaTestFile* pText)
+{
+	static const char c_achWhitespace[] = { ' ', '\t', '\n', '\r', '\v', '\x01' };
+	while (_Random(3) == 0)
+		pText->AppendByte((uint8_t)c_achWhitespace[_Random(sizeof(c_achWhitespace))]);
+}
+
+static void _AppendString(CGmaTestFile* pText)
+{
+	static const char* const c_apszPieces[] = { "Some text", " ", "\\n", "\\t", "\\\"", "\\\\", "\\/", "\\u00e9", "\\u20AC", "\\ud83d\\ude00", "\\u0000", "\\u12", "\\uzzzz", "\\ud800", "\\udc00x", "\\q", "\xc3\xa9", "\xff", "\x01" };
+	pText->AppendByte('"');
+	uint32_t cPieces = _Random(6);
+	for (uint32_t i = 0; i < cPieces; i++)
+	{
+		// Mostly plain text, now and then something odd
+		const char* psz = (_Random(4) != 0) ? c_apszPieces[_Random(8)] : c_apszPieces[_Random(sizeof(c_apszPieces) / sizeof(c_apszPieces[0]))];
+		pText->Append(psz, strlen(psz));
+	}
+	pText->AppendByte('"');
+}
+
+static void _AppendKey(CGmaTestFile* pText)
+{
+	static const char* const c_apszKeys[] = { "\"description\"", "\"type\"", "\"tags\"", "\"ignore\"", "\"title\"", "\"Description\"", "\"TAGS\"", "\"TyPe\"", "\"descriptio\"", "\"typeX\"", "\"t\\u0061gs\"", "\"\"" };
+	const char* psz = c_apszKeys[_Random(sizeof(c_apszKeys) / sizeof(c_apszKeys[0]))];
+	pText->Append(psz, strlen(psz));
+}
+
+static void _AppendValue(CGmaTestFile* pText, uint32_t cDepth);
+
+static void _AppendContainer(CGmaTestFile* pText, bool bObject, uint32_t cDepth)
+{
+	pText->AppendByte(bObject ? '{' : '[');
+	_AppendWhitespace(pText);
+	uint32_t cItems = _Random(cDepth < 2 ? 6 : 3);
+	for (uint32_t i = 0; i < cItems; i++)
+	{
+		if (i != 0)
+		{
+			pText->AppendByte(',');
+			_AppendWhitespace(pText);
+		}
+		if (bObject)
+		{
+			_AppendKey(pText);
+			_AppendWhitespace(pText);
+			pText->AppendByte(':');
+			_AppendWhitespace(pText);
+		}
+		_AppendValue(pText, cDepth + 1);
+		_AppendWhitespace(pText);
+	}
+	pText->AppendByte(bObject ? '}' : ']');
+}
+
+static void _AppendValue(CGmaTestFile* pText, uint32_t cDepth)
+{
+	static const char* const c_apszScalars[] = { "true", "false", "null", "0", "-1", "12.5", "1e3", "-0.0e-2", "1e", "--1", "+1", "1.2.3", "tru", "nul", "0x10", "-.5", "1.", "12345678901234567890123456789012345678901234567890123456789012345678901234567890" };
+	switch (_Random((cDepth < 4) ? 5 : 3))
+	{
+	case 0:
+	case 1:
+		_AppendString(pText);
+		break;
+	case 2:
+		{
+			// Mostly valid scalars, sometimes ones cJSON rejects
+			const char* psz = (_Random(4) != 0) ? c_apszScalars[_Random(8)] : c_apszScalars[_Random(sizeof(c_apszScalars) / sizeof(c_apszScalars[0]))];
+			pText->Append(psz, strlen(psz));
+		}
+		break;
+	case 3:
+		_AppendContainer(pText, false, cDepth);
+		break;
+	default:
+		_AppendContainer(pText, true, cDepth);
+		break;
+	}
+}
+
+// Changes, inserts, removes or repeats a few bytes
+static void _Mutate(CGmaTestFile* pText)
+{
+	static const char c_achInteresting[] = "{}[]\",:\\ tfn0-";
+	uint32_t cMutations = 1 + _Random(3);
+	for (uint32_t i = 0; i < cMutations && pText->GetSize() > 2; i++)
+	{
+		uint8_t* pb = (uint8_t*)pText->GetData();
+		size_t cb = pText->GetSize();
+		size_t ul = _Random((uint32_t)cb);
+		switch (_Random(3))
+		{
+		case 0:
+			pb[ul] = (_Random(2) != 0) ? (uint8_t)c_achInteresting[_Random(sizeof(c_achInteresting) - 1)] : (uint8_t)_Random(256);
+			break;
+		case 1:
+			memmove(pb + ul, pb + ul + 1, cb - ul - 1);
+			pText->Truncate(cb - 1);
+			break;
+		default:
+			pText->AppendByte(0); // Makes room
+			pb = (uint8_t*)pText->GetData();
+			memmove(pb + ul + 1, pb + ul, cb - ul);
+			break;
+		}
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Description checks
+// ____________________________________________________________________________________________________
+//
+
+static bool _SameString(const GmaString& str, const char* psz)
+{
+	size_t cch = (psz != NULL) ? strlen(psz) : 0;
+	return str.cch == cch && (cch == 0 || memcmp(str.psz, psz, cch) == 0);
+}
+
+static bool _IsBraced(const char* psz, size_t cch)
+{
+	size_t ulFirst = 0;
+	while (ulFirst < cch && (psz[ulFirst] == ' ' || (psz[ulFirst] >= '\t' && psz[ulFirst] <= '\r')))
+		ulFirst++;
+	size_t ulLast = cch;
+	while (ulLast > 0 && (psz[ulLast - 1] == ' ' || (psz[ulLast - 1] >= '\t' && psz[ulLast - 1] <= '\r')))
+		ulLast--;
+	return ulFirst < ulLast && psz[ulFirst] == '{' && psz[ulLast - 1] == '}';
+}
+
+// What cJSON finds must be what the parser found
+static bool _MatchesTree(const GmaHeaderInfo& info, const cJSON* pjnRoot)
+{
+	const cJSON* pjnDescription = cJSON_GetObjectItem(pjnRoot, "description");
+	const cJSON* pjnType = cJSON_GetObjectItem(pjnRoot, "type");
+	const cJSON* pjnTags = cJSON_GetObjectItem(pjnRoot, "tags");
+
+	if (!_SameString(info.strDescription, cJSON_IsString(pjnDescription) ? pjnDescription->valuestring : NULL))
+		return false;
+	if (!_SameString(info.strType, cJSON_IsString(pjnType) ? pjnType->valuestring : NULL))
+		return false;
+
+	uint32_t cTags = 0ul;
+	if (cJSON_IsArray(pjnTags))
+	{
+		const cJSON* pjnTag;
+		cJSON_ArrayForEach(pjnTag, pjnTags)
+		{
+			if (!cJSON_IsString(pjnTag))
+				continue;
+			if (cTags >= info.cTags || !_SameString(info.astrTags[cTags], pjnTag->valuestring))
+				return false;
+			cTags++;
+		}
+	}
+	return cTags == info.cTags;
+}
+
+// Whether the extractor got to see every wanted key, which is the only way it may stop before cJSON finds a problem
+static bool _FoundAllKeys(const char* psz, size_t cch)
+{
+	GmaJsonKey aKeys[3];
+	memset(aKeys, 0, sizeof(aKeys));
+	aKeys[0].pszName = "description";
+	aKeys[1].pszName = "type";
+	aKeys[2].pszName = "tags";
+	aKeys[2].bStringArray = true;
+
+	CGmaArena arena;
+	return GmaJsonExtractKeys(psz, (uint32_t)cch, aKeys, 3, &arena) == GMA_S_OK && aKeys[0].bFound && aKeys[1].bFound && aKeys[2].bFound;
+}
+
+// Returns whether cJSON accepted it
+static bool _CheckDescription(CGmaTestFile* pText, CGmaArena* pArena, CGmaArena* pScratchArena)
+{
+	size_t cch = pText->GetSize();
+	pText->AppendByte(0);
+	const char* psz = (const char*)pText->GetData();
+	cch = strnlen(psz, cch); // The field ends at its terminator, as it does in a GMA
+
+	GmaHeaderInfo info;
+	memset(&info, 0, sizeof(info));
+	pArena->Reset();
+	if (GmaParseDescriptionField(psz, (uint32_t)cch, pArena, pScratchArena, &info) != GMA_S_OK)
+	{
+		GMA_CHECK(!"GmaParseDescriptionField failed");
+		return false;
+	}
+
+	cJSON* pjnRoot = _IsBraced(psz, cch) ? cJSON_ParseWithLengthOpts(psz, cch + 1, NULL, false) : NULL;
+	bool bAccepted = (pjnRoot != NULL);
+	bool bMatched;
+	if (bAccepted)
+		bMatched = info.bUsesJsonChunkInDescription && _MatchesTree(info, pjnRoot);
+	else if (info.bUsesJsonChunkInDescription)
+		bMatched = _FoundAllKeys(psz, cch);
+	else
+		bMatched = info.strDescription.psz == psz && info.strDescription.cch == cch;
+	cJSON_Delete(pjnRoot);
+
+	if (!bMatched)
+	{
+		fprintf(stderr, "description parsed differently from cJSON: %s\n", psz);
+		GMA_CHECK(bMatched);
+	}
+	return bAccepted;
+}
+
+static void _FuzzDescriptions()
+{
+	CGmaArena arena;
+	CGmaArena arenaScratch;
+	CGmaTestFile text;
+	uint32_t cAccepted = 0ul;
+	for (uint32_t i = 0; i < c_cDescriptions; i++)
+	{
+		text.Clear();
+		_AppendWhitespace(&text);
+		_AppendContainer(&text, true, 0);
+		_AppendWhitespace(&text);
+		if (_Random(2) == 0)
+			_Mutate(&text);
+		cAccepted += _CheckDescription(&text, &arena, (i & 1) ? &arenaScratch : NULL) ? 1ul : 0ul;
+	}
+
+	// Both sides of the oracle need to come up often
+	GMA_CHECK(cAccepted > c_cDescriptions / 4 && cAccepted < c_cDescriptions - c_cDescriptions / 8);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     GMA checks
+// ____________________________________________________________________________________________________
+//
+
+// What one parser made of a file
+struct ParseResult
+{
+	bool bHeader;
+	char szName[64];
+	uint32_t cchDescription;
+	uint32_t cTags;
+	bool bToc;
+	uint32_t cFiles;
+	uint64_t ullDataStart;
+	uint64_t ullTotalSize;
+};
+
+static void _SetHeader(ParseResult* pResult, const GmaHeaderInfo& header)
+{
+	pResult->bHeader = true;
+	snprintf(pResult->szName, sizeof(pResult->szName), "%.*s", (int)header.strName.cch, header.strName.psz);
+	pResult->cchDescription = header.strDescription.cch;
+	pResult->cTags = header.cTags;
+}
+
+static void _ParseDocument(IGmaByteSource* pSource, CGmaParseContext* pContext, ParseResult* pResult)
+{
+	memset(pResult, 0, sizeof(*pResult));
+	pContext->Reset();
+	CGmaDocument document(pSource, pContext);
+	if (document.EnsureStage(GMA_STAGE_HEADER) != GMA_S_OK)
+		return;
+	_SetHeader(pResult, document.GetHeader());
+
+	document.EnsureStage(GMA_STAGE_TOC);
+	if (document.GetTocStatus() != GMA_S_OK)
+		return;
+	pResult->bToc = true;
+	pResult->cFiles = document.GetTocSummary().cFiles;
+	pResult->ullDataStart = document.GetTocSummary().ullDataStart;
+	pResult->ullTotalSize = document.GetTocSummary().ullTotalSize;
+}
+
+class CFuzzSink : public IGmaPushParserSink
+{
+public:
+	explicit CFuzzSink(ParseResult* pResult) : _pResult(pResult) {}
+
+	GmaStatus OnHeader(const GmaHeaderInfo& info) { _SetHeader(_pResult, info); return GMA_S_OK; }
+	GmaStatus OnTocEntry(const GmaTocEntry&) { return GMA_S_OK; }
+
+	GmaStatus OnTocEnd(const GmaTocSummary& summary)
+	{
+		_pResult->bToc = true;
+		_pResult->cFiles = summary.cFiles;
+		_pResult->ullDataStart = summary.ullDataStart;
+		_pResult->ullTotalSize = summary.ullTotalSize;
+		return GMA_S_OK;
+	}
+
+private:
+	ParseResult* _pResult;
+};
+
+static void _ParsePush(const CGmaTestFile& file, CGmaArena* pArena, ParseResult* pResult)
+{
+	memset(pResult, 0, sizeof(*pResult));
+	pArena->Reset();
+	CFuzzSink sink(pResult);
+	CGmaPushParser parser(&sink, pArena);
+
+	size_t ul = 0;
+	while (ul < file.GetSize())
+	{
+		size_t cb = 1 + _Random(4096);
+		if (cb > file.GetSize() - ul)
+			cb = file.GetSize() - ul;
+		if (GMA_FAILED(parser.Feed(file.GetData() + ul, cb)))
+			return;
+		ul += cb;
+	}
+	parser.Finish();
+}
+
+static bool _SameResult(const ParseResult& result1, const ParseResult& result2)
+{
+	if (result1.bHeader != result2.bHeader || result1.bToc != result2.bToc)
+		return false;
+	if (result1.bHeader && (strcmp(result1.szName, result2.szName) != 0 || result1.cchDescription != result2.cchDescription || result1.cTags != result2.cTags))
+		return false;
+	return !result1.bToc || (result1.cFiles == result2.cFiles && result1.ullDataStart == result2.ullDataStart && result1.ullTotalSize == result2.ullTotalSize);
+}
+
+static void _FuzzGmas()
+{
+	static const char* const c_apszDescriptions[] = { "Plain text", "{\"description\":\"d\",\"type\":\"tool\",\"tags\":[\"fun\",\"build\"]}", "{\n\t\"title\": \"t\",\n\t\"type\": \"map\",\n\t\"tags\": [\"scenic\"],\n\t\"ignore\": [\"*.psd\"]\n}" };
+
+	CGmaParseContext context;
+	CGmaArena arenaPush;
+	CGmaTestFile file;
+	uint32_t cHeaders = 0ul;
+	uint32_t cTocs = 0ul;
+	for (uint32_t i = 0; i < c_cGmas; i++)
+	{
+		file.BuildGma("Fuzzed", c_apszDescriptions[_Random(3)], "Author", _Random(40));
+
+		// Aim most changes at the header and file table, where the parsers look
+		uint32_t cChanges = 1 + _Random(4);
+		for (uint32_t j = 0; j < cChanges; j++)
+		{
+			uint8_t* pb = (uint8_t*)file.GetData();
+			switch (_Random(4))
+			{
+			case 0:
+				file.Truncate(_Random((uint32_t)file.GetSize()));
+				break;
+			case 1:
+				pb[_Random((uint32_t)file.GetHeaderSize())] = (uint8_t)_Random(256);
+				break;
+			default:
+				pb[_Random((uint32_t)file.GetSize())] = (_Random(2) != 0) ? 0 : 0xff;
+				break;
+			}
+			if (file.GetSize() == 0)
+				break;
+		}
+
+		ParseResult resultView;
+		ParseResult resultStream;
+		ParseResult resultPush;
+		{
+			CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+			_ParseDocument(&memory, &context, &resultView);
+		}
+		{
+			CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+			CGmaTestStreamSource stream(&memory);
+			_ParseDocument(&stream, &context, &resultStream);
+		}
+		_ParsePush(file, &arenaPush, &resultPush);
+
+		GMA_CHECK(_SameResult(resultView, resultStream));
+		GMA_CHECK(_SameResult(resultView, resultPush));
+		cHeaders += resultView.bHeader ? 1ul : 0ul;
+		cTocs += resultView.bToc ? 1ul : 0ul;
+	}
+
+	// The mutations shouldn't be so heavy that nothing gets past the magic
+	GMA_CHECK(cHeaders > c_cGmas / 4);
+	GMA_CHECK(cTocs > c_cGmas / 8);
+}
+
+int main()
+{
+	_FuzzDescriptions();
+	_FuzzGmas();
+	return GmaTestResult("JsonFuzzTest");
+}
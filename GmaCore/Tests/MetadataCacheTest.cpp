@@ -0,0 +1,405 @@
+// Checks CGmaMetadataCache: LRU order and eviction within a stripe, the per-stripe budget, which results get cached, SetBudget(), replacing entries and the counters
+// Entries with the same string lengths take the same number of bytes, so budgets are given in entries, measured from the first one inserted.
+// Ends with several threads looking up and inserting overlapping keys through evictions. Build it with make check-tsan to have ThreadSanitizer watch them.
+
+#include "GmaTest.h"
+#include "GmaCache.h"
+#include <pthread.h>
+
+const size_t c_cchDescription = 64;
+const uint32_t c_cThreads = 4ul;
+const uint32_t c_cThreadKeys = 512ul;
+const uint32_t c_cThreadOperations = 20000ul;
+
+static char s_szDescription[4096];
+
+static GmaCacheKey _MakeKey(uint32_t i)
+{
+	GmaCacheKey key;
+	key.ullVolume = 7ull;
+	key.ullFileId = 1000ull + i;
+	key.ullSize = 4096ull + i;
+	key.ullLastWrite = 1600000000ull;
+	return key;
+}
+
+// The stripe CGmaMetadataCache::_GetStripe() picks for key
+static uint32_t _GetStripe(const GmaCacheKey& key)
+{
+	return (uint32_t)(GmaHashCacheKey(key) >> 58) & (c_cGmaMetadataCacheStripes - 1);
+}
+
+// The first cKeys key numbers from iFirst on whose keys fall into stripe iStripe
+static void _FindStripeKeys(uint32_t iStripe, uint32_t iFirst, uint32_t* ai, uint32_t cKeys)
+{
+	for (uint32_t i = iFirst, iKey = 0; iKey < cKeys; i++)
+	{
+		if (_GetStripe(_MakeKey(i)) == iStripe)
+			ai[iKey++] = i;
+	}
+}
+
+// A parsed header for key number i. szName must stay valid until the entry is inserted.
+static void _MakeMeta(uint32_t i, size_t cchDescription, char (&szName)[32], GmaCachedMetadata* pMeta)
+{
+	snprintf(szName, sizeof(szName), "addon-%08u", i);
+
+	memset(pMeta, 0, sizeof(*pMeta));
+	pMeta->stage = GMA_STAGE_HEADER;
+	pMeta->statusFailed = GMA_S_OK;
+	pMeta->statusToc = GMA_E_UNEXPECTED;
+	pMeta->header.strName.psz = szName;
+	pMeta->header.strName.cch = (uint32_t)strlen(szName);
+	pMeta->header.strDescription.psz = s_szDescription;
+	pMeta->header.strDescription.cch = (uint32_t)cchDescription;
+	pMeta->header.strAuthor.psz = "Author";
+	pMeta->header.strAuthor.cch = 6ul;
+	pMeta->header.bFormatVersion = 3;
+}
+
+static GmaStatus _Insert(CGmaMetadataCache* pCache, uint32_t i, size_t cchDescription = c_cchDescription)
+{
+	char szName[32];
+	GmaCachedMetadata meta;
+	_MakeMeta(i, cchDescription, szName, &meta);
+	return pCache->Insert(_MakeKey(i), meta);
+}
+
+// Looks key number i up, which marks it most recently used on a hit. A hit must be exactly what _Insert() put in.
+static bool _Lookup(CGmaMetadataCache* pCache, uint32_t i, bool* pbCorrect, size_t cchDescription = c_cchDescription)
+{
+	CGmaArena arena;
+	GmaCachedMetadata meta;
+	*pbCorrect = true;
+	if (!pCache->Lookup(_MakeKey(i), &meta, &arena))
+		return false;
+
+	char szName[32];
+	snprintf(szName, sizeof(szName), "addon-%08u", i);
+	*pbCorrect = meta.stage == GMA_STAGE_HEADER && meta.statusFailed == GMA_S_OK && meta.header.strName.cch == strlen(szName) && strcmp(meta.header.strName.psz, szName) == 0
+		&& meta.header.strDescription.cch == cchDescription && memcmp(meta.header.strDescription.psz, s_szDescription, cchDescription) == 0
+		&& meta.header.strAuthor.cch == 6ul && strcmp(meta.header.strAuthor.psz, "Author") == 0 && meta.header.bFormatVersion == 3;
+	return true;
+}
+
+static bool _IsCached(CGmaMetadataCache* pCache, uint32_t i, size_t cchDescription = c_cchDescription)
+{
+	bool bCorrect;
+	bool bHit = _Lookup(pCache, i, &bCorrect, cchDescription);
+	GMA_CHECK(bCorrect);
+	return bHit;
+}
+
+// What GetStats() should say, kept up to date by the checks as they go
+struct ExpectedStats
+{
+	uint64_t cHits;
+	uint64_t cMisses;
+	uint64_t cInserts;
+	uint64_t cEvictions;
+	size_t cEntries;
+	size_t cbUsed;
+	size_t cbBudget;
+};
+
+static void _CheckStats(CGmaMetadataCache* pCache, const ExpectedStats& expected)
+{
+	GmaCacheStats stats;
+	pCache->GetStats(&stats);
+	GMA_CHECK(stats.cHits == expected.cHits);
+	GMA_CHECK(stats.cMisses == expected.cMisses);
+	GMA_CHECK(stats.cInserts == expected.cInserts);
+	GMA_CHECK(stats.cEvictions == expected.cEvictions);
+	GMA_CHECK(stats.cEntries == expected.cEntries);
+	GMA_CHECK(stats.cbUsed == expected.cbUsed);
+	GMA_CHECK(stats.cbBudget == expected.cbBudget);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Single thread
+// ____________________________________________________________________________________________________
+//
+
+// Bytes one entry from _Insert() takes, with the default description
+static size_t _MeasureEntry()
+{
+	CGmaMetadataCache cache;
+	GMA_CHECK(_Insert(&cache, 0) == GMA_S_OK);
+	GmaCacheStats stats;
+	cache.GetStats(&stats);
+	GMA_CHECK(stats.cEntries == 1 && stats.cbUsed > c_cchDescription);
+	return stats.cbUsed;
+}
+
+// Three entries fit in each stripe. Lookups keep entries alive, eviction goes from the least recently used end, and other stripes are left alone.
+static void _CheckLru(size_t cbEntry)
+{
+	CGmaMetadataCache cache(c_cGmaMetadataCacheStripes * 3 * cbEntry);
+	ExpectedStats expected = { 0ull, 0ull, 0ull, 0ull, 0, 0, c_cGmaMetadataCacheStripes * 3 * cbEntry };
+	_CheckStats(&cache, expected);
+
+	uint32_t ai[8];
+	uint32_t iOther;
+	_FindStripeKeys(0ul, 0ul, ai, 8ul);
+	_FindStripeKeys(1ul, 0ul, &iOther, 1ul);
+
+	GMA_CHECK(_Insert(&cache, iOther) == GMA_S_OK);
+	for (uint32_t i = 0; i < 3; i++)
+		GMA_CHECK(_Insert(&cache, ai[i]) == GMA_S_OK);
+	expected.cInserts += 4;
+	expected.cEntries = 4;
+	expected.cbUsed = 4 * cbEntry;
+	_CheckStats(&cache, expected);
+
+	// Stripe 0 from most to least recently used: 0 2 1
+	GMA_CHECK(_IsCached(&cache, ai[0]));
+	GMA_CHECK(_Insert(&cache, ai[3]) == GMA_S_OK); // 3 0 2, evicting 1
+	expected.cHits++;
+	expected.cInserts++;
+	expected.cEvictions++;
+	_CheckStats(&cache, expected);
+
+	GMA_CHECK(!_IsCached(&cache, ai[1]));
+	GMA_CHECK(_IsCached(&cache, ai[2])); // 2 3 0
+	GMA_CHECK(_IsCached(&cache, ai[3])); // 3 2 0
+	expected.cMisses++;
+	expected.cHits += 2;
+	GMA_CHECK(_Insert(&cache, ai[4]) == GMA_S_OK); // 4 3 2, evicting 0
+	expected.cInserts++;
+	expected.cEvictions++;
+	GMA_CHECK(!_IsCached(&cache, ai[0]));
+	expected.cMisses++;
+	_CheckStats(&cache, expected);
+
+	// An entry of one and a half normal ones makes room by evicting the two least recently used: 5 4
+	GMA_CHECK(_Insert(&cache, ai[5], c_cchDescription + cbEntry / 2) == GMA_S_OK);
+	expected.cInserts++;
+	expected.cEvictions += 2;
+	expected.cEntries = 3;
+	expected.cbUsed = 3 * cbEntry + cbEntry / 2;
+	_CheckStats(&cache, expected);
+	GMA_CHECK(!_IsCached(&cache, ai[2]) && !_IsCached(&cache, ai[3]));
+	GMA_CHECK(_IsCached(&cache, ai[4]));
+	GMA_CHECK(_IsCached(&cache, ai[5], c_cchDescription + cbEntry / 2));
+	expected.cMisses += 2;
+	expected.cHits += 2;
+
+	// The other stripe still has its entry, although stripe 0 could have used its share
+	GMA_CHECK(_IsCached(&cache, iOther));
+	expected.cHits++;
+	_CheckStats(&cache, expected);
+
+	// An entry larger than a stripe's share is refused, without evicting anything for it
+	GMA_CHECK(_Insert(&cache, ai[6], c_cchDescription + 3 * cbEntry) == GMA_E_ABORT);
+	_CheckStats(&cache, expected);
+	GMA_CHECK(!_IsCached(&cache, ai[6], c_cchDescription + 3 * cbEntry));
+	GMA_CHECK(_IsCached(&cache, ai[4]));
+	expected.cMisses++;
+	expected.cHits++;
+	_CheckStats(&cache, expected);
+
+	// Counters survive Clear()
+	cache.Clear();
+	expected.cEntries = 0;
+	expected.cbUsed = 0;
+	_CheckStats(&cache, expected);
+	GMA_CHECK(!_IsCached(&cache, ai[4]) && !_IsCached(&cache, iOther));
+}
+
+// Insert() on a key already cached replaces its entry rather than adding another
+static void _CheckReplace(size_t cbEntry)
+{
+	CGmaMetadataCache cache;
+	GMA_CHECK(_Insert(&cache, 1ul) == GMA_S_OK);
+	GMA_CHECK(_Insert(&cache, 1ul, c_cchDescription * 2) == GMA_S_OK);
+	GMA_CHECK(_IsCached(&cache, 1ul, c_cchDescription * 2));
+	ExpectedStats expected = { 1ull, 0ull, 2ull, 0ull, 1, cbEntry + c_cchDescription, c_cbGmaMetadataCacheDefaultBudget };
+	_CheckStats(&cache, expected);
+
+	// A different key for the same file, e.g. after it was modified, is a separate entry
+	GmaCacheKey key = _MakeKey(1ul);
+	key.ullLastWrite++;
+	char szName[32];
+	GmaCachedMetadata meta;
+	_MakeMeta(1ul, c_cchDescription, szName, &meta);
+	GMA_CHECK(cache.Insert(key, meta) == GMA_S_OK);
+	GMA_CHECK(_IsCached(&cache, 1ul, c_cchDescription * 2));
+	expected.cHits++;
+	expected.cInserts++;
+	expected.cEntries++;
+	expected.cbUsed += cbEntry;
+	_CheckStats(&cache, expected);
+}
+
+// Files that aren't GMAs, or are corrupt, are cached like any other, but failures that may not happen next time are not
+static void _CheckNegativeResults()
+{
+	CGmaMetadataCache cache;
+	CGmaArena arena;
+	GmaCachedMetadata meta;
+	GmaCachedMetadata metaHit;
+
+	memset(&meta, 0, sizeof(meta));
+	meta.stage = GMA_STAGE_NONE;
+	meta.statusFailed = GMA_E_ABORT;
+	meta.statusToc = GMA_E_UNEXPECTED;
+	GMA_CHECK(cache.Insert(_MakeKey(1ul), meta) == GMA_S_OK);
+	GMA_CHECK(cache.Lookup(_MakeKey(1ul), &metaHit, &arena) && metaHit.stage == GMA_STAGE_NONE && metaHit.statusFailed == GMA_E_ABORT);
+	GMA_CHECK(metaHit.header.strName.psz == NULL && metaHit.header.astrTags == NULL);
+
+	// A header that parsed, with a file table that didn't
+	char szName[32];
+	_MakeMeta(2ul, c_cchDescription, szName, &meta);
+	meta.statusFailed = GMA_E_UNEXPECTED;
+	GMA_CHECK(cache.Insert(_MakeKey(2ul), meta) == GMA_S_OK);
+	GMA_CHECK(cache.Lookup(_MakeKey(2ul), &metaHit, &arena) && metaHit.stage == GMA_STAGE_HEADER && metaHit.statusFailed == GMA_E_UNEXPECTED);
+	GMA_CHECK(strcmp(metaHit.header.strName.psz, szName) == 0);
+
+	meta.statusFailed = GMA_E_IO;
+	GMA_CHECK(cache.Insert(_MakeKey(3ul), meta) == GMA_S_OK);
+	meta.statusFailed = GMA_E_OUTOFMEMORY;
+	GMA_CHECK(cache.Insert(_MakeKey(4ul), meta) == GMA_S_OK);
+	GMA_CHECK(!cache.Lookup(_MakeKey(3ul), &metaHit, &arena) && !cache.Lookup(_MakeKey(4ul), &metaHit, &arena));
+
+	GmaCacheStats stats;
+	cache.GetStats(&stats);
+	GMA_CHECK(stats.cInserts == 2 && stats.cEntries == 2 && stats.cHits == 2 && stats.cMisses == 2);
+}
+
+// Shrinking the budget evicts the least recently used entries of each stripe right away. 0 empties the cache and refuses everything.
+static void _CheckSetBudget(size_t cbEntry)
+{
+	CGmaMetadataCache cache(c_cGmaMetadataCacheStripes * 3 * cbEntry);
+	uint32_t ai[3];
+	uint32_t aiOther[3];
+	_FindStripeKeys(2ul, 0ul, ai, 3ul);
+	_FindStripeKeys(3ul, 0ul, aiOther, 3ul);
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		GMA_CHECK(_Insert(&cache, ai[i]) == GMA_S_OK);
+		GMA_CHECK(_Insert(&cache, aiOther[i]) == GMA_S_OK);
+	}
+	GMA_CHECK(_IsCached(&cache, ai[0]));
+
+	// A budget that doesn't divide evenly is rounded down to what the stripes get
+	cache.SetBudget(c_cGmaMetadataCacheStripes * 2 * cbEntry + c_cGmaMetadataCacheStripes - 1);
+	ExpectedStats expected = { 1ull, 0ull, 6ull, 2ull, 4, 4 * cbEntry, c_cGmaMetadataCacheStripes * 2 * cbEntry };
+	_CheckStats(&cache, expected);
+	GMA_CHECK(_IsCached(&cache, ai[0]) && _IsCached(&cache, ai[2]) && !_IsCached(&cache, ai[1]));
+	GMA_CHECK(!_IsCached(&cache, aiOther[0]) && _IsCached(&cache, aiOther[1]) && _IsCached(&cache, aiOther[2]));
+	expected.cHits += 4;
+	expected.cMisses += 2;
+
+	// Growing it again doesn't bring anything back
+	cache.SetBudget(c_cGmaMetadataCacheStripes * 3 * cbEntry);
+	expected.cbBudget = c_cGmaMetadataCacheStripes * 3 * cbEntry;
+	_CheckStats(&cache, expected);
+
+	cache.SetBudget(0);
+	expected.cEvictions += 4;
+	expected.cEntries = 0;
+	expected.cbUsed = 0;
+	expected.cbBudget = 0;
+	_CheckStats(&cache, expected);
+	GMA_CHECK(_Insert(&cache, ai[0]) == GMA_E_ABORT);
+	GMA_CHECK(!_IsCached(&cache, ai[0]));
+	expected.cMisses++;
+	_CheckStats(&cache, expected);
+
+	cache.SetBudget(c_cGmaMetadataCacheStripes * cbEntry);
+	GMA_CHECK(_Insert(&cache, ai[0]) == GMA_S_OK && _IsCached(&cache, ai[0]));
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Threads
+// ____________________________________________________________________________________________________
+//
+
+struct WorkerArgs
+{
+	CGmaMetadataCache* pCache;
+	size_t cbEntry;
+	uint32_t iThread;
+	uint32_t cLookups;
+	uint32_t cInserts;
+	uint32_t cFailures;
+};
+
+// Looks up random keys out of a set shared with the other threads, and inserts the ones that miss. The last thread also changes the budget now and then.
+static void* _WorkerProc(void* pv)
+{
+	WorkerArgs* pArgs = (WorkerArgs*)pv;
+	uint64_t ullRandom = 0x9E3779B97F4A7C15ull * (pArgs->iThread + 1);
+	for (uint32_t iOperation = 0; iOperation < c_cThreadOperations; iOperation++)
+	{
+		ullRandom = ullRandom * 6364136223846793005ull + 1442695040888963407ull;
+		uint32_t i = (uint32_t)(ullRandom >> 33) % c_cThreadKeys;
+
+		bool bCorrect;
+		pArgs->cLookups++;
+		if (!_Lookup(pArgs->pCache, i, &bCorrect))
+		{
+			pArgs->cInserts++;
+			if (_Insert(pArgs->pCache, i) != GMA_S_OK)
+				pArgs->cFailures++;
+		}
+		if (!bCorrect)
+			pArgs->cFailures++;
+
+		if (pArgs->iThread == c_cThreads - 1 && iOperation % 1000 == 999)
+			pArgs->pCache->SetBudget(c_cGmaMetadataCacheStripes * ((iOperation % 2000 == 999) ? 4 : 8) * pArgs->cbEntry);
+	}
+	return NULL;
+}
+
+// Every hit is the entry inserted for its key, every insert succeeds, and the counters add up
+static void _CheckThreads(size_t cbEntry)
+{
+	CGmaMetadataCache cache(c_cGmaMetadataCacheStripes * 8 * cbEntry);
+	pthread_t athreads[c_cThreads];
+	WorkerArgs aArgs[c_cThreads];
+	for (uint32_t i = 0; i < c_cThreads; i++)
+	{
+		memset(&aArgs[i], 0, sizeof(aArgs[i]));
+		aArgs[i].pCache = &cache;
+		aArgs[i].cbEntry = cbEntry;
+		aArgs[i].iThread = i;
+		pthread_create(&athreads[i], NULL, _WorkerProc, &aArgs[i]);
+	}
+
+	uint64_t cLookups = 0ull;
+	uint64_t cInserts = 0ull;
+	for (uint32_t i = 0; i < c_cThreads; i++)
+	{
+		pthread_join(athreads[i], NULL);
+		GMA_CHECK(aArgs[i].cFailures == 0ul);
+		cLookups += aArgs[i].cLookups;
+		cInserts += aArgs[i].cInserts;
+	}
+
+	GmaCacheStats stats;
+	cache.GetStats(&stats);
+	GMA_CHECK(stats.cHits + stats.cMisses == cLookups && stats.cMisses == cInserts && stats.cInserts == cInserts);
+	GMA_CHECK(stats.cHits != 0ull && stats.cEvictions != 0ull);
+	GMA_CHECK(stats.cbUsed == stats.cEntries * cbEntry && stats.cbUsed <= stats.cbBudget);
+	printf("MetadataCacheTest: %llu lookups from %u threads, %llu hits, %llu evictions\n", (unsigned long long)cLookups, c_cThreads, (unsigned long long)stats.cHits, (unsigned long long)stats.cEvictions);
+}
+
+
+int main()
+{
+	for (size_t i = 0; i < sizeof(s_szDescription); i++)
+		s_szDescription[i] = (char)('a' + i % 26);
+
+	size_t cbEntry = _MeasureEntry();
+	_CheckLru(cbEntry);
+	_CheckReplace(cbEntry);
+	_CheckNegativeResults();
+	_CheckSetBudget(cbEntry);
+	_CheckThreads(cbEntry);
+	return GmaTestResult("MetadataCacheTest");
+}
@@ -0,0 +1,105 @@
+// Throughput of whole-file parsing up to the end of the file table, over an in-memory corpus of GMAs
+// CGmaDocument over views and over streams, and CGmaPushParser fed in 64 KB chunks, as the property handler and gmainfo use them. Everything is in memory, so this is the parsers' cost alone, without any I/O.
+
+#include "GmaTest.h"
+#include "GmaDocument.h"
+#include "GmaPushParser.h"
+
+const uint32_t c_cCorpusFiles = 500ul;
+
+// Sizes shaped like a workshop corpus: mostly small addons, a few with thousands of files
+static uint32_t _GetFileCount(uint32_t i)
+{
+	if (i % 50 == 0)
+		return 4000ul + i;
+	if (i % 5 == 0)
+		return 300ul + i;
+	return 5ul + i % 60;
+}
+
+class CBenchSink : public IGmaPushParserSink
+{
+public:
+	CBenchSink() : cFiles(0ul) {}
+
+	GmaStatus OnHeader(const GmaHeaderInfo&) { return GMA_S_OK; }
+	GmaStatus OnTocEntry(const GmaTocEntry&) { return GMA_S_OK; }
+	GmaStatus OnTocEnd(const GmaTocSummary& summary) { cFiles += summary.cFiles; return GMA_S_OK; }
+
+	uint64_t cFiles;
+};
+
+enum BenchSource
+{
+	BENCH_VIEW,
+	BENCH_STREAM,
+	BENCH_PUSH,
+};
+
+// Parses the whole corpus once, returning the number of file table entries seen
+static uint64_t _ParseCorpus(CGmaTestFile* aFiles, BenchSource source, CGmaParseContext* pContext)
+{
+	uint64_t cEntries = 0ull;
+	for (uint32_t i = 0; i < c_cCorpusFiles; i++)
+	{
+		pContext->Reset();
+		CGmaMemoryByteSource memory(aFiles[i].GetData(), aFiles[i].GetSize());
+		if (source == BENCH_PUSH)
+		{
+			CBenchSink sink;
+			CGmaPushParser parser(&sink, pContext->GetArena(), c_cbGmaPushParserDefaultMemoryLimit, pContext->GetScratchArena());
+			for (size_t ul = 0; ul < aFiles[i].GetSize() && !parser.IsDone(); ul += 65536)
+			{
+				size_t cb = aFiles[i].GetSize() - ul;
+				parser.Feed(aFiles[i].GetData() + ul, (cb < 65536) ? cb : 65536);
+			}
+			cEntries += sink.cFiles;
+		}
+		else
+		{
+			CGmaTestStreamSource stream(&memory);
+			CGmaDocument document((source == BENCH_STREAM) ? (IGmaByteSource*)&stream : &memory, pContext);
+			if (document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK && document.GetTocStatus() == GMA_S_OK)
+				cEntries += document.GetTocSummary().cFiles;
+		}
+	}
+	return cEntries;
+}
+
+int main()
+{
+	CGmaTestFile* aFiles = new CGmaTestFile[c_cCorpusFiles];
+	uint64_t cbParsed = 0ull; // Header and file table, i.e. what the parsers look at
+	uint64_t cEntriesExpected = 0ull;
+	for (uint32_t i = 0; i < c_cCorpusFiles; i++)
+	{
+		uint32_t cFiles = _GetFileCount(i);
+		aFiles[i].BuildGma("Some Addon", "{\n\t\"description\": \"A description of a few words\",\n\t\"type\": \"tool\",\n\t\"tags\": [\n\t\t\"fun\",\n\t\t\"build\"\n\t]\n}", "Author", cFiles);
+		cbParsed += aFiles[i].GetDataStart();
+		cEntriesExpected += cFiles;
+	}
+
+	static const char* const c_apszSources[] = { "view", "stream", "push" };
+	CGmaParseContext context;
+	printf("ParseBench: %u files, %llu file table entries, %.1f MB of headers and file tables\n", c_cCorpusFiles, (unsigned long long)cEntriesExpected, cbParsed / 1e6);
+	for (int iSource = BENCH_VIEW; iSource <= BENCH_PUSH; iSource++)
+	{
+		GMA_CHECK(_ParseCorpus(aFiles, (BenchSource)iSource, &context) == cEntriesExpected); // Also warms up
+
+		uint64_t cPasses = 0ull;
+		uint64_t nsStart = GmaTestGetMonotonicNs();
+		uint64_t nsElapsed;
+		do
+		{
+			_ParseCorpus(aFiles, (BenchSource)iSource, &context);
+			cPasses++;
+			nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+		} while (nsElapsed < 500000000ull);
+
+		double dSeconds = nsElapsed / 1e9;
+		printf("  %-8s %10.0f files/s %12.0f entries/s %9.1f MB/s\n", c_apszSources[iSource], cPasses * c_cCorpusFiles / dSeconds, cPasses * cEntriesExpected / dSeconds, cPasses * cbParsed / 1e6 / dSeconds);
+	}
+
+	delete[] aFiles;
+	return GmaTestResult("ParseBench");
+}
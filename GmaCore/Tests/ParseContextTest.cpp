@@ -0,0 +1,100 @@
+// Checks that a warmed-up CGmaParseContext parses files without any heap allocation
+// Counts every operator new and every cJSON allocation made while parsing the same mix of files over and over.
+
+#include "GmaTest.h"
+#include "GmaByteSource.h"
+#include "GmaDocument.h"
+#include "GmaParseContext.h"
+#include "cJSON.h"
+#include <stdlib.h>
+#include <new>
+
+static unsigned long g_cAllocs = 0ul;
+
+void* operator new(size_t cb)
+{
+	g_cAllocs++;
+	void* pv = malloc((cb != 0) ? cb : 1);
+	if (pv == NULL)
+		throw std::bad_alloc();
+	return pv;
+}
+
+void* operator new[](size_t cb) { return operator new(cb); }
+void* operator new(size_t cb, const std::nothrow_t&) throw() { g_cAllocs++; return malloc((cb != 0) ? cb : 1); }
+void* operator new[](size_t cb, const std::nothrow_t&) throw() { g_cAllocs++; return malloc((cb != 0) ? cb : 1); }
+void operator delete(void* pv) throw() { free(pv); }
+void operator delete[](void* pv) throw() { free(pv); }
+void operator delete(void* pv, size_t) throw() { free(pv); }
+void operator delete[](void* pv, size_t) throw() { free(pv); }
+
+static void* CJSON_CDECL _CountingMalloc(size_t cb)
+{
+	g_cAllocs++;
+	return malloc(cb);
+}
+
+// Header fields a few files that between them take every path through the header parser
+static const char* const c_apszDescriptions[] =
+{
+	"A plain text description",
+	"{\"description\":\"Json description\",\"type\":\"tool\",\"tags\":[\"fun\",\"build\"]}", // single-pass extractor
+	"{\"descr\\u0069ption\":\"Escaped key\",\"type\":\"map\",\"tags\":[\"roleplay\"],\"ignore\":[\"*.psd\",\"*.vcproj\"]}", // left to cJSON
+	"{ not json }", // cJSON rejects it, so it's plain text again
+};
+
+static void _ParseAll(CGmaParseContext* pContext, CGmaTestFile* afiles, size_t cFiles, bool bStream)
+{
+	for (size_t i = 0; i < cFiles; i++)
+	{
+		pContext->Reset();
+
+		CGmaMemoryByteSource memory(afiles[i].GetData(), afiles[i].GetSize());
+		CGmaTestStreamSource stream(&memory);
+		CGmaDocument document(bStream ? (IGmaByteSource*)&stream : (IGmaByteSource*)&memory, pContext);
+		GMA_CHECK(document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK);
+		GMA_CHECK(document.GetTocStatus() == GMA_S_OK);
+		GMA_CHECK(document.GetHeader().strDescription.psz != NULL);
+	}
+}
+
+int main()
+{
+	cJSON_Hooks hooks = { _CountingMalloc, free };
+	cJSON_InitHooks(&hooks);
+
+	const size_t cDescriptions = sizeof(c_apszDescriptions) / sizeof(c_apszDescriptions[0]);
+	const uint32_t c_acFiles[] = { 1ul, 40ul, 3000ul };
+	const size_t cFiles = cDescriptions * 3;
+	CGmaTestFile afiles[cFiles];
+	for (size_t i = 0; i < cFiles; i++)
+		afiles[i].BuildGma("Addon", c_apszDescriptions[i % cDescriptions], "Author", c_acFiles[i / cDescriptions]);
+
+	// The escaped key does go through cJSON
+	{
+		CGmaParseContext context;
+		CGmaMemoryByteSource memory(afiles[2].GetData(), afiles[2].GetSize());
+		CGmaDocument document(&memory, &context);
+		GMA_CHECK(document.EnsureStage(GMA_STAGE_HEADER) == GMA_S_OK);
+		GMA_CHECK(document.GetHeader().bUsesJsonChunkInDescription);
+		GMA_CHECK(document.GetHeader().cTags == 1ul);
+		GMA_CHECK(strcmp(document.GetHeader().strDescription.psz, "Escaped key") == 0);
+	}
+
+	for (int iStream = 0; iStream < 2; iStream++)
+	{
+		CGmaParseContext context;
+		_ParseAll(&context, afiles, cFiles, iStream != 0); // Grows the context to its high-water mark
+
+		unsigned long cAllocsBefore = g_cAllocs;
+		for (int iRound = 0; iRound < 10; iRound++)
+			_ParseAll(&context, afiles, cFiles, iStream != 0);
+		unsigned long cAllocs = g_cAllocs - cAllocsBefore;
+
+		if (cAllocs != 0ul)
+			fprintf(stderr, "%s sources: %lu allocation(s) after warm-up\n", iStream ? "stream" : "memory", cAllocs);
+		GMA_CHECK(cAllocs == 0ul);
+	}
+
+	return GmaTestResult("ParseContextTest");
+}
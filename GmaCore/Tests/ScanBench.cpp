@@ -0,0 +1,142 @@
+// Microbenchmarks for the null terminator scans in GmaScan, each implementation against the scalar one
+// Buffers are shaped like what the parsers scan: a header's three text fields, a file table's short paths, and long runs without a terminator. Every implementation's results are compared with the scalar ones first.
+
+#include "GmaTest.h"
+#include "GmaScan.h"
+
+static const char* _GetImplName(GmaScanImpl impl)
+{
+	switch (impl)
+	{
+	case GMA_SCAN_SCALAR: return "scalar";
+	case GMA_SCAN_SSE2: return "sse2";
+	case GMA_SCAN_AVX2: return "avx2";
+	default: return "?";
+	}
+}
+
+struct ScanInput
+{
+	const char* pszName;
+	uint8_t* pb;
+	size_t cb;
+};
+
+// A header: name, a pretty-printed json description and author
+static void _BuildHeader(CGmaTestFile* pFile)
+{
+	pFile->Clear();
+	pFile->AppendString("Some Addon Name");
+	pFile->AppendString("{\n\t\"description\": \"A description that runs on for a while, as they tend to do in the workshop, with a few sentences of text.\",\n\t\"type\": \"tool\",\n\t\"tags\": [\n\t\t\"fun\",\n\t\t\"build\"\n\t]\n}");
+	pFile->AppendString("Author");
+}
+
+// A file table's paths, without the fixed-size fields between them
+static void _BuildPaths(CGmaTestFile* pFile, uint32_t cPaths)
+{
+	pFile->Clear();
+	char szPath[96];
+	for (uint32_t i = 0; i < cPaths; i++)
+	{
+		snprintf(szPath, sizeof(szPath), (i % 3) ? "materials/models/props/thing_%u.vmt" : "lua/autorun/f%u.lua", i);
+		pFile->AppendString(szPath);
+	}
+}
+
+static void _BuildLongRun(CGmaTestFile* pFile, size_t cb)
+{
+	pFile->Clear();
+	for (size_t i = 0; i + 1 < cb; i++)
+		pFile->AppendByte((uint8_t)('a' + i % 26));
+	pFile->AppendByte(0);
+}
+
+// Same answers as the scalar scan, for every length and alignment of the input
+static void _CheckAgainstScalar(const ScanInput& input, GmaScanImpl impl, GmaSpan* aSpansScalar, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	for (size_t ulStart = 0; ulStart < 64 && ulStart < input.cb; ulStart += 7)
+	{
+		size_t cb = input.cb - ulStart;
+
+		GmaSetScanImpl(GMA_SCAN_SCALAR);
+		size_t ulNullScalar = GmaFindNull(input.pb + ulStart, cb);
+		size_t cSpansScalar = GmaFindNullTerminatedSpans(input.pb + ulStart, cb, aSpansScalar, cMaxSpans);
+
+		GmaSetScanImpl(impl);
+		GMA_CHECK(GmaFindNull(input.pb + ulStart, cb) == ulNullScalar);
+		size_t cSpans = GmaFindNullTerminatedSpans(input.pb + ulStart, cb, aSpans, cMaxSpans);
+		GMA_CHECK(cSpans == cSpansScalar && memcmp(aSpans, aSpansScalar, cSpans * sizeof(GmaSpan)) == 0);
+	}
+}
+
+// Runs each scan over the input until enough time has passed to time it, and prints the rate
+static void _Bench(const ScanInput& input, GmaScanImpl impl, GmaSpan* aSpans, size_t cMaxSpans)
+{
+	GmaSetScanImpl(impl);
+
+	size_t ulSink = 0;
+	uint64_t cIterations = 0ull;
+	uint64_t nsStart = GmaTestGetMonotonicNs();
+	uint64_t nsElapsed;
+	do
+	{
+		for (int i = 0; i < 64; i++)
+			ulSink += GmaFindNullTerminatedSpans(input.pb, input.cb, aSpans, cMaxSpans);
+		cIterations += 64;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	double dSpansNs = (double)nsElapsed / cIterations;
+
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		for (int i = 0; i < 64; i++)
+			ulSink += GmaFindNull(input.pb + (i & 7), input.cb - (i & 7));
+		cIterations += 64;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	double dNullNs = (double)nsElapsed / cIterations;
+
+	printf("  %-8s %-10s spans %10.1f ns %7.2f GB/s   first null %10.1f ns\n", input.pszName, _GetImplName(impl), dSpansNs, input.cb / dSpansNs, dNullNs);
+	if (ulSink == 0)
+		printf("\n"); // Keeps the calls from being optimized away
+}
+
+int main()
+{
+	GmaScanImpl implBest = GmaGetScanImpl();
+	printf("ScanBench: best implementation here is %s\n", _GetImplName(implBest));
+
+	CGmaTestFile fileHeader, filePaths, fileLong;
+	_BuildHeader(&fileHeader);
+	_BuildPaths(&filePaths, 20000ul);
+	_BuildLongRun(&fileLong, 65536);
+
+	ScanInput aInputs[] =
+	{
+		{ "header", (uint8_t*)fileHeader.GetData(), fileHeader.GetSize() },
+		{ "paths", (uint8_t*)filePaths.GetData(), filePaths.GetSize() },
+		{ "longrun", (uint8_t*)fileLong.GetData(), fileLong.GetSize() },
+	};
+
+	const size_t cMaxSpans = 20000;
+	GmaSpan* aSpansScalar = new GmaSpan[cMaxSpans];
+	GmaSpan* aSpans = new GmaSpan[cMaxSpans];
+
+	for (size_t iInput = 0; iInput < sizeof(aInputs) / sizeof(aInputs[0]); iInput++)
+	{
+		for (int iImpl = GMA_SCAN_SCALAR; iImpl <= GMA_SCAN_AVX2; iImpl++)
+		{
+			if (!GmaIsScanImplSupported((GmaScanImpl)iImpl))
+				continue;
+			_CheckAgainstScalar(aInputs[iInput], (GmaScanImpl)iImpl, aSpansScalar, aSpans, cMaxSpans);
+			_Bench(aInputs[iInput], (GmaScanImpl)iImpl, aSpans, cMaxSpans);
+		}
+	}
+
+	delete[] aSpansScalar;
+	delete[] aSpans;
+	GmaSetScanImpl(implBest);
+	return GmaTestResult("ScanBench");
+}
@@ -0,0 +1,145 @@
+// Throughput of UTF-8 validation and conversion, each implementation on the same inputs, and of the Windows-1252 fallback
+// Inputs are 4 KB of ASCII, Cyrillic (2-byte) and CJK (3-byte) text, as valid UTF-8, plus the same ASCII with Windows-1252 bytes sprinkled in for the fallback. Results are compared with the scalar ones first.
+
+#include "GmaTest.h"
+#include "GmaText.h"
+
+const size_t c_cbInput = 4096;
+
+static const char* _GetImplName(GmaScanImpl impl)
+{
+	switch (impl)
+	{
+	case GMA_SCAN_SCALAR: return "scalar";
+	case GMA_SCAN_SSE2: return "sse2";
+	case GMA_SCAN_AVX2: return "avx2";
+	default: return "?";
+	}
+}
+
+struct TextInput
+{
+	const char* pszName;
+	CGmaTestFile text;
+};
+
+// Repeats psz up to c_cbInput bytes, without splitting a sequence
+static void _BuildRepeated(CGmaTestFile* pText, const char* psz)
+{
+	size_t cch = strlen(psz);
+	pText->Clear();
+	while (pText->GetSize() + cch <= c_cbInput)
+		pText->Append(psz, cch);
+}
+
+static void _PrintRate(const char* pszInput, GmaScanImpl impl, const char* pszWhat, uint64_t cIterations, uint64_t nsElapsed, size_t cb)
+{
+	double dNs = (double)nsElapsed / cIterations;
+	printf("  %-8s %-8s %-22s %9.1f ns %7.2f GB/s\n", pszInput, _GetImplName(impl), pszWhat, dNs, cb / dNs);
+}
+
+static void _Bench(const TextInput& input, GmaScanImpl impl, GmaWChar* pwchOut, CGmaArena* pArena)
+{
+	GmaSetTextImpl(impl);
+	const char* pch = (const char*)input.text.GetData();
+	size_t cb = input.text.GetSize();
+	size_t ulSink = 0;
+	uint64_t cIterations;
+	uint64_t nsStart;
+	uint64_t nsElapsed;
+
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		for (int i = 0; i < 16; i++)
+			ulSink += GmaIsValidUtf8(pch, cb) ? 1 : 0;
+		cIterations += 16;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input.pszName, impl, "GmaIsValidUtf8", cIterations, nsElapsed, cb);
+
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		for (int i = 0; i < 16; i++)
+			ulSink += GmaUtf8ToUtf16(pch, cb, pwchOut, NULL);
+		cIterations += 16;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input.pszName, impl, "GmaUtf8ToUtf16", cIterations, nsElapsed, cb);
+
+	// What the property handler does with each header string, including the Windows-1252 fallback for invalid ones
+	GmaString str;
+	str.psz = pch;
+	str.cch = (uint32_t)cb;
+	cIterations = 0ull;
+	nsStart = GmaTestGetMonotonicNs();
+	do
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			pArena->Reset();
+			GmaWChar* pwsz;
+			uint32_t cch = 0;
+			GmaHeaderStringToUtf16(str, pArena, &pwsz, &cch, NULL);
+			ulSink += cch;
+		}
+		cIterations += 16;
+		nsElapsed = GmaTestGetMonotonicNs() - nsStart;
+	} while (nsElapsed < 200000000ull);
+	_PrintRate(input.pszName, impl, "GmaHeaderStringToUtf16", cIterations, nsElapsed, cb);
+
+	if (ulSink == 0)
+		printf("\n"); // Keeps the calls from being optimized away
+}
+
+int main()
+{
+	GmaScanImpl implBest = GmaGetTextImpl();
+	printf("TextBench: best implementation here is %s\n", _GetImplName(implBest));
+
+	TextInput aInputs[4];
+	aInputs[0].pszName = "ascii";
+	_BuildRepeated(&aInputs[0].text, "A description of some addon, in plain ASCII. ");
+	aInputs[1].pszName = "cyrillic";
+	_BuildRepeated(&aInputs[1].text, "\xD0\x9E\xD0\xBF\xD0\xB8\xD1\x81\xD0\xB0\xD0\xBD\xD0\xB8\xD0\xB5 \xD0\xB0\xD0\xB4\xD0\xB4\xD0\xBE\xD0\xBD\xD0\xB0 "); // "Описание аддона "
+	aInputs[2].pszName = "cjk";
+	_BuildRepeated(&aInputs[2].text, "\xE3\x82\xA2\xE3\x83\x89\xE3\x82\xAA\xE3\x83\xB3\xE3\x81\xAE\xE8\xAA\xAC\xE6\x98\x8E"); // "アドオンの説明"
+	aInputs[3].pszName = "cp1252";
+	_BuildRepeated(&aInputs[3].text, "Caf\xE9 \x96 \x93quoted\x94 text, mostly ASCII otherwise. ");
+
+	GmaWChar* pwchOut = new GmaWChar[c_cbInput];
+	GmaWChar* pwchScalar = new GmaWChar[c_cbInput];
+	CGmaArena arena;
+	for (size_t iInput = 0; iInput < sizeof(aInputs) / sizeof(aInputs[0]); iInput++)
+	{
+		const char* pch = (const char*)aInputs[iInput].text.GetData();
+		size_t cb = aInputs[iInput].text.GetSize();
+		GMA_CHECK(GmaIsValidUtf8(pch, cb) == (iInput != 3));
+
+		GmaSetTextImpl(GMA_SCAN_SCALAR);
+		bool bValidScalar;
+		size_t cchScalar = GmaUtf8ToUtf16(pch, cb, pwchScalar, &bValidScalar);
+		bool bValidScalarCheck = GmaIsValidUtf8(pch, cb);
+
+		for (int iImpl = GMA_SCAN_SCALAR; iImpl <= GMA_SCAN_AVX2; iImpl++)
+		{
+			if (GMA_FAILED(GmaSetTextImpl((GmaScanImpl)iImpl)))
+				continue;
+
+			bool bValid;
+			size_t cch = GmaUtf8ToUtf16(pch, cb, pwchOut, &bValid);
+			GMA_CHECK(cch == cchScalar && bValid == bValidScalar && memcmp(pwchOut, pwchScalar, cch * sizeof(GmaWChar)) == 0);
+			GMA_CHECK(GmaIsValidUtf8(pch, cb) == bValidScalarCheck);
+
+			_Bench(aInputs[iInput], (GmaScanImpl)iImpl, pwchOut, &arena);
+		}
+	}
+
+	delete[] pwchOut;
+	delete[] pwchScalar;
+	GmaSetTextImpl(implBest);
+	return GmaTestResult("TextBench");
+}
@@ -0,0 +1,385 @@
+// Checks every implementation of the UTF-8 to UTF-16 converters and of the UTF-8 validator against a plain reference decoder, and the Windows-1252 fallback against its code chart
+// Inputs mix ASCII runs with 2-, 3- and 4-byte sequences and invalid bytes, and every prefix of each is converted at several alignments, so inputs end at every point of a block and of a sequence. Each one is copied to a heap block of exactly its size, so make check-asan catches reads and writes past either buffer.
+
+#include "GmaTest.h"
+#include "GmaText.h"
+
+const uint32_t c_cInputs = 1500ul;
+
+static uint64_t s_ullRandom = 0x9E3779B97F4A7C15ull;
+
+static uint32_t _Random(uint32_t ulBound)
+{
+	s_ullRandom ^= s_ullRandom << 13;
+	s_ullRandom ^= s_ullRandom >> 7;
+	s_ullRandom ^= s_ullRandom << 17;
+	return (uint32_t)((s_ullRandom >> 16) % ulBound);
+}
+
+static const char* _GetImplName(GmaScanImpl impl)
+{
+	switch (impl)
+	{
+	case GMA_SCAN_SCALAR: return "scalar";
+	case GMA_SCAN_SSE2: return "sse2";
+	case GMA_SCAN_AVX2: return "avx2";
+	default: return "?";
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Reference decoder
+// ____________________________________________________________________________________________________
+//
+
+// Decodes UTF-8 the way the Unicode standard recommends for replacement: each maximal subpart of an ill-formed sequence (a lead byte and as many of the continuation bytes it allows as follow) becomes one U+FFFD
+static size_t _ReferenceUtf8ToUtf16(const uint8_t* pb, size_t cb, GmaWChar* pwchOut, bool* pbValid)
+{
+	size_t ulOut = 0;
+	*pbValid = true;
+	size_t i = 0;
+	while (i < cb)
+	{
+		uint8_t b = pb[i];
+		if (b < 0x80)
+		{
+			pwchOut[ulOut++] = b;
+			i++;
+			continue;
+		}
+
+		// Length of the sequence b starts, and the range its second byte must be in
+		size_t cbSequence;
+		uint8_t bSecondMin = 0x80;
+		uint8_t bSecondMax = 0xBF;
+		uint32_t ulCodePoint;
+		if (b >= 0xC2 && b <= 0xDF)
+		{
+			cbSequence = 2;
+			ulCodePoint = b & 0x1F;
+		}
+		else if (b >= 0xE0 && b <= 0xEF)
+		{
+			cbSequence = 3;
+			ulCodePoint = b & 0x0F;
+			if (b == 0xE0)
+				bSecondMin = 0xA0; // overlong
+			else if (b == 0xED)
+				bSecondMax = 0x9F; // surrogates
+		}
+		else if (b >= 0xF0 && b <= 0xF4)
+		{
+			cbSequence = 4;
+			ulCodePoint = b & 0x07;
+			if (b == 0xF0)
+				bSecondMin = 0x90; // overlong
+			else if (b == 0xF4)
+				bSecondMax = 0x8F; // past U+10FFFF
+		}
+		else
+		{
+			// Continuation byte, C0, C1 or F5 and up: never part of a valid sequence
+			pwchOut[ulOut++] = c_wchGmaReplacement;
+			*pbValid = false;
+			i++;
+			continue;
+		}
+
+		size_t cbMatched = 1;
+		while (cbMatched < cbSequence && i + cbMatched < cb)
+		{
+			uint8_t bNext = pb[i + cbMatched];
+			bool bOk = (cbMatched == 1) ? (bNext >= bSecondMin && bNext <= bSecondMax) : (bNext >= 0x80 && bNext <= 0xBF);
+			if (!bOk)
+				break;
+			ulCodePoint = (ulCodePoint << 6) | (bNext & 0x3F);
+			cbMatched++;
+		}
+
+		if (cbMatched < cbSequence)
+		{
+			pwchOut[ulOut++] = c_wchGmaReplacement;
+			*pbValid = false;
+		}
+		else if (ulCodePoint >= 0x10000)
+		{
+			pwchOut[ulOut++] = (GmaWChar)(0xD800 + ((ulCodePoint - 0x10000) >> 10));
+			pwchOut[ulOut++] = (GmaWChar)(0xDC00 + ((ulCodePoint - 0x10000) & 0x3FF));
+		}
+		else
+		{
+			pwchOut[ulOut++] = (GmaWChar)ulCodePoint;
+		}
+		i += cbMatched;
+	}
+	return ulOut;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Inputs
+// ____________________________________________________________________________________________________
+//
+
+// Pieces an input is made of. The invalid ones are listed last.
+static const char* const c_apszValidPieces[] =
+{
+	"a", "Some Addon Name", "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOP", // ASCII, some longer than a block
+	"\xC3\xA9", "\xC3\xBC\xC3\xB6\xC3\xA4", "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", "\xCE\xB1\xCE\xB2\xCE\xB3", "\xC2\x80", "\xDF\xBF", // 2 bytes
+	"\xE2\x82\xAC", "\xE3\x81\x82\xE3\x81\x84", "\xE0\xA0\x80", "\xED\x9F\xBF", "\xEE\x80\x80", "\xEF\xBF\xBD", "\xEF\xBF\xBF", // 3 bytes
+	"\xF0\x9F\x98\x80", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF", "\xF3\xA0\x80\x81", // 4 bytes, i.e. surrogate pairs
+};
+static const char* const c_apszInvalidPieces[] =
+{
+	"\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF", // stray continuations and overlongs
+	"\xED\xA0\x80", "\xED\xBF\xBF", "\xED\xA0\x80\xED\xB0\x80", // surrogates, alone and paired
+	"\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF7\xBF\xBF\xBF", "\xF8\x88\x80\x80\x80", "\xFE", "\xFF", // past U+10FFFF, and bytes UTF-8 never uses
+	"\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xE2\x28\xA1", "\xF0\x28\x8C\x28", // truncated, or broken by an ASCII byte
+};
+
+static void _BuildInput(CGmaTestFile* pInput, bool bValid)
+{
+	pInput->Clear();
+	uint32_t cPieces = 1 + _Random(24);
+	for (uint32_t i = 0; i < cPieces; i++)
+	{
+		const char* psz;
+		if (!bValid && _Random(4) == 0)
+			psz = c_apszInvalidPieces[_Random(sizeof(c_apszInvalidPieces) / sizeof(c_apszInvalidPieces[0]))];
+		else if (_Random(3) == 0)
+			psz = c_apszValidPieces[_Random(3)]; // Lots of ASCII, as in real headers
+		else
+			psz = c_apszValidPieces[_Random(sizeof(c_apszValidPieces) / sizeof(c_apszValidPieces[0]))];
+		pInput->Append(psz, strlen(psz));
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Checks
+// ____________________________________________________________________________________________________
+//
+
+// Converts and validates pb[0..cb), placed at offset ulAlign of an exactly sized heap block, with every implementation, and compares each with the reference
+static void _CheckConversion(const uint8_t* pb, size_t cb, size_t ulAlign)
+{
+	uint8_t* pbBlock = new uint8_t[ulAlign + cb];
+	memcpy(pbBlock + ulAlign, pb, cb);
+	const char* pch = (const char*)(pbBlock + ulAlign);
+
+	GmaWChar* pwchExpected = new GmaWChar[cb + 1];
+	bool bValidExpected;
+	size_t cchExpected = _ReferenceUtf8ToUtf16(pb, cb, pwchExpected, &bValidExpected);
+
+	for (int iImpl = GMA_SCAN_SCALAR; iImpl <= GMA_SCAN_AVX2; iImpl++)
+	{
+		if (GMA_FAILED(GmaSetTextImpl((GmaScanImpl)iImpl)))
+			continue;
+
+		GmaWChar* pwchOut = new GmaWChar[cb]; // All the room the converter may use, and no more
+		bool bValid = !bValidExpected;
+		size_t cch = GmaUtf8ToUtf16(pch, cb, pwchOut, &bValid);
+		bool bSame = (cch == cchExpected) && (bValid == bValidExpected) && (cch == 0 || memcmp(pwchOut, pwchExpected, cch * sizeof(GmaWChar)) == 0);
+		if (!bSame)
+		{
+			fprintf(stderr, "%s converts %u bytes at alignment %u differently:", _GetImplName((GmaScanImpl)iImpl), (unsigned)cb, (unsigned)ulAlign);
+			for (size_t i = 0; i < cb; i++)
+				fprintf(stderr, " %02X", pb[i]);
+			fprintf(stderr, "\n");
+		}
+		GMA_CHECK(bSame);
+		delete[] pwchOut;
+
+		bool bValidated = GmaIsValidUtf8(pch, cb);
+		if (bValidated != bValidExpected)
+			fprintf(stderr, "%s validates %u bytes at alignment %u wrongly\n", _GetImplName((GmaScanImpl)iImpl), (unsigned)cb, (unsigned)ulAlign);
+		GMA_CHECK(bValidated == bValidExpected);
+	}
+
+	delete[] pwchExpected;
+	delete[] pbBlock;
+}
+
+static void _CheckConversions()
+{
+	CGmaTestFile input;
+	for (uint32_t i = 0; i < c_cInputs; i++)
+	{
+		_BuildInput(&input, (i % 3) != 0);
+		size_t cb = input.GetSize();
+		for (size_t cbPrefix = 0; cbPrefix <= cb; cbPrefix++)
+			_CheckConversion(input.GetData(), cbPrefix, (cbPrefix + i) % 5);
+	}
+
+	// Every single byte and every pair, which covers all the lead and continuation combinations
+	uint8_t ab[2];
+	for (uint32_t ul = 0; ul < 65536; ul++)
+	{
+		ab[0] = (uint8_t)ul;
+		ab[1] = (uint8_t)(ul >> 8);
+		_CheckConversion(ab, (ul < 256) ? 1 : 2, 0);
+	}
+}
+
+// Each kind of invalid sequence, and each truncated tail, at every position across two validator blocks of ASCII
+// The block-based validators check sequences that straddle blocks separately from the rest, so placement matters.
+static void _CheckValidationPlacement()
+{
+	static const char* const c_apszBad[] =
+	{
+		"\xC0\xAF", "\xE0\x80\xAF", "\xF0\x80\x80\xAF", "\xC1\xBF", // overlongs
+		"\xED\xA0\x80", "\xED\xAF\xBF", "\xED\xB0\x80", "\xED\xBF\xBF", // surrogates
+		"\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xF7\xBF\xBF\xBF", // past U+10FFFF
+		"\x80", "\xC3\xA9\xA9", "\xF8\x88\x80\x80\x80", "\xFF", // stray continuations and bytes UTF-8 never uses
+	};
+	static const char* const c_apszTails[] = { "\xC3", "\xE2\x82", "\xF0\x9F\x98", "\xF0\x9F", "\xE2" };
+	static const char* const c_apszGood[] = { "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF", "\xF4\x8F\xBF\xBF" };
+
+	uint8_t ab[80];
+	for (size_t ulPos = 0; ulPos < 72; ulPos++)
+	{
+		for (size_t iBad = 0; iBad < sizeof(c_apszBad) / sizeof(c_apszBad[0]); iBad++)
+		{
+			size_t cch = strlen(c_apszBad[iBad]);
+			memset(ab, 'a', sizeof(ab));
+			memcpy(ab + ulPos, c_apszBad[iBad], cch);
+			_CheckConversion(ab, sizeof(ab), 0);
+			_CheckConversion(ab, ulPos + cch, 0);
+		}
+		for (size_t iGood = 0; iGood < sizeof(c_apszGood) / sizeof(c_apszGood[0]); iGood++)
+		{
+			size_t cch = strlen(c_apszGood[iGood]);
+			memset(ab, 'a', sizeof(ab));
+			memcpy(ab + ulPos, c_apszGood[iGood], cch);
+			_CheckConversion(ab, sizeof(ab), 0);
+		}
+
+		// Input that ends partway through a sequence
+		for (size_t iTail = 0; iTail < sizeof(c_apszTails) / sizeof(c_apszTails[0]); iTail++)
+		{
+			size_t cch = strlen(c_apszTails[iTail]);
+			memset(ab, 'a', sizeof(ab));
+			memcpy(ab + ulPos, c_apszTails[iTail], cch);
+			_CheckConversion(ab, ulPos + cch, 0);
+		}
+	}
+}
+
+// Windows-1252's 0x80..0x9F, from the code chart, with the 5 undefined bytes as the C1 controls MultiByteToWideChar maps them to. Everything else is Latin-1.
+static const uint16_t c_awCp1252C1[32] =
+{
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, // euro sign, -, low quote, f with hook, low double quote, ellipsis, dagger, double dagger
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F, // circumflex, per mille, S caron, single left angle quote, OE, -, Z caron, -
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, // -, left and right quotes, left and right double quotes, bullet, en dash, em dash
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178, // small tilde, trade mark, s caron, single right angle quote, oe, -, z caron, Y diaeresis
+};
+
+static GmaWChar _ExpectedCp1252(uint8_t b)
+{
+	return (b >= 0x80 && b < 0xA0) ? (GmaWChar)c_awCp1252C1[b - 0x80] : (GmaWChar)b;
+}
+
+static void _CheckCp1252()
+{
+	char ach[256];
+	for (int i = 0; i < 256; i++)
+		ach[i] = (char)(255 - i); // Something other than the identity, to catch an off-by-one lookup
+
+	GmaWChar awch[256];
+	GMA_CHECK(GmaCodepageToUtf16(ach, sizeof(ach), GMA_TEXT_CP1252, awch) == sizeof(ach));
+	for (int i = 0; i < 256; i++)
+		GMA_CHECK(awch[i] == _ExpectedCp1252((uint8_t)ach[i]));
+
+	GMA_CHECK(GmaCodepageToUtf16(ach, sizeof(ach), GMA_TEXT_UTF8, awch) == 0); // Not a single-byte codepage
+
+	// A header string written in Windows-1252: "Café – “quoted” €5" with its 0x80..0x9F punctuation
+	const char szCp1252[] = "Caf\xE9 \x96 \x93quoted\x94 \x80" "5 \x8A\x9F\x81";
+	GmaString str;
+	str.psz = szCp1252;
+	str.cch = (uint32_t)strlen(szCp1252);
+	CGmaArena arena;
+	for (int iImpl = GMA_SCAN_SCALAR; iImpl <= GMA_SCAN_AVX2; iImpl++)
+	{
+		if (GMA_FAILED(GmaSetTextImpl((GmaScanImpl)iImpl)))
+			continue;
+
+		GmaWChar* pwsz = NULL;
+		uint32_t cch = 0;
+		GmaTextEncoding encoding = GMA_TEXT_UTF8;
+		GMA_CHECK(!GmaIsValidUtf8(str.psz, str.cch));
+		GMA_CHECK(GmaHeaderStringToUtf16(str, &arena, &pwsz, &cch, &encoding) == GMA_S_OK);
+		GMA_CHECK(encoding == GMA_TEXT_CP1252 && cch == str.cch && pwsz[cch] == 0);
+		for (uint32_t i = 0; i < str.cch && i < cch; i++)
+			GMA_CHECK(pwsz[i] == _ExpectedCp1252((uint8_t)str.psz[i]));
+	}
+}
+
+// The arena flavor adds a terminator, and GmaHeaderStringToUtf16() falls back to Windows-1252 for anything that isn't valid UTF-8
+static void _CheckArenaConversions()
+{
+	CGmaArena arena;
+	CGmaTestFile input;
+	for (uint32_t i = 0; i < 300; i++)
+	{
+		_BuildInput(&input, (i % 2) != 0);
+		input.AppendByte(0);
+		GmaString str;
+		str.psz = (const char*)input.GetData();
+		str.cch = (uint32_t)input.GetSize() - 1;
+
+		GmaWChar* pwchExpected = new GmaWChar[str.cch + 1];
+		bool bValidExpected;
+		size_t cchExpected = _ReferenceUtf8ToUtf16((const uint8_t*)str.psz, str.cch, pwchExpected, &bValidExpected);
+
+		for (int iImpl = GMA_SCAN_SCALAR; iImpl <= GMA_SCAN_AVX2; iImpl++)
+		{
+			if (GMA_FAILED(GmaSetTextImpl((GmaScanImpl)iImpl)))
+				continue;
+			arena.Reset();
+
+			GmaWChar* pwsz = NULL;
+			uint32_t cch = 0;
+			bool bValid = false;
+			GMA_CHECK(GmaUtf8ToUtf16(str, &arena, &pwsz, &cch, &bValid) == GMA_S_OK);
+			GMA_CHECK(bValid == bValidExpected && cch == cchExpected && memcmp(pwsz, pwchExpected, cch * sizeof(GmaWChar)) == 0 && pwsz[cch] == 0);
+
+			GmaTextEncoding encoding = GMA_TEXT_CP1252;
+			GMA_CHECK(GmaHeaderStringToUtf16(str, &arena, &pwsz, &cch, &encoding) == GMA_S_OK);
+			if (bValidExpected)
+			{
+				GMA_CHECK(encoding == GMA_TEXT_UTF8 && cch == cchExpected && memcmp(pwsz, pwchExpected, cch * sizeof(GmaWChar)) == 0 && pwsz[cch] == 0);
+			}
+			else
+			{
+				GMA_CHECK(encoding == GMA_TEXT_CP1252 && cch == str.cch && pwsz[cch] == 0);
+				for (uint32_t j = 0; j < str.cch && j < cch; j++)
+					GMA_CHECK(pwsz[j] == _ExpectedCp1252((uint8_t)str.psz[j]));
+			}
+		}
+		delete[] pwchExpected;
+	}
+
+	// A missing string stays missing
+	GmaString strMissing;
+	strMissing.psz = NULL;
+	strMissing.cch = 0;
+	GmaWChar* pwsz = (GmaWChar*)&arena;
+	GMA_CHECK(GmaUtf8ToUtf16(strMissing, &arena, &pwsz, NULL, NULL) == GMA_S_OK && pwsz == NULL);
+}
+
+int main()
+{
+	GmaScanImpl implBest = GmaGetTextImpl();
+
+	_CheckConversions();
+	_CheckValidationPlacement();
+	_CheckCp1252();
+	_CheckArenaConversions();
+
+	GmaSetTextImpl(implBest);
+	return GmaTestResult("TextTest");
+}
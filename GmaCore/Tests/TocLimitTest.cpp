@@ -0,0 +1,168 @@
+// Checks that every parser applies the same limit to a single file table entry, c_cbGmaMaxTocEntry, and fails the same way past it
+// A file table entry with a long path, among ordinary ones, goes through CGmaDocument over a view and over a stream, through CGmaPushParser fed in chunks of several sizes, and through the push parser fallback CGmaDocument uses for headers past c_ullGmaHeaderSizeLimit.
+// Entries up to the limit parse, anything over it fails with GMA_E_TOOLARGE, and so does a file cut off once the entry has passed the limit.
+
+#include "GmaTest.h"
+#include "GmaDocument.h"
+#include "GmaPushParser.h"
+
+const uint32_t c_cFilesBefore = 3ul;
+const uint32_t c_cFilesAfter = 2ul;
+
+class CTocSink : public IGmaPushParserSink
+{
+public:
+	CTocSink() : cFiles(0ul) {}
+
+	GmaStatus OnHeader(const GmaHeaderInfo&) { return GMA_S_OK; }
+	GmaStatus OnTocEntry(const GmaTocEntry&) { return GMA_S_OK; }
+	GmaStatus OnTocEnd(const GmaTocSummary& summary) { cFiles = summary.cFiles; return GMA_S_OK; }
+
+	uint32_t cFiles;
+};
+
+static void _AppendEntry(CGmaTestFile* pFile, uint32_t ulIndex, const char* pszPath)
+{
+	pFile->AppendLE32(ulIndex);
+	pFile->AppendString(pszPath);
+	pFile->AppendLE64(16ull);
+	pFile->AppendLE32(0x12345678ul);
+}
+
+// A GMA whose file table has an entry of exactly cbEntry bytes between ordinary ones. A description of cchDescription bytes makes the header as large as wanted.
+// *pcbBeforeEntry is where that entry starts.
+static void _BuildGma(size_t cbEntry, size_t cchDescription, CGmaTestFile* pFile, size_t* pcbBeforeEntry)
+{
+	char* pszDescription = new char[cchDescription + 1];
+	memset(pszDescription, 'd', cchDescription);
+	pszDescription[cchDescription] = 0;
+	pFile->BuildGma("Long Paths", pszDescription, "Author", 0ul);
+	delete[] pszDescription;
+	pFile->Truncate(pFile->GetHeaderSize());
+
+	for (uint32_t i = 0; i < c_cFilesBefore; i++)
+		_AppendEntry(pFile, i + 1, "lua/autorun/short.lua");
+
+	*pcbBeforeEntry = pFile->GetSize();
+	size_t cchPath = cbEntry - 4 - 1 - 12;
+	char* pszPath = new char[cchPath + 1];
+	for (size_t i = 0; i < cchPath; i++)
+		pszPath[i] = (i % 64 == 63) ? '/' : 'a' + (char)(i % 26);
+	pszPath[cchPath] = 0;
+	_AppendEntry(pFile, c_cFilesBefore + 1, pszPath);
+	delete[] pszPath;
+
+	for (uint32_t i = 0; i < c_cFilesAfter; i++)
+		_AppendEntry(pFile, c_cFilesBefore + 2 + i, "lua/autorun/short.lua");
+	pFile->AppendLE32(0ul);
+	pFile->Append("file data", 9);
+}
+
+// The file table status CGmaDocument reports, over a view or over a stream
+static GmaStatus _ParseDocument(const CGmaTestFile& file, bool bStream, uint32_t* pcFiles)
+{
+	CGmaMemoryByteSource memory(file.GetData(), file.GetSize());
+	CGmaTestStreamSource stream(&memory);
+	CGmaDocument document(bStream ? (IGmaByteSource*)&stream : &memory);
+	*pcFiles = 0ul;
+	GmaStatus status = document.EnsureStage(GMA_STAGE_TOC);
+	if (GMA_FAILED(status))
+		return status;
+	*pcFiles = document.GetTocSummary().cFiles;
+	return document.GetTocStatus();
+}
+
+static GmaStatus _ParsePush(const CGmaTestFile& file, size_t cbChunk, uint32_t* pcFiles)
+{
+	CTocSink sink;
+	CGmaArena arena;
+	CGmaPushParser parser(&sink, &arena);
+	GmaStatus status = GMA_S_OK;
+	for (size_t ul = 0; ul < file.GetSize() && GMA_SUCCEEDED(status) && !parser.IsDone(); ul += cbChunk)
+	{
+		size_t cb = file.GetSize() - ul;
+		status = parser.Feed(file.GetData() + ul, (cb < cbChunk) ? cb : cbChunk);
+	}
+	if (GMA_SUCCEEDED(status))
+		status = parser.Finish();
+	*pcFiles = sink.cFiles;
+	return status;
+}
+
+// Every source must give statusExpected, and the whole table when that's success
+static void _CheckAllSources(const CGmaTestFile& file, GmaStatus statusExpected, const char* pszCase)
+{
+	static const size_t c_acbChunks[] = { 1, 7, 4096, 65536, 1 << 30 };
+	uint32_t cFilesExpected = GMA_SUCCEEDED(statusExpected) ? c_cFilesBefore + 1 + c_cFilesAfter : 0ul;
+	uint32_t cFiles;
+	GmaStatus status;
+
+	for (int iStream = 0; iStream < 2; iStream++)
+	{
+		status = _ParseDocument(file, iStream != 0, &cFiles);
+		if (status != statusExpected || cFiles != cFilesExpected)
+		{
+			fprintf(stderr, "%s, document over a %s: status %d, %u files\n", pszCase, (iStream != 0) ? "stream" : "view", status, cFiles);
+			g_cGmaTestFailures++;
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(c_acbChunks) / sizeof(c_acbChunks[0]); i++)
+	{
+		// Feeding a byte at a time is slow enough under the sanitizers to stick to the small files
+		if (c_acbChunks[i] == 1 && file.GetSize() > 4 * c_cbGmaMaxTocEntry)
+			continue;
+
+		status = _ParsePush(file, c_acbChunks[i], &cFiles);
+		if (GMA_SUCCEEDED(statusExpected) ? (status != GMA_S_OK || cFiles != cFilesExpected) : status != statusExpected)
+		{
+			fprintf(stderr, "%s, push parser in %zu byte chunks: status %d, %u files\n", pszCase, c_acbChunks[i], status, cFiles);
+			g_cGmaTestFailures++;
+		}
+	}
+}
+
+int main()
+{
+	static const size_t c_acbEntries[] =
+	{
+		100,
+		c_cbGmaMaxTocEntry - 1,
+		c_cbGmaMaxTocEntry,
+		c_cbGmaMaxTocEntry + 1,
+		2 * c_cbGmaMaxTocEntry,
+		c_cbGmaPushParserDefaultMemoryLimit + 1000, // Past the push parser's own buffering limit too
+	};
+
+	// Small headers the reader parses itself, and one large enough that CGmaDocument falls back to the push parser
+	static const size_t c_acchDescriptions[] = { 10, (size_t)c_ullGmaHeaderSizeLimit + 100 };
+
+	char szCase[128];
+	CGmaTestFile file;
+	for (size_t iDescription = 0; iDescription < sizeof(c_acchDescriptions) / sizeof(c_acchDescriptions[0]); iDescription++)
+	{
+		for (size_t iEntry = 0; iEntry < sizeof(c_acbEntries) / sizeof(c_acbEntries[0]); iEntry++)
+		{
+			size_t cbEntry = c_acbEntries[iEntry];
+			size_t cbBeforeEntry;
+			_BuildGma(cbEntry, c_acchDescriptions[iDescription], &file, &cbBeforeEntry);
+			GmaStatus statusExpected = (cbEntry <= c_cbGmaMaxTocEntry) ? GMA_S_OK : GMA_E_TOOLARGE;
+			snprintf(szCase, sizeof(szCase), "%zu byte entry after a %zu byte description", cbEntry, c_acchDescriptions[iDescription]);
+			_CheckAllSources(file, statusExpected, szCase);
+
+			// Cut off early in the entry, it's just truncated. Cut off after the limit, it's still too large.
+			file.Truncate(cbBeforeEntry + 100);
+			snprintf(szCase, sizeof(szCase), "%zu byte entry after a %zu byte description, cut off early", cbEntry, c_acchDescriptions[iDescription]);
+			_CheckAllSources(file, GMA_E_UNEXPECTED, szCase);
+			if (cbEntry > c_cbGmaMaxTocEntry + 100)
+			{
+				_BuildGma(cbEntry, c_acchDescriptions[iDescription], &file, &cbBeforeEntry);
+				file.Truncate(cbBeforeEntry + c_cbGmaMaxTocEntry + 50);
+				snprintf(szCase, sizeof(szCase), "%zu byte entry after a %zu byte description, cut off past the limit", cbEntry, c_acchDescriptions[iDescription]);
+				_CheckAllSources(file, GMA_E_TOOLARGE, szCase);
+			}
+		}
+	}
+
+	return GmaTestResult("TocLimitTest");
+}
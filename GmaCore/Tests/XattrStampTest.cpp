@@ -0,0 +1,223 @@
+// Checks GmaWriteXattrStamp() and GmaReadXattrStamp() on a temporary file: a stamp reads back as written, goes stale when the file's size or modification time changes, and with a byte source also when it's rewritten keeping both
+// Also checks the failures: GMA_E_ABORT for stamps too large for the filesystem, and GMA_E_NOTIMPL rather than GMA_E_IO where there are no user extended attributes (files in /proc).
+// If the temporary directory's filesystem doesn't support user extended attributes either, only the failures are checked.
+
+#include "GmaTest.h"
+#include "GmaXattr.h"
+#include "GmaDocument.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/xattr.h>
+
+const uint32_t c_cFiles = 12ul;
+
+static char s_szPath[256];
+
+// Parses the file open on fd as far as the file table, the way gmainfo does before stamping it
+static void _Parse(int fd, CGmaArena* pArena, GmaCachedMetadata* pMeta)
+{
+	CGmaFdByteSource source(fd);
+	CGmaDocument document(&source);
+	GMA_CHECK(document.EnsureStage(GMA_STAGE_TOC) == GMA_S_OK && document.GetTocStatus() == GMA_S_OK);
+	GmaCachedMetadata meta;
+	GmaGetDocumentMetadata(document, &meta);
+	GMA_CHECK(GmaCopyMetadata(meta, pMeta, pArena) == GMA_S_OK);
+}
+
+// Reads the stamp with the file's current key, through its byte source too if bFingerprint. Returns whether there is a current one.
+static bool _ReadStamp(int fd, bool bFingerprint, GmaCachedMetadata* pMeta, CGmaArena* pArena)
+{
+	GmaCacheKey key;
+	GMA_CHECK(GmaGetPathCacheKey(s_szPath, &key) == GMA_S_OK);
+	CGmaFdByteSource source(fd);
+	bool bFound = true;
+	GMA_CHECK(GmaReadXattrStamp(s_szPath, key, bFingerprint ? &source : NULL, pMeta, pArena, &bFound) == GMA_S_OK);
+	return bFound;
+}
+
+static bool _IsStamped(int fd, bool bFingerprint)
+{
+	CGmaArena arena;
+	GmaCachedMetadata meta;
+	return _ReadStamp(fd, bFingerprint, &meta, &arena);
+}
+
+// Puts the modification time back to what st recorded, as a careless tool rewriting the file might
+static void _RestoreMtime(int fd, const struct stat& st)
+{
+	struct timespec ats[2];
+	ats[0].tv_sec = 0;
+	ats[0].tv_nsec = UTIME_OMIT;
+	ats[1] = st.st_mtim;
+	GMA_CHECK(futimens(fd, ats) == 0);
+}
+
+// Writes a stamp and reads it back, then changes the file in the ways a stamp must notice. Returns false if the filesystem has no user extended attributes.
+static bool _CheckRoundTrip(int fd, const CGmaTestFile& file)
+{
+	CGmaArena arena;
+	GmaCacheKey key;
+	GMA_CHECK(GmaGetFileCacheKey(fd, &key) == GMA_S_OK);
+	GmaCachedMetadata meta;
+	_Parse(fd, &arena, &meta);
+
+	CGmaFdByteSource source(fd);
+	GmaStatus status = GmaWriteXattrStamp(fd, key, &source, meta);
+	if (status == GMA_E_NOTIMPL)
+		return false;
+	GMA_CHECK(status == GMA_S_OK);
+
+	// Stamping doesn't change the modification time, so the key still matches
+	GmaCacheKey keyAfter;
+	GMA_CHECK(GmaGetFileCacheKey(fd, &keyAfter) == GMA_S_OK && GmaCacheKeysEqual(key, keyAfter));
+
+	GmaCachedMetadata metaRead;
+	GMA_CHECK(_ReadStamp(fd, false, &metaRead, &arena));
+	GMA_CHECK(metaRead.stage == GMA_STAGE_TOC && metaRead.statusFailed == GMA_S_OK && metaRead.statusToc == GMA_S_OK);
+	GMA_CHECK(metaRead.header.strName.cch == 7ul && strcmp(metaRead.header.strName.psz, "Stamped") == 0);
+	GMA_CHECK(metaRead.header.strAuthor.cch == 6ul && strcmp(metaRead.header.strAuthor.psz, "Author") == 0);
+	GMA_CHECK(metaRead.tocSummary.cFiles == c_cFiles && metaRead.tocSummary.ullDataStart == file.GetDataStart() && metaRead.tocSummary.ullTotalSize == meta.tocSummary.ullTotalSize);
+	GMA_CHECK(_IsStamped(fd, true));
+
+	struct stat st;
+	GMA_CHECK(fstat(fd, &st) == 0);
+
+	// touch
+	struct timespec ats[2];
+	ats[0].tv_sec = 0;
+	ats[0].tv_nsec = UTIME_OMIT;
+	ats[1] = st.st_mtim;
+	ats[1].tv_sec += 10;
+	GMA_CHECK(futimens(fd, ats) == 0);
+	GMA_CHECK(!_IsStamped(fd, false) && !_IsStamped(fd, true));
+	_RestoreMtime(fd, st);
+	GMA_CHECK(_IsStamped(fd, false));
+
+	// A byte appended, with the time put back
+	GMA_CHECK(pwrite(fd, "x", 1, (off_t)file.GetSize()) == 1);
+	_RestoreMtime(fd, st);
+	GMA_CHECK(!_IsStamped(fd, false) && !_IsStamped(fd, true));
+	GMA_CHECK(ftruncate(fd, (off_t)file.GetSize()) == 0);
+	_RestoreMtime(fd, st);
+	GMA_CHECK(_IsStamped(fd, true));
+
+	// Rewritten with a different name of the same length, keeping size and time. Only the fingerprint tells.
+	const uint8_t* pbName = (const uint8_t*)memmem(file.GetData(), file.GetHeaderSize(), "Stamped", 7);
+	GMA_CHECK(pbName != NULL);
+	if (pbName != NULL)
+		GMA_CHECK(pwrite(fd, "Swapped", 7, (off_t)(pbName - file.GetData())) == 7);
+	_RestoreMtime(fd, st);
+	GMA_CHECK(_IsStamped(fd, false));
+	GMA_CHECK(!_IsStamped(fd, true));
+
+	// Stamped again for what's there now
+	GMA_CHECK(GmaGetFileCacheKey(fd, &key) == GMA_S_OK);
+	_Parse(fd, &arena, &meta);
+	GMA_CHECK(GmaWriteXattrStamp(fd, key, &source, meta) == GMA_S_OK);
+	GMA_CHECK(_ReadStamp(fd, true, &metaRead, &arena) && strcmp(metaRead.header.strName.psz, "Swapped") == 0);
+
+	// Past the 64 KB any Linux filesystem takes, GMA_E_ABORT without trying. Below that, the filesystem may still refuse it (ext4 keeps attributes in a single block), which is GMA_E_ABORT too.
+	static const size_t c_acchDescriptions[] = { 70000, 10000 };
+	for (size_t i = 0; i < sizeof(c_acchDescriptions) / sizeof(c_acchDescriptions[0]); i++)
+	{
+		char* pszDescription = new char[c_acchDescriptions[i] + 1];
+		memset(pszDescription, 'd', c_acchDescriptions[i]);
+		pszDescription[c_acchDescriptions[i]] = 0;
+		GmaCachedMetadata metaLarge = meta;
+		metaLarge.header.strDescription.psz = pszDescription;
+		metaLarge.header.strDescription.cch = (uint32_t)c_acchDescriptions[i];
+
+		status = GmaWriteXattrStamp(fd, key, &source, metaLarge);
+		if (i == 0)
+			GMA_CHECK(status == GMA_E_ABORT);
+		else
+			GMA_CHECK(status == GMA_E_ABORT || status == GMA_S_OK);
+
+		// A refused stamp leaves the one before it
+		GMA_CHECK(_ReadStamp(fd, true, &metaRead, &arena));
+		if (status == GMA_S_OK)
+			GMA_CHECK(metaRead.header.strDescription.cch == c_acchDescriptions[i] && memcmp(metaRead.header.strDescription.psz, pszDescription, c_acchDescriptions[i]) == 0);
+		else
+			GMA_CHECK(metaRead.header.strDescription.cch == meta.header.strDescription.cch);
+		printf("XattrStampTest: %zu byte description %s\n", c_acchDescriptions[i], (status == GMA_S_OK) ? "stamped" : "refused");
+		delete[] pszDescription;
+	}
+
+	// Something else's attribute of the same name is ignored, not misread
+	GMA_CHECK(fsetxattr(fd, c_szGmaXattrName, "not a stamp", 11, 0) == 0);
+	GMA_CHECK(!_IsStamped(fd, false));
+
+	GMA_CHECK(GmaRemoveXattrStamp(fd) == GMA_S_OK);
+	GMA_CHECK(!_IsStamped(fd, false));
+	GMA_CHECK(GmaRemoveXattrStamp(fd) == GMA_S_OK);
+	return true;
+}
+
+// Files in /proc have no user extended attributes: reading, writing and removing stamps there is GMA_E_NOTIMPL, not GMA_E_IO
+static void _CheckUnsupported(const CGmaTestFile& file)
+{
+	char ab[4];
+	if (getxattr("/proc/self/status", c_szGmaXattrName, ab, sizeof(ab)) >= 0 || errno != ENOTSUP)
+	{
+		printf("XattrStampTest: /proc has extended attributes here, skipped the unsupported filesystem checks\n");
+		return;
+	}
+
+	CGmaArena arena;
+	GmaCachedMetadata meta;
+	GmaCacheKey key;
+	bool bFound = true;
+	GMA_CHECK(GmaGetPathCacheKey("/proc/self/status", &key) == GMA_S_OK);
+	GMA_CHECK(GmaReadXattrStamp("/proc/self/status", key, NULL, &meta, &arena, &bFound) == GMA_E_NOTIMPL && !bFound);
+
+	int fd = open("/proc/self/comm", O_WRONLY);
+	GMA_CHECK(fd >= 0);
+	if (fd < 0)
+		return;
+	CGmaMemoryByteSource source(file.GetData(), file.GetSize());
+	memset(&meta, 0, sizeof(meta));
+	meta.stage = GMA_STAGE_MAGIC;
+	GMA_CHECK(GmaWriteXattrStamp(fd, key, &source, meta) == GMA_E_NOTIMPL);
+	GMA_CHECK(GmaRemoveXattrStamp(fd) == GMA_E_NOTIMPL);
+	close(fd);
+
+	// Whereas a file that isn't there is a plain I/O failure
+	GMA_CHECK(GmaReadXattrStamp("/proc/self/no such file", key, NULL, &meta, &arena, &bFound) == GMA_E_IO);
+}
+
+int main()
+{
+	CGmaTestFile file;
+	file.BuildGma("Stamped", "{\"description\": \"An addon to stamp\", \"type\": \"tool\", \"tags\": [\"fun\"]}", "Author", c_cFiles);
+
+	const char* pszTemp = getenv("TMPDIR");
+	snprintf(s_szPath, sizeof(s_szPath), "%s/gmaxattrtest.XXXXXX", (pszTemp != NULL && pszTemp[0] != 0) ? pszTemp : "/tmp");
+	int fd = mkstemp(s_szPath);
+	GMA_CHECK(fd >= 0);
+	if (fd >= 0)
+	{
+		GMA_CHECK(write(fd, file.GetData(), file.GetSize()) == (ssize_t)file.GetSize());
+		if (!_CheckRoundTrip(fd, file))
+			printf("XattrStampTest: %s has no user extended attributes, skipped the round trip\n", s_szPath);
+		close(fd);
+		unlink(s_szPath);
+	}
+
+	_CheckUnsupported(file);
+	return GmaTestResult("XattrStampTest");
+}
+
+#else
+
+int main()
+{
+	printf("XattrStampTest: extended attribute stamps are only implemented on Linux\n");
+	return 0;
+}
+
+#endif
@@ -99,6 +99,9 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
 
+/* Lookup acceleration for large arrays and objects. Internal to cJSON. */
+struct cJSON_Index;
+
 /* The cJSON structure: */
 typedef struct cJSON
 {
@@ -120,6 +123,9 @@ typedef struct cJSON
 
     /* The item's name string, if this item is the child of, or is in the list of subitems of an object. */
     char *string;
+
+    /* Built by cJSON_BuildIndex for large arrays and objects, and dropped whenever their children are changed through the API. Managed by cJSON, don't touch. */
+    struct cJSON_Index *index;
 } cJSON;
 
 typedef struct cJSON_Hooks
@@ -129,6 +135,15 @@ typedef struct cJSON_Hooks
       void (CJSON_CDECL *free_fn)(void *ptr);
 } cJSON_Hooks;
 
+/* Allocator for a single parse, passed per call instead of installed globally with cJSON_InitHooks, so concurrent parses can each use their own.
+ * context is passed back to both functions. free_fn may be NULL when the context releases everything at once (e.g. an arena); nothing is then freed item by item. */
+typedef struct cJSON_ContextHooks
+{
+      void *(CJSON_CDECL *malloc_fn)(void *context, size_t sz);
+      void (CJSON_CDECL *free_fn)(void *context, void *ptr);
+      void *context;
+} cJSON_ContextHooks;
+
 typedef int cJSON_bool;
 
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
@@ -137,6 +152,11 @@ typedef int cJSON_bool;
 #define CJSON_NESTING_LIMIT 1000
 #endif
 
+/* cJSON_BuildIndex only indexes arrays and objects with at least this many children. Smaller ones are walked about as fast. */
+#ifndef CJSON_INDEX_THRESHOLD
+#define CJSON_INDEX_THRESHOLD 16
+#endif
+
 /* returns the version of cJSON as a string */
 CJSON_PUBLIC(const char*) cJSON_Version(void);
 
@@ -151,6 +171,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 /* If you supply a ptr in return_parse_end and parsing fails, then return_parse_end will contain a pointer to the error so will match cJSON_GetErrorPtr(). */
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
+/* ParseWithHooks allocates the tree through hooks rather than the global hooks, and leaves cJSON_GetErrorPtr alone, so it is safe to call from several threads at once.
+ * Free the result with cJSON_DeleteWithHooks using the same hooks, or, if hooks->free_fn is NULL, by releasing the context. Use return_parse_end to find where parsing failed. */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithHooks(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, const cJSON_ContextHooks *hooks);
 
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
@@ -163,15 +186,22 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format);
 /* Delete a cJSON entity and all subentities. */
 CJSON_PUBLIC(void) cJSON_Delete(cJSON *item);
+/* Same, for a tree parsed with cJSON_ParseWithHooks */
+CJSON_PUBLIC(void) cJSON_DeleteWithHooks(cJSON *item, const cJSON_ContextHooks *hooks);
 
 /* Returns the number of items in an array (or object). */
 CJSON_PUBLIC(int) cJSON_GetArraySize(const cJSON *array);
 /* Retrieve item number "index" from array "array". Returns NULL if unsuccessful. */
 CJSON_PUBLIC(cJSON *) cJSON_GetArrayItem(const cJSON *array, int index);
 /* Get item "string" from object. Case insensitive. */
+/* These lookups never change the tree, so any number of threads may run them on it at once. They use an index where cJSON_BuildIndex has built one. */
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItem(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON *) cJSON_GetObjectItemCaseSensitive(const cJSON * const object, const char * const string);
 CJSON_PUBLIC(cJSON_bool) cJSON_HasObjectItem(const cJSON *object, const char *string);
+/* Indexes item and every array and object in it with at least CJSON_INDEX_THRESHOLD children, so that looking up many keys, or fetching many items by position, isn't quadratic.
+ * Call it once the tree is built, and before sharing it between threads: it changes the tree. Any change to an item's children drops its index, until this is called again.
+ * Returns false if out of memory (lookups still work, just unindexed where that happened), or for trees parsed with cJSON_ParseWithHooks, which are never indexed since the index would have to be allocated outside of their hooks. */
+CJSON_PUBLIC(cJSON_bool) cJSON_BuildIndex(cJSON *item);
 /* For analysing failed parses. This returns a pointer to the parse error. You'll probably need to look a few chars back to make sense of it. Defined when cJSON_Parse() returns 0. 0 when cJSON_Parse() succeeds. */
 CJSON_PUBLIC(const char *) cJSON_GetErrorPtr(void);
 
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
+#include <new>  // std::nothrow
+#include "GmaStatus.h"
+
+const uint32_t c_cQueueSpins = 64; // Yields before a waiting thread starts sleeping between attempts
+const long c_nsQueueSleep = 50000;
+
+// Time a stage's threads spent waiting on their queues, for tuning stage sizes
+struct QueueWaitStats
+{
+	uint64_t nsWaitingForInput; // Queue empty
+	uint64_t nsBlockedOnOutput; // Next queue full: backpressure from the stage after
+	uint64_t cPops;
+	uint64_t cDepthSum; // Queue depth seen at each pop, for the average
+};
+
+static inline uint64_t GetMonotonicNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Bounded multi-producer, multi-consumer queue of pointers, without locks
+// A ring of cells, each carrying a sequence number that says whether it's ready to be written or read on the current lap (Vyukov's design). Producers and consumers each claim a position with one compare-and-swap and never wait on one another's cells except when the queue is full or empty.
+// Push() and Pop() wait by yielding and then sleeping, which costs nothing while stages keep up and lets a stalled stage back up into the ones before it. Once the producers are done they Close() the queue, and Pop() returns false when it's drained.
+template <class T> class CBoundedQueue
+{
+public:
+	CBoundedQueue() : _aCells(NULL), _ulMask(0), _iPush(0), _iPop(0), _bClosed(false) {}
+	~CBoundedQueue() { delete[] _aCells; }
+
+	// cCapacity is rounded up to a power of two
+	GmaStatus Initialize(size_t cCapacity)
+	{
+		size_t cCells = 2;
+		while (cCells < cCapacity)
+			cCells *= 2;
+		_aCells = new (std::nothrow) Cell[cCells];
+		if (_aCells == NULL)
+			return GMA_E_OUTOFMEMORY;
+		for (size_t i = 0; i < cCells; i++)
+			_aCells[i].iSequence = i;
+		_ulMask = cCells - 1;
+		return GMA_S_OK;
+	}
+
+	bool TryPush(T item)
+	{
+		size_t iPos = __atomic_load_n(&_iPush, __ATOMIC_RELAXED);
+		for (;;)
+		{
+			Cell* pCell = &_aCells[iPos & _ulMask];
+			size_t iSequence = __atomic_load_n(&pCell->iSequence, __ATOMIC_ACQUIRE);
+			intptr_t lDiff = (intptr_t)iSequence - (intptr_t)iPos;
+			if (lDiff == 0)
+			{
+				if (__atomic_compare_exchange_n(&_iPush, &iPos, iPos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				{
+					pCell->item = item;
+					__atomic_store_n(&pCell->iSequence, iPos + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+			}
+			else if (lDiff < 0)
+			{
+				return false; // full
+			}
+			else
+			{
+				iPos = __atomic_load_n(&_iPush, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	bool TryPop(T* pItem)
+	{
+		size_t iPos = __atomic_load_n(&_iPop, __ATOMIC_RELAXED);
+		for (;;)
+		{
+			Cell* pCell = &_aCells[iPos & _ulMask];
+			size_t iSequence = __atomic_load_n(&pCell->iSequence, __ATOMIC_ACQUIRE);
+			intptr_t lDiff = (intptr_t)iSequence - (intptr_t)(iPos + 1);
+			if (lDiff == 0)
+			{
+				if (__atomic_compare_exchange_n(&_iPop, &iPos, iPos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				{
+					*pItem = pCell->item;
+					__atomic_store_n(&pCell->iSequence, iPos + _ulMask + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+			}
+			else if (lDiff < 0)
+			{
+				return false; // empty
+			}
+			else
+			{
+				iPos = __atomic_load_n(&_iPop, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	// Waits for room, and adds the wait to pStats->nsBlockedOnOutput
+	void Push(T item, QueueWaitStats* pStats)
+	{
+		if (TryPush(item))
+			return;
+
+		uint64_t nsStart = GetMonotonicNs();
+		for (uint32_t cWaits = 0; !TryPush(item); cWaits++)
+			_Wait(cWaits);
+		pStats->nsBlockedOnOutput += GetMonotonicNs() - nsStart;
+	}
+
+	// Waits for an item, and adds the wait to pStats->nsWaitingForInput. Returns false once the queue is closed and empty.
+	bool Pop(T* pItem, QueueWaitStats* pStats)
+	{
+		size_t cDepth = GetDepth();
+		bool bFound = TryPop(pItem);
+		if (!bFound)
+		{
+			uint64_t nsStart = GetMonotonicNs();
+			for (uint32_t cWaits = 0; !bFound; cWaits++)
+			{
+				// Whatever was pushed before Close() is visible once the close is, so one more try after seeing it settles it
+				if (__atomic_load_n(&_bClosed, __ATOMIC_ACQUIRE))
+				{
+					bFound = TryPop(pItem);
+					break;
+				}
+				_Wait(cWaits);
+				bFound = TryPop(pItem);
+			}
+			pStats->nsWaitingForInput += GetMonotonicNs() - nsStart;
+			cDepth = 0;
+		}
+
+		if (bFound)
+		{
+			pStats->cPops++;
+			pStats->cDepthSum += cDepth;
+		}
+		return bFound;
+	}
+
+	// Called once every producer is done
+	void Close() { __atomic_store_n(&_bClosed, true, __ATOMIC_RELEASE); }
+
+	// Approximate, since it races with everyone else
+	size_t GetDepth() const
+	{
+		size_t iPush = __atomic_load_n(&_iPush, __ATOMIC_RELAXED);
+		size_t iPop = __atomic_load_n(&_iPop, __ATOMIC_RELAXED);
+		return iPush > iPop ? iPush - iPop : 0;
+	}
+
+	size_t GetCapacity() const { return _ulMask + 1; }
+
+private:
+	struct Cell
+	{
+		size_t iSequence;
+		T item;
+	};
+
+	Cell* _aCells;
+	size_t _ulMask;
+	char _abPadding1[64];
+	size_t _iPush; // Producers' and consumers' positions, on their own cache lines
+	char _abPadding2[64];
+	size_t _iPop;
+	char _abPadding3[64];
+	bool _bClosed;
+
+	static void _Wait(uint32_t cWaits)
+	{
+		if (cWaits < c_cQueueSpins)
+		{
+			sched_yield();
+		}
+		else
+		{
+			struct timespec ts = { 0, c_nsQueueSleep };
+			nanosleep(&ts, NULL);
+		}
+	}
+
+	CBoundedQueue(const CBoundedQueue&);
+	CBoundedQueue& operator=(const CBoundedQueue&);
+};
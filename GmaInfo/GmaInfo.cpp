@@ -0,0 +1,380 @@
+// gmainfo: scans directory trees for .gma files and prints their metadata as NDJSON or CSV
+// Built on the GMA core, so it reports exactly what the shell extension shows. Linux/POSIX only.
+
+#include "GmaStatus.h"
+#include "GmaCacheFile.h"
+#include "ScanPipeline.h"
+#include "IoUring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/stat.h>
+
+const uint32_t c_cMaxThreads = 256; // Per stage
+const uint32_t c_cMaxWalkers = 4; // Default directory walkers. More rarely help, since listing directories mostly waits on the filesystem's locks.
+const uint32_t c_cDefaultReaders = 16; // With blocking reads: enough in flight to keep an SSD's queue busy, while a disk still seeks sensibly
+const uint32_t c_cDefaultRingReaders = 1; // With io_uring, one thread keeps a whole ring's worth of reads in flight
+const uint32_t c_cDefaultRingDepth = 128;
+const uint32_t c_cDefaultInFlight = 256; // Each holds a c_cbReadAheadWindow buffer and possibly an open descriptor
+const uint32_t c_cMaxInFlight = 16384;
+
+
+// ____________________________________________________________________________________________________
+//
+//     Options
+// ____________________________________________________________________________________________________
+//
+
+struct Options
+{
+	OutputFormat format;
+	bool bDescription;
+	uint32_t cWalkers; // 0 for the defaults
+	uint32_t cReaders;
+	uint32_t cParsers;
+	uint32_t cInFlight;
+	int iBackend; // A ReadBackend, or -1 to use io_uring where it's supported
+	uint32_t cRingDepth;
+	ReadOrder readOrder;
+	const char* pszCacheFile;
+	bool bReadXattr;
+	bool bWriteXattr;
+	bool bAllFiles; // Scan every file in a directory, not just *.gma
+	bool bStats;
+	bool bStageStats;
+};
+
+static void _PrintUsage(FILE* pFile)
+{
+	fprintf(pFile,
+		"Usage: gmainfo [options] <path>...\n"
+		"Scans files and directory trees for .gma addons and prints their metadata.\n"
+		"\n"
+		"  -f, --format <ndjson|csv>  Output format (default ndjson)\n"
+		"  -j, --jobs <n>             Parse threads (default: one per available CPU)\n"
+		"      --io <auto|uring|pread|mmap>\n"
+		"                             How files are read: batched on io_uring, with blocking calls, or mapped and parsed in place (default auto: io_uring where supported)\n"
+		"                             mmap is unsafe on trees other processes write to: a file truncated mid-parse kills gmainfo with SIGBUS\n"
+		"      --readers <n>          Threads opening and reading files (default %u, or %u with io_uring)\n"
+		"      --ring-depth <n>       Files each io_uring thread reads at once (default %u)\n"
+		"      --walkers <n>          Threads listing directories (default: up to %u)\n"
+		"      --order <dir|inode|physical>\n"
+		"                             Order to read each directory's files in: as listed, by inode, or by where their data lies on disk (default dir)\n"
+		"      --in-flight <n>        Files read ahead of the output at once (default %u)\n"
+		"  -d, --description          Include the description\n"
+		"  -a, --all                  Scan every file found in directories, not just *.gma\n"
+		"  -c, --cache <file>         Reuse and update a persistent metadata cache file\n"
+		"  -x, --xattr                Reuse results stamped on files by --stamp\n"
+		"  -s, --stamp                Stamp parsed results on files as extended attributes\n"
+		"  -q, --quiet                Don't print the throughput summary to stderr\n"
+		"      --stages               Also print how busy each pipeline stage was\n"
+		"  -h, --help                 Show this help\n",
+		c_cDefaultReaders, c_cDefaultRingReaders, c_cDefaultRingDepth, c_cMaxWalkers, c_cDefaultInFlight);
+}
+
+static bool _ParseUInt(const char* psz, uint32_t* pul)
+{
+	char* pszEnd;
+	errno = 0;
+	unsigned long ul = strtoul(psz, &pszEnd, 10);
+	if (errno != 0 || pszEnd == psz || *pszEnd != '\0' || ul > 0xFFFFFFFFul)
+		return false;
+	*pul = (uint32_t)ul;
+	return true;
+}
+
+static bool _ParseCount(const char* pszOption, const char* pszValue, uint32_t cMax, uint32_t* pc)
+{
+	if (!_ParseUInt(pszValue, pc) || *pc == 0 || *pc > cMax)
+	{
+		fprintf(stderr, "gmainfo: %s must be between 1 and %u\n", pszOption, cMax);
+		return false;
+	}
+	return true;
+}
+
+// Returns the index of the first path argument, or -1 to exit with *piExit
+static int _ParseOptions(int argc, char** argv, Options* pOptions, int* piExit)
+{
+	memset(pOptions, 0, sizeof(*pOptions));
+	pOptions->format = OUTPUT_NDJSON;
+	pOptions->bStats = true;
+	pOptions->iBackend = -1;
+	*piExit = 2;
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+	{
+		const char* pszArg = argv[i];
+		if (strcmp(pszArg, "--") == 0)
+		{
+			i++;
+			break;
+		}
+
+		bool bTakesValue = strcmp(pszArg, "-f") == 0 || strcmp(pszArg, "--format") == 0 || strcmp(pszArg, "-j") == 0 || strcmp(pszArg, "--jobs") == 0
+			|| strcmp(pszArg, "--readers") == 0 || strcmp(pszArg, "--walkers") == 0 || strcmp(pszArg, "--in-flight") == 0
+			|| strcmp(pszArg, "--io") == 0 || strcmp(pszArg, "--ring-depth") == 0 || strcmp(pszArg, "--order") == 0 || strcmp(pszArg, "-c") == 0 || strcmp(pszArg, "--cache") == 0;
+		if (bTakesValue && i + 1 >= argc)
+		{
+			fprintf(stderr, "gmainfo: option '%s' needs a value\n", pszArg);
+			return -1;
+		}
+
+		if (strcmp(pszArg, "-f") == 0 || strcmp(pszArg, "--format") == 0)
+		{
+			const char* pszValue = argv[++i];
+			if (strcmp(pszValue, "ndjson") == 0)
+				pOptions->format = OUTPUT_NDJSON;
+			else if (strcmp(pszValue, "csv") == 0)
+				pOptions->format = OUTPUT_CSV;
+			else
+			{
+				fprintf(stderr, "gmainfo: unknown format '%s'\n", pszValue);
+				return -1;
+			}
+		}
+		else if (strcmp(pszArg, "-j") == 0 || strcmp(pszArg, "--jobs") == 0)
+		{
+			if (!_ParseCount(pszArg, argv[++i], c_cMaxThreads, &pOptions->cParsers))
+				return -1;
+		}
+		else if (strcmp(pszArg, "--readers") == 0)
+		{
+			if (!_ParseCount(pszArg, argv[++i], c_cMaxThreads, &pOptions->cReaders))
+				return -1;
+		}
+		else if (strcmp(pszArg, "--walkers") == 0)
+		{
+			if (!_ParseCount(pszArg, argv[++i], c_cMaxThreads, &pOptions->cWalkers))
+				return -1;
+		}
+		else if (strcmp(pszArg, "--io") == 0)
+		{
+			const char* pszValue = argv[++i];
+			if (strcmp(pszValue, "auto") == 0)
+				pOptions->iBackend = -1;
+			else if (strcmp(pszValue, "uring") == 0)
+				pOptions->iBackend = READ_BACKEND_URING;
+			else if (strcmp(pszValue, "pread") == 0)
+				pOptions->iBackend = READ_BACKEND_PREAD;
+			else if (strcmp(pszValue, "mmap") == 0)
+				pOptions->iBackend = READ_BACKEND_MMAP;
+			else
+			{
+				fprintf(stderr, "gmainfo: unknown I/O backend '%s'\n", pszValue);
+				return -1;
+			}
+		}
+		else if (strcmp(pszArg, "--order") == 0)
+		{
+			const char* pszValue = argv[++i];
+			if (strcmp(pszValue, "dir") == 0)
+				pOptions->readOrder = READ_ORDER_DIRECTORY;
+			else if (strcmp(pszValue, "inode") == 0)
+				pOptions->readOrder = READ_ORDER_INODE;
+			else if (strcmp(pszValue, "physical") == 0)
+				pOptions->readOrder = READ_ORDER_PHYSICAL;
+			else
+			{
+				fprintf(stderr, "gmainfo: unknown read order '%s'\n", pszValue);
+				return -1;
+			}
+		}
+		else if (strcmp(pszArg, "--ring-depth") == 0)
+		{
+			if (!_ParseCount(pszArg, argv[++i], c_cMaxInFlight, &pOptions->cRingDepth))
+				return -1;
+		}
+		else if (strcmp(pszArg, "--in-flight") == 0)
+		{
+			if (!_ParseCount(pszArg, argv[++i], c_cMaxInFlight, &pOptions->cInFlight))
+				return -1;
+		}
+		else if (strcmp(pszArg, "-c") == 0 || strcmp(pszArg, "--cache") == 0)
+		{
+			pOptions->pszCacheFile = argv[++i];
+		}
+		else if (strcmp(pszArg, "-d") == 0 || strcmp(pszArg, "--description") == 0)
+			pOptions->bDescription = true;
+		else if (strcmp(pszArg, "-a") == 0 || strcmp(pszArg, "--all") == 0)
+			pOptions->bAllFiles = true;
+		else if (strcmp(pszArg, "-x") == 0 || strcmp(pszArg, "--xattr") == 0)
+			pOptions->bReadXattr = true;
+		else if (strcmp(pszArg, "-s") == 0 || strcmp(pszArg, "--stamp") == 0)
+			pOptions->bWriteXattr = true;
+		else if (strcmp(pszArg, "-q") == 0 || strcmp(pszArg, "--quiet") == 0)
+			pOptions->bStats = false;
+		else if (strcmp(pszArg, "--stages") == 0)
+			pOptions->bStageStats = true;
+		else if (strcmp(pszArg, "-h") == 0 || strcmp(pszArg, "--help") == 0)
+		{
+			_PrintUsage(stdout);
+			*piExit = 0;
+			return -1;
+		}
+		else
+		{
+			fprintf(stderr, "gmainfo: unknown option '%s'\n", pszArg);
+			_PrintUsage(stderr);
+			return -1;
+		}
+	}
+
+	if (i >= argc)
+	{
+		_PrintUsage(stderr);
+		return -1;
+	}
+	return i;
+}
+
+// CPUs this process may run on, which is less than the machine has under taskset or a container's cpuset
+static uint32_t _GetAvailableCpus()
+{
+	cpu_set_t cpus;
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 0)
+		return (uint32_t)CPU_COUNT(&cpus);
+
+	long cCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cCpus > 0 ? (uint32_t)cCpus : 1;
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Entry point
+// ____________________________________________________________________________________________________
+//
+
+static void _PrintStageStats(const CScanPipeline& pipeline)
+{
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		const StageStats& stats = pipeline.GetStageStats((ScanStage)i);
+		double dTotal = stats.nsTotal != 0 ? (double)stats.nsTotal : 1.0;
+		double dInput = 100.0 * stats.waits.nsWaitingForInput / dTotal;
+		double dOutput = 100.0 * stats.waits.nsBlockedOnOutput / dTotal;
+		double dBusy = 100.0 - dInput - dOutput;
+		fprintf(stderr, "gmainfo: %-9s %3u threads, %9llu items, busy %5.1f%%, waiting for input %5.1f%%, blocked on output %5.1f%%",
+			GetStageName((ScanStage)i), stats.cThreads, (unsigned long long)stats.cItems, dBusy < 0.0 ? 0.0 : dBusy, dInput, dOutput);
+		if (stats.cInputCapacity != 0)
+			fprintf(stderr, ", input queue %.1f/%llu", stats.waits.cPops != 0 ? (double)stats.waits.cDepthSum / stats.waits.cPops : 0.0, (unsigned long long)stats.cInputCapacity);
+		fputc('\n', stderr);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	int iExit;
+	int iFirstPath = _ParseOptions(argc, argv, &options, &iExit);
+	if (iFirstPath < 0)
+		return iExit;
+
+	ReadBackend backend = (options.iBackend >= 0) ? (ReadBackend)options.iBackend : (CIoUring::IsSupported() ? READ_BACKEND_URING : READ_BACKEND_PREAD);
+	if (backend == READ_BACKEND_URING && !CIoUring::IsSupported())
+	{
+		fprintf(stderr, "gmainfo: io_uring isn't available on this system\n");
+		return 1;
+	}
+
+	uint32_t cCpus = _GetAvailableCpus();
+	PipelineConfig config;
+	memset(&config, 0, sizeof(config));
+	config.format = options.format;
+	config.bDescription = options.bDescription;
+	config.bAllFiles = options.bAllFiles;
+	config.acThreads[STAGE_ENUMERATE] = options.cWalkers != 0 ? options.cWalkers : (cCpus < c_cMaxWalkers ? cCpus : c_cMaxWalkers);
+	config.acThreads[STAGE_READ] = options.cReaders != 0 ? options.cReaders : (backend == READ_BACKEND_URING ? c_cDefaultRingReaders : c_cDefaultReaders);
+	config.acThreads[STAGE_PARSE] = options.cParsers != 0 ? options.cParsers : (cCpus < c_cMaxThreads ? cCpus : c_cMaxThreads);
+	config.acThreads[STAGE_OUTPUT] = 1;
+	config.cInFlight = options.cInFlight != 0 ? options.cInFlight : c_cDefaultInFlight;
+	config.readBackend = backend;
+	config.cRingDepth = options.cRingDepth != 0 ? options.cRingDepth : c_cDefaultRingDepth;
+	config.readOrder = options.readOrder;
+	config.bReadXattr = options.bReadXattr;
+	config.bWriteXattr = options.bWriteXattr;
+	config.pOut = stdout;
+
+	CGmaCacheFile cacheFile;
+	if (options.pszCacheFile != NULL)
+	{
+		GmaStatus statusCache = cacheFile.Open(options.pszCacheFile);
+		if (statusCache == GMA_E_ABORT)
+			fprintf(stderr, "gmainfo: %s isn't a cache file, so it won't be used or replaced\n", options.pszCacheFile);
+		else if (GMA_FAILED(statusCache))
+			fprintf(stderr, "gmainfo: can't open cache file %s: %s\n", options.pszCacheFile, strerror(cacheFile.GetLastErrno()));
+		else
+			config.pCacheFile = &cacheFile;
+	}
+
+	CScanPipeline pipeline(config);
+	if (GMA_FAILED(pipeline.Initialize()))
+	{
+		fprintf(stderr, "gmainfo: out of memory\n");
+		return 1;
+	}
+
+	// Explicit files are scanned whatever their extension
+	int iResult = 0;
+	for (int i = iFirstPath; i < argc; i++)
+	{
+		struct stat st;
+		if (stat(argv[i], &st) != 0)
+		{
+			fprintf(stderr, "gmainfo: %s: %s\n", argv[i], strerror(errno));
+			iResult = 1;
+			continue;
+		}
+		if (GMA_FAILED(pipeline.AddPath(argv[i], S_ISDIR(st.st_mode))))
+		{
+			fprintf(stderr, "gmainfo: out of memory\n");
+			return 1;
+		}
+	}
+
+	CResultWriter writer(options.format, options.bDescription);
+	CTextBuffer header;
+	writer.WriteHeader(&header);
+	fwrite(header.GetText(), 1, header.GetLength(), stdout);
+
+	uint64_t nsStart = GetMonotonicNs();
+	GmaStatus status = pipeline.Run();
+	double dElapsed = (GetMonotonicNs() - nsStart) / 1e9;
+	if (GMA_FAILED(status))
+	{
+		fprintf(stderr, "gmainfo: can't start the scan's threads\n");
+		iResult = 1;
+	}
+
+	if (fflush(stdout) != 0 || pipeline.OutputFailed())
+	{
+		fprintf(stderr, "gmainfo: error writing output\n");
+		iResult = 1;
+	}
+
+	const ScanCounters& totals = pipeline.GetCounters();
+	if (totals.cDirectoryErrors != 0)
+		iResult = 1;
+
+	if (options.bStats)
+	{
+		double dSeconds = dElapsed > 1e-9 ? dElapsed : 1e-9;
+		fprintf(stderr, "gmainfo: %llu files (%llu failed, %llu cached) in %.3f s with %s reads, %llu steals\n",
+			(unsigned long long)totals.cFiles, (unsigned long long)totals.cFailed, (unsigned long long)totals.cCached, dElapsed,
+			backend == READ_BACKEND_URING ? "io_uring" : backend == READ_BACKEND_MMAP ? "mmap" : "pread", (unsigned long long)pipeline.GetStealCount());
+		fprintf(stderr, "gmainfo: %.1f files/s, %.1f MB/s read (%.1f MB), %.1f MB/s of addons (%.1f MB)\n",
+			totals.cFiles / dSeconds, totals.cbRead / 1e6 / dSeconds, totals.cbRead / 1e6, totals.cbFiles / 1e6 / dSeconds, totals.cbFiles / 1e6);
+		if (totals.cMappedFallbacks != 0)
+			fprintf(stderr, "gmainfo: %llu files changed size while mapped and were read again with pread\n", (unsigned long long)totals.cMappedFallbacks);
+	}
+	if (options.bStageStats)
+		_PrintStageStats(pipeline);
+
+	return iResult;
+}
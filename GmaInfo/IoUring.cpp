@@ -0,0 +1,236 @@
+#include "IoUring.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+CIoUring::CIoUring() : _fdRing(-1), _pvSqRing(NULL), _cbSqRing(0), _pvCqRing(NULL), _cbCqRing(0), _pvSqes(NULL), _cbSqes(0), _cSqEntries(0), _pulSqHead(NULL), _pulSqTail(NULL), _ulSqMask(0),
+	_aulSqArray(NULL), _ulSqTail(0), _cToSubmit(0), _pulCqHead(NULL), _pulCqTail(NULL), _ulCqMask(0), _pvCqes(NULL), _iLastErrno(0)
+{
+}
+
+CIoUring::~CIoUring()
+{
+	_Close();
+}
+
+#ifdef __linux__
+
+bool CIoUring::IsSupported()
+{
+	static int s_iSupported = -1; // Benign race: every thread probes to the same answer
+	int iSupported = __atomic_load_n(&s_iSupported, __ATOMIC_RELAXED);
+	if (iSupported >= 0)
+		return iSupported != 0;
+
+	iSupported = 0;
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int fd = (int)syscall(__NR_io_uring_setup, 2, &params);
+	if (fd >= 0)
+	{
+		const size_t cOps = 256;
+		uint8_t abProbe[sizeof(struct io_uring_probe) + cOps * sizeof(struct io_uring_probe_op)];
+		memset(abProbe, 0, sizeof(abProbe));
+		struct io_uring_probe* pProbe = (struct io_uring_probe*)abProbe;
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, pProbe, cOps) == 0)
+		{
+			static const uint8_t c_abOps[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+			iSupported = 1;
+			for (size_t i = 0; i < sizeof(c_abOps); i++)
+			{
+				if (c_abOps[i] > pProbe->last_op || !(pProbe->ops[c_abOps[i]].flags & IO_URING_OP_SUPPORTED))
+					iSupported = 0;
+			}
+		}
+		close(fd);
+	}
+
+	__atomic_store_n(&s_iSupported, iSupported, __ATOMIC_RELAXED);
+	return iSupported != 0;
+}
+
+GmaStatus CIoUring::Initialize(uint32_t cEntries)
+{
+	if (_fdRing >= 0)
+		return GMA_E_UNEXPECTED;
+	if (!IsSupported())
+		return GMA_E_NOTIMPL;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	_fdRing = (int)syscall(__NR_io_uring_setup, cEntries, &params);
+	if (_fdRing < 0)
+	{
+		_iLastErrno = errno;
+		return (errno == ENOSYS || errno == EPERM) ? GMA_E_NOTIMPL : GMA_E_IO;
+	}
+
+	// Kernels since 5.4 map both rings with one mapping
+	_cbSqRing = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	_cbCqRing = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	bool bSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (bSingleMmap && _cbCqRing > _cbSqRing)
+		_cbSqRing = _cbCqRing;
+
+	_pvSqRing = mmap(NULL, _cbSqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fdRing, IORING_OFF_SQ_RING);
+	if (_pvSqRing == MAP_FAILED)
+	{
+		_pvSqRing = NULL;
+		_iLastErrno = errno;
+		_Close();
+		return GMA_E_IO;
+	}
+	if (bSingleMmap)
+	{
+		_pvCqRing = _pvSqRing;
+	}
+	else
+	{
+		_pvCqRing = mmap(NULL, _cbCqRing, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fdRing, IORING_OFF_CQ_RING);
+		if (_pvCqRing == MAP_FAILED)
+		{
+			_pvCqRing = NULL;
+			_iLastErrno = errno;
+			_Close();
+			return GMA_E_IO;
+		}
+	}
+
+	_cbSqes = params.sq_entries * sizeof(struct io_uring_sqe);
+	_pvSqes = mmap(NULL, _cbSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fdRing, IORING_OFF_SQES);
+	if (_pvSqes == MAP_FAILED)
+	{
+		_pvSqes = NULL;
+		_iLastErrno = errno;
+		_Close();
+		return GMA_E_IO;
+	}
+
+	uint8_t* pbSq = (uint8_t*)_pvSqRing;
+	_cSqEntries = params.sq_entries;
+	_pulSqHead = (uint32_t*)(pbSq + params.sq_off.head);
+	_pulSqTail = (uint32_t*)(pbSq + params.sq_off.tail);
+	_ulSqMask = *(uint32_t*)(pbSq + params.sq_off.ring_mask);
+	_aulSqArray = (uint32_t*)(pbSq + params.sq_off.array);
+	_ulSqTail = *_pulSqTail;
+
+	uint8_t* pbCq = (uint8_t*)_pvCqRing;
+	_pulCqHead = (uint32_t*)(pbCq + params.cq_off.head);
+	_pulCqTail = (uint32_t*)(pbCq + params.cq_off.tail);
+	_ulCqMask = *(uint32_t*)(pbCq + params.cq_off.ring_mask);
+	_pvCqes = pbCq + params.cq_off.cqes;
+	return GMA_S_OK;
+}
+
+struct io_uring_sqe* CIoUring::GetSqe()
+{
+	for (int iAttempt = 0; iAttempt < 2; iAttempt++)
+	{
+		uint32_t ulHead = __atomic_load_n(_pulSqHead, __ATOMIC_ACQUIRE);
+		if (_ulSqTail - ulHead < _cSqEntries)
+		{
+			uint32_t iSqe = _ulSqTail & _ulSqMask;
+			struct io_uring_sqe* pSqe = (struct io_uring_sqe*)_pvSqes + iSqe;
+			memset(pSqe, 0, sizeof(*pSqe));
+			_aulSqArray[iSqe] = iSqe;
+			_ulSqTail++;
+			_cToSubmit++;
+			return pSqe;
+		}
+
+		// Full of entries the kernel hasn't consumed yet
+		if (GMA_FAILED(Submit(0)))
+			break;
+	}
+	return NULL;
+}
+
+GmaStatus CIoUring::Submit(uint32_t cWaitFor)
+{
+	__atomic_store_n(_pulSqTail, _ulSqTail, __ATOMIC_RELEASE);
+	for (;;)
+	{
+		if (_cToSubmit == 0 && cWaitFor == 0)
+			return GMA_S_OK;
+
+		unsigned int ulFlags = (cWaitFor != 0) ? IORING_ENTER_GETEVENTS : 0;
+		long lSubmitted = syscall(__NR_io_uring_enter, _fdRing, _cToSubmit, cWaitFor, ulFlags, NULL, 0);
+		if (lSubmitted < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			// Completions the kernel couldn't post yet. Reaping them is the caller's way out.
+			if (errno == EBUSY || errno == EAGAIN)
+				return GMA_S_OK;
+			_iLastErrno = errno;
+			return GMA_E_IO;
+		}
+
+		_cToSubmit -= (uint32_t)lSubmitted;
+		return GMA_S_OK;
+	}
+}
+
+bool CIoUring::PopCompletion(uint64_t* pullUserData, int32_t* plResult)
+{
+	uint32_t ulHead = *_pulCqHead;
+	if (ulHead == __atomic_load_n(_pulCqTail, __ATOMIC_ACQUIRE))
+		return false;
+
+	const struct io_uring_cqe* pCqe = (const struct io_uring_cqe*)_pvCqes + (ulHead & _ulCqMask);
+	*pullUserData = pCqe->user_data;
+	*plResult = pCqe->res;
+	__atomic_store_n(_pulCqHead, ulHead + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+void CIoUring::_Close()
+{
+	if (_pvSqes != NULL)
+		munmap(_pvSqes, _cbSqes);
+	if (_pvCqRing != NULL && _pvCqRing != _pvSqRing)
+		munmap(_pvCqRing, _cbCqRing);
+	if (_pvSqRing != NULL)
+		munmap(_pvSqRing, _cbSqRing);
+	if (_fdRing >= 0)
+		close(_fdRing);
+	_pvSqes = _pvCqRing = _pvSqRing = NULL;
+	_fdRing = -1;
+}
+
+#else
+
+bool CIoUring::IsSupported()
+{
+	return false;
+}
+
+GmaStatus CIoUring::Initialize(uint32_t cEntries)
+{
+	(void)cEntries;
+	return GMA_E_NOTIMPL;
+}
+
+GmaStatus CIoUring::Submit(uint32_t cWaitFor)
+{
+	(void)cWaitFor;
+	return GMA_E_NOTIMPL;
+}
+
+bool CIoUring::PopCompletion(uint64_t* pullUserData, int32_t* plResult)
+{
+	(void)pullUserData;
+	(void)plResult;
+	return false;
+}
+
+void CIoUring::_Close()
+{
+}
+
+#endif
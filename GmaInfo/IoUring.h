@@ -0,0 +1,65 @@
+#pragma once
+
+#include "GmaStatus.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+// Minimal io_uring submission and completion rings, on the raw system calls so there's no dependency on liburing
+// Only what the scanner's read stage needs: queue operations, submit them in one system call while waiting for completions, and reap the completions. Not thread-safe; use one per thread.
+// Everywhere but Linux, and on kernels without io_uring or the operations the scanner uses (5.6+), Initialize() fails with GMA_E_NOTIMPL.
+class CIoUring
+{
+public:
+	CIoUring();
+	~CIoUring();
+
+	GmaStatus Initialize(uint32_t cEntries);
+	uint32_t GetEntryCount() const { return _cSqEntries; }
+
+	// Whether the kernel supports every operation the scanner submits. Probed once per process.
+	static bool IsSupported();
+
+#ifdef __linux__
+	// Returns a zeroed submission entry to fill in, or NULL if the submission queue is full even after submitting what's in it
+	struct io_uring_sqe* GetSqe();
+#endif
+
+	// Submits everything queued, and waits until at least cWaitFor completions are ready
+	GmaStatus Submit(uint32_t cWaitFor);
+
+	// Takes the next completion, if there is one
+	bool PopCompletion(uint64_t* pullUserData, int32_t* plResult);
+
+	int GetLastErrno() const { return _iLastErrno; } // errno of the last call that returned GMA_E_IO
+
+private:
+	int _fdRing;
+	void* _pvSqRing;
+	size_t _cbSqRing;
+	void* _pvCqRing;
+	size_t _cbCqRing;
+	void* _pvSqes;
+	size_t _cbSqes;
+
+	uint32_t _cSqEntries;
+	uint32_t* _pulSqHead;
+	uint32_t* _pulSqTail;
+	uint32_t _ulSqMask;
+	uint32_t* _aulSqArray;
+	uint32_t _ulSqTail; // Ours, published to *_pulSqTail on submit
+	uint32_t _cToSubmit;
+
+	uint32_t* _pulCqHead;
+	uint32_t* _pulCqTail;
+	uint32_t _ulCqMask;
+	void* _pvCqes;
+
+	int _iLastErrno;
+
+	void _Close();
+
+	CIoUring(const CIoUring&);
+	CIoUring& operator=(const CIoUring&);
+};
@@ -0,0 +1,372 @@
+#include "ScanOutput.h"
+#include <string.h>
+#include <new>  // std::nothrow
+
+
+// ____________________________________________________________________________________________________
+//
+//     Text buffer
+// ____________________________________________________________________________________________________
+//
+
+bool CTextBuffer::_Reserve(size_t cchMore)
+{
+	if (_bFailed)
+		return false;
+	if (cchMore <= _cchCapacity - _cch)
+		return true;
+
+	size_t cchNewCapacity = (_cchCapacity != 0) ? _cchCapacity : 4096;
+	while (cchNewCapacity - _cch < cchMore)
+		cchNewCapacity *= 2;
+
+	char* pchNew = new (std::nothrow) char[cchNewCapacity];
+	if (pchNew == NULL)
+	{
+		_bFailed = true;
+		return false;
+	}
+	if (_cch != 0)
+		memcpy(pchNew, _pch, _cch);
+	delete[] _pch;
+	_pch = pchNew;
+	_cchCapacity = cchNewCapacity;
+	return true;
+}
+
+void CTextBuffer::Append(const char* pch, size_t cch)
+{
+	if (!_Reserve(cch))
+		return;
+	memcpy(_pch + _cch, pch, cch);
+	_cch += cch;
+}
+
+void CTextBuffer::Append(const char* psz)
+{
+	Append(psz, strlen(psz));
+}
+
+void CTextBuffer::AppendChar(char ch)
+{
+	if (!_Reserve(1))
+		return;
+	_pch[_cch++] = ch;
+}
+
+void CTextBuffer::AppendUInt(uint64_t ull)
+{
+	char achDigits[20];
+	size_t cchDigits = 0;
+	do
+	{
+		achDigits[sizeof(achDigits) - ++cchDigits] = (char)('0' + ull % 10);
+		ull /= 10;
+	} while (ull != 0);
+	Append(achDigits + sizeof(achDigits) - cchDigits, cchDigits);
+}
+
+void CTextBuffer::AppendInt(int64_t ll)
+{
+	if (ll < 0)
+	{
+		AppendChar('-');
+		AppendUInt(0ull - (uint64_t)ll);
+	}
+	else
+	{
+		AppendUInt((uint64_t)ll);
+	}
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Results
+// ____________________________________________________________________________________________________
+//
+
+const char* GetStatusName(GmaStatus status)
+{
+	switch (status)
+	{
+	case GMA_S_OK:
+		return "ok";
+	case GMA_E_UNEXPECTED:
+		return "corrupt";
+	case GMA_E_ABORT:
+		return "not_gma";
+	case GMA_E_OUTOFMEMORY:
+		return "out_of_memory";
+	case GMA_E_ARITHMETIC:
+		return "overflow";
+	case GMA_E_IO:
+		return "io_error";
+	case GMA_E_NOTIMPL:
+		return "not_supported";
+	case GMA_E_TOOLARGE:
+		return "too_large";
+	default:
+		return "unknown";
+	}
+}
+
+static const char* _GetSourceName(ResultSource source)
+{
+	switch (source)
+	{
+	case RESULT_CACHE_FILE:
+		return "cache";
+	case RESULT_XATTR:
+		return "xattr";
+	default:
+		return "parse";
+	}
+}
+
+static const char* const c_apszCsvColumns[] =
+{
+	"path", "size", "status", "source", "name", "author", "type", "tags", "steam_id", "timestamp", "format_version", "addon_version", "json_description",
+	"files", "total_size", "largest_size", "toc_status",
+};
+
+void CResultWriter::WriteHeader(CTextBuffer* pOut)
+{
+	if (_format != OUTPUT_CSV)
+		return;
+
+	for (size_t i = 0; i < sizeof(c_apszCsvColumns) / sizeof(c_apszCsvColumns[0]); i++)
+	{
+		if (i != 0)
+			pOut->AppendChar(',');
+		pOut->Append(c_apszCsvColumns[i]);
+	}
+	if (_bDescription)
+		pOut->Append(",description");
+	pOut->Append("\r\n");
+}
+
+void CResultWriter::WriteResult(const ScanResult& result, CTextBuffer* pOut)
+{
+	const GmaCachedMetadata* pMeta = result.pMeta;
+	bool bHeader = pMeta != NULL && pMeta->stage >= GMA_STAGE_HEADER;
+	bool bToc = pMeta != NULL && pMeta->stage >= GMA_STAGE_TOC;
+
+	GmaStatus status = result.statusOpen;
+	if (GMA_SUCCEEDED(status) && !bHeader)
+		status = (pMeta != NULL && GMA_FAILED(pMeta->statusFailed)) ? pMeta->statusFailed : GMA_E_UNEXPECTED;
+
+	// NDJSON leaves out what doesn't apply, while every CSV row needs every column
+	bool bCsv = _format == OUTPUT_CSV;
+	if (!bCsv)
+		pOut->AppendChar('{');
+
+	_WriteField("path", true, pOut);
+	_WriteString(result.pszPath, strlen(result.pszPath), pOut);
+	_WriteField("size", false, pOut);
+	pOut->AppendUInt(result.ullSize);
+	_WriteField("status", false, pOut);
+	_WriteString(GetStatusName(status), strlen(GetStatusName(status)), pOut);
+	_WriteField("source", false, pOut);
+	if (pMeta != NULL)
+		_WriteString(_GetSourceName(result.source), strlen(_GetSourceName(result.source)), pOut);
+
+	if (bHeader)
+	{
+		const GmaHeaderInfo& header = pMeta->header;
+		_WriteField("name", false, pOut);
+		_WriteString(header.strName.psz, header.strName.cch, pOut);
+		_WriteField("author", false, pOut);
+		_WriteString(header.strAuthor.psz, header.strAuthor.cch, pOut);
+		_WriteField("type", false, pOut);
+		_WriteString(header.strType.psz, header.strType.cch, pOut);
+
+		_WriteField("tags", false, pOut);
+		pOut->AppendChar(bCsv ? '"' : '[');
+		for (uint32_t i = 0; i < header.cTags; i++)
+		{
+			if (i != 0)
+				pOut->AppendChar(bCsv ? ';' : ',');
+			if (bCsv)
+			{
+				_AppendUtf8(header.astrTags[i].psz, header.astrTags[i].cch, pOut);
+			}
+			else
+			{
+				_WriteString(header.astrTags[i].psz, header.astrTags[i].cch, pOut);
+			}
+		}
+		pOut->AppendChar(bCsv ? '"' : ']');
+
+		_WriteField("steam_id", false, pOut);
+		pOut->AppendUInt(header.ullSteamId);
+		_WriteField("timestamp", false, pOut);
+		pOut->AppendUInt(header.ullTimestamp);
+		_WriteField("format_version", false, pOut);
+		pOut->AppendUInt(header.bFormatVersion);
+		_WriteField("addon_version", false, pOut);
+		pOut->AppendInt(header.lAddonVersion);
+		_WriteField("json_description", false, pOut);
+		pOut->Append(header.bUsesJsonChunkInDescription ? "true" : "false");
+	}
+	else if (bCsv)
+	{
+		pOut->Append(",,,,,,,,,");
+	}
+
+	if (bToc)
+	{
+		_WriteField("files", false, pOut);
+		pOut->AppendUInt(pMeta->tocSummary.cFiles);
+		_WriteField("total_size", false, pOut);
+		pOut->AppendUInt(pMeta->tocSummary.ullTotalSize);
+		_WriteField("largest_size", false, pOut);
+		pOut->AppendUInt(pMeta->tocSummary.ullLargestSize);
+		_WriteField("toc_status", false, pOut);
+		_WriteString(GetStatusName(pMeta->statusToc), strlen(GetStatusName(pMeta->statusToc)), pOut);
+	}
+	else if (bCsv)
+	{
+		pOut->Append(",,,,");
+	}
+
+	if (_bDescription)
+	{
+		_WriteField("description", false, pOut);
+		if (bHeader)
+			_WriteString(pMeta->header.strDescription.psz, pMeta->header.strDescription.cch, pOut);
+		else
+			_WriteNull(pOut);
+	}
+
+	pOut->Append(bCsv ? "\r\n" : "}\n");
+}
+
+void CResultWriter::_WriteField(const char* pszName, bool bFirst, CTextBuffer* pOut)
+{
+	if (!bFirst)
+		pOut->AppendChar(',');
+	if (_format == OUTPUT_NDJSON)
+	{
+		pOut->AppendChar('"');
+		pOut->Append(pszName);
+		pOut->Append("\":");
+	}
+}
+
+void CResultWriter::_WriteNull(CTextBuffer* pOut)
+{
+	if (_format == OUTPUT_NDJSON)
+		pOut->Append("null");
+}
+
+// Writes a quoted string, or null (an empty CSV field) for a missing one
+void CResultWriter::_WriteString(const char* pch, size_t cch, CTextBuffer* pOut)
+{
+	if (pch == NULL)
+	{
+		_WriteNull(pOut);
+		return;
+	}
+	pOut->AppendChar('"');
+	_AppendUtf8(pch, cch, pOut);
+	pOut->AppendChar('"');
+}
+
+// Appends text escaped for the output format, as UTF-8
+void CResultWriter::_AppendUtf8(const char* pch, size_t cch, CTextBuffer* pOut)
+{
+	if (pch == NULL)
+		return;
+	if (GmaIsValidUtf8(pch, cch))
+	{
+		_AppendEscaped(pch, cch, pOut);
+		return;
+	}
+
+	if (_cwchScratch < cch)
+	{
+		delete[] _pwchScratch;
+		_cwchScratch = 0;
+		_pwchScratch = new (std::nothrow) GmaWChar[cch];
+		if (_pwchScratch == NULL)
+			return;
+		_cwchScratch = cch;
+	}
+
+	// Windows-1252 only maps to the BMP, so every code unit is a whole code point of at most 3 UTF-8 bytes
+	size_t cwch = GmaCodepageToUtf16(pch, cch, GMA_TEXT_CP1252, _pwchScratch);
+	char achUtf8[768];
+	size_t cchUtf8 = 0;
+	for (size_t i = 0; i < cwch; i++)
+	{
+		uint32_t ulChar = _pwchScratch[i];
+		if (ulChar < 0x80)
+		{
+			achUtf8[cchUtf8++] = (char)ulChar;
+		}
+		else if (ulChar < 0x800)
+		{
+			achUtf8[cchUtf8++] = (char)(0xC0 | (ulChar >> 6));
+			achUtf8[cchUtf8++] = (char)(0x80 | (ulChar & 0x3F));
+		}
+		else
+		{
+			achUtf8[cchUtf8++] = (char)(0xE0 | (ulChar >> 12));
+			achUtf8[cchUtf8++] = (char)(0x80 | ((ulChar >> 6) & 0x3F));
+			achUtf8[cchUtf8++] = (char)(0x80 | (ulChar & 0x3F));
+		}
+
+		if (cchUtf8 > sizeof(achUtf8) - 3)
+		{
+			_AppendEscaped(achUtf8, cchUtf8, pOut);
+			cchUtf8 = 0;
+		}
+	}
+	_AppendEscaped(achUtf8, cchUtf8, pOut);
+}
+
+// Appends UTF-8 text, escaping what the format needs escaped: quotes for CSV, and quotes, backslashes and control characters for JSON
+void CResultWriter::_AppendEscaped(const char* pch, size_t cch, CTextBuffer* pOut)
+{
+	static const char c_achHex[] = "0123456789abcdef";
+	bool bJson = _format == OUTPUT_NDJSON;
+
+	size_t iRun = 0;
+	for (size_t i = 0; i < cch; i++)
+	{
+		unsigned char ch = (unsigned char)pch[i];
+		if (ch != '"' && (!bJson || (ch != '\\' && ch >= 0x20)))
+			continue;
+
+		pOut->Append(pch + iRun, i - iRun);
+		iRun = i + 1;
+		if (!bJson)
+		{
+			pOut->Append("\"\"", 2);
+		}
+		else if (ch == '"' || ch == '\\')
+		{
+			pOut->AppendChar('\\');
+			pOut->AppendChar((char)ch);
+		}
+		else if (ch == '\n')
+		{
+			pOut->Append("\\n", 2);
+		}
+		else if (ch == '\r')
+		{
+			pOut->Append("\\r", 2);
+		}
+		else if (ch == '\t')
+		{
+			pOut->Append("\\t", 2);
+		}
+		else
+		{
+			char achEscape[6] = { '\\', 'u', '0', '0', c_achHex[ch >> 4], c_achHex[ch & 0xF] };
+			pOut->Append(achEscape, sizeof(achEscape));
+		}
+	}
+	pOut->Append(pch + iRun, cch - iRun);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "GmaStatus.h"
+#include "GmaCache.h"
+#include "GmaText.h"
+
+enum OutputFormat
+{
+	OUTPUT_NDJSON = 0, // One JSON object per line
+	OUTPUT_CSV = 1, // RFC 4180, with a header row
+};
+
+// Growable text buffer. Running out of memory is sticky: later appends are dropped and Failed() says so.
+class CTextBuffer
+{
+public:
+	CTextBuffer() : _pch(NULL), _cch(0), _cchCapacity(0), _bFailed(false) {}
+	~CTextBuffer() { delete[] _pch; }
+
+	void Append(const char* pch, size_t cch);
+	void Append(const char* psz);
+	void AppendChar(char ch);
+	void AppendUInt(uint64_t ull);
+	void AppendInt(int64_t ll);
+
+	const char* GetText() const { return _pch; }
+	size_t GetLength() const { return _cch; }
+	bool Failed() const { return _bFailed; }
+	void Clear() { _cch = 0; }
+
+private:
+	char* _pch;
+	size_t _cch;
+	size_t _cchCapacity;
+	bool _bFailed;
+
+	bool _Reserve(size_t cchMore);
+
+	CTextBuffer(const CTextBuffer&);
+	CTextBuffer& operator=(const CTextBuffer&);
+};
+
+// Where a result came from
+enum ResultSource
+{
+	RESULT_PARSED = 0,
+	RESULT_CACHE_FILE = 1,
+	RESULT_XATTR = 2,
+};
+
+// One scanned file
+struct ScanResult
+{
+	const char* pszPath;
+	uint64_t ullSize;
+	GmaStatus statusOpen; // Failure to open or stat the file, in which case pMeta is NULL
+	ResultSource source;
+	const GmaCachedMetadata* pMeta;
+};
+
+// Formats results, converting header strings that aren't valid UTF-8 from Windows-1252 as the shell handler does
+// Keeps scratch space between calls, so use one per thread.
+class CResultWriter
+{
+public:
+	CResultWriter(OutputFormat format, bool bDescription) : _format(format), _bDescription(bDescription), _pwchScratch(NULL), _cwchScratch(0) {}
+	~CResultWriter() { delete[] _pwchScratch; }
+
+	void WriteHeader(CTextBuffer* pOut); // Only CSV has one
+	void WriteResult(const ScanResult& result, CTextBuffer* pOut);
+
+private:
+	OutputFormat _format;
+	bool _bDescription;
+	GmaWChar* _pwchScratch;
+	size_t _cwchScratch;
+
+	void _WriteString(const char* pch, size_t cch, CTextBuffer* pOut);
+	void _WriteNull(CTextBuffer* pOut);
+	void _WriteField(const char* pszName, bool bFirst, CTextBuffer* pOut);
+	void _AppendUtf8(const char* pch, size_t cch, CTextBuffer* pOut);
+	void _AppendEscaped(const char* pch, size_t cch, CTextBuffer* pOut);
+
+	CResultWriter(const CResultWriter&);
+	CResultWriter& operator=(const CResultWriter&);
+};
+
+// Short machine-readable name for a status, e.g. "not_gma" for GMA_E_ABORT
+const char* GetStatusName(GmaStatus status);
@@ -0,0 +1,1312 @@
+#include "ScanPipeline.h"
+#include "GmaByteSource.h"
+#include "GmaDocument.h"
+#include "GmaXattr.h"
+#include "GmaFormat.h"
+#include "IoUring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <new>  // std::nothrow
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+
+// ____________________________________________________________________________________________________
+//
+//     Read-ahead window
+// ____________________________________________________________________________________________________
+//
+
+// Serves a file from the window the read stage loaded, and reads whatever lies past it from the descriptor
+// For most addons the parser never leaves the window. When the whole file fits, the window doubles as a view and the parser works on it in place.
+class CWindowByteSource : public IGmaByteSource
+{
+public:
+	CWindowByteSource(int fd, const uint8_t* pbWindow, uint32_t cbWindow, uint64_t ullSize) : _fd(fd), _pbWindow(pbWindow), _cbWindow(cbWindow), _ullSize(ullSize), _ullPos(0ull), _cbReadPastWindow(0ull) {}
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead)
+	{
+		*pcbRead = 0;
+		uint8_t* pb = (uint8_t*)pBuf;
+		if (_ullPos < _cbWindow)
+		{
+			uint32_t cbCopy = _cbWindow - (uint32_t)_ullPos;
+			if (cbCopy > cbToRead)
+				cbCopy = cbToRead;
+			memcpy(pb, _pbWindow + _ullPos, cbCopy);
+			_ullPos += cbCopy;
+			*pcbRead = cbCopy;
+		}
+
+		while (*pcbRead < cbToRead && _ullPos < _ullSize)
+		{
+			ssize_t cb = pread(_fd, pb + *pcbRead, cbToRead - *pcbRead, (off_t)_ullPos);
+			if (cb < 0 && errno == EINTR)
+				continue;
+			if (cb < 0)
+				return GMA_E_IO;
+			if (cb == 0)
+				break;
+			_ullPos += (uint64_t)cb;
+			_cbReadPastWindow += (uint64_t)cb;
+			*pcbRead += (uint32_t)cb;
+		}
+		return GMA_S_OK;
+	}
+
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos)
+	{
+		int64_t llBase = (origin == GMA_SEEK_SET) ? 0ll : (origin == GMA_SEEK_CUR) ? (int64_t)_ullPos : (int64_t)_ullSize;
+		if ((llOffset < 0 && -llOffset > llBase) || (llOffset > 0 && llOffset > INT64_MAX - llBase))
+			return GMA_E_ARITHMETIC;
+		_ullPos = (uint64_t)(llBase + llOffset);
+		if (pullNewPos != NULL)
+			*pullNewPos = _ullPos;
+		return GMA_S_OK;
+	}
+
+	GmaStatus GetSize(uint64_t* pullSize)
+	{
+		*pullSize = _ullSize;
+		return GMA_S_OK;
+	}
+
+	GmaStatus GetView(const uint8_t** ppbView, uint64_t* pcbView)
+	{
+		if (_cbWindow != _ullSize)
+			return IGmaByteSource::GetView(ppbView, pcbView);
+		*ppbView = _pbWindow;
+		*pcbView = _cbWindow;
+		return GMA_S_OK;
+	}
+
+	uint64_t GetBytesReadPastWindow() const { return _cbReadPastWindow; }
+
+private:
+	int _fd;
+	const uint8_t* _pbWindow;
+	uint32_t _cbWindow;
+	uint64_t _ullSize;
+	uint64_t _ullPos;
+	uint64_t _cbReadPastWindow;
+};
+
+
+// ____________________________________________________________________________________________________
+//
+//     Pipeline
+// ____________________________________________________________________________________________________
+//
+
+// A directory to walk or a file to scan. The path follows in the same allocation.
+struct CScanPipeline::PathTask
+{
+	bool bDirectory;
+	char szPath[1];
+};
+
+// One file on its way from the read stage to the output stage. Recycled through _queueFree.
+struct CScanPipeline::FileItem
+{
+	PathTask* pTask;
+	int fd; // Open from the read stage until the parse stage is done with it, unless the window holds all the parser needs
+	GmaCacheKey key;
+	GmaStatus statusOpen;
+	ResultSource source;
+	uint8_t* pbWindow; // Start of the file
+	uint32_t cbWindowCapacity; // c_cbReadAheadWindow, or up to c_cbMaxReadAhead once a long file table has needed more
+	uint32_t cbWindow; // Loaded so far
+	uint32_t cbWindowTarget; // What the reads in progress are loading it up to
+	bool bSizeKnown; // Until it is, key.ullSize is 0 and the first read asks for a whole window
+	GmaCachedMetadata meta; // Strings in arena
+	CGmaArena arena;
+
+	// io_uring read stage
+	struct statx stx;
+	uint32_t cPending; // Of the open and statx
+	bool bStatFailed;
+
+	void Reset()
+	{
+		fd = -1;
+		memset(&key, 0, sizeof(key));
+		statusOpen = GMA_S_OK;
+		source = RESULT_PARSED;
+		cbWindow = 0;
+		cbWindowTarget = 0;
+		bSizeKnown = false;
+		memset(&meta, 0, sizeof(meta));
+		cPending = 0;
+		bStatFailed = false;
+	}
+
+	// Learns the size of a file that wasn't statted, once its first read is back
+	// A regular file only reads short at its end, so a window that came back short holds the whole file; only files that fill it, or failed to read, need a stat.
+	void SettleSize(bool bAtEnd)
+	{
+		struct stat st;
+		if (!bAtEnd && fstat(fd, &st) == 0)
+			key.ullSize = (uint64_t)st.st_size;
+		else
+			key.ullSize = cbWindow;
+		if (cbWindowTarget > key.ullSize)
+			cbWindowTarget = (uint32_t)key.ullSize;
+		bSizeKnown = true;
+	}
+
+	// Once the window is loaded up to cbWindowTarget, decides whether the parser will want more of the file, and if so makes room for a follow-up read by raising cbWindowTarget
+	// Returns false if there's nothing more to read, with *pbComplete saying whether that's because the window covers the whole file table.
+	bool PlanFollowUp(bool* pbComplete)
+	{
+		uint64_t ullTocEnd;
+		*pbComplete = cbWindow >= key.ullSize || GmaFindTocEnd(pbWindow, cbWindow, &ullTocEnd) != GMA_E_UNEXPECTED;
+		if (*pbComplete || cbWindow >= c_cbMaxReadAhead)
+			return false;
+
+		uint64_t cbTarget = (uint64_t)cbWindow * 2;
+		if (cbTarget > c_cbMaxReadAhead)
+			cbTarget = c_cbMaxReadAhead;
+		if (cbTarget > key.ullSize)
+			cbTarget = key.ullSize;
+
+		if (cbTarget > cbWindowCapacity)
+		{
+			uint8_t* pbNew = new (std::nothrow) uint8_t[(size_t)cbTarget];
+			if (pbNew == NULL)
+				return false;
+			memcpy(pbNew, pbWindow, cbWindow);
+			delete[] pbWindow;
+			pbWindow = pbNew;
+			cbWindowCapacity = (uint32_t)cbTarget;
+		}
+		cbWindowTarget = (uint32_t)cbTarget;
+		return true;
+	}
+};
+
+struct CScanPipeline::ThreadStart
+{
+	CScanPipeline* pPipeline;
+	ScanStage stage;
+	pthread_t thread;
+};
+
+// A file waiting in a walker's batch to be put in read order
+struct CScanPipeline::OrderEntry
+{
+	uint64_t ullOrder; // Physical offset of the first block with READ_ORDER_PHYSICAL, once known; the inode number until then
+	uint64_t ullInode;
+	PathTask* pTask;
+};
+
+// What each directory walker keeps to itself
+struct CScanPipeline::Walker
+{
+	QueueWaitStats waits;
+	uint64_t cDirectoryErrors;
+	uint8_t* pbDirectoryBuffer; // c_cbDirectoryBuffer bytes, and c_cMaxReadOrderBatch entries for the read order. NULL while a walk has them.
+	OrderEntry* aBatch;
+};
+
+const char* GetStageName(ScanStage stage)
+{
+	switch (stage)
+	{
+	case STAGE_ENUMERATE:
+		return "enumerate";
+	case STAGE_READ:
+		return "read";
+	case STAGE_PARSE:
+		return "parse";
+	case STAGE_OUTPUT:
+		return "output";
+	default:
+		return "unknown";
+	}
+}
+
+CScanPipeline::CScanPipeline(const PipelineConfig& config) : _config(config), _pool(_RunWalkTask, this), _aWalkers(NULL), _aItems(NULL), _cReadersLeft(0), _cParsersLeft(0), _cbReadByStages(0ull), _bOutputFailed(false)
+{
+	_config.acThreads[STAGE_OUTPUT] = 1;
+	_bNeedFileKey = _config.pCacheFile != NULL || _config.bReadXattr || _config.bWriteXattr;
+	memset(_aStageStats, 0, sizeof(_aStageStats));
+	memset(&_counters, 0, sizeof(_counters));
+	pthread_mutex_init(&_mutexStats, NULL);
+}
+
+CScanPipeline::~CScanPipeline()
+{
+	if (_aItems != NULL)
+	{
+		for (uint32_t i = 0; i < _config.cInFlight; i++)
+			delete[] _aItems[i].pbWindow;
+		delete[] _aItems;
+	}
+
+	// Anything left over from a failed start
+	PathTask* pTask;
+	while (_queuePaths.TryPop(&pTask))
+		free(pTask);
+
+	if (_aWalkers != NULL)
+	{
+		for (uint32_t i = 0; i < _config.acThreads[STAGE_ENUMERATE]; i++)
+		{
+			delete[] _aWalkers[i].pbDirectoryBuffer;
+			delete[] _aWalkers[i].aBatch;
+		}
+		delete[] _aWalkers;
+	}
+	pthread_mutex_destroy(&_mutexStats);
+}
+
+GmaStatus CScanPipeline::Initialize()
+{
+	for (int i = 0; i < STAGE_COUNT; i++)
+	{
+		if (_config.acThreads[i] == 0)
+			return GMA_E_UNEXPECTED;
+	}
+	if (_config.cInFlight == 0)
+		return GMA_E_UNEXPECTED;
+
+	uint32_t cWalkers = _config.acThreads[STAGE_ENUMERATE];
+	GmaStatus status = _pool.Initialize(cWalkers);
+	if (GMA_FAILED(status))
+		return status;
+
+	_aWalkers = new (std::nothrow) Walker[cWalkers];
+	_aItems = new (std::nothrow) FileItem[_config.cInFlight];
+	if (_aWalkers == NULL || _aItems == NULL)
+		return GMA_E_OUTOFMEMORY;
+	memset(_aWalkers, 0, cWalkers * sizeof(Walker));
+	for (uint32_t i = 0; i < cWalkers; i++)
+	{
+		_aWalkers[i].pbDirectoryBuffer = new (std::nothrow) uint8_t[c_cbDirectoryBuffer];
+		_aWalkers[i].aBatch = new (std::nothrow) OrderEntry[c_cMaxReadOrderBatch];
+		if (_aWalkers[i].pbDirectoryBuffer == NULL || _aWalkers[i].aBatch == NULL)
+			return GMA_E_OUTOFMEMORY;
+	}
+	for (uint32_t i = 0; i < _config.cInFlight; i++)
+		_aItems[i].pbWindow = NULL;
+
+	// Each item queue can hold every item, but a push can still find it full for a moment: the ring only frees a cell once the consumer that claimed it has copied it out. So hand-offs use the blocking Push(), which waits that out.
+	if (GMA_FAILED(_queuePaths.Initialize(_config.cInFlight)) || GMA_FAILED(_queueFree.Initialize(_config.cInFlight))
+		|| GMA_FAILED(_queueRead.Initialize(_config.cInFlight)) || GMA_FAILED(_queueParsed.Initialize(_config.cInFlight)))
+		return GMA_E_OUTOFMEMORY;
+
+	for (uint32_t i = 0; i < _config.cInFlight; i++)
+	{
+		FileItem* pItem = &_aItems[i];
+		pItem->pbWindow = new (std::nothrow) uint8_t[c_cbReadAheadWindow];
+		if (pItem->pbWindow == NULL)
+			return GMA_E_OUTOFMEMORY;
+		pItem->cbWindowCapacity = c_cbReadAheadWindow;
+		pItem->pTask = NULL;
+		pItem->fd = -1;
+		_queueFree.TryPush(pItem); // No consumers yet, so this can't find the queue full
+	}
+	return GMA_S_OK;
+}
+
+GmaStatus CScanPipeline::AddPath(const char* pszPath, bool bDirectory)
+{
+	PathTask* pTask = _CreatePathTask(bDirectory, pszPath, NULL);
+	if (pTask == NULL)
+		return GMA_E_OUTOFMEMORY;
+	GmaStatus status = _pool.Add(pTask);
+	if (GMA_FAILED(status))
+		free(pTask);
+	return status;
+}
+
+GmaStatus CScanPipeline::Run()
+{
+	uint32_t cThreads = 1 + _config.acThreads[STAGE_READ] + _config.acThreads[STAGE_PARSE];
+	ThreadStart* aStarts = new (std::nothrow) ThreadStart[cThreads];
+	if (aStarts == NULL)
+		return GMA_E_OUTOFMEMORY;
+
+	// Stages start from the back, so each has its consumers before it produces anything. Should one come up short of threads, the ones it did get carry on; should it get none, the stages already running are drained and the scan fails.
+	GmaStatus status = GMA_S_OK;
+	uint32_t iThread = 0;
+	_cParsersLeft = _config.acThreads[STAGE_PARSE];
+	uint32_t cParsers = _StartThreads(STAGE_PARSE, _config.acThreads[STAGE_PARSE], aStarts, &iThread);
+	if (cParsers == 0)
+	{
+		delete[] aStarts;
+		return GMA_E_OUTOFMEMORY;
+	}
+	if (__atomic_sub_fetch(&_cParsersLeft, _config.acThreads[STAGE_PARSE] - cParsers, __ATOMIC_ACQ_REL) == 0)
+		_queueParsed.Close();
+
+	_cReadersLeft = _config.acThreads[STAGE_READ];
+	uint32_t cReaders = _StartThreads(STAGE_READ, _config.acThreads[STAGE_READ], aStarts, &iThread);
+	if (__atomic_sub_fetch(&_cReadersLeft, _config.acThreads[STAGE_READ] - cReaders, __ATOMIC_ACQ_REL) == 0)
+		_queueRead.Close();
+
+	// The enumeration thread runs the walker pool, as its worker 0
+	if (cReaders == 0 || _StartThreads(STAGE_ENUMERATE, 1, aStarts, &iThread) == 0)
+	{
+		_queuePaths.Close();
+		status = GMA_E_OUTOFMEMORY;
+	}
+
+	StageStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.cThreads = 1;
+	uint64_t nsStart = GetMonotonicNs();
+	_Output(&stats);
+	stats.nsTotal = GetMonotonicNs() - nsStart;
+	_MergeStats(STAGE_OUTPUT, stats, 0ull);
+
+	for (uint32_t i = 0; i < iThread; i++)
+		pthread_join(aStarts[i].thread, NULL);
+	delete[] aStarts;
+
+	_counters.cbRead = _cbReadByStages;
+	_aStageStats[STAGE_READ].cInputCapacity = _queuePaths.GetCapacity();
+	_aStageStats[STAGE_PARSE].cInputCapacity = _queueRead.GetCapacity();
+	_aStageStats[STAGE_OUTPUT].cInputCapacity = _queueParsed.GetCapacity();
+	return status;
+}
+
+// Starts up to cThreads threads for stage, and returns how many started
+uint32_t CScanPipeline::_StartThreads(ScanStage stage, uint32_t cThreads, ThreadStart* aStarts, uint32_t* piThread)
+{
+	uint32_t cStarted = 0;
+	for (; cStarted < cThreads; cStarted++)
+	{
+		ThreadStart* pStart = &aStarts[*piThread];
+		pStart->pPipeline = this;
+		pStart->stage = stage;
+		if (pthread_create(&pStart->thread, NULL, _ThreadProc, pStart) != 0)
+			break;
+		(*piThread)++;
+	}
+	return cStarted;
+}
+
+void* CScanPipeline::_ThreadProc(void* pvStart)
+{
+	ThreadStart* pStart = (ThreadStart*)pvStart;
+	CScanPipeline* pThis = pStart->pPipeline;
+	if (pStart->stage == STAGE_ENUMERATE)
+	{
+		pThis->_Enumerate();
+		return NULL;
+	}
+
+	StageStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.cThreads = 1;
+	uint64_t cbRead = 0ull;
+	uint64_t nsStart = GetMonotonicNs();
+	if (pStart->stage == STAGE_READ && pThis->_config.readBackend == READ_BACKEND_URING)
+		pThis->_ReadRing(&stats, &cbRead);
+	else if (pStart->stage == STAGE_READ)
+		pThis->_Read(&stats, &cbRead);
+	else
+		pThis->_Parse(&stats, &cbRead);
+	stats.nsTotal = GetMonotonicNs() - nsStart;
+	pThis->_MergeStats(pStart->stage, stats, cbRead);
+	return NULL;
+}
+
+void CScanPipeline::_MergeStats(ScanStage stage, const StageStats& stats, uint64_t cbRead)
+{
+	pthread_mutex_lock(&_mutexStats);
+	StageStats* pTotal = &_aStageStats[stage];
+	pTotal->cThreads += stats.cThreads;
+	pTotal->cItems += stats.cItems;
+	pTotal->nsTotal += stats.nsTotal;
+	pTotal->waits.nsWaitingForInput += stats.waits.nsWaitingForInput;
+	pTotal->waits.nsBlockedOnOutput += stats.waits.nsBlockedOnOutput;
+	pTotal->waits.cPops += stats.waits.cPops;
+	pTotal->waits.cDepthSum += stats.waits.cDepthSum;
+	_cbReadByStages += cbRead;
+	pthread_mutex_unlock(&_mutexStats);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Enumerate stage
+// ____________________________________________________________________________________________________
+//
+
+CScanPipeline::PathTask* CScanPipeline::_CreatePathTask(bool bDirectory, const char* pszDirectory, const char* pszName)
+{
+	size_t cchDirectory = strlen(pszDirectory);
+	size_t cchName = (pszName != NULL) ? strlen(pszName) : 0;
+	bool bSeparator = pszName != NULL && cchDirectory != 0 && pszDirectory[cchDirectory - 1] != '/';
+
+	PathTask* pTask = (PathTask*)malloc(sizeof(PathTask) + cchDirectory + bSeparator + cchName);
+	if (pTask == NULL)
+		return NULL;
+	pTask->bDirectory = bDirectory;
+	char* pch = pTask->szPath;
+	memcpy(pch, pszDirectory, cchDirectory);
+	pch += cchDirectory;
+	if (bSeparator)
+		*pch++ = '/';
+	if (cchName != 0)
+		memcpy(pch, pszName, cchName);
+	pch[cchName] = '\0';
+	return pTask;
+}
+
+#ifdef __linux__
+// Entries as getdents64() returns them. glibc only declares the call from 2.30 on.
+struct LinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[1];
+};
+#endif
+
+// Lists a directory with each entry's type and inode, so the walk needn't stat anything
+// On Linux it fills the caller's buffer straight from getdents64(), a buffer's worth of entries per system call.
+class CDirectoryReader
+{
+public:
+	CDirectoryReader(uint8_t* pbBuffer, uint32_t cbBuffer) : _pbBuffer(pbBuffer), _cbBuffer(cbBuffer), _cbFilled(0), _ibNext(0), _fd(-1), _pDir(NULL), _iLastErrno(0) {}
+	~CDirectoryReader() { Close(); }
+
+	GmaStatus Open(const char* pszPath)
+	{
+#ifdef __linux__
+		_fd = open(pszPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (_fd < 0)
+#else
+		_pDir = opendir(pszPath);
+		if (_pDir == NULL)
+#endif
+		{
+			_iLastErrno = errno;
+			return GMA_E_IO;
+		}
+		return GMA_S_OK;
+	}
+
+	// Returns false at the end of the directory, or on an error, when GetLastErrno() is nonzero
+	bool Next(const char** ppszName, uint8_t* pbType, uint64_t* pullInode)
+	{
+#ifdef __linux__
+		if (_ibNext >= _cbFilled)
+		{
+			long cb = syscall(SYS_getdents64, _fd, _pbBuffer, _cbBuffer);
+			if (cb <= 0)
+			{
+				_iLastErrno = (cb < 0) ? errno : 0;
+				return false;
+			}
+			_cbFilled = (uint32_t)cb;
+			_ibNext = 0;
+		}
+
+		const LinuxDirent64* pEntry = (const LinuxDirent64*)(_pbBuffer + _ibNext);
+		_ibNext += pEntry->d_reclen;
+#else
+		errno = 0;
+		const struct dirent* pEntry = readdir(_pDir);
+		if (pEntry == NULL)
+		{
+			_iLastErrno = errno;
+			return false;
+		}
+#endif
+		*ppszName = pEntry->d_name;
+		*pbType = pEntry->d_type;
+		*pullInode = pEntry->d_ino;
+		return true;
+	}
+
+	// For looking up entries relative to the directory
+	int GetFd() const
+	{
+#ifdef __linux__
+		return _fd;
+#else
+		return dirfd(_pDir);
+#endif
+	}
+
+	int GetLastErrno() const { return _iLastErrno; }
+
+	void Close()
+	{
+		if (_fd >= 0)
+			close(_fd);
+		if (_pDir != NULL)
+			closedir(_pDir);
+		_fd = -1;
+		_pDir = NULL;
+	}
+
+private:
+	uint8_t* _pbBuffer;
+	uint32_t _cbBuffer;
+	uint32_t _cbFilled;
+	uint32_t _ibNext;
+	int _fd;
+	DIR* _pDir;
+	int _iLastErrno;
+
+	CDirectoryReader(const CDirectoryReader&);
+	CDirectoryReader& operator=(const CDirectoryReader&);
+};
+
+static bool _HasGmaExtension(const char* pszName)
+{
+	size_t cch = strlen(pszName);
+	return cch > 4 && strcasecmp(pszName + cch - 4, ".gma") == 0;
+}
+
+void CScanPipeline::_Enumerate()
+{
+	uint64_t nsStart = GetMonotonicNs();
+	_pool.Run();
+	uint64_t nsElapsed = GetMonotonicNs() - nsStart;
+	_queuePaths.Close();
+
+	StageStats stats;
+	memset(&stats, 0, sizeof(stats));
+	stats.cThreads = _pool.GetWorkerCount();
+	stats.nsTotal = nsElapsed * stats.cThreads;
+	for (uint32_t i = 0; i < stats.cThreads; i++)
+	{
+		stats.waits.nsBlockedOnOutput += _aWalkers[i].waits.nsBlockedOnOutput;
+		stats.cItems += _aWalkers[i].waits.cPops; // Counts directories walked
+		__atomic_add_fetch(&_counters.cDirectoryErrors, _aWalkers[i].cDirectoryErrors, __ATOMIC_RELAXED);
+	}
+
+	// The pool's workers don't wait on a queue for input; whatever time they didn't spend walking or blocked, they spent looking for a directory to steal
+	_MergeStats(STAGE_ENUMERATE, stats, 0ull);
+}
+
+void CScanPipeline::_RunWalkTask(void* pvContext, uint32_t iWorker, void* pvTask)
+{
+	((CScanPipeline*)pvContext)->_Walk(iWorker, (PathTask*)pvTask);
+}
+
+void CScanPipeline::_Walk(uint32_t iWorker, PathTask* pTask)
+{
+	Walker* pWalker = &_aWalkers[iWorker];
+	if (!pTask->bDirectory)
+	{
+		_queuePaths.Push(pTask, &pWalker->waits);
+		return;
+	}
+
+	// A walk only finds the walker's buffers taken if the pool ran it from inside another, having no room to queue it
+	uint8_t* pbBuffer = pWalker->pbDirectoryBuffer;
+	OrderEntry* aBatch = pWalker->aBatch;
+	pWalker->pbDirectoryBuffer = NULL;
+	pWalker->aBatch = NULL;
+	if (pbBuffer == NULL)
+		pbBuffer = new (std::nothrow) uint8_t[c_cbDirectoryBuffer];
+	if (aBatch == NULL)
+		aBatch = new (std::nothrow) OrderEntry[c_cMaxReadOrderBatch];
+
+	const char* pszPath = pTask->szPath;
+	pWalker->waits.cPops++;
+	CDirectoryReader reader(pbBuffer, c_cbDirectoryBuffer);
+	if (pbBuffer == NULL || aBatch == NULL)
+	{
+		fprintf(stderr, "gmainfo: out of memory\n");
+		pWalker->cDirectoryErrors++;
+	}
+	else if (GMA_FAILED(reader.Open(pszPath)))
+	{
+		fprintf(stderr, "gmainfo: %s: %s\n", pszPath, strerror(reader.GetLastErrno()));
+		pWalker->cDirectoryErrors++;
+	}
+	else
+	{
+		// Subdirectories go on this walker's deque, where idle walkers can steal them. Files go to the read stage, waiting for room if it has fallen behind, either straight away or a batch at a time in read order.
+		uint32_t cBatch = 0;
+		const char* pszName;
+		uint8_t bType;
+		uint64_t ullInode;
+		while (reader.Next(&pszName, &bType, &ullInode))
+		{
+			if (pszName[0] == '.' && (pszName[1] == '\0' || (pszName[1] == '.' && pszName[2] == '\0')))
+				continue;
+
+			bool bDirectory = bType == DT_DIR;
+			bool bFile = bType == DT_REG;
+			if (bType == DT_UNKNOWN || bType == DT_LNK)
+			{
+				// Follows links to files, but not to directories, so a link cycle can't trap the walk
+				struct stat st;
+				if (fstatat(reader.GetFd(), pszName, &st, bType == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) == 0)
+				{
+					bDirectory = bType == DT_UNKNOWN && S_ISDIR(st.st_mode);
+					bFile = S_ISREG(st.st_mode);
+				}
+			}
+
+			if (!bDirectory && !(bFile && (_config.bAllFiles || _HasGmaExtension(pszName))))
+				continue;
+
+			PathTask* pChild = _CreatePathTask(bDirectory, pszPath, pszName);
+			if (pChild == NULL)
+			{
+				fprintf(stderr, "gmainfo: out of memory\n");
+				pWalker->cDirectoryErrors++;
+				break;
+			}
+
+			if (bDirectory)
+			{
+				_pool.Push(iWorker, pChild);
+			}
+			else if (_config.readOrder == READ_ORDER_DIRECTORY)
+			{
+				_queuePaths.Push(pChild, &pWalker->waits);
+			}
+			else
+			{
+				aBatch[cBatch].ullOrder = ullInode;
+				aBatch[cBatch].ullInode = ullInode;
+				aBatch[cBatch].pTask = pChild;
+				if (++cBatch == c_cMaxReadOrderBatch)
+				{
+					_QueueInReadOrder(pWalker, aBatch, cBatch);
+					cBatch = 0;
+				}
+			}
+		}
+		_QueueInReadOrder(pWalker, aBatch, cBatch);
+
+		if (reader.GetLastErrno() != 0)
+		{
+			fprintf(stderr, "gmainfo: %s: %s\n", pszPath, strerror(reader.GetLastErrno()));
+			pWalker->cDirectoryErrors++;
+		}
+	}
+	reader.Close();
+
+	if (pWalker->pbDirectoryBuffer == NULL && pWalker->aBatch == NULL)
+	{
+		pWalker->pbDirectoryBuffer = pbBuffer;
+		pWalker->aBatch = aBatch;
+	}
+	else
+	{
+		delete[] pbBuffer;
+		delete[] aBatch;
+	}
+	free(pTask);
+}
+
+int CScanPipeline::_CompareReadOrder(const void* pv1, const void* pv2)
+{
+	const OrderEntry* pEntry1 = (const OrderEntry*)pv1;
+	const OrderEntry* pEntry2 = (const OrderEntry*)pv2;
+	if (pEntry1->ullOrder != pEntry2->ullOrder)
+		return pEntry1->ullOrder < pEntry2->ullOrder ? -1 : 1;
+	if (pEntry1->ullInode != pEntry2->ullInode)
+		return pEntry1->ullInode < pEntry2->ullInode ? -1 : 1;
+	return 0;
+}
+
+// Where the file's data starts on its device, or 0 if the filesystem can't say: no FIEMAP, data held in the inode, or not allocated yet
+static uint64_t _GetPhysicalOffset(int fd)
+{
+#ifdef __linux__
+	union
+	{
+		struct fiemap fm;
+		uint8_t ab[sizeof(struct fiemap) + sizeof(struct fiemap_extent)];
+	} map;
+	memset(&map, 0, sizeof(map));
+	map.fm.fm_start = 0;
+	map.fm.fm_length = c_cbReadAheadWindow;
+	map.fm.fm_extent_count = 1;
+	if (ioctl(fd, FS_IOC_FIEMAP, &map.fm) != 0 || map.fm.fm_mapped_extents == 0)
+		return 0ull;
+	const struct fiemap_extent& extent = map.fm.fm_extents[0];
+	if (extent.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DATA_INLINE))
+		return 0ull;
+	return extent.fe_physical;
+#else
+	(void)fd;
+	return 0ull;
+#endif
+}
+
+// Sorts a batch of one directory's files into the configured order and queues them for the read stage
+// For READ_ORDER_PHYSICAL, each file is opened in inode order to look up where its data lies, and the kernel is asked to start reading its window, so the reads reach the disk already sorted. Files whose data can't be located go first, in inode order.
+void CScanPipeline::_QueueInReadOrder(Walker* pWalker, OrderEntry* aBatch, uint32_t cBatch)
+{
+	qsort(aBatch, cBatch, sizeof(OrderEntry), _CompareReadOrder);
+	if (_config.readOrder == READ_ORDER_PHYSICAL)
+	{
+		for (uint32_t i = 0; i < cBatch; i++)
+		{
+			int fd = open(aBatch[i].pTask->szPath, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+			aBatch[i].ullOrder = 0ull;
+			if (fd < 0)
+				continue;
+			aBatch[i].ullOrder = _GetPhysicalOffset(fd);
+			posix_fadvise(fd, 0, c_cbReadAheadWindow, POSIX_FADV_WILLNEED);
+			close(fd);
+		}
+		qsort(aBatch, cBatch, sizeof(OrderEntry), _CompareReadOrder);
+	}
+
+	for (uint32_t i = 0; i < cBatch; i++)
+		_queuePaths.Push(aBatch[i].pTask, &pWalker->waits);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Read stage
+// ____________________________________________________________________________________________________
+//
+
+void CScanPipeline::_Read(StageStats* pStats, uint64_t* pcbRead)
+{
+	PathTask* pTask;
+	while (_queuePaths.Pop(&pTask, &pStats->waits))
+	{
+		// Waiting for a free item is waiting on the output stage to finish with one, i.e. backpressure
+		FileItem* pItem;
+		QueueWaitStats waitsFree;
+		memset(&waitsFree, 0, sizeof(waitsFree));
+		bool bGotItem = _queueFree.Pop(&pItem, &waitsFree);
+		pStats->waits.nsBlockedOnOutput += waitsFree.nsWaitingForInput;
+		if (!bGotItem)
+		{
+			// The free list is never closed, so this can't happen
+			free(pTask);
+			break;
+		}
+
+		pItem->pTask = pTask;
+		_ReadFile(pItem, &pStats->waits, pcbRead);
+		pStats->cItems++;
+	}
+
+	if (__atomic_sub_fetch(&_cReadersLeft, 1, __ATOMIC_ACQ_REL) == 0)
+		_queueRead.Close();
+}
+
+bool CScanPipeline::_LookupStored(FileItem* pItem)
+{
+	bool bFound = false;
+	if (_config.bReadXattr)
+	{
+		GmaStatus statusXattr = GmaReadXattrStamp(pItem->pTask->szPath, pItem->key, NULL, &pItem->meta, &pItem->arena, &bFound);
+		bFound = GMA_SUCCEEDED(statusXattr) && bFound;
+		pItem->source = RESULT_XATTR;
+	}
+	if (!bFound && _config.pCacheFile != NULL)
+	{
+		bFound = _config.pCacheFile->Lookup(pItem->key, NULL, &pItem->meta, &pItem->arena);
+		pItem->source = RESULT_CACHE_FILE;
+	}
+	if (!bFound)
+		pItem->source = RESULT_PARSED;
+	return bFound;
+}
+
+// Hands a loaded window to the parse stage
+// The descriptor is only kept for the parse stage if it may need to read past the window, or has to stamp the file. Otherwise *pfdToClose receives it, for the caller to close however suits it.
+void CScanPipeline::_FinishRead(FileItem* pItem, bool bWindowComplete, int* pfdToClose, QueueWaitStats* pWaits)
+{
+	*pfdToClose = -1;
+	if (bWindowComplete && !_config.bWriteXattr)
+	{
+		*pfdToClose = pItem->fd;
+		pItem->fd = -1;
+	}
+	_queueRead.Push(pItem, pWaits);
+}
+
+void CScanPipeline::_ReadFile(FileItem* pItem, QueueWaitStats* pWaits, uint64_t* pcbRead)
+{
+	pItem->Reset();
+	pItem->fd = open(pItem->pTask->szPath, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+	pItem->statusOpen = (pItem->fd >= 0) ? GMA_S_OK : GMA_E_IO;
+	if (GMA_SUCCEEDED(pItem->statusOpen) && _bNeedFileKey)
+	{
+		pItem->statusOpen = GmaGetFileCacheKey(pItem->fd, &pItem->key);
+		pItem->bSizeKnown = true;
+	}
+	if (GMA_FAILED(pItem->statusOpen))
+	{
+		if (pItem->fd >= 0)
+			close(pItem->fd);
+		pItem->fd = -1;
+		memset(&pItem->key, 0, sizeof(pItem->key));
+		_queueParsed.Push(pItem, pWaits);
+		return;
+	}
+
+	if (_bNeedFileKey && _LookupStored(pItem))
+	{
+		close(pItem->fd);
+		pItem->fd = -1;
+		_queueParsed.Push(pItem, pWaits);
+		return;
+	}
+
+	if (_config.readBackend == READ_BACKEND_MMAP)
+	{
+		_queueRead.Push(pItem, pWaits); // The parse stage maps it
+		return;
+	}
+
+	pItem->cbWindowTarget = (pItem->bSizeKnown && pItem->key.ullSize < c_cbReadAheadWindow) ? (uint32_t)pItem->key.ullSize : c_cbReadAheadWindow;
+	bool bComplete = false;
+	for (;;)
+	{
+		bool bAtEnd = false;
+		while (pItem->cbWindow < pItem->cbWindowTarget)
+		{
+			uint32_t cbToRead = pItem->cbWindowTarget - pItem->cbWindow;
+			ssize_t cb = pread(pItem->fd, pItem->pbWindow + pItem->cbWindow, cbToRead, (off_t)pItem->cbWindow);
+			if (cb < 0 && errno == EINTR)
+				continue;
+			if (cb <= 0)
+			{
+				bAtEnd = cb == 0;
+				break;
+			}
+			pItem->cbWindow += (uint32_t)cb;
+			if (!pItem->bSizeKnown && (uint32_t)cb < cbToRead)
+			{
+				bAtEnd = true;
+				break;
+			}
+		}
+		if (!pItem->bSizeKnown)
+			pItem->SettleSize(bAtEnd);
+
+		// On an error or a file that shrank, the parse stage reads the rest itself, and sees what went wrong for itself
+		if (pItem->cbWindow < pItem->cbWindowTarget || !pItem->PlanFollowUp(&bComplete))
+			break;
+	}
+	*pcbRead += pItem->cbWindow;
+
+	int fdToClose;
+	_FinishRead(pItem, bComplete, &fdToClose, pWaits);
+	if (fdToClose >= 0)
+		close(fdToClose);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Read stage on io_uring
+// ____________________________________________________________________________________________________
+//
+
+// Operations in flight are tagged with their item's address, which is 8-byte aligned, ORed with what they are
+enum RingOp
+{
+	RING_OP_CLOSE = 0, // No item: the descriptor was detached from it before the close was queued
+	RING_OP_OPEN = 1,
+	RING_OP_STATX = 2,
+	RING_OP_READ = 3,
+};
+const uint64_t c_ullRingOpMask = 7ull;
+
+static void _PrepRingOp(struct io_uring_sqe* pSqe, uint8_t bOpcode, int fd, const void* pv, uint32_t ul, uint64_t ullOffset, void* pvItem, RingOp op)
+{
+	pSqe->opcode = bOpcode;
+	pSqe->fd = fd;
+	pSqe->addr = (uint64_t)(uintptr_t)pv;
+	pSqe->len = ul;
+	pSqe->off = ullOffset;
+	pSqe->user_data = (uint64_t)(uintptr_t)pvItem | (uint64_t)op;
+}
+
+// Same key GmaGetFileCacheKey() builds from fstat(), so cache file entries and stamps match whichever backend made them
+static void _KeyFromStatx(const struct statx& stx, GmaCacheKey* pKey)
+{
+	pKey->ullVolume = (uint64_t)makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	pKey->ullFileId = stx.stx_ino;
+	pKey->ullSize = stx.stx_size;
+	pKey->ullLastWrite = (uint64_t)stx.stx_mtime.tv_sec * 1000000000ull + stx.stx_mtime.tv_nsec;
+}
+
+// Keeps up to cRingDepth files in flight on a ring of the thread's own
+// Each file takes three batched round trips: open (with a statx alongside when the cache file or xattr stamps need the file's identity), then one read of the window (plus follow-up reads for long file tables), then close. Every trip through the loop submits whatever was queued and reaps whatever completed in a single io_uring_enter(), so the system calls are shared by every file in flight rather than paid per file.
+void CScanPipeline::_ReadRing(StageStats* pStats, uint64_t* pcbRead)
+{
+	CIoUring ring;
+	uint32_t cDepth = _config.cRingDepth;
+	if (GMA_FAILED(ring.Initialize(cDepth * 4 < 4096 ? cDepth * 4 : 4096)))
+	{
+		// Out of locked memory for rings, say. This thread still pulls its weight the old way.
+		_Read(pStats, pcbRead);
+		return;
+	}
+	uint32_t cMaxOps = ring.GetEntryCount();
+	if (cDepth * 2 > cMaxOps)
+		cDepth = cMaxOps / 2;
+
+	uint32_t cActive = 0; // Items with operations in flight
+	uint32_t cOps = 0; // Operations in flight, closes included
+	PathTask* pTaskHeld = NULL;
+	bool bPathsDone = false;
+
+	for (;;)
+	{
+		// Start as many new files as there's room for. Only block on the queues when there's nothing in flight to reap instead.
+		while (!bPathsDone && cActive < cDepth && cOps + 2 <= cMaxOps)
+		{
+			if (pTaskHeld == NULL)
+			{
+				bool bGot;
+				if (cOps == 0)
+				{
+					bGot = _queuePaths.Pop(&pTaskHeld, &pStats->waits);
+				}
+				else
+				{
+					size_t cDepth = _queuePaths.GetDepth();
+					bGot = _queuePaths.TryPop(&pTaskHeld);
+					if (bGot)
+					{
+						pStats->waits.cPops++;
+						pStats->waits.cDepthSum += cDepth;
+					}
+				}
+				if (!bGot)
+				{
+					bPathsDone = cOps == 0;
+					break;
+				}
+			}
+
+			FileItem* pItem;
+			if (cActive == 0)
+			{
+				QueueWaitStats waitsFree;
+				memset(&waitsFree, 0, sizeof(waitsFree));
+				bool bGotItem = _queueFree.Pop(&pItem, &waitsFree);
+				pStats->waits.nsBlockedOnOutput += waitsFree.nsWaitingForInput;
+				if (!bGotItem)
+					break; // The free list is never closed, so this can't happen
+			}
+			else if (!_queueFree.TryPop(&pItem))
+			{
+				break;
+			}
+
+			pItem->pTask = pTaskHeld;
+			pTaskHeld = NULL;
+			pItem->Reset();
+			pItem->cPending = _bNeedFileKey ? 2 : 1;
+			// Both fit, since the submission queue has an entry for every operation that can be in flight
+			struct io_uring_sqe* pSqe = ring.GetSqe();
+			_PrepRingOp(pSqe, IORING_OP_OPENAT, AT_FDCWD, pItem->pTask->szPath, 0, 0ull, pItem, RING_OP_OPEN);
+			pSqe->open_flags = O_RDONLY | O_CLOEXEC | O_NOCTTY;
+			if (_bNeedFileKey)
+			{
+				pSqe = ring.GetSqe();
+				_PrepRingOp(pSqe, IORING_OP_STATX, AT_FDCWD, pItem->pTask->szPath, STATX_BASIC_STATS, (uint64_t)(uintptr_t)&pItem->stx, pItem, RING_OP_STATX);
+			}
+			cActive++;
+			cOps += pItem->cPending;
+			pStats->cItems++;
+		}
+
+		if (cOps == 0)
+		{
+			if (bPathsDone)
+				break;
+			continue;
+		}
+
+		// Only fails for bad arguments, and the operations in flight can't be recovered from that
+		if (GMA_FAILED(ring.Submit(1)))
+		{
+			fprintf(stderr, "gmainfo: io_uring_enter: %s\n", strerror(ring.GetLastErrno()));
+			abort();
+		}
+
+		uint64_t ullUserData;
+		int32_t lResult;
+		while (ring.PopCompletion(&ullUserData, &lResult))
+		{
+			cOps--;
+			FileItem* pItem = (FileItem*)(uintptr_t)(ullUserData & ~c_ullRingOpMask);
+			RingOp op = (RingOp)(ullUserData & c_ullRingOpMask);
+			int fdToClose = -1;
+			bool bDone = false;
+			bool bRead = false; // Whether to carry on filling the window
+
+			switch (op)
+			{
+			case RING_OP_OPEN:
+				pItem->fd = lResult >= 0 ? lResult : -1;
+				break;
+			case RING_OP_STATX:
+				pItem->bStatFailed = lResult < 0;
+				break;
+			case RING_OP_READ:
+				if (lResult > 0)
+				{
+					pItem->cbWindow += (uint32_t)lResult;
+					*pcbRead += (uint32_t)lResult;
+				}
+				// The first read of a file that wasn't statted asked for a whole window from the start
+				if (!pItem->bSizeKnown)
+					pItem->SettleSize(lResult >= 0 && pItem->cbWindow < pItem->cbWindowTarget);
+				bRead = true;
+				break;
+			default:
+				continue;
+			}
+
+			if (op != RING_OP_READ && --pItem->cPending == 0)
+			{
+				// Opened and statted
+				pItem->statusOpen = (pItem->fd >= 0 && !pItem->bStatFailed) ? GMA_S_OK : GMA_E_IO;
+				if (GMA_SUCCEEDED(pItem->statusOpen) && _bNeedFileKey)
+				{
+					_KeyFromStatx(pItem->stx, &pItem->key);
+					pItem->bSizeKnown = true;
+				}
+
+				if (GMA_FAILED(pItem->statusOpen) || (_bNeedFileKey && _LookupStored(pItem)))
+				{
+					fdToClose = pItem->fd;
+					pItem->fd = -1;
+					_queueParsed.Push(pItem, &pStats->waits);
+					bDone = true;
+				}
+				else
+				{
+					pItem->cbWindowTarget = (pItem->bSizeKnown && pItem->key.ullSize < c_cbReadAheadWindow) ? (uint32_t)pItem->key.ullSize : c_cbReadAheadWindow;
+					bRead = true;
+				}
+			}
+
+			if (bRead)
+			{
+				// Keep reading until the window is full and covers the file table, or a read fails or hits the end of the file
+				bool bComplete = false;
+				bool bProgress = op != RING_OP_READ || lResult > 0;
+				bool bMore = bProgress && (pItem->cbWindow < pItem->cbWindowTarget || pItem->PlanFollowUp(&bComplete));
+				struct io_uring_sqe* pSqe = bMore ? ring.GetSqe() : NULL;
+				if (pSqe != NULL)
+				{
+					_PrepRingOp(pSqe, IORING_OP_READ, pItem->fd, pItem->pbWindow + pItem->cbWindow, pItem->cbWindowTarget - pItem->cbWindow, pItem->cbWindow, pItem, RING_OP_READ);
+					cOps++;
+				}
+				else
+				{
+					_FinishRead(pItem, bComplete, &fdToClose, &pStats->waits);
+					bDone = true;
+				}
+			}
+
+			if (bDone)
+				cActive--;
+			if (fdToClose >= 0)
+			{
+				struct io_uring_sqe* pSqe = cOps < cMaxOps ? ring.GetSqe() : NULL;
+				if (pSqe != NULL)
+				{
+					_PrepRingOp(pSqe, IORING_OP_CLOSE, fdToClose, NULL, 0, 0ull, NULL, RING_OP_CLOSE);
+					cOps++;
+				}
+				else
+				{
+					close(fdToClose);
+				}
+			}
+		}
+	}
+
+	if (__atomic_sub_fetch(&_cReadersLeft, 1, __ATOMIC_ACQ_REL) == 0)
+		_queueRead.Close();
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Parse stage
+// ____________________________________________________________________________________________________
+//
+
+void CScanPipeline::_Parse(StageStats* pStats, uint64_t* pcbRead)
+{
+	// Each file's parse reuses the last one's memory, and its results are copied out before the next
+	CGmaParseContext context;
+	FileItem* pItem;
+	while (_queueRead.Pop(&pItem, &pStats->waits))
+	{
+		context.Reset();
+		_ParseFile(pItem, &context, pcbRead);
+		_queueParsed.Push(pItem, &pStats->waits);
+		pStats->cItems++;
+	}
+
+	if (__atomic_sub_fetch(&_cParsersLeft, 1, __ATOMIC_ACQ_REL) == 0)
+		_queueParsed.Close();
+}
+
+void CScanPipeline::_ParseFile(FileItem* pItem, CGmaParseContext* pContext, uint64_t* pcbRead)
+{
+	uint64_t ullSize = pItem->key.ullSize;
+	bool bParsed = false;
+	if (_config.readBackend == READ_BACKEND_MMAP)
+	{
+		// Touching a mapped page past the end of a file that was truncated after mapping raises SIGBUS, which can't be recovered from here (see READ_BACKEND_MMAP)
+		// What can be done is to keep the window small: a file whose size no longer matches its key is changing, so it isn't mapped at all, and one whose size changes during the parse is parsed again with pread, before anything is stored.
+		CGmaMappedFileByteSource source;
+		pItem->statusOpen = source.Map(pItem->fd);
+		if (GMA_FAILED(pItem->statusOpen))
+			bParsed = true; // Reported as failing to open
+		else
+		{
+			uint64_t cbMapped;
+			source.GetSize(&cbMapped);
+			if (!pItem->bSizeKnown)
+			{
+				pItem->key.ullSize = cbMapped;
+				pItem->bSizeKnown = true;
+			}
+
+			if (cbMapped == pItem->key.ullSize)
+			{
+				_ParseSource(pItem, &source, pContext);
+				struct stat st;
+				bParsed = fstat(pItem->fd, &st) == 0 && (uint64_t)st.st_size == cbMapped;
+				ullSize = bParsed ? cbMapped : (uint64_t)st.st_size;
+			}
+			else
+			{
+				struct stat st;
+				ullSize = (fstat(pItem->fd, &st) == 0) ? (uint64_t)st.st_size : cbMapped;
+			}
+
+			if (bParsed)
+			{
+				_StoreResult(pItem, &source);
+
+				// Page faults can't be counted from here, so this is the part parsing needs: up to the end of the file table, or all of a file that isn't a GMA
+				*pcbRead += (pItem->meta.stage >= GMA_STAGE_TOC && pItem->meta.tocSummary.ullDataStart < cbMapped) ? pItem->meta.tocSummary.ullDataStart : cbMapped;
+			}
+			else
+			{
+				pContext->Reset();
+				__atomic_add_fetch(&_counters.cMappedFallbacks, 1ull, __ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	if (!bParsed)
+	{
+		CWindowByteSource source(pItem->fd, pItem->pbWindow, pItem->cbWindow, ullSize);
+		_ParseSource(pItem, &source, pContext);
+		_StoreResult(pItem, &source);
+		*pcbRead += source.GetBytesReadPastWindow();
+	}
+
+	if (pItem->fd >= 0)
+		close(pItem->fd);
+	pItem->fd = -1;
+}
+
+void CScanPipeline::_ParseSource(FileItem* pItem, IGmaByteSource* pSource, CGmaParseContext* pContext)
+{
+	CGmaDocument document(pSource, pContext);
+	document.EnsureStage(GMA_STAGE_TOC);
+
+	// The document's strings go with the next file's parse, so the output stage gets its own copy
+	GmaCachedMetadata meta;
+	GmaGetDocumentMetadata(document, &meta);
+	if (GMA_FAILED(GmaCopyMetadata(meta, &pItem->meta, &pItem->arena)))
+	{
+		memset(&pItem->meta, 0, sizeof(pItem->meta));
+		pItem->meta.statusFailed = GMA_E_OUTOFMEMORY;
+	}
+}
+
+void CScanPipeline::_StoreResult(FileItem* pItem, IGmaByteSource* pSource)
+{
+	// Transient failures aren't worth remembering, and the cache and xattr code skip them anyway
+	if (_config.pCacheFile != NULL)
+		_config.pCacheFile->Insert(pItem->key, pSource, pItem->meta);
+	if (_config.bWriteXattr)
+		GmaWriteXattrStamp(pItem->fd, pItem->key, pSource, pItem->meta);
+}
+
+
+// ____________________________________________________________________________________________________
+//
+//     Output stage
+// ____________________________________________________________________________________________________
+//
+
+void CScanPipeline::_Output(StageStats* pStats)
+{
+	CResultWriter writer(_config.format, _config.bDescription);
+	CTextBuffer out;
+
+	FileItem* pItem;
+	while (_queueParsed.Pop(&pItem, &pStats->waits))
+	{
+		ScanResult result;
+		result.pszPath = pItem->pTask->szPath;
+		result.ullSize = pItem->key.ullSize;
+		result.statusOpen = pItem->statusOpen;
+		result.source = pItem->source;
+		result.pMeta = GMA_SUCCEEDED(pItem->statusOpen) ? &pItem->meta : NULL;
+		writer.WriteResult(result, &out);
+
+		_counters.cFiles++;
+		_counters.cbFiles += pItem->key.ullSize;
+		if (result.pMeta == NULL || pItem->meta.stage < GMA_STAGE_HEADER)
+			_counters.cFailed++;
+		if (result.pMeta != NULL && pItem->source != RESULT_PARSED)
+			_counters.cCached++;
+
+		if (out.GetLength() >= c_cbOutputFlushThreshold)
+		{
+			if (out.Failed() || fwrite(out.GetText(), 1, out.GetLength(), _config.pOut) != out.GetLength())
+				_bOutputFailed = true;
+			out.Clear();
+		}
+
+		if (pItem->fd >= 0)
+		{
+			close(pItem->fd);
+			pItem->fd = -1;
+		}
+		free(pItem->pTask);
+		pItem->pTask = NULL;
+		pItem->arena.Reset();
+		_queueFree.Push(pItem, &pStats->waits);
+		pStats->cItems++;
+	}
+
+	if (out.Failed() || (out.GetLength() != 0 && fwrite(out.GetText(), 1, out.GetLength(), _config.pOut) != out.GetLength()))
+		_bOutputFailed = true;
+}
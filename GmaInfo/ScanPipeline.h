@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stdio.h>
+#include <pthread.h>
+#include "GmaStatus.h"
+#include "GmaArena.h"
+#include "GmaCache.h"
+#include "GmaCacheFile.h"
+#include "GmaParseContext.h"
+#include "BoundedQueue.h"
+#include "WorkPool.h"
+#include "ScanOutput.h"
+
+const uint32_t c_cbReadAheadWindow = 65536; // Bytes the read stage loads from the start of each file: the header and, for most addons, the whole file table
+const uint32_t c_cbMaxReadAhead = 1024 * 1024; // Furthest the read stage follows a file table that doesn't fit in the first window. The parse stage reads the rest of longer ones itself.
+const size_t c_cbOutputFlushThreshold = 65536; // Output buffered before it's written out
+const uint32_t c_cbDirectoryBuffer = 65536; // Each walker's getdents64() buffer: a few hundred entries per system call
+const uint32_t c_cMaxReadOrderBatch = 1024; // Files of one directory put in read order at once. Bounds the walker's memory and, with READ_ORDER_PHYSICAL, how far its prefetching runs ahead.
+
+// Stages of the scan, in the order files go through them
+enum ScanStage
+{
+	STAGE_ENUMERATE = 0, // Walks directories and queues the paths of the files to scan
+	STAGE_READ = 1, // Opens each file and reads its first c_cbReadAheadWindow bytes, or answers it from the cache file or an xattr stamp
+	STAGE_PARSE = 2, // Parses the header and file table, mostly from the window
+	STAGE_OUTPUT = 3, // Formats results and writes them out
+	STAGE_COUNT = 4,
+};
+
+// How the read stage does its I/O
+enum ReadBackend
+{
+	READ_BACKEND_PREAD = 0, // Each read thread opens, reads and closes one file at a time with blocking calls
+	READ_BACKEND_URING = 1, // Each read thread keeps many files' opens and reads in flight on an io_uring, submitted in batches (Linux 5.6+)
+	READ_BACKEND_MMAP = 2, // Read threads only open files. The parse stage maps each one and parses it in place, so nothing is copied and the page cache is read directly.
+	                       // Not safe for trees other processes write to: a file truncated while it's being parsed kills the process with SIGBUS. Files seen changing size are parsed with pread instead, which narrows that window but can't close it.
+};
+
+// What order the read stage takes each directory's files in
+// Directories list in hash order on most filesystems, which on a disk means a seek between every two files. Sorting a directory's files by inode reads their inodes in table order, and sorting by where their data starts reads their data in disk order too.
+enum ReadOrder
+{
+	READ_ORDER_DIRECTORY = 0, // As the directory lists them
+	READ_ORDER_INODE = 1, // By inode number, which the directory listing gives for free
+	READ_ORDER_PHYSICAL = 2, // By the physical offset of each file's first block, from FIEMAP. The walker opens each file to find it, and has the kernel start reading the file's window in that order.
+};
+
+struct PipelineConfig
+{
+	OutputFormat format;
+	bool bDescription;
+	bool bAllFiles; // Scan every file in a directory, not just *.gma
+	uint32_t acThreads[STAGE_COUNT]; // The output stage always has one
+	uint32_t cInFlight; // Files between the read and output stages at once, which bounds memory and open descriptors. Also the capacity of each queue.
+	ReadBackend readBackend;
+	uint32_t cRingDepth; // Files each io_uring read thread works on at once
+	ReadOrder readOrder;
+	CGmaCacheFile* pCacheFile; // NULL if not in use
+	bool bReadXattr;
+	bool bWriteXattr;
+	FILE* pOut;
+};
+
+struct ScanCounters
+{
+	uint64_t cFiles;
+	uint64_t cFailed; // Files that couldn't be opened or aren't valid GMAs
+	uint64_t cbFiles; // Sum of the scanned files' sizes
+	uint64_t cbRead; // Bytes actually read to parse them
+	uint64_t cCached; // Answered from the cache file or an xattr stamp
+	uint64_t cDirectoryErrors;
+	uint64_t cMappedFallbacks; // Files that changed size while mapped, and were parsed again with pread
+};
+
+// How one stage spent its time, summed over its threads
+// Busy time is whatever a thread didn't spend waiting. A stage that is mostly waiting for input is oversized, or starved by the one before it; one mostly blocked on output is held back by the one after it.
+struct StageStats
+{
+	uint32_t cThreads;
+	uint64_t cItems;
+	uint64_t nsTotal; // Thread lifetimes
+	QueueWaitStats waits;
+	size_t cInputCapacity; // Of the queue the stage takes its input from. 0 for the enumeration stage, which has none.
+};
+
+// The scan as a pipeline of stages, each with its own threads, joined by bounded queues
+// Cold storage makes reading I/O-bound while parsing is CPU-bound, so each gets as many threads as it needs and they overlap instead of taking turns. Files in flight come from a fixed pool that the output stage recycles, so however many files a scan covers, memory stays flat: a slow stage fills its input queue and the stages before it wait.
+// Directory walking runs on a work-stealing pool, since directories vary wildly in size.
+class CScanPipeline
+{
+public:
+	explicit CScanPipeline(const PipelineConfig& config);
+	~CScanPipeline();
+
+	GmaStatus Initialize();
+
+	// Queues a directory to walk, or a file to scan whatever its extension. Only before Run().
+	GmaStatus AddPath(const char* pszPath, bool bDirectory);
+
+	// Runs every stage to completion
+	GmaStatus Run();
+
+	const ScanCounters& GetCounters() const { return _counters; }
+	const StageStats& GetStageStats(ScanStage stage) const { return _aStageStats[stage]; }
+	uint64_t GetStealCount() const { return _pool.GetStealCount(); }
+	bool OutputFailed() const { return _bOutputFailed; }
+
+private:
+	struct PathTask;
+	struct FileItem;
+	struct ThreadStart;
+	struct OrderEntry;
+	struct Walker;
+
+	PipelineConfig _config;
+	bool _bNeedFileKey; // Whether the read stage needs each file's identity and timestamp, to look it up or store it. Otherwise it only needs the size, and learns that lazily.
+	CWorkPool _pool;
+	Walker* _aWalkers; // One per pool worker
+
+	FileItem* _aItems;
+	CBoundedQueue<PathTask*> _queuePaths; // enumerate -> read
+	CBoundedQueue<FileItem*> _queueFree; // output -> read
+	CBoundedQueue<FileItem*> _queueRead; // read -> parse
+	CBoundedQueue<FileItem*> _queueParsed; // read and parse -> output
+
+	long _cReadersLeft;
+	long _cParsersLeft;
+	pthread_mutex_t _mutexStats;
+	StageStats _aStageStats[STAGE_COUNT];
+	ScanCounters _counters;
+	uint64_t _cbReadByStages; // Read and parse stages' bytes, merged at thread exit under _mutexStats
+	bool _bOutputFailed;
+
+	static PathTask* _CreatePathTask(bool bDirectory, const char* pszDirectory, const char* pszName);
+	static void _RunWalkTask(void* pvContext, uint32_t iWorker, void* pvTask);
+	static void* _ThreadProc(void* pvStart);
+	static int _CompareReadOrder(const void* pv1, const void* pv2);
+
+	uint32_t _StartThreads(ScanStage stage, uint32_t cThreads, ThreadStart* aStarts, uint32_t* piThread);
+	void _Walk(uint32_t iWorker, PathTask* pTask);
+	void _QueueInReadOrder(Walker* pWalker, OrderEntry* aBatch, uint32_t cBatch);
+	void _Enumerate();
+	void _Read(StageStats* pStats, uint64_t* pcbRead);
+	void _ReadRing(StageStats* pStats, uint64_t* pcbRead);
+	void _Parse(StageStats* pStats, uint64_t* pcbRead);
+	void _Output(StageStats* pStats);
+	void _ReadFile(FileItem* pItem, QueueWaitStats* pWaits, uint64_t* pcbRead);
+	bool _LookupStored(FileItem* pItem);
+	void _FinishRead(FileItem* pItem, bool bWindowComplete, int* pfdToClose, QueueWaitStats* pWaits);
+	void _ParseFile(FileItem* pItem, CGmaParseContext* pContext, uint64_t* pcbRead);
+	void _ParseSource(FileItem* pItem, IGmaByteSource* pSource, CGmaParseContext* pContext);
+	void _StoreResult(FileItem* pItem, IGmaByteSource* pSource); // Into the cache file and the file's stamp, as configured
+	void _MergeStats(ScanStage stage, const StageStats& stats, uint64_t cbRead);
+
+	CScanPipeline(const CScanPipeline&);
+	CScanPipeline& operator=(const CScanPipeline&);
+};
+
+const char* GetStageName(ScanStage stage);
@@ -0,0 +1,239 @@
+#include "WorkPool.h"
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <new>  // std::nothrow
+
+const size_t c_cInitialDequeCapacity = 256; // power of two
+const uint32_t c_cIdleSpins = 64; // Yields before an idle worker starts sleeping between attempts to find work
+const long c_nsIdleSleep = 100000;
+
+struct CWorkPool::Worker
+{
+	CWorkPool* pPool;
+	uint32_t iWorker;
+	pthread_t thread;
+	bool bThreadStarted;
+
+	// Ring buffer of tasks, from iFront (oldest) to iFront + cTasks - 1 (newest)
+	pthread_mutex_t mutex;
+	void** apvTasks;
+	size_t cCapacity; // power of two
+	size_t iFront;
+	size_t cTasks; // Changed under the mutex, but also peeked at without it
+
+	uint32_t ulRandom; // Picks the first victim to steal from
+	uint64_t cSteals;
+
+	char abPadding[64]; // Keeps neighbouring workers' hot fields off each other's cache lines
+};
+
+CWorkPool::CWorkPool(PfnRunTask pfnRunTask, void* pvContext) : _pfnRunTask(pfnRunTask), _pvContext(pvContext), _aWorkers(NULL), _cWorkers(0), _iNextAdd(0), _cPending(0)
+{
+}
+
+CWorkPool::~CWorkPool()
+{
+	for (uint32_t i = 0; i < _cWorkers; i++)
+	{
+		pthread_mutex_destroy(&_aWorkers[i].mutex);
+		delete[] _aWorkers[i].apvTasks;
+	}
+	delete[] _aWorkers;
+}
+
+GmaStatus CWorkPool::Initialize(uint32_t cWorkers)
+{
+	if (_aWorkers != NULL || cWorkers == 0)
+		return GMA_E_UNEXPECTED;
+
+	_aWorkers = new (std::nothrow) Worker[cWorkers];
+	if (_aWorkers == NULL)
+		return GMA_E_OUTOFMEMORY;
+	memset(_aWorkers, 0, cWorkers * sizeof(Worker));
+
+	for (; _cWorkers < cWorkers; _cWorkers++)
+	{
+		Worker* pWorker = &_aWorkers[_cWorkers];
+		pWorker->pPool = this;
+		pWorker->iWorker = _cWorkers;
+		pWorker->ulRandom = 0x9E3779B9ul * (_cWorkers + 1);
+		pWorker->apvTasks = new (std::nothrow) void*[c_cInitialDequeCapacity];
+		if (pWorker->apvTasks == NULL)
+			return GMA_E_OUTOFMEMORY;
+		pWorker->cCapacity = c_cInitialDequeCapacity;
+		pthread_mutex_init(&pWorker->mutex, NULL);
+	}
+	return GMA_S_OK;
+}
+
+GmaStatus CWorkPool::Add(void* pvTask)
+{
+	if (_cWorkers == 0)
+		return GMA_E_UNEXPECTED;
+
+	Worker* pWorker = &_aWorkers[_iNextAdd];
+	_iNextAdd = (_iNextAdd + 1) % _cWorkers;
+
+	__atomic_add_fetch(&_cPending, 1, __ATOMIC_RELAXED);
+	if (!_PushBack(pWorker, pvTask))
+	{
+		__atomic_sub_fetch(&_cPending, 1, __ATOMIC_RELAXED);
+		return GMA_E_OUTOFMEMORY;
+	}
+	return GMA_S_OK;
+}
+
+GmaStatus CWorkPool::Run()
+{
+	if (_cWorkers == 0)
+		return GMA_E_UNEXPECTED;
+
+	for (uint32_t i = 1; i < _cWorkers; i++)
+		_aWorkers[i].bThreadStarted = pthread_create(&_aWorkers[i].thread, NULL, _ThreadProc, &_aWorkers[i]) == 0;
+
+	_Work(&_aWorkers[0]);
+
+	for (uint32_t i = 1; i < _cWorkers; i++)
+	{
+		if (_aWorkers[i].bThreadStarted)
+			pthread_join(_aWorkers[i].thread, NULL);
+		_aWorkers[i].bThreadStarted = false;
+	}
+	return GMA_S_OK;
+}
+
+void CWorkPool::Push(uint32_t iWorker, void* pvTask)
+{
+	__atomic_add_fetch(&_cPending, 1, __ATOMIC_RELAXED);
+	if (_PushBack(&_aWorkers[iWorker], pvTask))
+		return;
+
+	_pfnRunTask(_pvContext, iWorker, pvTask);
+	__atomic_sub_fetch(&_cPending, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t CWorkPool::GetStealCount() const
+{
+	uint64_t cSteals = 0;
+	for (uint32_t i = 0; i < _cWorkers; i++)
+		cSteals += _aWorkers[i].cSteals;
+	return cSteals;
+}
+
+void* CWorkPool::_ThreadProc(void* pvWorker)
+{
+	Worker* pWorker = (Worker*)pvWorker;
+	pWorker->pPool->_Work(pWorker);
+	return NULL;
+}
+
+void CWorkPool::_Work(Worker* pWorker)
+{
+	uint32_t cIdle = 0;
+	for (;;)
+	{
+		void* pvTask;
+		if (_PopBack(pWorker, &pvTask) || _Steal(pWorker, &pvTask))
+		{
+			_pfnRunTask(_pvContext, pWorker->iWorker, pvTask);
+			__atomic_sub_fetch(&_cPending, 1, __ATOMIC_RELEASE);
+			cIdle = 0;
+			continue;
+		}
+
+		if (__atomic_load_n(&_cPending, __ATOMIC_ACQUIRE) == 0)
+			return;
+
+		// Someone is still running a task that may queue more. Spin politely, then back off.
+		if (++cIdle < c_cIdleSpins)
+		{
+			sched_yield();
+		}
+		else
+		{
+			struct timespec ts = { 0, c_nsIdleSleep };
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+bool CWorkPool::_PushBack(Worker* pWorker, void* pvTask)
+{
+	pthread_mutex_lock(&pWorker->mutex);
+	if (pWorker->cTasks == pWorker->cCapacity)
+	{
+		size_t cNewCapacity = pWorker->cCapacity * 2;
+		void** apvNewTasks = new (std::nothrow) void*[cNewCapacity];
+		if (apvNewTasks == NULL)
+		{
+			pthread_mutex_unlock(&pWorker->mutex);
+			return false;
+		}
+		for (size_t i = 0; i < pWorker->cTasks; i++)
+			apvNewTasks[i] = pWorker->apvTasks[(pWorker->iFront + i) & (pWorker->cCapacity - 1)];
+		delete[] pWorker->apvTasks;
+		pWorker->apvTasks = apvNewTasks;
+		pWorker->cCapacity = cNewCapacity;
+		pWorker->iFront = 0;
+	}
+
+	pWorker->apvTasks[(pWorker->iFront + pWorker->cTasks) & (pWorker->cCapacity - 1)] = pvTask;
+	__atomic_store_n(&pWorker->cTasks, pWorker->cTasks + 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&pWorker->mutex);
+	return true;
+}
+
+bool CWorkPool::_PopBack(Worker* pWorker, void** ppvTask)
+{
+	// Unlocked peek: an owner that sees an empty deque just goes stealing, and thieves never add
+	if (__atomic_load_n(&pWorker->cTasks, __ATOMIC_RELAXED) == 0)
+		return false;
+
+	pthread_mutex_lock(&pWorker->mutex);
+	bool bFound = pWorker->cTasks > 0;
+	if (bFound)
+	{
+		__atomic_store_n(&pWorker->cTasks, pWorker->cTasks - 1, __ATOMIC_RELAXED);
+		*ppvTask = pWorker->apvTasks[(pWorker->iFront + pWorker->cTasks) & (pWorker->cCapacity - 1)];
+	}
+	pthread_mutex_unlock(&pWorker->mutex);
+	return bFound;
+}
+
+bool CWorkPool::_Steal(Worker* pThief, void** ppvTask)
+{
+	if (_cWorkers < 2)
+		return false;
+
+	// xorshift32, so thieves don't all descend on the same victim
+	uint32_t ulRandom = pThief->ulRandom;
+	ulRandom ^= ulRandom << 13;
+	ulRandom ^= ulRandom >> 17;
+	ulRandom ^= ulRandom << 5;
+	pThief->ulRandom = ulRandom;
+
+	for (uint32_t i = 0; i < _cWorkers; i++)
+	{
+		Worker* pVictim = &_aWorkers[(ulRandom + i) % _cWorkers];
+		if (pVictim == pThief || __atomic_load_n(&pVictim->cTasks, __ATOMIC_RELAXED) == 0)
+			continue;
+
+		pthread_mutex_lock(&pVictim->mutex);
+		bool bFound = pVictim->cTasks > 0;
+		if (bFound)
+		{
+			*ppvTask = pVictim->apvTasks[pVictim->iFront];
+			pVictim->iFront = (pVictim->iFront + 1) & (pVictim->cCapacity - 1);
+			__atomic_store_n(&pVictim->cTasks, pVictim->cTasks - 1, __ATOMIC_RELAXED);
+		}
+		pthread_mutex_unlock(&pVictim->mutex);
+
+		if (bFound)
+		{
+			pThief->cSteals++;
+			return true;
+		}
+	}
+	return false;
+}
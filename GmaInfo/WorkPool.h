@@ -0,0 +1,50 @@
+#pragma once
+
+#include <pthread.h>
+#include "GmaStatus.h"
+
+// Thread pool that balances its tasks by work stealing
+// Each worker has its own deque. Tasks it queues go on the back, and it takes them back from there newest first, so it stays on work whose data is still in its cache. A worker that runs dry steals from the front of someone else's deque instead: the oldest tasks, which in a directory walk are the directories nearest the root and so bring the most work with them.
+// Tasks are opaque pointers, all run by the same task function. Run() returns once every task has finished, including the ones tasks queued while running.
+class CWorkPool
+{
+public:
+	typedef void (*PfnRunTask)(void* pvContext, uint32_t iWorker, void* pvTask);
+
+	CWorkPool(PfnRunTask pfnRunTask, void* pvContext);
+	~CWorkPool();
+
+	GmaStatus Initialize(uint32_t cWorkers);
+
+	// Queues a task before Run(). Tasks are dealt out to the workers in turn.
+	GmaStatus Add(void* pvTask);
+
+	// Runs all tasks, using the calling thread as worker 0
+	// If some worker threads can't be started, the others steal their tasks, so everything still runs.
+	GmaStatus Run();
+
+	// Queues a task from a task running on worker iWorker. If the worker's deque can't grow, the task runs right away instead.
+	void Push(uint32_t iWorker, void* pvTask);
+
+	uint32_t GetWorkerCount() const { return _cWorkers; }
+	uint64_t GetStealCount() const; // Tasks run by a worker other than the one that queued them
+
+private:
+	struct Worker;
+
+	PfnRunTask _pfnRunTask;
+	void* _pvContext;
+	Worker* _aWorkers;
+	uint32_t _cWorkers;
+	uint32_t _iNextAdd;
+	long _cPending; // Tasks queued or running. Only reaches 0 once all work is done, since tasks queue their children before they finish.
+
+	static void* _ThreadProc(void* pvWorker);
+	void _Work(Worker* pWorker);
+	bool _PushBack(Worker* pWorker, void* pvTask);
+	bool _PopBack(Worker* pWorker, void** ppvTask);
+	bool _Steal(Worker* pThief, void** ppvTask);
+
+	CWorkPool(const CWorkPool&);
+	CWorkPool& operator=(const CWorkPool&);
+};
@@ -1,24 +1,24 @@
 // Adapted from Microsoft sample PlaylistPropertyHandler/PlaylistPropertyHandler.cpp
 
 #include "dll.h"
-#include "Helpers.h"
 #include "RegisterExtension.h"
 #include "PropertyStoreHelpers.h"
-#include "cJSON.h"
+#include "StreamByteSource.h"
+#include "GmaDocument.h"
+#include "GmaCache.h"
+#include "GmaCacheFile.h"
+#include "GmaText.h"
 #include <shobjidl.h>
+#include <shlobj.h>
 #include <shlwapi.h>
 #include <propvarutil.h>
 #include <propkey.h>
 #include <intsafe.h>
+#include <strsafe.h>
 
 class DECLSPEC_UUID("9DBD2C50-62AD-11D0-B806-00C04FD706EC") PropertyThumbnailHandler;
 
-const ULONGLONG c_ullGmaHeaderSizeLimit = 8192ull; // Safety catch to abort reading GMA header past this number of bytes
-// Afaik there is no data in the GMA header that specifies its length, and there is no public specification I can find that specifies a length on the 3 fields it contains
-// The only way to know we've reached the end of the header is to find the null byte that follows and delineates each of the 3 consecutive fields, which could be unnaturally deep in the file
-// So we will abort our reading past this number of bytes as a fallback, for bizarre GMAs and non-GMAs that might otherwise fool us into reading say 3GB of null bytes
-// 8192 is an arbitrary number that should be plenty long for the majority of GMAs. GMAs using the recently added "ignore" field in the json chunk with an absurd number of entries might breach this limit.
-
+// UTF-16 conversions of the header strings, made on demand as their properties are requested. A field stays NULL until converted, and also if the GMA doesn't have it.
 struct GmaHeaderInfoExtract
 {
 	PWSTR pwszName;
@@ -31,11 +31,67 @@ struct GmaHeaderInfoExtract
 
 struct GmaInfo
 {
+	GmaHeaderInfo Header; // UTF-8 views into the parse arena
 	GmaHeaderInfoExtract HeaderExtract;
 	BOOL HeaderUsesJsonChunkInDescription;
 	PWSTR HeaderConcatForSearchContents;
+	BYTE FormatVersion;
+	ULONGLONG Timestamp; // Unix seconds, 0 if absent
+	BOOL HasToc; // The file table could be read. FileCount and TotalFileSize are only meaningful if set.
+	DWORD FileCount;
+	ULONGLONG TotalFileSize;
+};
+
+// Every property we provide, each built only when first asked for
+// Each header string belongs to exactly one of these, so its UTF-16 conversion happens exactly once
+enum GmaLazyProperty
+{
+	GMA_LAZYPROP_TITLE = 0x001,
+	GMA_LAZYPROP_AUTHOR = 0x002,
+	GMA_LAZYPROP_DESCRIPTION = 0x004,
+	GMA_LAZYPROP_CATEGORY = 0x008,
+	GMA_LAZYPROP_KEYWORDS = 0x010,
+	GMA_LAZYPROP_SEARCHCONTENTS = 0x020, // needs all of the above
+	GMA_LAZYPROP_DATECREATED = 0x040,
+	GMA_LAZYPROP_FILEVERSION = 0x080,
+	GMA_LAZYPROP_FILECOUNT = 0x100,
+	GMA_LAZYPROP_TOTALFILESIZE = 0x200,
+
+	GMA_LAZYPROP_ALL = 0x3ff,
 };
 
+// Which property each key is, and how much of the GMA has to be parsed to build it
+struct GmaLazyPropertyKey
+{
+	const PROPERTYKEY* pkey;
+	DWORD dwProp;
+	GmaParseStage stage;
+};
+
+const GmaLazyPropertyKey c_aGmaLazyPropertyKeys[] =
+{
+	{ &PKEY_Title, GMA_LAZYPROP_TITLE, GMA_STAGE_HEADER },
+	{ &PKEY_Author, GMA_LAZYPROP_AUTHOR, GMA_STAGE_HEADER },
+	{ &PKEY_Link_Description, GMA_LAZYPROP_DESCRIPTION, GMA_STAGE_HEADER },
+	{ &PKEY_Category, GMA_LAZYPROP_CATEGORY, GMA_STAGE_HEADER },
+	{ &PKEY_Keywords, GMA_LAZYPROP_KEYWORDS, GMA_STAGE_HEADER },
+	{ &PKEY_Search_Contents, GMA_LAZYPROP_SEARCHCONTENTS, GMA_STAGE_HEADER },
+	{ &PKEY_Document_DateCreated, GMA_LAZYPROP_DATECREATED, GMA_STAGE_HEADER },
+	{ &PKEY_FileVersion, GMA_LAZYPROP_FILEVERSION, GMA_STAGE_HEADER },
+	{ &PKEY_FileCount, GMA_LAZYPROP_FILECOUNT, GMA_STAGE_TOC },
+	{ &PKEY_TotalFileSize, GMA_LAZYPROP_TOTALFILESIZE, GMA_STAGE_TOC },
+};
+
+// Parse results shared by every handler in the process
+// The shell creates a new handler each time it wants a file's properties (column changes, re-sorts, the details pane, the indexer...), so this is what spares it from parsing the same file over and over.
+static CGmaMetadataCache s_metadataCache;
+static HRESULT _GetCacheKey(IStream* pStream, GmaCacheKey* pKey);
+
+// The same results kept on disk, in %LOCALAPPDATA%\GmaShellPropertyHandler\metadata.cache
+// Explorer, the indexer and each preview host process have their own s_metadataCache, so this is what spares a new process (or a new session) from parsing files it has seen before. Opened on first use by _GetCacheFile(), which returns NULL if it couldn't be.
+static CGmaCacheFile s_cacheFile;
+static CGmaCacheFile* _GetCacheFile();
+
 
 // ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //
@@ -50,7 +106,7 @@ class CGmaPropertyHandler :
     public IObjectProvider
 {
 public:
-    CGmaPropertyHandler() : _cRef(1), _pStream(NULL), _pCache(NULL), _GmaInfo()
+    CGmaPropertyHandler() : _cRef(1), _pStream(NULL), _pCache(NULL), _pSource(NULL), _pDocument(NULL), _bHasCacheKey(false), _cacheKey(), _metadata(), _GmaInfo(), _dwPendingProps(0ul)
     {
         DllAddRef();
     }
@@ -126,6 +182,13 @@ private:
         SafeRelease(&_pStream);
         SafeRelease(&_pCache);
 		_ReleaseGmaHeaderInfoExtractAllocs();
+		delete _pDocument;
+		_pDocument = NULL;
+		delete _pSource;
+		_pSource = NULL;
+		_arenaCached.Release();
+		ZeroMemory(&_metadata, sizeof(_metadata));
+		_bHasCacheKey = false;
     }
 
     ~CGmaPropertyHandler()
@@ -137,34 +200,28 @@ private:
     long _cRef;
     IStream *_pStream; // Stream from Initialize()
     IPropertyStoreCache *_pCache; // Storage unit for the final property values which Windows retrieves
+
+	CStreamByteSource* _pSource; // _pStream, for the GMA core
+	CGmaDocument* _pDocument; // Parses _pSource on demand, as properties are asked for
+
+	bool _bHasCacheKey; // _pStream could identify its file, so s_metadataCache can be used
+	GmaCacheKey _cacheKey;
+	GmaCachedMetadata _metadata; // Everything known about the GMA so far, from _pDocument or from s_metadataCache
+	CGmaArena _arenaCached; // Backs _metadata's strings when they came from s_metadataCache
 	
 	GmaInfo _GmaInfo; // Relevant information of the GMA file
+	DWORD _dwPendingProps; // GmaLazyProperty flags of the properties not yet in _pCache
 
-	void _SafeReleaseWString(PWSTR* ppws)
-	{
-		if (*ppws != NULL)
-		{
-			delete[] *ppws;
-			*ppws = NULL;
-		}
-	}
+	CGmaArena _arena; // Backs the UTF-16 conversions in _GmaInfo. The UTF-8 strings they come from belong to _pDocument or _arenaCached.
 
 	void _ReleaseGmaHeaderInfoExtractAllocs()
 	{
-		_SafeReleaseWString(&_GmaInfo.HeaderExtract.pwszName);
-		_SafeReleaseWString(&_GmaInfo.HeaderExtract.pwszAuthor);
-		_SafeReleaseWString(&_GmaInfo.HeaderExtract.pwszDescription);
-		_SafeReleaseWString(&_GmaInfo.HeaderExtract.pwszType);
-		if (_GmaInfo.HeaderExtract.awszTags != NULL)
-		{
-			for (DWORD i = 0; i < _GmaInfo.HeaderExtract.cTags; i++)
-				_SafeReleaseWString(&_GmaInfo.HeaderExtract.awszTags[i]);
-			delete[] _GmaInfo.HeaderExtract.awszTags;
-			_GmaInfo.HeaderExtract.awszTags = NULL;
-			_GmaInfo.HeaderExtract.cTags = 0ul;
-		}
-
-		_SafeReleaseWString(&_GmaInfo.HeaderConcatForSearchContents);
+		// Everything was allocated from the arena, so a single release frees it all
+		_arena.Release();
+		ZeroMemory(&_GmaInfo.Header, sizeof(_GmaInfo.Header));
+		ZeroMemory(&_GmaInfo.HeaderExtract, sizeof(_GmaInfo.HeaderExtract));
+		_GmaInfo.HeaderConcatForSearchContents = NULL;
+		_dwPendingProps = 0ul;
 	}
 
 
@@ -176,18 +233,22 @@ private:
 	// GMA information retrieval
 	//
 
-    HRESULT _ReadRelevantGmaData();
-	HRESULT _ReadGmaHeaderField(ULONGLONG* ullStreamSize, ULONGLONG* ullStreamPos, BYTE** pcBuf);
-	HRESULT _ReadAndParseStringGmaHeaderField(ULONGLONG* ullStreamSize, ULONGLONG* ullStreamPos, PSTR* pszOutField, PWSTR* pszWString);
-	HRESULT _PostProcessGmaData();
+    HRESULT _ReadRelevantGmaData(GmaParseStage stage);
+	bool _LookupCacheFile();
+	void _InsertIntoCacheFile();
+	void _ApplyMetadata();
+	HRESULT _ConvertHeaderString(const GmaString& strField, PWSTR* ppwszField);
 
 	//
 	// Transport to Property value store
 	//
 
-	HRESULT _SendGmaDataToPropertyStore();
+	HRESULT _SendLazyPropertyToPropertyStore(DWORD dwProp);
+	HRESULT _EnsurePropertyInPropertyStore(REFPROPERTYKEY key);
+	HRESULT _EnsureAllPropertiesInPropertyStore();
 	HRESULT _SetWstrPropertyValueInPropertyCache(PWSTR pwszPropValue, PROPERTYKEY propKey);
 	HRESULT _SetWstrArrayPropertyValueInPropertyCache(LPWSTR* apwstrPropValue, ULONG cPropValue, PROPERTYKEY propKey);
+	HRESULT _SetUnixTimePropertyValueInPropertyCache(ULONGLONG ullUnixTime, PROPERTYKEY propKey);
 	bool _SearchContentStringConcat(PWSTR pwszSearchContents, PWSTR pwszInsertString, const WCHAR wcSuffixChar, size_t* pullInsertPos);
 	
 };
@@ -216,22 +277,46 @@ HRESULT CGmaPropertyHandler_CreateInstance(REFIID riid, void **ppv)
 //   IPropertyStore
 // --------------------------------------------------
 
+// Enumerating the store means the caller wants to see every key, so everything gets built
+// Single value lookups only build the property asked for, which is all thumbnail and tile views ever do
+
 HRESULT CGmaPropertyHandler::GetCount(DWORD *pcProps)
 {
     *pcProps = 0;
-    return _pCache ? _pCache->GetCount(pcProps) : E_UNEXPECTED;
+	if (!_pCache)
+		return E_UNEXPECTED;
+
+	HRESULT hr = _EnsureAllPropertiesInPropertyStore();
+	if (FAILED(hr))
+		return hr;
+
+    return _pCache->GetCount(pcProps);
 }
 
 HRESULT CGmaPropertyHandler::GetAt(DWORD iProp, PROPERTYKEY *pkey)
 {
     *pkey = PKEY_Null;
-    return _pCache ? _pCache->GetAt(iProp, pkey) : E_UNEXPECTED;
+	if (!_pCache)
+		return E_UNEXPECTED;
+
+	HRESULT hr = _EnsureAllPropertiesInPropertyStore();
+	if (FAILED(hr))
+		return hr;
+
+    return _pCache->GetAt(iProp, pkey);
 }
 
 HRESULT CGmaPropertyHandler::GetValue(REFPROPERTYKEY key, PROPVARIANT *pPropVar)
 {
     PropVariantInit(pPropVar);
-    return _pCache ? _pCache->GetValue(key, pPropVar) : E_UNEXPECTED;
+	if (!_pCache)
+		return E_UNEXPECTED;
+
+	HRESULT hr = _EnsurePropertyInPropertyStore(key);
+	if (FAILED(hr))
+		return hr;
+
+    return _pCache->GetValue(key, pPropVar);
 }
 
 // SetValue just updates the internal value cache
@@ -273,29 +358,35 @@ HRESULT CGmaPropertyHandler::Initialize(IStream *pStream, DWORD grfMode)
 			return hr;
 		}
 
-		// Read the property data we want from the GMA file
-		hr = _ReadRelevantGmaData();
-		if (FAILED(hr))
+		// Only check that this is a GMA at all for now
+		// Many callers only ever ask for one or two properties, so the header and file table are parsed, and the property cache filled, as GetValue() asks for them
+		_pSource = new (std::nothrow) CStreamByteSource(_pStream);
+		if (_pSource != NULL)
+			_pDocument = new (std::nothrow) CGmaDocument(_pSource);
+		if (_pDocument == NULL)
 		{
 			_ReleaseResources();
-			return hr;
+			return E_OUTOFMEMORY;
 		}
 
-		// Clean up the data
-		hr = _PostProcessGmaData();
-		if (FAILED(hr))
+		// A file seen before is answered from the cache, as far as it was parsed then, without reading the stream at all. That includes files that turned out not to be GMAs.
+		_bHasCacheKey = SUCCEEDED(_GetCacheKey(_pStream, &_cacheKey));
+		if (_bHasCacheKey && s_metadataCache.Lookup(_cacheKey, &_metadata, &_arenaCached))
+			_ApplyMetadata();
+		else if (_bHasCacheKey && _LookupCacheFile())
 		{
-			_ReleaseResources();
-			return hr;
+			_ApplyMetadata();
+			s_metadataCache.Insert(_cacheKey, _metadata);
 		}
 
-		// Send the read-in data to our property cache for Windows to read
-		hr = _SendGmaDataToPropertyStore();
+		hr = _ReadRelevantGmaData(GMA_STAGE_MAGIC);
 		if (FAILED(hr))
 		{
 			_ReleaseResources();
 			return hr;
 		}
+
+		_dwPendingProps = GMA_LAZYPROP_ALL;
     }
     return hr;
 }
@@ -326,89 +417,224 @@ HRESULT CGmaPropertyHandler::Initialize(IStream *pStream, DWORD grfMode)
 		]
 	}
 
+	`timestamp` fixed header field					   ->	System.Document.DateCreated  (when gmad.exe built the addon)
+
+	`version` fixed header field					   ->	System.FileVersion  (GMA format version, not the addon's own version)
+
+	File table entry count							   ->	System.FileCount
+
+	Sum of file table entry sizes					   ->	System.TotalFileSize  (uncompressed payload size, as opposed to System.Size of the .gma itself)
+
 */
 
-HRESULT CGmaPropertyHandler::_SendGmaDataToPropertyStore()
+// Builds one property and puts it in the property cache
+// The part of the GMA it comes from must already be parsed
+HRESULT CGmaPropertyHandler::_SendLazyPropertyToPropertyStore(DWORD dwProp)
 {
 	HRESULT hr = E_UNEXPECTED;
-	
-	//
-	// Main properties
-	//
-	
-	// Name (string)
-	hr = _SetWstrPropertyValueInPropertyCache(_GmaInfo.HeaderExtract.pwszName, PKEY_Title); // method handles fallback to empty string for NULL
-	if (FAILED(hr))
-		return hr;
-	
-	// Author (multi-value string)
-	PWSTR apwszDescription[1] = { _GmaInfo.HeaderExtract.pwszAuthor };
-	hr = _SetWstrArrayPropertyValueInPropertyCache(_GmaInfo.HeaderExtract.pwszAuthor ? apwszDescription : NULL, 1ul, PKEY_Author); // ditto
-	if (FAILED(hr))
-		return hr;
-	
-	// Description (string)
-	hr = _SetWstrPropertyValueInPropertyCache(_GmaInfo.HeaderExtract.pwszDescription, PKEY_Link_Description);
-	if (FAILED(hr))
-		return hr;
-	
-	// Type (multi-value string)
-	PWSTR apwszType[1] = { _GmaInfo.HeaderExtract.pwszType ? _GmaInfo.HeaderExtract.pwszType : L"" };
-	hr = _SetWstrArrayPropertyValueInPropertyCache(_GmaInfo.HeaderExtract.pwszAuthor ? apwszType : NULL, 1ul, PKEY_Category);
-	if (FAILED(hr))
-		return hr;
-	
-	// Tags (multi-value string)
-	hr = _SetWstrArrayPropertyValueInPropertyCache(_GmaInfo.HeaderExtract.cTags > 0ul ? _GmaInfo.HeaderExtract.awszTags : NULL, _GmaInfo.HeaderExtract.cTags, PKEY_Keywords);
-	if (FAILED(hr))
-		return hr;
+	GmaHeaderInfoExtract& extract = _GmaInfo.HeaderExtract;
 
-	//
-	// "Contents" string for the search indexer
-	//
+	switch (dwProp)
+	{
+	case GMA_LAZYPROP_TITLE:
+	{
+		// Name (string)
+		hr = _ConvertHeaderString(_GmaInfo.Header.strName, &extract.pwszName);
+		if (SUCCEEDED(hr))
+			hr = _SetWstrPropertyValueInPropertyCache(extract.pwszName, PKEY_Title); // method handles fallback to empty string for NULL
+		break;
+	}
+
+	case GMA_LAZYPROP_AUTHOR:
+	{
+		// Author (multi-value string)
+		hr = _ConvertHeaderString(_GmaInfo.Header.strAuthor, &extract.pwszAuthor);
+		if (SUCCEEDED(hr))
+		{
+			PWSTR apwszAuthor[1] = { extract.pwszAuthor };
+			hr = _SetWstrArrayPropertyValueInPropertyCache(extract.pwszAuthor ? apwszAuthor : NULL, 1ul, PKEY_Author); // ditto
+		}
+		break;
+	}
 
-	// We will concatenate all strings together, using newlines to separate each property and whitespace to separate each item within multi-string properties
-	ULONG cSearchContents = 0ul;
-	if (_GmaInfo.HeaderExtract.pwszName != NULL)
-		cSearchContents += lstrlenW(_GmaInfo.HeaderExtract.pwszName) + 1ul; // +1 for trailing \n
+	case GMA_LAZYPROP_DESCRIPTION:
+	{
+		// Description (string)
+		hr = _ConvertHeaderString(_GmaInfo.Header.strDescription, &extract.pwszDescription);
+		if (SUCCEEDED(hr))
+			hr = _SetWstrPropertyValueInPropertyCache(extract.pwszDescription, PKEY_Link_Description);
+		break;
+	}
+
+	case GMA_LAZYPROP_CATEGORY:
+	{
+		// Type (multi-value string)
+		hr = _ConvertHeaderString(_GmaInfo.Header.strType, &extract.pwszType);
+		if (SUCCEEDED(hr))
+		{
+			PWSTR apwszType[1] = { extract.pwszType ? extract.pwszType : L"" };
+			hr = _SetWstrArrayPropertyValueInPropertyCache(_GmaInfo.Header.strAuthor.psz ? apwszType : NULL, 1ul, PKEY_Category);
+		}
+		break;
+	}
+
+	case GMA_LAZYPROP_KEYWORDS:
+	{
+		// Tags (multi-value string)
+		hr = S_OK;
+		if (_GmaInfo.Header.cTags > 0ul)
+		{
+			extract.awszTags = _arena.AllocArray<PWSTR>(_GmaInfo.Header.cTags);
+			if (extract.awszTags == NULL)
+				return E_OUTOFMEMORY;
+			for (uint32_t i = 0; i < _GmaInfo.Header.cTags && SUCCEEDED(hr); i++)
+				hr = _ConvertHeaderString(_GmaInfo.Header.astrTags[i], &extract.awszTags[i]);
+			if (FAILED(hr))
+				return hr;
+			extract.cTags = _GmaInfo.Header.cTags;
+		}
+		hr = _SetWstrArrayPropertyValueInPropertyCache(extract.cTags > 0ul ? extract.awszTags : NULL, extract.cTags, PKEY_Keywords);
+		break;
+	}
+
+	case GMA_LAZYPROP_SEARCHCONTENTS:
+	{
+		// "Contents" string for the search indexer
+		// It's made of every other string, so they all need converting first
+		hr = S_OK;
+		for (DWORD dwOther = GMA_LAZYPROP_TITLE; dwOther < GMA_LAZYPROP_SEARCHCONTENTS && SUCCEEDED(hr); dwOther <<= 1)
+		{
+			if ((_dwPendingProps & dwOther) != 0)
+			{
+				hr = _SendLazyPropertyToPropertyStore(dwOther);
+				if (SUCCEEDED(hr))
+					_dwPendingProps &= ~dwOther;
+			}
+		}
+		if (FAILED(hr))
+			return hr;
+
+		// We will concatenate all strings together, using newlines to separate each property and whitespace to separate each item within multi-string properties
+		ULONG cSearchContents = 0ul;
+		if (extract.pwszName != NULL)
+			cSearchContents += lstrlenW(extract.pwszName) + 1ul; // +1 for trailing \n
 	
-	if (_GmaInfo.HeaderExtract.pwszAuthor != NULL)
-		cSearchContents += lstrlenW(_GmaInfo.HeaderExtract.pwszAuthor) + 1ul; // +1 for trailing \n
+		if (extract.pwszAuthor != NULL)
+			cSearchContents += lstrlenW(extract.pwszAuthor) + 1ul; // +1 for trailing \n
 	
-	if (_GmaInfo.HeaderExtract.pwszDescription != NULL)
-		cSearchContents += lstrlenW(_GmaInfo.HeaderExtract.pwszDescription) + 1ul; // +1 for trailing \n
+		if (extract.pwszDescription != NULL)
+			cSearchContents += lstrlenW(extract.pwszDescription) + 1ul; // +1 for trailing \n
 	
-	if (_GmaInfo.HeaderExtract.pwszType != NULL)
-		cSearchContents += lstrlenW(_GmaInfo.HeaderExtract.pwszType) + 1ul; // +1 for trailing \n
+		if (extract.pwszType != NULL)
+			cSearchContents += lstrlenW(extract.pwszType) + 1ul; // +1 for trailing \n
+
+		if (extract.cTags > 0ul && extract.awszTags != NULL)
+		{
+			for (ULONG i = 0ul; i < extract.cTags; i++)
+				cSearchContents += lstrlenW(extract.awszTags[i]) + 1ul; // +1 for trailing space
+			cSearchContents += 1; // trailing \n
+		}
+
+		_GmaInfo.HeaderConcatForSearchContents = _arena.AllocArray<WCHAR>(cSearchContents + 1);
+		if (_GmaInfo.HeaderConcatForSearchContents == NULL)
+			return E_OUTOFMEMORY;
+		ZeroMemory(_GmaInfo.HeaderConcatForSearchContents, (cSearchContents + 1) * sizeof(WCHAR));
+		size_t ullInsertPos = 0;
+		_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, extract.pwszName, L'\n', &ullInsertPos);
+		_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, extract.pwszAuthor, L'\n', &ullInsertPos);
+		_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, extract.pwszDescription, L'\n', &ullInsertPos);
+		_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, extract.pwszType, L'\n', &ullInsertPos);
+		if (extract.cTags > 0ul && extract.awszTags != NULL)
+		{
+			for (ULONG i = 0ul; i < extract.cTags; i++)
+			{
+				WCHAR wcSuffixChar = (i < extract.cTags - 1ul) ? L' ' : L'\n';
+				_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, extract.awszTags[i], wcSuffixChar, &ullInsertPos);
+			}
+		}
 
-	if (_GmaInfo.HeaderExtract.cTags > 0ul && _GmaInfo.HeaderExtract.awszTags != NULL)
+		hr = _SetWstrPropertyValueInPropertyCache(_GmaInfo.HeaderConcatForSearchContents, PKEY_Search_Contents);
+		break;
+	}
+
+	case GMA_LAZYPROP_DATECREATED:
+	{
+		// Timestamp (date)
+		hr = _SetUnixTimePropertyValueInPropertyCache(_GmaInfo.Timestamp, PKEY_Document_DateCreated);
+		break;
+	}
+
+	case GMA_LAZYPROP_FILEVERSION:
 	{
-		for (ULONG i = 0ul; i < _GmaInfo.HeaderExtract.cTags; i++)
-			cSearchContents += lstrlenW(_GmaInfo.HeaderExtract.awszTags[i]) + 1ul; // +1 for trailing space
-		cSearchContents += 1; // trailing \n
+		// Format version (string)
+		WCHAR wszFormatVersion[4];
+		StringCchPrintfW(wszFormatVersion, ARRAYSIZE(wszFormatVersion), L"%u", (UINT)_GmaInfo.FormatVersion);
+		hr = _SetWstrPropertyValueInPropertyCache(wszFormatVersion, PKEY_FileVersion);
+		break;
 	}
 
-	_GmaInfo.HeaderConcatForSearchContents = new WCHAR[cSearchContents + 1]();
-	size_t ullInsertPos = 0;
-	_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, _GmaInfo.HeaderExtract.pwszName, L'\n', &ullInsertPos);
-	_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, _GmaInfo.HeaderExtract.pwszAuthor, L'\n', &ullInsertPos);
-	_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, _GmaInfo.HeaderExtract.pwszDescription, L'\n', &ullInsertPos);
-	_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, _GmaInfo.HeaderExtract.pwszType, L'\n', &ullInsertPos);
-	if (_GmaInfo.HeaderExtract.cTags > 0ul && _GmaInfo.HeaderExtract.awszTags != NULL)
+	case GMA_LAZYPROP_FILECOUNT:
 	{
-		for (ULONG i = 0ul; i < _GmaInfo.HeaderExtract.cTags; i++)
+		// File count (uint32)
+		PROPVARIANT propvar = {};
+		InitPropVariantFromUInt32(_GmaInfo.FileCount, &propvar);
+		hr = _pCache->SetValueAndState(PKEY_FileCount, &propvar, _GmaInfo.HasToc ? PSC_NORMAL : PSC_NOTINSOURCE);
+		PropVariantClear(&propvar);
+		break;
+	}
+
+	case GMA_LAZYPROP_TOTALFILESIZE:
+	{
+		// Total uncompressed size of all files (uint64)
+		PROPVARIANT propvar = {};
+		InitPropVariantFromUInt64(_GmaInfo.TotalFileSize, &propvar);
+		hr = _pCache->SetValueAndState(PKEY_TotalFileSize, &propvar, _GmaInfo.HasToc ? PSC_NORMAL : PSC_NOTINSOURCE);
+		PropVariantClear(&propvar);
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return hr;
+}
+
+// Makes sure the property cache holds key, building it first if it's one of the lazy properties
+HRESULT CGmaPropertyHandler::_EnsurePropertyInPropertyStore(REFPROPERTYKEY key)
+{
+	for (size_t i = 0; i < ARRAYSIZE(c_aGmaLazyPropertyKeys); i++)
+	{
+		if (IsEqualPropertyKey(key, *c_aGmaLazyPropertyKeys[i].pkey))
 		{
-			WCHAR wcSuffixChar = (i < _GmaInfo.HeaderExtract.cTags - 1ul) ? L' ' : L'\n';
-			_SearchContentStringConcat(_GmaInfo.HeaderConcatForSearchContents, _GmaInfo.HeaderExtract.awszTags[i], wcSuffixChar, &ullInsertPos);
+			DWORD dwProp = c_aGmaLazyPropertyKeys[i].dwProp;
+			if ((_dwPendingProps & dwProp) == 0)
+				return S_OK;
+
+			HRESULT hr = _ReadRelevantGmaData(c_aGmaLazyPropertyKeys[i].stage);
+			if (FAILED(hr))
+				return hr;
+
+			hr = _SendLazyPropertyToPropertyStore(dwProp);
+			if (SUCCEEDED(hr))
+				_dwPendingProps &= ~dwProp;
+			return hr;
 		}
 	}
 
-	hr = _SetWstrPropertyValueInPropertyCache(_GmaInfo.HeaderConcatForSearchContents, PKEY_Search_Contents);
-	if (FAILED(hr))
-		return hr;
+	return S_OK; // Not a lazy property, so it's either in the cache already or we don't provide it
+}
 
-	// All properties set
-	return hr;
+HRESULT CGmaPropertyHandler::_EnsureAllPropertiesInPropertyStore()
+{
+	for (size_t i = 0; i < ARRAYSIZE(c_aGmaLazyPropertyKeys) && _dwPendingProps != 0ul; i++)
+	{
+		HRESULT hr = _EnsurePropertyInPropertyStore(*c_aGmaLazyPropertyKeys[i].pkey);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	return S_OK;
 }
 
 HRESULT CGmaPropertyHandler::_SetWstrPropertyValueInPropertyCache(PWSTR pwszPropValue, PROPERTYKEY propKey)
@@ -467,6 +693,33 @@ HRESULT CGmaPropertyHandler::_SetWstrArrayPropertyValueInPropertyCache(LPWSTR* a
 	return hr;
 }
 
+HRESULT CGmaPropertyHandler::_SetUnixTimePropertyValueInPropertyCache(ULONGLONG ullUnixTime, PROPERTYKEY propKey)
+{
+	HRESULT hr = E_UNEXPECTED;
+
+	if (_pCache == NULL)
+		return hr;
+
+	// FILETIME counts 100ns intervals since 1601-01-01
+	ULARGE_INTEGER uliFileTime;
+	uliFileTime.QuadPart = (ullUnixTime + 11644473600ull) * 10000000ull;
+	FILETIME ft;
+	ft.dwLowDateTime = uliFileTime.LowPart;
+	ft.dwHighDateTime = uliFileTime.HighPart;
+
+	PROPVARIANT propvar = {};
+	InitPropVariantFromFileTime(&ft, &propvar);
+
+	if (ullUnixTime != 0ull) // If property was extracted from the GMA, set it in the prop store normally
+		hr = _pCache->SetValueAndState(propKey, &propvar, PSC_NORMAL);
+	else // Otherwise store the dummy value and report it as absent
+		hr = _pCache->SetValueAndState(propKey, &propvar, PSC_NOTINSOURCE);
+
+	PropVariantClear(&propvar);
+
+	return hr;
+}
+
 bool CGmaPropertyHandler::_SearchContentStringConcat(PWSTR pwszSearchContents, PWSTR pwszInsertString, const WCHAR wcSuffixChar, size_t* pullInsertPos)
 {
 	if (pwszInsertString != NULL)
@@ -490,455 +743,198 @@ bool CGmaPropertyHandler::_SearchContentStringConcat(PWSTR pwszSearchContents, P
 //     GMA information retrieval
 // ____________________________________________________________________________________________________
 //
-	
-/*
-	Header examples
-
-	159321088.gma
-		- Old(er) gma header format, back when `description` actually had a description in it, before it was turned into a json chunk
-		- `author` field is always* constant "author" string
-
-		0000h  47 4D 41 44 03 1E 18 19 08 01 00 10 01 0C 11 DF 51 00 00 00 00 00 74 74  GMAD...........Q.....tt 
-		0018h  74 5F 6D 69 6E 65 63 72 61 66 74 5F 62 35 00 4E 6F 20 63 72 65 64 69 74  t_minecraft_b5.No credit 
-		0030h  20 74 6F 20 6D 65 20 69 20 6A 75 73 74 20 75 70 6C 6F 61 64 65 64 20 61   to me i just uploaded a 
-		0048h  6C 6C 20 63 72 65 64 69 74 20 74 6F 20 20 20 20 20 28 3D 43 47 3D 29 20  ll credit to     (=CG=)  
-		0060h  46 69 6E 6E 69 65 73 70 2E 20 41 20 54 72 6F 75 62 6C 65 20 49 6E 20 54  Finniesp. A Trouble In T 
-		0078h  65 72 72 6F 72 69 73 74 20 54 6F 77 6E 20 4D 43 20 62 65 74 61 20 6D 61  errorist Town MC beta ma 
-		0090h  70 2E 20 49 66 20 74 68 65 20 6F 77 6E 65 72 20 77 61 6E 74 73 20 69 74  p. If the owner wants it 
-		00A8h  20 6F 66 66 20 74 68 65 20 77 6F 72 6B 73 68 6F 70 20 68 65 20 63 61 6E   off the workshop he can 
-		00C0h  20 6A 75 73 74 20 6C 65 61 76 65 20 61 20 63 6F 6D 6D 65 6E 74 2E 0A 20   just leave a comment..  
-		00D8h  20 20 20 0A 00 61 75 74 68 6F 72 00 01 00 00 00 01 00 00 00 6D 61 70 73     ..author.........maps 
-		00F0h  2F 74 74 74 5F 6D 69 6E 65 63 72 61 66 74 5F 62 35 2E 62 73 70 00 9A 6C  /ttt_minecraft_b5.bsp.l 
-		0108h  53 01 00 00 00 00 9B 50 51 93 00 00 00 00 56 42 53 50 14 00 00 00 04 48  S.....PQ....VBSP.....H 
-
-	124648402.gma
-		- New(er) gma header format, with json chunk in `description`
-		- `author` field is now always* a constant "Author Name" string
-
-		0000h  47 4D 41 44 03 00 00 00 00 00 00 00 00 E4 78 0B 5D 00 00 00 00 00 4F 72  GMAD.........x.].....Or 
-		0018h  62 69 74 61 6C 20 46 72 69 65 6E 64 73 68 69 70 20 43 61 6E 6E 6F 6E 00  bital Friendship Cannon. 
-		0030h  7B 0A 09 22 64 65 73 63 72 69 70 74 69 6F 6E 22 3A 20 22 44 65 73 63 72  {.."description": "Descr 
-		0048h  69 70 74 69 6F 6E 22 2C 0A 09 22 74 79 70 65 22 3A 20 22 77 65 61 70 6F  iption",.."type": "weapo 
-		0060h  6E 22 2C 0A 09 22 74 61 67 73 22 3A 20 5B 0A 09 09 22 66 75 6E 22 2C 0A  n",.."tags": [..."fun",. 
-		0078h  09 09 22 63 61 72 74 6F 6F 6E 22 0A 09 5D 0A 7D 00 41 75 74 68 6F 72 20  .."cartoon"..].}.Author  
-		0090h  4E 61 6D 65 00 01 00 00 00 01 00 00 00 6C 75 61 2F 77 65 61 70 6F 6E 73  Name.........lua/weapons 
-		00A8h  2F 6F 72 62 69 74 61 6C 5F 66 72 69 65 6E 64 73 68 69 70 5F 63 61 6E 6E  /orbital_friendship_cann 
-		00C0h  6F 6E 2E 6C 75 61 00 CB 3C 00 00 00 00 00 00 37 E2 3B 90 02 00 00 00 6D  on.lua.<......7;
-	
-	*Some gmas have actual strings in `author`. gmad.exe does not support this, so these gmas were modified or produced through alternate means.
 
-	The header fields are delineated by null bytes.
-	There are always exactly header three fields:
-	- Name
-	- Author
-	- Description
-*/
-
-// Load the property data we want from the current file stream to the GMA file
-HRESULT CGmaPropertyHandler::_ReadRelevantGmaData()
+// Gets the volume serial number and file index of the file at pwszPath
+// The file is only opened to query it, and shares everything, so it can't get in the way of whoever has it open
+static HRESULT _GetFileIdentity(PCWSTR pwszPath, ULONGLONG* pullVolume, ULONGLONG* pullFileId)
 {
-	HRESULT hr = E_UNEXPECTED;
-
-
-	//
-	// Seek and stat the stream
-	//
+	HANDLE hFile = CreateFileW(pwszPath, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
 
-	LARGE_INTEGER liSeek;
-	liSeek.QuadPart = 0;
-	hr = _pStream->Seek(liSeek, STREAM_SEEK_SET, NULL);
+	BY_HANDLE_FILE_INFORMATION info;
+	HRESULT hr = GetFileInformationByHandle(hFile, &info) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+	CloseHandle(hFile);
 	if (FAILED(hr))
 		return hr;
 
-	STATSTG statstg;
-	hr = _pStream->Stat(&statstg, STATFLAG_NONAME);
-	if (FAILED(hr))
-		return hr;
-
-	ULONGLONG ullStreamSize = statstg.cbSize.QuadPart;
-	ULONGLONG ullStreamPos = 0ull;
-
-
-	//
-	// Verify 4 byte magic
-	//
-
-	if (ullStreamSize < 4ull)
-		return E_ABORT;
-
-	BYTE cBufMagic[5];
-	ULONG ulBytesRead = 0;
-	hr = _pStream->Read(&cBufMagic, 4, &ulBytesRead);
-	if (FAILED(hr))
-		return hr;
-	if (ulBytesRead < 4ul)
-		return E_UNEXPECTED;
-	
-	cBufMagic[4] = 0;
-
-	ullStreamPos += ulBytesRead;
-
-	if (strcmp((char*)cBufMagic, "GMAD") != 0) // First four bytes are "GMAD" in ascii
-		return E_ABORT;
-
-
-	//
-	// Jump to relevant data
-	//
-
-	// Skip 13 unknown bytes that start with nulls then end with something
-	ullStreamPos += 13ull;
-	if (ullStreamPos >= ullStreamSize)
-		return E_ABORT;
-
-	liSeek.QuadPart = 13ll;
-	hr = _pStream->Seek(liSeek, STREAM_SEEK_CUR, NULL);
-	if (FAILED(hr))
-		return hr;
-
-	// Skip nulls until we reach the first non-null byte
-	// This will be the first character of the addon name
-	BYTE cBuf1 = 0;
-	while (cBuf1 == 0 && ullStreamPos < ullStreamSize && ullStreamPos < c_ullGmaHeaderSizeLimit)
-	{
-		hr = _pStream->Read(&cBuf1, 1ul, &ulBytesRead);
-		if (FAILED(hr))
-			return hr;
-		if (ulBytesRead == 0)
-			return E_UNEXPECTED;
-
-		ullStreamPos += ulBytesRead;
-	}
-	
-	if (ullStreamPos >= ullStreamSize)
-		return E_UNEXPECTED;
-	if (ullStreamPos >= c_ullGmaHeaderSizeLimit)
-		return E_ABORT;
-	
-	// Back up to field start
-	liSeek.QuadPart = -1ll;
-	hr = _pStream->Seek(liSeek, STREAM_SEEK_CUR, NULL);
-	if (FAILED(hr))
-		return hr;
-	ullStreamPos -= 1ull;
-
-
-	//
-	// Parse `name` header field
-	//
-
-	// Read in
-	PWSTR pwszAddonName;
-	hr = _ReadAndParseStringGmaHeaderField(&ullStreamSize, &ullStreamPos, NULL, &pwszAddonName);
-	if (FAILED(hr))
-		return hr;
-
-	_GmaInfo.HeaderExtract.pwszName = pwszAddonName;
-
-
-	//
-	// Parse `description` field
-	//
-	
-	// Read in
-	PSTR pszAddonDescription; // needed for cJSON, in the case of json chunk
-	PWSTR pwszAddonDescription;
-	hr = _ReadAndParseStringGmaHeaderField(&ullStreamSize, &ullStreamPos, &pszAddonDescription, &pwszAddonDescription);
-	if (FAILED(hr))
-	{
-		_ReleaseGmaHeaderInfoExtractAllocs();
-		return hr;
-	}
-	
-	// Detect json chunk in this field and handle it
-	// Afaik there is no indicator in the GMA header that states whether the bytes in `description` are an old(er)-format normal string or a new(er)-format json chunk
-	// And I do not know how ugc/gmod does the json or not detection
-	// So we will simply check for a leading '{' and trailing '}' and try to parse it as json if both are found
+	*pullVolume = info.dwVolumeSerialNumber;
+	*pullFileId = ((ULONGLONG)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+	return S_OK;
+}
 
-	BOOL bFoundLeadingBrace = false;
-	BOOL bFoundTrailingBrace = false;
-	
-	// Search for leading brace
-	size_t cAddonDescription;
-	IntToSizeT(lstrlenW(pwszAddonDescription), &cAddonDescription);
-	for (size_t i = 0; i < cAddonDescription; i++)
+// Gets the volume serial number and file index of the file behind a stream, if there is one and its path can be found
+// File streams the shell hands out implement IPersistFile. Otherwise Stat() may still have reported the full path.
+static HRESULT _GetStreamFileIdentity(IStream* pStream, PCWSTR pwszStatName, ULONGLONG* pullVolume, ULONGLONG* pullFileId)
+{
+	IPersistFile* pPersistFile = NULL;
+	if (SUCCEEDED(pStream->QueryInterface(IID_PPV_ARGS(&pPersistFile))))
 	{
-		WCHAR wcCur = pwszAddonDescription[i];
-
-		if (iswspace(wcCur))
-			continue;
-
-		if (wcCur == L'{')
+		PWSTR pwszPath = NULL;
+		HRESULT hr = pPersistFile->GetCurFile(&pwszPath);
+		pPersistFile->Release();
+		if (hr == S_OK)
 		{
-			bFoundLeadingBrace = true;
-			break;
+			hr = _GetFileIdentity(pwszPath, pullVolume, pullFileId);
+			CoTaskMemFree(pwszPath);
+			if (SUCCEEDED(hr))
+				return hr;
 		}
-	}
-	
-	// Search for trailing brace
-	if (bFoundLeadingBrace)
-	{
-		for (size_t i = cAddonDescription; i >= 0; i--)
+		else if (SUCCEEDED(hr))
 		{
-			WCHAR wcCur = pwszAddonDescription[i];
-
-			if (iswspace(wcCur))
-				continue;
-
-			if (wcCur == L'}')
-			{
-				bFoundTrailingBrace = true;
-				break;
-			}
+			CoTaskMemFree(pwszPath); // S_FALSE: just the default file name
 		}
 	}
 
-	// Try to parse json object from header field
-	cJSON* pDescriptionJson = NULL;
+	if (PathIsRelativeW(pwszStatName))
+		return E_FAIL; // Just a file name
+	return _GetFileIdentity(pwszStatName, pullVolume, pullFileId);
+}
 
-	if (bFoundLeadingBrace && bFoundTrailingBrace)
-	{
-		// JSON is a Unicode standard, yet cJSON expects a UTF8 encoded string when parsing json bytes
-		pDescriptionJson = cJSON_Parse(pszAddonDescription);
-
-		// Return will be null if parsing failed
-		// cJSON_GetErrorPtr() will have details on why
-		// Could be malformed json, could be data that is not json
-		// gmad.exe presumably validates addon.json on gma creation, so the former is unlikely, but still possible
-		// In any regard, if the parsing fails, we will treat the body of the `description` field as basic text, i.e. the old(er) format before the json chunk introduction
-	}
+// Identifies the file behind a stream, for s_metadataCache
+// The volume serial number and file index identify it for certain. For streams that can't be traced back to a file, a hash of the name Stat() reports stands in for the file index, and the creation time for the volume, which along with the size and last write time tells files apart in practice.
+static HRESULT _GetCacheKey(IStream* pStream, GmaCacheKey* pKey)
+{
+	STATSTG statstg;
+	HRESULT hr = pStream->Stat(&statstg, STATFLAG_DEFAULT);
+	if (FAILED(hr))
+		return hr;
+	if (statstg.pwcsName == NULL)
+		return E_FAIL;
 
-	if (pDescriptionJson == NULL)
+	ULONGLONG ullVolume;
+	ULONGLONG ullFileId;
+	if (FAILED(_GetStreamFileIdentity(pStream, statstg.pwcsName, &ullVolume, &ullFileId)))
 	{
-		// Treat as basic text
-		_GmaInfo.HeaderUsesJsonChunkInDescription = false;
-		_GmaInfo.HeaderExtract.pwszDescription = pwszAddonDescription;
-	}
-	else
-	{
-		_GmaInfo.HeaderUsesJsonChunkInDescription = true;
-
-		// Extract "description" from json chunk
-		cJSON* pjnDescription = cJSON_GetObjectItem(pDescriptionJson, "description");
-		if (cJSON_IsString(pjnDescription) && (pjnDescription->valuestring != NULL))
-		{
-			PWSTR pwszJsonDescription;
-			hr = ConvertMultiByteStringToWide( pjnDescription->valuestring, (int)strlen(pjnDescription->valuestring), &pwszJsonDescription, CP_UTF8 );
-			if (FAILED(hr))
-			{
-				cJSON_Delete(pDescriptionJson);
-				_ReleaseGmaHeaderInfoExtractAllocs();
-				return hr;
-			}
-
-			_GmaInfo.HeaderExtract.pwszDescription = pwszJsonDescription;
-		}
-
-		// Extract "type" from json chunk
-		cJSON* pjnType = cJSON_GetObjectItem(pDescriptionJson, "type");
-		if (cJSON_IsString(pjnType) && (pjnType->valuestring != NULL))
+		ULONGLONG ullNameHash = 14695981039346656037ull; // FNV-1a
+		for (PCWSTR pwch = statstg.pwcsName; *pwch != L'\0'; pwch++)
 		{
-			PWSTR pwszJsonType;
-			hr = ConvertMultiByteStringToWide( pjnType->valuestring, (int)strlen(pjnType->valuestring), &pwszJsonType, CP_UTF8 );
-			if (FAILED(hr))
-			{
-				cJSON_Delete(pDescriptionJson);
-				_ReleaseGmaHeaderInfoExtractAllocs();
-				return hr;
-			}
-
-			_GmaInfo.HeaderExtract.pwszType = pwszJsonType;
-		}
-
-		// Extact the "tags" list from json chunk
-		cJSON* pjnTags = cJSON_GetObjectItem(pDescriptionJson, "tags");
-		if (cJSON_IsArray(pjnTags))
-		{
-			int cTags = cJSON_GetArraySize(pjnTags);
-			if (cTags > 0ul)
-			{
-				PWSTR* pawszTags = new PWSTR[cTags];
-
-				for (int i = 0; i < cTags; i++)
-				{
-					cJSON* pjnTagsTag = cJSON_GetArrayItem(pjnTags, i);
-					if (cJSON_IsString(pjnTagsTag) && (pjnTagsTag->valuestring != NULL))
-					{
-						PWSTR pwszJsonTag;
-						hr = ConvertMultiByteStringToWide( pjnTagsTag->valuestring, (int)strlen(pjnTagsTag->valuestring), &pwszJsonTag, CP_UTF8 );
-						if (FAILED(hr))
-						{
-							for (int j = 0; j < i; j++)
-								delete pawszTags[j];
-							delete[] pawszTags;
-							cJSON_Delete(pDescriptionJson);
-							_ReleaseGmaHeaderInfoExtractAllocs();
-							return hr;
-						}
-
-						pawszTags[i] = pwszJsonTag;
-					}
-				}
-
-				_GmaInfo.HeaderExtract.awszTags = pawszTags;
-				IntToDWord(cTags, &_GmaInfo.HeaderExtract.cTags);
-			}
+			ullNameHash ^= (ULONGLONG)*pwch;
+			ullNameHash *= 1099511628211ull;
 		}
+		ullVolume = ((ULONGLONG)statstg.ctime.dwHighDateTime << 32) | statstg.ctime.dwLowDateTime;
+		ullFileId = ullNameHash;
 	}
+	CoTaskMemFree(statstg.pwcsName);
 
-
-	//
-	// Parse `author` header field
-	//
-
-	PWSTR pwszAddonAuthor;
-	hr = _ReadAndParseStringGmaHeaderField(&ullStreamSize, &ullStreamPos, NULL, &pwszAddonAuthor);
-	if (FAILED(hr))
-		return hr;
-
-	_GmaInfo.HeaderExtract.pwszAuthor = pwszAddonAuthor;
-
-
-	// All required data has been read from the GMA file
-	hr = S_OK;
-    return hr;
+	pKey->ullVolume = ullVolume;
+	pKey->ullFileId = ullFileId;
+	pKey->ullSize = statstg.cbSize.QuadPart;
+	pKey->ullLastWrite = ((ULONGLONG)statstg.mtime.dwHighDateTime << 32) | statstg.mtime.dwLowDateTime;
+	return S_OK;
 }
 
-HRESULT CGmaPropertyHandler::_ReadGmaHeaderField(ULONGLONG* ullStreamSize, ULONGLONG* ullStreamPos, BYTE** pcBuf)
+// Opens s_cacheFile the first time any handler asks for it
+static BOOL CALLBACK _OpenCacheFile(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
 {
-	HRESULT hr = E_UNEXPECTED;
-
-	ULONGLONG ullFieldStartPos = *ullStreamPos;
-
-	//
-	// Seek to the next null byte, which marks the end of this field and the start of the next one
-	//
-
-	ULONG ulBytesRead;
-	BYTE cBuf1 = 1;
-	while (cBuf1 != 0 && *ullStreamPos < *ullStreamSize && *ullStreamPos < c_ullGmaHeaderSizeLimit)
-	{
-		hr = _pStream->Read(&cBuf1, 1ul, &ulBytesRead);
-		if (FAILED(hr))
-			return hr;
-		if (ulBytesRead == 0)
-			return E_UNEXPECTED;
-
-		*ullStreamPos += ulBytesRead;
-	}
-
-	if (*ullStreamPos >= *ullStreamSize)
-		return E_UNEXPECTED;
-	if (*ullStreamPos >= c_ullGmaHeaderSizeLimit)
-		return E_ABORT;
-
-	//
-	// Copy the field, including its terminating null byte
-	//
-
-	ULONGLONG ullFieldLength = *ullStreamPos - ullFieldStartPos;
-
-	LARGE_INTEGER liRewindAmount;
-	LONGLONG llFieldLength;
-	hr = ULongLongToLongLong(ullFieldLength, &llFieldLength);
-	if (FAILED(hr))
-		return hr;
-	liRewindAmount.QuadPart = llFieldLength * -1ll;
-
-	ULARGE_INTEGER uliRewindResultPos;
-	hr = _pStream->Seek(liRewindAmount, STREAM_SEEK_CUR, &uliRewindResultPos);
-	if (FAILED(hr))
-		return hr;
-	*ullStreamPos = uliRewindResultPos.QuadPart;
-
-	ULONG ulReadLength;
-	hr = ULongLongToULong(ullFieldLength, &ulReadLength);
-	if (FAILED(hr))
-		return hr;
-
-	BYTE* pcBufFull = new BYTE[ulReadLength];
-	hr = _pStream->Read(pcBufFull, ulReadLength, &ulBytesRead);
-	if (FAILED(hr))
-		return hr;
-
-	*pcBuf = pcBufFull;
-
-	return S_OK;
+	UNREFERENCED_PARAMETER(pInitOnce);
+	UNREFERENCED_PARAMETER(pvParameter);
+	*ppvContext = NULL;
+
+	WCHAR szPath[MAX_PATH];
+	if (FAILED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA | CSIDL_FLAG_CREATE, NULL, 0, szPath)) || !PathAppendW(szPath, L"GmaShellPropertyHandler"))
+		return TRUE;
+	if (!CreateDirectoryW(szPath, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+		return TRUE;
+	if (!PathAppendW(szPath, L"metadata.cache"))
+		return TRUE;
+
+	if (GMA_SUCCEEDED(s_cacheFile.Open(szPath)))
+		*ppvContext = &s_cacheFile;
+	return TRUE; // Without the file, s_metadataCache still works on its own
 }
 
-HRESULT CGmaPropertyHandler::_ReadAndParseStringGmaHeaderField(ULONGLONG* ullStreamSize, ULONGLONG* ullStreamPos, PSTR* pszOutField, PWSTR* pwszOutField)
+static CGmaCacheFile* _GetCacheFile()
 {
-	HRESULT hr = E_UNEXPECTED;
+	static INIT_ONCE s_initOnce = INIT_ONCE_STATIC_INIT;
+	PVOID pvCacheFile = NULL;
+	if (!InitOnceExecuteOnce(&s_initOnce, _OpenCacheFile, NULL, &pvCacheFile))
+		return NULL;
+	return (CGmaCacheFile*)pvCacheFile;
+}
 
-	//
-	// Read field
-	//
+// Looks the file up in s_cacheFile, into _metadata
+// The entry's fingerprint is checked against the stream, since the cache key alone can't catch a file rewritten in place. The strings then point into s_cacheFile's mapping, which stays valid for as long as the process has it open.
+bool CGmaPropertyHandler::_LookupCacheFile()
+{
+	CGmaCacheFile* pCacheFile = _GetCacheFile();
+	if (pCacheFile == NULL)
+		return false;
 
-	BYTE* pcFieldBytes;
-	hr = _ReadGmaHeaderField(ullStreamSize, ullStreamPos, &pcFieldBytes);
-	if (FAILED(hr))
-		return hr;
+	// Another process may have compacted the file since it was mapped, which would hide what it has written since
+	pCacheFile->Refresh();
+	return pCacheFile->Lookup(_cacheKey, _pSource, &_metadata, &_arenaCached);
+}
 
-	//
-	// Convert raw bytes to unicode strings
-	//
-	
-	// Note that the very limited design of the gma header format (using \0 to delineate strings) implies that these strings cannot possibly be in any multi-byte encoding
-	// In all likelihood these are UTF8 strings
+// Adds _metadata to s_cacheFile. Failures only cost a parse in some later process, so they're ignored.
+void CGmaPropertyHandler::_InsertIntoCacheFile()
+{
+	CGmaCacheFile* pCacheFile = _GetCacheFile();
+	if (pCacheFile == NULL)
+		return;
+
+	// Fingerprinting reads the stream, and the document may still want to carry on from where it left off, so its position is put back
+	uint64_t ullPos;
+	if (GMA_FAILED(_pSource->Seek(0ll, GMA_SEEK_CUR, &ullPos)))
+		return;
+	pCacheFile->Insert(_cacheKey, _pSource, _metadata);
+	_pSource->Seek((int64_t)ullPos, GMA_SEEK_SET, NULL);
+}
 
-	PWSTR pwszFieldBytes = NULL;
-	hr = ConvertMultiByteStringToWide( (char*)pcFieldBytes, (int)strlen((char*)pcFieldBytes), &pwszFieldBytes, CP_UTF8 );
-	if (FAILED(hr))
+// Make sure the GMA has been parsed up to stage, and pick up the property data we want from it
+// The GMA parsing itself lives in the GMA core (GmaDocument.cpp). All we do here is feed it our stream and keep the UTF-8 results for later conversion.
+HRESULT CGmaPropertyHandler::_ReadRelevantGmaData(GmaParseStage stage)
+{
+	// Already known, from an earlier call or from the cache, and so is a failure to get that far
+	if (_metadata.stage >= stage)
+		return S_OK;
+	if (GMA_FAILED(_metadata.statusFailed))
+		return GmaStatusToHResult(_metadata.statusFailed, _pSource);
+
+	// A cached entry that didn't go far enough means parsing from the start. The header strings converted so far stay valid, since the new ones are identical.
+	GmaStatus status = _pDocument->EnsureStage(stage);
+	GmaGetDocumentMetadata(*_pDocument, &_metadata);
+	_ApplyMetadata();
+
+	// Only worth caching once it would spare the next handler more than a magic check: a header, or a definite failure
+	if (_bHasCacheKey && (_metadata.stage >= GMA_STAGE_HEADER || GMA_FAILED(_metadata.statusFailed)))
 	{
-		delete[] pwszFieldBytes;
-		return hr;
+		s_metadataCache.Insert(_cacheKey, _metadata);
+		_InsertIntoCacheFile();
 	}
 
-	if (pszOutField != NULL)
-		*pszOutField = (PSTR)pcFieldBytes;
-
-	if (pwszOutField != NULL)
-		*pwszOutField = pwszFieldBytes;
-
+	if (GMA_FAILED(status))
+		return GmaStatusToHResult(status, _pSource);
 	return S_OK;
 }
 
-// Various adjustments to the data read in from the GMA
-HRESULT CGmaPropertyHandler::_PostProcessGmaData()
+// Picks the property data we want out of _metadata
+void CGmaPropertyHandler::_ApplyMetadata()
 {
-	HRESULT hr = E_UNEXPECTED;
-
-	//
-	// Remove stubs
-	//
-
-	// Some fields are unused and populated with meaningless stub values. We're going to remove those, so the associated Property is blank instead.
-
-	// Author
-	// In the old(er) GMA format, the `author` header field is always "author"
-	// In the new(er) format, the "author" element in the json chunk is always "Author Name"
-	if (_GmaInfo.HeaderExtract.pwszAuthor != NULL)
+	if (_metadata.stage >= GMA_STAGE_HEADER)
 	{
-		if (StrCmpW(_GmaInfo.HeaderExtract.pwszAuthor, _GmaInfo.HeaderUsesJsonChunkInDescription ? L"Author Name" : L"author") == 0)
-		{
-			delete _GmaInfo.HeaderExtract.pwszAuthor;
-			_GmaInfo.HeaderExtract.pwszAuthor = new WCHAR[1]();
-		}
+		const GmaHeaderInfo& headerInfo = _metadata.header;
+		_GmaInfo.Header = headerInfo; // the strings stay where _metadata has them, and are only converted to UTF-16 once a property needs them
+		_GmaInfo.HeaderUsesJsonChunkInDescription = headerInfo.bUsesJsonChunkInDescription;
+		_GmaInfo.FormatVersion = headerInfo.bFormatVersion;
+		_GmaInfo.Timestamp = headerInfo.ullTimestamp;
 	}
 
-	// Description
-	// In the new(er) GMA format, the "description" element in the json chunk is always "Description"
-	if (_GmaInfo.HeaderExtract.pwszDescription != NULL)
+	// Only the file table is read, not the file data
+	// A damaged table (e.g. a truncated download) doesn't invalidate the header, so the header properties are still provided in that case
+	if (_metadata.stage >= GMA_STAGE_TOC && GMA_SUCCEEDED(_metadata.statusToc))
 	{
-		if (_GmaInfo.HeaderUsesJsonChunkInDescription && StrCmpW(_GmaInfo.HeaderExtract.pwszDescription, L"Description") == 0)
-		{
-			delete _GmaInfo.HeaderExtract.pwszDescription;
-			_GmaInfo.HeaderExtract.pwszDescription = new WCHAR[1]();
-		}
+		_GmaInfo.HasToc = true;
+		_GmaInfo.FileCount = _metadata.tocSummary.cFiles;
+		_GmaInfo.TotalFileSize = _metadata.tocSummary.ullTotalSize;
 	}
+}
 
-	hr = S_OK;
-	return hr;
+// Converts one header string from the GMA core to UTF-16, into the arena. NULL (field not present) stays NULL.
+// Strings that aren't valid UTF-8 come from older or hand-made addons, and are decoded as Windows-1252 rather than shown with U+FFFD in place of every accented letter.
+HRESULT CGmaPropertyHandler::_ConvertHeaderString(const GmaString& strField, PWSTR* ppwszField)
+{
+	return GmaStatusToHResult(GmaHeaderStringToUtf16(strField, &_arena, ppwszField, NULL, NULL), NULL);
 }
 
 
@@ -952,10 +948,10 @@ HRESULT CGmaPropertyHandler::_PostProcessGmaData()
 HRESULT RegisterPropLists(CRegisterExtension &re, PCWSTR pszFileAssoc)
 {
     const WCHAR c_szPropertiesTileInfo[] = L"prop:System.Title;System.Author;System.Size;System.DateModified";
-    const WCHAR c_szPropertiesPreviewDetails[] = L"prop:System.Title;System.Author;System.Link.Description;System.Category;System.Keywords;System.DateModified";
+    const WCHAR c_szPropertiesPreviewDetails[] = L"prop:System.Title;System.Author;System.Link.Description;System.Category;System.Keywords;System.Document.DateCreated;System.DateModified";
     const WCHAR c_szPropertiesInfoTip[] = L"prop:System.Title;System.Author;System.DateModified;System.Size";
-    const WCHAR c_szPropertiesFullDetails[] = L"prop:System.Title;System.PropGroup.Description;System.Author;System.Link.Description;System.Category;System.Keywords;System.PropGroup.FileSystem;System.ItemNameDisplay;System.ItemType;System.ItemFolderPathDisplay;System.DateCreated;System.DateModified;System.Size;System.FileAttributes;System.OfflineAvailability;System.OfflineStatus;System.SharedWith;System.FileOwner;System.ComputerName";
-    const WCHAR c_szPropertiesExtendedTileInfo[] = L"prop:System.ItemType;System.Size;System.Link.Description;System.Category;System.Keywords";
+    const WCHAR c_szPropertiesFullDetails[] = L"prop:System.Title;System.PropGroup.Description;System.Author;System.Link.Description;System.Category;System.Keywords;System.Document.DateCreated;System.FileVersion;System.FileCount;System.TotalFileSize;System.PropGroup.FileSystem;System.ItemNameDisplay;System.ItemType;System.ItemFolderPathDisplay;System.DateCreated;System.DateModified;System.Size;System.FileAttributes;System.OfflineAvailability;System.OfflineStatus;System.SharedWith;System.FileOwner;System.ComputerName";
+    const WCHAR c_szPropertiesExtendedTileInfo[] = L"prop:System.ItemType;System.Size;System.FileCount;System.Link.Description;System.Category;System.Keywords";
 
     HRESULT hr = re.RegisterProgIDValue(pszFileAssoc, L"TileInfo", c_szPropertiesTileInfo);
     if (SUCCEEDED(hr))
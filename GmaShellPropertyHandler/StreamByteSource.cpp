@@ -0,0 +1,63 @@
+#include "StreamByteSource.h"
+#include <intsafe.h>
+
+GmaStatus CStreamByteSource::Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead)
+{
+	ULONG ulBytesRead = 0;
+	HRESULT hr = _pStream->Read(pBuf, cbToRead, &ulBytesRead);
+	*pcbRead = ulBytesRead;
+	if (FAILED(hr))
+	{
+		_hrLast = hr;
+		return GMA_E_IO;
+	}
+	return GMA_S_OK;
+}
+
+GmaStatus CStreamByteSource::Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos)
+{
+	LARGE_INTEGER liSeek;
+	liSeek.QuadPart = llOffset;
+
+	ULARGE_INTEGER uliNewPos;
+	HRESULT hr = _pStream->Seek(liSeek, (DWORD)origin, &uliNewPos); // GmaSeekOrigin values match STREAM_SEEK_*
+	if (FAILED(hr))
+	{
+		_hrLast = hr;
+		return (hr == E_NOTIMPL) ? GMA_E_NOTIMPL : GMA_E_IO;
+	}
+
+	if (pullNewPos != NULL)
+		*pullNewPos = uliNewPos.QuadPart;
+	return GMA_S_OK;
+}
+
+GmaStatus CStreamByteSource::GetSize(uint64_t* pullSize)
+{
+	STATSTG statstg;
+	HRESULT hr = _pStream->Stat(&statstg, STATFLAG_NONAME);
+	if (FAILED(hr))
+	{
+		_hrLast = hr;
+		return GMA_E_IO;
+	}
+
+	*pullSize = statstg.cbSize.QuadPart;
+	return GMA_S_OK;
+}
+
+// Translates a GMA core result to the HRESULT the property handler has always returned for that condition
+HRESULT GmaStatusToHResult(GmaStatus status, const CStreamByteSource* pSource)
+{
+	switch (status)
+	{
+	case GMA_S_OK:          return S_OK;
+	case GMA_E_ABORT:       return E_ABORT;
+	case GMA_E_TOOLARGE:    return E_ABORT; // The handler has always given up on oversized headers and file table entries the same way as on non-GMAs
+	case GMA_E_OUTOFMEMORY: return E_OUTOFMEMORY;
+	case GMA_E_ARITHMETIC:  return INTSAFE_E_ARITHMETIC_OVERFLOW;
+	case GMA_E_NOTIMPL:     return E_NOTIMPL;
+	case GMA_E_IO:          return (pSource != NULL && FAILED(pSource->GetLastHResult())) ? pSource->GetLastHResult() : E_FAIL;
+	default:                return E_UNEXPECTED;
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <Windows.h>
+#include <objidl.h>
+#include "GmaByteSource.h"
+
+// Adapts the IStream handed to us by the shell to the GMA core's byte source interface
+// Does not take a reference on the stream; the owner must keep it alive for the lifetime of this object
+class CStreamByteSource : public IGmaByteSource
+{
+public:
+	explicit CStreamByteSource(IStream* pStream) : _pStream(pStream), _hrLast(S_OK) {}
+
+	GmaStatus Read(void* pBuf, uint32_t cbToRead, uint32_t* pcbRead);
+	GmaStatus Seek(int64_t llOffset, GmaSeekOrigin origin, uint64_t* pullNewPos);
+	GmaStatus GetSize(uint64_t* pullSize);
+
+	HRESULT GetLastHResult() const { return _hrLast; } // HRESULT of the last stream call that returned GMA_E_IO
+
+private:
+	IStream* _pStream;
+	HRESULT _hrLast;
+};
+
+HRESULT GmaStatusToHResult(GmaStatus status, const CStreamByteSource* pSource);